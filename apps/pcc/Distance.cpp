@@ -10,6 +10,7 @@
 
 #include <DistanceCorr.hpp>
 #include <EXPMatrixReader.hpp>
+#include <getopt.h>
 #include "LightPCC.h"
 
 /*execution mode*/
@@ -27,6 +28,13 @@
 #endif
 
 static Options option;
+static ResultOptions resultOptions;	/*persisted results [multi-threaded mode]*/
+static int shard = 0;			/*job-array shard [multi-threaded mode]*/
+static int numShards = 1;
+static struct option longOptions[] = {
+	{ "shard", required_argument, NULL, 's' },
+	{ NULL, 0, NULL, 0 }
+};
 static void printUsage() {
 	fprintf(stderr,
 			"LightPCC distance [options] -m exe_mode\n");
@@ -64,6 +72,20 @@ static void printUsage() {
 #ifdef WITH_PHI
 	fprintf(stderr, "\t-x <int> (Xeon Phi index [single Xeon Phi mode], default = %d)\n",
 			option._micIndex);
+#endif
+#ifndef WITH_MPI
+	fprintf(stderr, "\t-o <str> (output prefix of the result shards [multi-threaded mode], default = none)\n");
+	fprintf(stderr, "\t-N <int> (number of top neighbors per vector written with -o, default = %d [0 means no top-K])\n",
+			resultOptions._numNeighbors);
+	fprintf(stderr, "\t-S <float> (minimum reported value, default = none)\n");
+	fprintf(stderr, "\t-L <float> (maximum reported value, default = none)\n");
+	fprintf(stderr, "\t    without -N, specifying -S or -L writes all pairs within [min, max]\n");
+	fprintf(stderr, "\t-P <int> (write the full matrix to <prefix>.packed instead of the binary tiles, default = %d)\n",
+			resultOptions._packedEncoding);
+	fprintf(stderr, "\t    %d: none, %d: float, %d: 16-bit, %d: 8-bit quantized within [min, max] of -S and -L [-1 to 1 if not given]\n",
+			PM_NONE, PM_FLOAT, PM_INT16, PM_INT8);
+	fprintf(stderr, "\t--shard <i/n> (compute only shard i of n of the tile space [multi-threaded mode], default = 0/1)\n");
+	fprintf(stderr, "\t    shards are merged by utils/MergeShards\n");
 #endif
 	fprintf(stderr, "\t-h (print out options)\n");
 	fprintf(stderr, "\n");
@@ -75,7 +97,7 @@ static bool parseArgs(int argc, char* argv[]) {
 		printUsage();
 		return false;
 	}
-	while ((opt = getopt(argc, argv, "i:d:n:l:t:p:m:hx:")) != -1) {
+	while ((opt = getopt_long(argc, argv, "i:d:n:l:t:p:m:hx:o:N:S:L:P:", longOptions, NULL)) != -1) {
 		switch (opt) {
 		case 'i':
 			option._input = optarg;
@@ -123,6 +145,42 @@ static bool parseArgs(int argc, char* argv[]) {
 				option._micIndex = 0;
 			}
 			break;
+#ifndef WITH_MPI
+		case 'o':
+			resultOptions._prefix = optarg;
+			break;
+		case 'P':
+			resultOptions._packedEncoding = atoi(optarg);
+			if (resultOptions._packedEncoding < PM_NONE
+					|| resultOptions._packedEncoding > PM_INT8) {
+				fprintf(stderr, "Invalid packed matrix encoding %s\n", optarg);
+				return false;
+			}
+			/*the packed matrix replaces the binary tiles*/
+			resultOptions._writeTiles = resultOptions._packedEncoding == PM_NONE;
+			break;
+		case 's':
+			if (sscanf(optarg, "%d/%d", &shard, &numShards) != 2
+					|| numShards < 1 || shard < 0 || shard >= numShards) {
+				fprintf(stderr, "Invalid shard %s [expected i/n with 0 <= i < n]\n", optarg);
+				return false;
+			}
+			break;
+		case 'N':
+			resultOptions._numNeighbors = atoi(optarg);
+			if (resultOptions._numNeighbors < 0) {
+				resultOptions._numNeighbors = 0;
+			}
+			break;
+		case 'S':
+			resultOptions._minValue = atof(optarg);
+			resultOptions._writeEdges = true;
+			break;
+		case 'L':
+			resultOptions._maxValue = atof(optarg);
+			resultOptions._writeEdges = true;
+			break;
+#endif
 		case 'h':
 			printUsage();
 			return false;
@@ -219,6 +277,10 @@ int lightDistanceCorr(int argc, char* argv[]) {
 			pr.generateRandomData();
 		}
 
+		/*persisted results*/
+		pr.setResultOptions(resultOptions);
+		pr.setShard(shard, numShards);
+
 		/*run the kernel*/
 		switch (option._mode) {
 #ifndef WITH_MPI
@@ -259,6 +321,10 @@ int lightDistanceCorr(int argc, char* argv[]) {
 		} else {
 			pr.generateRandomData();
 		}
+
+		/*persisted results*/
+		pr.setResultOptions(resultOptions);
+		pr.setShard(shard, numShards);
 		/*run the kernel*/
 		switch (option._mode) {
 #ifndef WITH_MPI
@@ -10,6 +10,7 @@
 
 #include <KendallTau.hpp>
 #include <EXPMatrixReader.hpp>
+#include <getopt.h>
 #include "LightPCC.h"
 
 /*execution mode*/
@@ -24,12 +25,23 @@
 #ifdef WITH_PHI
 #define XEON_PHI_MPI			4
 #endif
+#define CPU_MPI_RING			5
 #endif
 
 /*define the type of rank*/
 typedef int RankType;
 
 static Options option;
+static ResultOptions resultOptions;	/*persisted results [MPI and shard modes]*/
+static int shard = 0;			/*job-array shard [multi-threaded mode]*/
+static int numShards = 1;
+static int kernel = KT_KERNEL_AUTO;	/*host pair kernel [multi-threaded and MPI CPU modes]*/
+static bool missing = false;	/*pairwise-complete mode with 0.0 as missing value*/
+static struct option longOptions[] = {
+	{ "shard", required_argument, NULL, 's' },
+	{ "kernel", required_argument, NULL, 'A' },
+	{ NULL, 0, NULL, 0 }
+};
 static void printUsage() {
 	fprintf(stderr,
 			"LightPCC kendall [options] -m exe_mode\n");
@@ -56,6 +68,17 @@ static void printUsage() {
 	fprintf(stderr, "\t    %d: Tau-A brute force computation\n", KT_BRUTE_FORCE_TAU_A);
 	fprintf(stderr, "\t    %d: Tau-A adapted from merge sort\n", KT_MERGE_SORT_TAU_A);
 	fprintf(stderr, "\t    %d: Tau-B adapted from merge sort\n", KT_MERGE_SORT_TAU_B);
+	fprintf(stderr, "\t-A, --kernel <int> (host kernel of the merge sort variants [multi-threaded and MPI CPU modes], default = %d)\n",
+			kernel);
+	fprintf(stderr, "\t    %d: fastest on a sample of the vectors\n", KT_KERNEL_AUTO);
+	fprintf(stderr, "\t    %d: brute force\n", KT_KERNEL_BRUTE_FORCE);
+	fprintf(stderr, "\t    %d: merge sort\n", KT_KERNEL_MERGE);
+	fprintf(stderr, "\t    %d: Fenwick tree\n", KT_KERNEL_FENWICK);
+	fprintf(stderr, "\t    %d: bit planes [multi-threaded mode, at most %d elements per vector]\n",
+			KT_KERNEL_BIT_PLANE, KT_BIT_PLANE_MAX_SIZE);
+	fprintf(stderr, "\t-M (treat 0.0 as missing and use the jointly observed elements of each pair [multi-threaded and MPI CPU modes])\n");
+	fprintf(stderr, "\t-C <int> (minimum number of jointly observed elements of reported pairs with -M, default = %d)\n",
+			resultOptions._minCount);
 
 	fprintf(stderr, "\t-m <int> (execution mode, default = %d [-1 invaid])\n",
 			option._mode);
@@ -68,6 +91,7 @@ static void printUsage() {
 
 #else	/*WITH_MPI*/
 	fprintf(stderr, "\t    %d: MPI for CPU clusters\n", CPU_MPI);
+	fprintf(stderr, "\t    %d: MPI for CPU clusters with ring distribution [O(N/p) vectors per process]\n", CPU_MPI_RING);
 #ifdef WITH_PHI
 	fprintf(stderr, "\t    %d: MPI for Xeon Phi clusters\n", XEON_PHI_MPI);
 #endif	/*WITH_PHI*/
@@ -76,6 +100,23 @@ static void printUsage() {
 #ifdef WITH_PHI
 	fprintf(stderr, "\t-x <int> (Xeon Phi index [single Xeon Phi mode], default = %d)\n",
 			option._micIndex);
+#endif
+	fprintf(stderr, "\t-o <str> (output prefix of the result shards [MPI and --shard modes], default = none)\n");
+	fprintf(stderr, "\t-N <int> (number of top neighbors per vector written with -o, default = %d [0 means no top-K])\n",
+			resultOptions._numNeighbors);
+	fprintf(stderr, "\t-S <float> (minimum reported value, default = none)\n");
+	fprintf(stderr, "\t-L <float> (maximum reported value, default = none)\n");
+	fprintf(stderr, "\t    without -N, specifying -S or -L writes all pairs within [min, max]\n");
+	fprintf(stderr, "\t    with -M, the histogram of values per count is written as well\n");
+	fprintf(stderr, "\t-P <int> (write the full matrix to <prefix>.packed instead of the binary tiles, default = %d)\n",
+			resultOptions._packedEncoding);
+	fprintf(stderr, "\t    %d: none, %d: float, %d: 16-bit, %d: 8-bit quantized within [min, max] of -S and -L [-1 to 1 if not given]\n",
+			PM_NONE, PM_FLOAT, PM_INT16, PM_INT8);
+#ifdef WITH_MPI
+	fprintf(stderr, "\t-F (write one file per result kind for all processes with MPI-IO, default = per-process shards)\n");
+#else
+	fprintf(stderr, "\t--shard <i/n> (compute only shard i of n of the tile space [multi-threaded mode], default = 0/1)\n");
+	fprintf(stderr, "\t    shards are merged by utils/MergeShards\n");
 #endif
 	fprintf(stderr, "\t-h (print out options)\n");
 	fprintf(stderr, "\n");
@@ -87,7 +128,7 @@ static bool parseArgs(int argc, char* argv[]) {
 		printUsage();
 		return false;
 	}
-	while ((opt = getopt(argc, argv, "i:d:n:l:t:p:m:hx:r:R:")) != -1) {
+	while ((opt = getopt_long(argc, argv, "i:d:n:l:t:p:m:hx:r:A:MC:R:o:N:S:L:FP:", longOptions, NULL)) != -1) {
 		switch (opt) {
 		case 'i':
 			option._input = optarg;
@@ -110,6 +151,23 @@ static bool parseArgs(int argc, char* argv[]) {
 		case 'r':
 			option._kendallVariant = atoi(optarg);
 			break;
+		case 'A':
+			kernel = atoi(optarg);
+			if (kernel < KT_KERNEL_AUTO || kernel > KT_KERNEL_BIT_PLANE) {
+				fprintf(stderr, "Invalid Kendall kernel %s\n", optarg);
+				return false;
+			}
+			break;
+		case 'M':
+			missing = true;
+			resultOptions._writeHistogram = true;
+			break;
+		case 'C':
+			resultOptions._minCount = atoi(optarg);
+			if (resultOptions._minCount < 0) {
+				resultOptions._minCount = 0;
+			}
+			break;
 		case 'R':
 			option._transpose = atoi(optarg);
 			break;
@@ -141,6 +199,45 @@ static bool parseArgs(int argc, char* argv[]) {
 				option._micIndex = 0;
 			}
 			break;
+		case 'o':
+			resultOptions._prefix = optarg;
+			break;
+		case 'F':
+			resultOptions._singleFile = true;
+			break;
+		case 'P':
+			resultOptions._packedEncoding = atoi(optarg);
+			if (resultOptions._packedEncoding < PM_NONE
+					|| resultOptions._packedEncoding > PM_INT8) {
+				fprintf(stderr, "Invalid packed matrix encoding %s\n", optarg);
+				return false;
+			}
+			/*the packed matrix replaces the binary tiles*/
+			resultOptions._writeTiles = resultOptions._packedEncoding == PM_NONE;
+			break;
+#ifndef WITH_MPI
+		case 's':
+			if (sscanf(optarg, "%d/%d", &shard, &numShards) != 2
+					|| numShards < 1 || shard < 0 || shard >= numShards) {
+				fprintf(stderr, "Invalid shard %s [expected i/n with 0 <= i < n]\n", optarg);
+				return false;
+			}
+			break;
+#endif
+		case 'N':
+			resultOptions._numNeighbors = atoi(optarg);
+			if (resultOptions._numNeighbors < 0) {
+				resultOptions._numNeighbors = 0;
+			}
+			break;
+		case 'S':
+			resultOptions._minValue = atof(optarg);
+			resultOptions._writeEdges = true;
+			break;
+		case 'L':
+			resultOptions._maxValue = atof(optarg);
+			resultOptions._writeEdges = true;
+			break;
 		case 'h':
 			printUsage();
 			return false;
@@ -184,6 +281,23 @@ static bool parseArgs(int argc, char* argv[]) {
 	return true;
 }
 
+/*read in the input rows this process needs: all of them, its share of the node-local
+ *shared copy [CPU_MPI] or its ring block [CPU_MPI_RING]. Transposing needs the whole matrix*/
+template<typename FloatType, typename Engine>
+static bool loadInput(Engine& engine) {
+	FloatType* vectors = engine.getVectors();
+	int rowStart = 0, rowEnd = -1;
+
+#ifdef WITH_MPI
+	if ((option._mode == CPU_MPI || option._mode == CPU_MPI_RING) && !option._transpose) {
+		vectors = engine.getInputRows(rowStart, rowEnd);
+	}
+#endif
+	return EXPMatrixReader<FloatType>::loadMatrixData(option._input, option._genes,
+			option._samples, vectors, engine.getNumVectors(), engine.getVectorSize(),
+			engine.getVectorSizeAligned(), EXP_SKIP_TWO_ROWS, rowStart, rowEnd);
+}
+
 int lightKendallTau(int argc, char* argv[]) {
 
 	/*parse the arguments*/
@@ -217,6 +331,10 @@ int lightKendallTau(int argc, char* argv[]) {
 		fprintf(stderr, "Number of vector pairs: %ld\n", numPairs);
 		fprintf(stderr, "Execution mode: %d\n", option._mode);
 		fprintf(stderr, "Kendall variant: %d\n", option._kendallVariant);
+		fprintf(stderr, "Kendall kernel: %d\n", kernel);
+		if (missing) {
+			fprintf(stderr, "Pairwise-complete with minimum count: %d\n", resultOptions._minCount);
+		}
 #ifdef WITH_PHI_ASSEMBLY_FLOAT
 		fprintf(stderr, "Xeon Phi with assemblies for single precision\n");
 #endif
@@ -224,16 +342,20 @@ int lightKendallTau(int argc, char* argv[]) {
 		fprintf(stderr, "Xeon Phi with assemblies for double precision\n");
 #endif
 	}
+	/*the ring distribution holds only the own block of vectors. Transposing needs the whole matrix*/
+#ifdef WITH_MPI
+	const bool ringBlock = option._mode == CPU_MPI_RING && !option._transpose;
+#else
+	const bool ringBlock = false;
+#endif
 	/*create object and simulate data if applicable*/
 	if (!option._useDouble) {
 		KendallTau<float, RankType> sr(option._numVectors, option._vectorSize,
 				option._numCPUThreads, option._numMICThreads, option._micIndex,
-				option._rank, option._numProcs);
+				option._rank, option._numProcs, ringBlock);
 
 		if (option._input.length()) {
-			EXPMatrixReader<float>::loadMatrixData(option._input, option._genes,
-					option._samples, sr.getVectors(), sr.getNumVectors(),
-					sr.getVectorSize(), sr.getVectorSizeAligned());
+			loadInput<float>(sr);
 		} else {
 			sr.generateRandomData();
 		}
@@ -242,8 +364,14 @@ int lightKendallTau(int argc, char* argv[]) {
 			sr.transpose();
 		}
 
+		/*persisted results*/
+		sr.setResultOptions(resultOptions);
+		sr.setShard(shard, numShards);
+
 		/*run the kernel*/
 		sr.setVariant(option._kendallVariant);
+		sr.setKernel(kernel);
+		sr.setMissing(missing);
 		switch (option._mode) {
 #ifndef WITH_MPI
 		case SINGLE_THREADED:
@@ -262,6 +390,9 @@ int lightKendallTau(int argc, char* argv[]) {
 			case CPU_MPI:
 			sr.runMPICPU();
 			break;
+			case CPU_MPI_RING:
+			sr.runMPICPURing();
+			break;
 #ifdef WITH_PHI
 			case XEON_PHI_MPI:
 			sr.runMPIXeonPhi();
@@ -275,11 +406,9 @@ int lightKendallTau(int argc, char* argv[]) {
 	} else {
 		KendallTau<double, RankType> sr(option._numVectors, option._vectorSize,
 				option._numCPUThreads, option._numMICThreads, option._micIndex,
-				option._rank, option._numProcs);
+				option._rank, option._numProcs, ringBlock);
 		if (option._input.length()) {
-			EXPMatrixReader<double>::loadMatrixData(option._input, option._genes,
-					option._samples, sr.getVectors(), sr.getNumVectors(),
-					sr.getVectorSize(), sr.getVectorSizeAligned());
+			loadInput<double>(sr);
 		} else {
 			sr.generateRandomData();
 		}
@@ -289,8 +418,14 @@ int lightKendallTau(int argc, char* argv[]) {
       sr.transpose();
     }
 
+		/*persisted results*/
+		sr.setResultOptions(resultOptions);
+		sr.setShard(shard, numShards);
+
 		/*run the kernel*/
 		sr.setVariant(option._kendallVariant);
+		sr.setKernel(kernel);
+		sr.setMissing(missing);
 		switch (option._mode) {
 #ifndef WITH_MPI
 		case SINGLE_THREADED:
@@ -309,6 +444,9 @@ int lightKendallTau(int argc, char* argv[]) {
 			case CPU_MPI:
 			sr.runMPICPU();
 			break;
+			case CPU_MPI_RING:
+			sr.runMPICPURing();
+			break;
 #ifdef WITH_PHI
 			case XEON_PHI_MPI:
 			sr.runMPIXeonPhi();
@@ -0,0 +1,332 @@
+/*
+ * MIKSG.cpp
+ *
+ *  k-nearest-neighbour (Kraskov-Stoegbauer-Grassberger) mutual information
+ *  (see MIKSG.hpp).
+ */
+
+#include <MIKSG.hpp>
+#include <EXPMatrixReader.hpp>
+#include <getopt.h>
+#include "LightPCC.h"
+
+/*execution mode*/
+#define SINGLE_THREADED		0
+#define MULTI_THREADED		1
+
+#ifdef WITH_MPI
+#define CPU_MPI						3
+#define CPU_MPI_RING			5
+#endif
+
+static Options option;
+static ResultOptions resultOptions;	/*persisted results [MPI and shard modes]*/
+static int shard = 0;			/*job-array shard [multi-threaded mode]*/
+static int numShards = 1;
+static int numNeighbors = MI_KSG_NUM_NEIGHBORS;	/*k*/
+static struct option longOptions[] = {
+	{ "shard", required_argument, NULL, 's' },
+	{ NULL, 0, NULL, 0 }
+};
+static void printUsage() {
+	fprintf(stderr,
+			"LightPCC miksg [options] -m exe_mode\n");
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "\t-i <str> (input EXP formatted file [random data if not given]\n");
+	fprintf(stderr, "\t-d <int> (use double precision, default = %d)\n",
+			option._useDouble);
+	fprintf(stderr, "\t-n <int> (number of vectors, default = %d [random data])\n",
+			option._numVectors);
+	fprintf(stderr, "\t-l <int> (vector size, default = %d [random data])\n",
+			option._vectorSize);
+	fprintf(stderr,
+			"\t-t <int> (number of CPU threads, default = %d [0 means auto])\n",
+			option._numCPUThreads);
+	fprintf(stderr, "\t-k <int> (number of nearest neighbours of the estimator, default = %d)\n",
+			numNeighbors);
+	fprintf(stderr, "\t    tied values are at distance 0; add a little noise to tied input\n");
+	fprintf(stderr, "\t-H (write the histogram of the values with -o [values within -1 to 1], default = off)\n");
+
+	fprintf(stderr, "\t-m <int> (execution mode, default = %d [-1 invaid])\n",
+			option._mode);
+#ifndef WITH_MPI	/*without mpi*/
+	fprintf(stderr, "\t    %d: singled-threaded on the CPU\n", SINGLE_THREADED);
+	fprintf(stderr, "\t    %d: multi-threaded on the CPU\n", MULTI_THREADED);
+
+#else	/*WITH_MPI*/
+	fprintf(stderr, "\t    %d: MPI for CPU clusters\n", CPU_MPI);
+	fprintf(stderr, "\t    %d: MPI for CPU clusters with ring distribution [O(N/p) vectors per process]\n", CPU_MPI_RING);
+#endif	/*WITH_MPI*/
+
+	fprintf(stderr, "\t-o <str> (output prefix of the result shards [MPI and --shard modes], default = none)\n");
+	fprintf(stderr, "\t-N <int> (number of top neighbors per vector written with -o, default = %d [0 means no top-K])\n",
+			resultOptions._numNeighbors);
+	fprintf(stderr, "\t-S <float> (minimum reported value, default = none)\n");
+	fprintf(stderr, "\t-L <float> (maximum reported value, default = none)\n");
+	fprintf(stderr, "\t    without -N, specifying -S or -L writes all pairs within [min, max]\n");
+	fprintf(stderr, "\t-P <int> (write the full matrix to <prefix>.packed instead of the binary tiles, default = %d)\n",
+			resultOptions._packedEncoding);
+	fprintf(stderr, "\t    %d: none, %d: float, %d: 16-bit, %d: 8-bit quantized within [min, max] of -S and -L [-1 to 1 if not given]\n",
+			PM_NONE, PM_FLOAT, PM_INT16, PM_INT8);
+#ifdef WITH_MPI
+	fprintf(stderr, "\t-F (write one file per result kind for all processes with MPI-IO, default = per-process shards)\n");
+#else
+	fprintf(stderr, "\t--shard <i/n> (compute only shard i of n of the tile space [multi-threaded mode], default = 0/1)\n");
+	fprintf(stderr, "\t    shards are merged by utils/MergeShards\n");
+#endif
+	fprintf(stderr, "\t-h (print out options)\n");
+	fprintf(stderr, "\n");
+}
+
+static bool parseArgs(int argc, char* argv[]) {
+	int opt;
+	if (argc < 2) {
+		printUsage();
+		return false;
+	}
+	while ((opt = getopt_long(argc, argv, "i:d:n:l:t:k:Hm:ho:N:S:L:FP:", longOptions, NULL)) != -1) {
+		switch (opt) {
+		case 'i':
+			option._input = optarg;
+			break;
+		case 'd':
+			option._useDouble = atoi(optarg);
+			break;
+		case 'n':
+			option._numVectors = atoi(optarg);
+			if (option._numVectors < 0) {
+				option._numVectors = 0;
+			}
+			break;
+		case 'l':
+			option._vectorSize = atoi(optarg);
+			if (option._vectorSize < 0) {
+				option._vectorSize = 0;
+			}
+			break;
+		case 't':
+			option._numCPUThreads = atoi(optarg);
+			break;
+		case 'k':
+			numNeighbors = atoi(optarg);
+			if (numNeighbors < 1) {
+				fprintf(stderr, "Invalid number of neighbours %s [expected 1 or more]\n", optarg);
+				return false;
+			}
+			break;
+		case 'H':
+			resultOptions._writeHistogram = true;
+			break;
+		case 'm':
+			option._mode = atoi(optarg);
+			break;
+		case 'o':
+			resultOptions._prefix = optarg;
+			break;
+		case 'F':
+			resultOptions._singleFile = true;
+			break;
+		case 'P':
+			resultOptions._packedEncoding = atoi(optarg);
+			if (resultOptions._packedEncoding < PM_NONE
+					|| resultOptions._packedEncoding > PM_INT8) {
+				fprintf(stderr, "Invalid packed matrix encoding %s\n", optarg);
+				return false;
+			}
+			/*the packed matrix replaces the binary tiles*/
+			resultOptions._writeTiles = resultOptions._packedEncoding == PM_NONE;
+			break;
+#ifndef WITH_MPI
+		case 's':
+			if (sscanf(optarg, "%d/%d", &shard, &numShards) != 2
+					|| numShards < 1 || shard < 0 || shard >= numShards) {
+				fprintf(stderr, "Invalid shard %s [expected i/n with 0 <= i < n]\n", optarg);
+				return false;
+			}
+			break;
+#endif
+		case 'N':
+			resultOptions._numNeighbors = atoi(optarg);
+			if (resultOptions._numNeighbors < 0) {
+				resultOptions._numNeighbors = 0;
+			}
+			break;
+		case 'S':
+			resultOptions._minValue = atof(optarg);
+			resultOptions._writeEdges = true;
+			break;
+		case 'L':
+			resultOptions._maxValue = atof(optarg);
+			resultOptions._writeEdges = true;
+			break;
+		case 'h':
+			printUsage();
+			return false;
+		default:
+			fprintf(stderr, "Unknown option: %s\n", optarg);
+			return false;
+		}
+	}
+	if (option._mode < 0) {
+		fprintf(stderr, "Must specify the execution mode using paramter: -m\n");
+		return false;
+	}
+
+	if (option._input.length() == 0) {
+		if (option._numVectors == 0) {
+			fprintf(stderr,
+					"Must specifiy the number of vectors using paramter: -n\n");
+			return false;
+		}
+		if (option._vectorSize == 0) {
+			fprintf(stderr,
+					"Must specify the vector size using paramter: -l\n");
+			return false;
+		}
+	} else {
+		/*read the file*/
+		fprintf(stderr, "Get number of vectors and vector size\n");
+		if (!option._useDouble) {
+			if (EXPMatrixReader<float>::getMatrixSize(option._input,
+					option._numVectors, option._vectorSize) == false) {
+				return false;
+			}
+		} else {
+			if (EXPMatrixReader<double>::getMatrixSize(option._input,
+					option._numVectors, option._vectorSize) == false) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+/*read in the input rows this process needs: all of them, its share of the node-local
+ *shared copy [CPU_MPI] or its ring block [CPU_MPI_RING]*/
+template<typename FloatType, typename Engine>
+static bool loadInput(Engine& engine) {
+	FloatType* vectors = engine.getVectors();
+	int rowStart = 0, rowEnd = -1;
+
+#ifdef WITH_MPI
+	if (option._mode == CPU_MPI || option._mode == CPU_MPI_RING) {
+		vectors = engine.getInputRows(rowStart, rowEnd);
+	}
+#endif
+	return EXPMatrixReader<FloatType>::loadMatrixData(option._input, option._genes,
+			option._samples, vectors, engine.getNumVectors(), engine.getVectorSize(),
+			engine.getVectorSizeAligned(), EXP_SKIP_TWO_ROWS, rowStart, rowEnd);
+}
+
+int lightMIKSG(int argc, char* argv[]) {
+
+	/*parse the arguments*/
+	if (!parseArgs(argc, argv)) {
+		return -1;
+	}
+
+#ifdef WITH_MPI
+	MPI_Comm_rank(MPI_COMM_WORLD, &option._rank);
+	MPI_Comm_size(MPI_COMM_WORLD, &option._numProcs);
+#endif /*WITH_MPI*/
+
+	/*print out command line*/
+	if (option._rank == 0) {
+		fprintf(stderr, "command line: ");
+		for (int i = 0; i < argc; ++i) {
+			fprintf(stderr, "%s ", argv[i]);
+		}
+		fprintf(stderr, "\n");
+
+		/*statistics*/
+		size_t numPairs = (size_t) (option._numVectors + 1) * option._numVectors
+				/ 2;	/*including self-vs-self*/
+		fprintf(stderr, "Double precision: %d\n", option._useDouble ? 1 : 0);
+		fprintf(stderr, "Vector size: %d\n", option._vectorSize);
+		fprintf(stderr, "Number of vectors: %d\n", option._numVectors);
+		fprintf(stderr, "Number of vector pairs: %ld\n", numPairs);
+		fprintf(stderr, "Execution mode: %d\n", option._mode);
+		fprintf(stderr, "Number of neighbours: %d\n", numNeighbors);
+	}
+	/*the ring distribution holds only the own block of vectors*/
+#ifdef WITH_MPI
+	const bool ringBlock = option._mode == CPU_MPI_RING;
+#else
+	const bool ringBlock = false;
+#endif
+	/*create object and simulate data if applicable*/
+	if (!option._useDouble) {
+		MIKSG<float> sr(option._numVectors, option._vectorSize,
+				option._numCPUThreads, option._rank, option._numProcs, numNeighbors, ringBlock);
+
+		if (option._input.length()) {
+			loadInput<float>(sr);
+		} else {
+			sr.generateRandomData();
+		}
+
+		/*persisted results*/
+		sr.setResultOptions(resultOptions);
+		sr.setShard(shard, numShards);
+
+		/*run the kernel*/
+		switch (option._mode) {
+#ifndef WITH_MPI
+		case SINGLE_THREADED:
+			sr.runSingleThreaded();
+			break;
+		case MULTI_THREADED:
+			sr.runMultiThreaded();
+			break;
+
+#else
+			case CPU_MPI:
+			sr.runMPICPU();
+			break;
+			case CPU_MPI_RING:
+			sr.runMPICPURing();
+			break;
+#endif
+		default:
+			fprintf(stderr, "Not supported mode: %d\n", option._mode);
+			return -1;
+		}
+	} else {
+		MIKSG<double> sr(option._numVectors, option._vectorSize,
+				option._numCPUThreads, option._rank, option._numProcs, numNeighbors, ringBlock);
+		if (option._input.length()) {
+			loadInput<double>(sr);
+		} else {
+			sr.generateRandomData();
+		}
+		/*persisted results*/
+		sr.setResultOptions(resultOptions);
+		sr.setShard(shard, numShards);
+
+		/*run the kernel*/
+		switch (option._mode) {
+#ifndef WITH_MPI
+		case SINGLE_THREADED:
+			sr.runSingleThreaded();
+			break;
+		case MULTI_THREADED:
+			sr.runMultiThreaded();
+			break;
+
+#else
+			case CPU_MPI:
+			sr.runMPICPU();
+			break;
+			case CPU_MPI_RING:
+			sr.runMPICPURing();
+			break;
+#endif
+		default:
+			fprintf(stderr, "Not supported mode: %d\n", option._mode);
+			return -1;
+		}
+
+	}
+	return 0;
+}
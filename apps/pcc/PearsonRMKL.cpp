@@ -4,6 +4,7 @@
 
 #include <PearsonRMKL.hpp>
 #include <EXPMatrixReader.hpp>
+#include <getopt.h>
 #include "PCC.h"
 
 /*execution mode*/
@@ -21,6 +22,15 @@
 #endif
 
 static Options option;
+static int shard = 0;			/*job-array shard [multi-threaded mode]*/
+static int numShards = 1;
+static string packedPrefix;	/*packed full matrix [single-threaded mode]*/
+static int packedEncoding = PM_NONE;
+static bool rankTransform = false;	/*Spearman on average ranks*/
+static struct option longOptions[] = {
+	{ "shard", required_argument, NULL, 's' },
+	{ NULL, 0, NULL, 0 }
+};
 static void printUsage() {
 	fprintf(stderr,
 			"PCC pearson [options] -m exe_mode\n");
@@ -44,6 +54,17 @@ static void printUsage() {
 	fprintf(stderr, "\t-S <float> (minimum pcc score, default = %d [-1 to 1])\n", option._minPCC);
 	fprintf(stderr, "\t-L <float> (maximum pcc score, default = %d [-1 to 1])\n", option._maxPCC);
 	fprintf(stderr, "\t-B <size_t> (atomic batch size i.e. 200 default = %d [200])\n", option._batchSize);
+	fprintf(stderr, "\t-r (Spearman correlation: correlate the average ranks of the vectors, default = %d)\n",
+			rankTransform ? 1 : 0);
+	fprintf(stderr, "\t    the multi-threaded mode ranks the observed values of each vector only [0.0 is missing]\n");
+	fprintf(stderr, "\t-o <str> (output prefix of the packed full matrix [single-threaded mode], default = none)\n");
+	fprintf(stderr, "\t-P <int> (write the full matrix to <prefix>.packed, default = %d)\n", packedEncoding);
+	fprintf(stderr, "\t    %d: none, %d: float, %d: 16-bit, %d: 8-bit quantized within [-1, 1]\n",
+			PM_NONE, PM_FLOAT, PM_INT16, PM_INT8);
+#ifndef WITH_MPI
+	fprintf(stderr, "\t--shard <i/n> (compute only shard i of n of the row batches [multi-threaded mode], default = 0/1)\n");
+	fprintf(stderr, "\t    writes neighbors.i.csv and countTable.i.csv, merged by utils/MergeShards\n");
+#endif
         fprintf(stderr, "\t-m <int> (execution mode, default = %d [-1 invaid])\n",
                         option._mode);
 #ifndef WITH_MPI	/*without mpi*/
@@ -74,7 +95,7 @@ static bool parseArgs(int argc, char* argv[]) {
 		printUsage();
 		return false;
 	}
-	while ((opt = getopt(argc, argv, "i:d:n:l:t:p:m:N:C:S:L:B:hx:")) != -1) {
+	while ((opt = getopt_long(argc, argv, "i:d:n:l:t:p:m:N:C:S:L:B:rhx:o:P:", longOptions, NULL)) != -1) {
 		switch (opt) {
 		case 'i':
 			option._input = optarg;
@@ -115,6 +136,28 @@ static bool parseArgs(int argc, char* argv[]) {
                 case 'B':
                         option._batchSize = atoi(optarg);
                         break;
+		case 'r':
+			rankTransform = true;
+			break;
+		case 'o':
+			packedPrefix = optarg;
+			break;
+		case 'P':
+			packedEncoding = atoi(optarg);
+			if (packedEncoding < PM_NONE || packedEncoding > PM_INT8) {
+				fprintf(stderr, "Invalid packed matrix encoding %s\n", optarg);
+				return false;
+			}
+			break;
+#ifndef WITH_MPI
+		case 's':
+			if (sscanf(optarg, "%d/%d", &shard, &numShards) != 2
+					|| numShards < 1 || shard < 0 || shard >= numShards) {
+				fprintf(stderr, "Invalid shard %s [expected i/n with 0 <= i < n]\n", optarg);
+				return false;
+			}
+			break;
+#endif
 		case 'm':
 			option._mode = atoi(optarg);
 #ifdef WITH_PHI
@@ -149,6 +192,10 @@ static bool parseArgs(int argc, char* argv[]) {
 		fprintf(stderr, "Must specify the execution mode using paramter: -m\n");
 		return false;
 	}
+	if (packedEncoding != PM_NONE && packedPrefix.length() == 0) {
+		fprintf(stderr, "Must specify the output prefix of the packed matrix using paramter: -o\n");
+		return false;
+	}
 
 	if (option._input.length() == 0) {
 		if (option._numVectors == 0) {
@@ -216,6 +263,7 @@ int PCCPearsonRMKL(int argc, char* argv[]) {
 		fprintf(stderr, "Minimum pcc score: %f\n", option._minPCC);
 		fprintf(stderr, "Maximum pcc score: %f\n", option._maxPCC);
 		fprintf(stderr, "Batch size: %zu\n", option._batchSize);
+		fprintf(stderr, "Rank transform: %d\n", rankTransform ? 1 : 0);
 		fprintf(stderr, "Execution mode: %d\n", option._mode);
 #ifdef WITH_PHI_ASSEMBLY_FLOAT
 		fprintf(stderr, "Xeon Phi with assemblies for single precision\n");
@@ -237,6 +285,9 @@ int PCCPearsonRMKL(int argc, char* argv[]) {
 		} else {
 			pr.generateRandomData();
 		}
+		pr.setShard(shard, numShards);
+		pr.setPackedOutput(packedPrefix + ".packed", packedEncoding);
+		pr.setRankTransform(rankTransform);
 
 		/*run the kernel*/
 		switch (option._mode) {
@@ -278,6 +329,9 @@ option._rank, option._numProcs, option._numNeighbors, option._minCount, option._
 		} else {
 			pr.generateRandomData();
 		}
+		pr.setShard(shard, numShards);
+		pr.setPackedOutput(packedPrefix + ".packed", packedEncoding);
+		pr.setRankTransform(rankTransform);
 		/*run the kernel*/
 		switch (option._mode) {
 #ifndef WITH_MPI
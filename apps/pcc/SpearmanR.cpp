@@ -10,6 +10,7 @@
 
 #include <SpearmanR.hpp>
 #include <EXPMatrixReader.hpp>
+#include <getopt.h>
 #include "LightPCC.h"
 
 /*execution mode*/
@@ -24,9 +25,20 @@
 #ifdef WITH_PHI
 #define XEON_PHI_MPI			4
 #endif
+#define CPU_MPI_RING			5
 #endif
 
 static Options option;
+static ResultOptions resultOptions;	/*persisted results [MPI and shard modes]*/
+static int shard = 0;			/*job-array shard [multi-threaded mode]*/
+static int numShards = 1;
+static struct option longOptions[] = {
+	{ "shard", required_argument, NULL, 's' },
+	{ NULL, 0, NULL, 0 }
+};
+static int tileDim = 0;	/*0 means autotuning*/
+static int kBlock = 0;		/*0 means autotuning*/
+static int missing = SR_MISSING_NONE;	/*pairwise-complete mode with 0.0 as missing value*/
 static void printUsage() {
 	fprintf(stderr,
 			"LightPCC speaman [options] -m exe_mode\n");
@@ -45,6 +57,14 @@ static void printUsage() {
 			"\t-p <int> (number of Xeon Phi threads, default = %d [0 means auto])\n",
 			option._numMICThreads);
 
+	fprintf(stderr, "\t-M <int> (treat 0.0 as missing and correlate the jointly observed elements of each pair [multi-threaded and MPI CPU modes], default = %d)\n",
+			missing);
+	fprintf(stderr, "\t    %d: no missing values\n", SR_MISSING_NONE);
+	fprintf(stderr, "\t    %d: exact, ranks over the jointly observed elements\n", SR_MISSING_EXACT);
+	fprintf(stderr, "\t    %d: approximate, ranks over the observed elements of each vector\n", SR_MISSING_GLOBAL_RANKS);
+	fprintf(stderr, "\t-C <int> (minimum number of jointly observed elements of reported pairs with -M, default = %d)\n",
+			resultOptions._minCount);
+
 	fprintf(stderr, "\t-m <int> (execution mode, default = %d [-1 invaid])\n",
 			option._mode);
 #ifndef WITH_MPI	/*without mpi*/
@@ -56,6 +76,7 @@ static void printUsage() {
 
 #else	/*WITH_MPI*/
 	fprintf(stderr, "\t    %d: MPI for CPU clusters\n", CPU_MPI);
+	fprintf(stderr, "\t    %d: MPI for CPU clusters with ring distribution [O(N/p) vectors per process]\n", CPU_MPI_RING);
 #ifdef WITH_PHI
 	fprintf(stderr, "\t    %d: MPI for Xeon Phi clusters\n", XEON_PHI_MPI);
 #endif	/*WITH_PHI*/
@@ -64,6 +85,31 @@ static void printUsage() {
 #ifdef WITH_PHI
 	fprintf(stderr, "\t-x <int> (Xeon Phi index [single Xeon Phi mode], default = %d)\n",
 			option._micIndex);
+#endif
+	fprintf(stderr, "\t-T <int> (tile dimension for CPU modes, default = %d [0 means autotune])\n",
+			tileDim);
+#ifdef WITH_MPI
+	fprintf(stderr, "\t    the ring distribution needs a tile dimension dividing %d\n", TT_MAX_TILE_DIM);
+#endif
+	fprintf(stderr, "\t-K <int> (K-block size for CPU modes [multiple of 16], default = %d [0 means autotune])\n",
+			kBlock);
+	fprintf(stderr, "\t-o <str> (output prefix of the result shards [MPI and --shard modes], default = none)\n");
+	fprintf(stderr, "\t-N <int> (number of top neighbors per vector written with -o, default = %d [0 means no top-K])\n",
+			resultOptions._numNeighbors);
+	fprintf(stderr, "\t-S <float> (minimum reported value, default = none)\n");
+	fprintf(stderr, "\t-L <float> (maximum reported value, default = none)\n");
+	fprintf(stderr, "\t    without -N, specifying -S or -L writes all pairs within [min, max]\n");
+	fprintf(stderr, "\t    with -M, the histogram of values per count is written as well\n");
+	fprintf(stderr, "\t-P <int> (write the full matrix to <prefix>.packed instead of the binary tiles, default = %d)\n",
+			resultOptions._packedEncoding);
+	fprintf(stderr, "\t    %d: none, %d: float, %d: 16-bit, %d: 8-bit quantized within [min, max] of -S and -L [-1 to 1 if not given]\n",
+			PM_NONE, PM_FLOAT, PM_INT16, PM_INT8);
+#ifdef WITH_MPI
+	fprintf(stderr, "\t-F (write one file per result kind for all processes with MPI-IO, default = per-process shards)\n");
+#else
+	fprintf(stderr, "\t--shard <i/n> (compute only shard i of n of the tile space [multi-threaded mode], default = 0/1)\n");
+	fprintf(stderr, "\t    shards are merged by utils/MergeShards\n");
+	fprintf(stderr, "\t    all shards of a job array must be given the same -T\n");
 #endif
 	fprintf(stderr, "\t-h (print out options)\n");
 	fprintf(stderr, "\n");
@@ -75,7 +121,7 @@ static bool parseArgs(int argc, char* argv[]) {
 		printUsage();
 		return false;
 	}
-	while ((opt = getopt(argc, argv, "i:d:n:l:t:p:m:hx:")) != -1) {
+	while ((opt = getopt_long(argc, argv, "i:d:n:l:t:p:m:hx:T:K:M:C:o:N:S:L:FP:", longOptions, NULL)) != -1) {
 		switch (opt) {
 		case 'i':
 			option._input = optarg;
@@ -123,6 +169,71 @@ static bool parseArgs(int argc, char* argv[]) {
 				option._micIndex = 0;
 			}
 			break;
+		case 'T':
+			tileDim = atoi(optarg);
+			if (tileDim < 0) {
+				tileDim = 0;
+			}
+			break;
+		case 'K':
+			kBlock = atoi(optarg);
+			if (kBlock < 0 || kBlock % 16) {
+				kBlock = 0;
+			}
+			break;
+		case 'M':
+			missing = atoi(optarg);
+			if (missing < SR_MISSING_NONE || missing > SR_MISSING_GLOBAL_RANKS) {
+				fprintf(stderr, "Invalid pairwise-complete mode %s\n", optarg);
+				return false;
+			}
+			resultOptions._writeHistogram = missing != SR_MISSING_NONE;
+			break;
+		case 'C':
+			resultOptions._minCount = atoi(optarg);
+			if (resultOptions._minCount < 0) {
+				resultOptions._minCount = 0;
+			}
+			break;
+		case 'o':
+			resultOptions._prefix = optarg;
+			break;
+		case 'F':
+			resultOptions._singleFile = true;
+			break;
+		case 'P':
+			resultOptions._packedEncoding = atoi(optarg);
+			if (resultOptions._packedEncoding < PM_NONE
+					|| resultOptions._packedEncoding > PM_INT8) {
+				fprintf(stderr, "Invalid packed matrix encoding %s\n", optarg);
+				return false;
+			}
+			/*the packed matrix replaces the binary tiles*/
+			resultOptions._writeTiles = resultOptions._packedEncoding == PM_NONE;
+			break;
+#ifndef WITH_MPI
+		case 's':
+			if (sscanf(optarg, "%d/%d", &shard, &numShards) != 2
+					|| numShards < 1 || shard < 0 || shard >= numShards) {
+				fprintf(stderr, "Invalid shard %s [expected i/n with 0 <= i < n]\n", optarg);
+				return false;
+			}
+			break;
+#endif
+		case 'N':
+			resultOptions._numNeighbors = atoi(optarg);
+			if (resultOptions._numNeighbors < 0) {
+				resultOptions._numNeighbors = 0;
+			}
+			break;
+		case 'S':
+			resultOptions._minValue = atof(optarg);
+			resultOptions._writeEdges = true;
+			break;
+		case 'L':
+			resultOptions._maxValue = atof(optarg);
+			resultOptions._writeEdges = true;
+			break;
 		case 'h':
 			printUsage();
 			return false;
@@ -135,6 +246,18 @@ static bool parseArgs(int argc, char* argv[]) {
 		fprintf(stderr, "Must specify the execution mode using paramter: -m\n");
 		return false;
 	}
+	/*autotuning may pick a different tile space on each node of a job array*/
+	if (numShards > 1 && tileDim == 0) {
+		fprintf(stderr, "Must specify the tile dimension using parameter -T with --shard\n");
+		return false;
+	}
+#ifdef WITH_MPI
+	/*ring blocks are aligned to the largest tile dimension of the tuner*/
+	if (option._mode == CPU_MPI_RING && tileDim > 0 && TT_MAX_TILE_DIM % tileDim != 0) {
+		fprintf(stderr, "The tile dimension must divide %d with the ring distribution\n", TT_MAX_TILE_DIM);
+		return false;
+	}
+#endif
 
 	if (option._input.length() == 0) {
 		if (option._numVectors == 0) {
@@ -166,6 +289,23 @@ static bool parseArgs(int argc, char* argv[]) {
 	return true;
 }
 
+/*read in the input rows this process needs: all of them, its share of the node-local
+ *shared copy [CPU_MPI] or its ring block [CPU_MPI_RING]*/
+template<typename FloatType, typename Engine>
+static bool loadInput(Engine& engine) {
+	FloatType* vectors = engine.getVectors();
+	int rowStart = 0, rowEnd = -1;
+
+#ifdef WITH_MPI
+	if (option._mode == CPU_MPI || option._mode == CPU_MPI_RING) {
+		vectors = engine.getInputRows(rowStart, rowEnd);
+	}
+#endif
+	return EXPMatrixReader<FloatType>::loadMatrixData(option._input, option._genes,
+			option._samples, vectors, engine.getNumVectors(), engine.getVectorSize(),
+			engine.getVectorSizeAligned(), EXP_SKIP_TWO_ROWS, rowStart, rowEnd);
+}
+
 int lightSpearmanR(int argc, char* argv[]) {
 
 	/*parse the arguments*/
@@ -198,6 +338,10 @@ int lightSpearmanR(int argc, char* argv[]) {
 		fprintf(stderr, "Number of vectors: %d\n", option._numVectors);
 		fprintf(stderr, "Number of vector pairs: %ld\n", numPairs);
 		fprintf(stderr, "Execution mode: %d\n", option._mode);
+		if (missing != SR_MISSING_NONE) {
+			fprintf(stderr, "Pairwise-complete mode %d with minimum count: %d\n", missing,
+					resultOptions._minCount);
+		}
 #ifdef WITH_PHI_ASSEMBLY_FLOAT
 		fprintf(stderr, "Xeon Phi with assemblies for single precision\n");
 #endif
@@ -205,20 +349,35 @@ int lightSpearmanR(int argc, char* argv[]) {
 		fprintf(stderr, "Xeon Phi with assemblies for double precision\n");
 #endif
 	}
+	/*the ring distribution holds only the own block of vectors*/
+#ifdef WITH_MPI
+	const bool ringBlock = option._mode == CPU_MPI_RING;
+#else
+	const bool ringBlock = false;
+#endif
 	/*create object and simulate data if applicable*/
 	if (!option._useDouble) {
 		SpearmanR<float> sr(option._numVectors, option._vectorSize,
 				option._numCPUThreads, option._numMICThreads, option._micIndex,
-				option._rank, option._numProcs);
+				option._rank, option._numProcs, ringBlock);
 
 		if (option._input.length()) {
-			EXPMatrixReader<float>::loadMatrixData(option._input, option._genes,
-					option._samples, sr.getVectors(), sr.getNumVectors(),
-					sr.getVectorSize(), sr.getVectorSizeAligned());
+			loadInput<float>(sr);
 		} else {
 			sr.generateRandomData();
 		}
 
+		/*tile geometry*/
+		if (tileDim == 0 || kBlock == 0) {
+			sr.autotuneTileGeometry();
+		}
+		sr.setTileGeometry(tileDim, kBlock);
+
+		/*persisted results*/
+		sr.setResultOptions(resultOptions);
+		sr.setShard(shard, numShards);
+		sr.setMissing(missing);
+
 		/*run the kernel*/
 		switch (option._mode) {
 #ifndef WITH_MPI
@@ -238,6 +397,9 @@ int lightSpearmanR(int argc, char* argv[]) {
 			case CPU_MPI:
 			sr.runMPICPU();
 			break;
+			case CPU_MPI_RING:
+			sr.runMPICPURing();
+			break;
 #ifdef WITH_PHI
 			case XEON_PHI_MPI:
 			sr.runMPIXeonPhi();
@@ -251,14 +413,23 @@ int lightSpearmanR(int argc, char* argv[]) {
 	} else {
 		SpearmanR<double> sr(option._numVectors, option._vectorSize,
 				option._numCPUThreads, option._numMICThreads, option._micIndex,
-				option._rank, option._numProcs);
+				option._rank, option._numProcs, ringBlock);
 		if (option._input.length()) {
-			EXPMatrixReader<double>::loadMatrixData(option._input, option._genes,
-					option._samples, sr.getVectors(), sr.getNumVectors(),
-					sr.getVectorSize(), sr.getVectorSizeAligned());
+			loadInput<double>(sr);
 		} else {
 			sr.generateRandomData();
 		}
+
+		/*tile geometry*/
+		if (tileDim == 0 || kBlock == 0) {
+			sr.autotuneTileGeometry();
+		}
+		sr.setTileGeometry(tileDim, kBlock);
+		/*persisted results*/
+		sr.setResultOptions(resultOptions);
+		sr.setShard(shard, numShards);
+		sr.setMissing(missing);
+
 		/*run the kernel*/
 		switch (option._mode) {
 #ifndef WITH_MPI
@@ -278,6 +449,9 @@ int lightSpearmanR(int argc, char* argv[]) {
 			case CPU_MPI:
 			sr.runMPICPU();
 			break;
+			case CPU_MPI_RING:
+			sr.runMPICPURing();
+			break;
 #ifdef WITH_PHI
 			case XEON_PHI_MPI:
 			sr.runMPIXeonPhi();
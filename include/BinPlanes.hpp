@@ -0,0 +1,213 @@
+/*
+ * BinPlanes.hpp
+ *
+ *  Vectors discretised into B bins, for the joint histograms of fixed-bin
+ *  mutual information (see MIBinned). Up to BP_PLANE_MAX_BINS bins, a vector
+ *  is stored as one-hot bitplanes: bit i of plane b is set if element i falls
+ *  into bin b. The B x B joint histogram of two vectors is then
+ *	n_ab = popcount(x_a & y_b)
+ *  i.e. the product of their one-hot matrices with AND and popcount in place
+ *  of multiply and add. The product is register-blocked over BP_BLOCK planes
+ *  of the column vector. Only the first B - 1 planes are stored, as the last
+ *  row and column of the histogram follow from the elements per bin.
+ *
+ *  The planes cost (B - 1)^2 / 64 popcounts per element against one scattered
+ *  increment of a plain histogram, so more bins are stored as 8-bit bin
+ *  codes and counted directly.
+ */
+
+#ifndef __BIN_PLANES_HPP
+#define __BIN_PLANES_HPP
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <mm_malloc.h>
+
+/*maximum number of bins, limited by the 8-bit bin codes*/
+#define BP_MAX_BINS		256
+
+/*maximum number of bins stored as bitplanes*/
+#define BP_PLANE_MAX_BINS	12
+
+/*column planes per register block*/
+#define BP_BLOCK	4
+
+class BinPlanes
+{
+public:
+	/*storage holds getStorageSize() bytes owned by the caller [e.g. shared by the processes
+	 *of a node], or is allocated here if NULL*/
+	BinPlanes(const int numVectors, const int vectorSize, const int numBins,
+			void* storage = NULL) {
+		_numVectors = numVectors;
+		_vectorSize = vectorSize;
+		_numBins = numBins;
+		_usePlanes = numBins <= BP_PLANE_MAX_BINS;
+		_numPlanes = numBins - 1;
+		_numWords = getNumWords(vectorSize);
+		_planes = NULL;
+		_codes = NULL;
+		_storage = NULL;
+
+		if (!storage) {
+			storage = _storage = _mm_malloc(getStorageSize(numVectors, vectorSize, numBins), 64);
+			if (!_storage) {
+				fprintf(stderr, "Memory allocation failed\n");
+				exit(-1);
+			}
+		}
+		if (_usePlanes) {
+			_planes = (uint64_t*) storage;
+		} else {
+			_codes = (uint8_t*) storage;
+		}
+		_marginals = (int*) ((char*) storage + _getDataSize(numVectors, vectorSize, numBins));
+	}
+	~BinPlanes() {
+		if (_storage) {
+			_mm_free(_storage);
+		}
+	}
+
+	/*64-bit words per plane, rounded up to 64 bytes*/
+	static inline ssize_t getNumWords(const int vectorSize) {
+		return ((vectorSize + 63) / 64 + 7) / 8 * 8;
+	}
+
+	/*bytes of the planes or codes and the marginals of numVectors vectors*/
+	static inline ssize_t getStorageSize(const int numVectors, const int vectorSize,
+			const int numBins) {
+		return _getDataSize(numVectors, vectorSize, numBins)
+				+ (ssize_t) numVectors * numBins * sizeof(int);
+	}
+
+	inline int getNumBins() const {
+		return _numBins;
+	}
+	/*elements per bin of a vector*/
+	inline const int* getMarginals(const int vector) const {
+		return _marginals + (ssize_t) vector * _numBins;
+	}
+
+	/*store a vector of bin indices 0 .. B - 1. Different vectors may be built concurrently*/
+	template<typename FloatType>
+	void build(const int vector, const FloatType* bins) {
+		int* marginals = _marginals + (ssize_t) vector * _numBins;
+
+		memset(marginals, 0, _numBins * sizeof(int));
+		if (_usePlanes) {
+			uint64_t* planes = _getPlanes(vector);
+			memset(planes, 0, _numPlanes * _numWords * sizeof(uint64_t));
+			for (int i = 0; i < _vectorSize; ++i) {
+				const int b = (int) bins[i];
+				marginals[b]++;
+				if (b < _numPlanes) {
+					planes[b * _numWords + (i >> 6)] |= (uint64_t) 1 << (i & 63);
+				}
+			}
+		} else {
+			uint8_t* codes = _codes + (ssize_t) vector * _vectorSize;
+			for (int i = 0; i < _vectorSize; ++i) {
+				codes[i] = (uint8_t) bins[i];
+				marginals[codes[i]]++;
+			}
+		}
+	}
+
+	/*joint histogram of vector a of this and vector b of other, both with the same
+	 *vector size and bins: hist[i * B + j] counts the elements in bin i of a and bin j of b*/
+	inline void count(const int a, const BinPlanes& other, const int b,
+			int* __restrict__ hist) const {
+		const int numBins = _numBins;
+
+		if (!_usePlanes) {
+			const uint8_t* __restrict__ x = _codes + (ssize_t) a * _vectorSize;
+			const uint8_t* __restrict__ y = other._codes + (ssize_t) b * _vectorSize;
+			memset(hist, 0, numBins * numBins * sizeof(int));
+			for (int i = 0; i < _vectorSize; ++i) {
+				hist[x[i] * numBins + y[i]]++;
+			}
+			return;
+		}
+
+		/*the stored planes*/
+		const uint64_t* __restrict__ x = _getPlanes(a);
+		const uint64_t* __restrict__ y = other._getPlanes(b);
+		const ssize_t numWords = _numWords;
+		for (int i = 0; i < _numPlanes; ++i) {
+			const uint64_t* __restrict__ xi = x + i * numWords;
+			int j = 0;
+			for (; j + BP_BLOCK <= _numPlanes; j += BP_BLOCK) {
+				const uint64_t* __restrict__ yj = y + j * numWords;
+				uint64_t n0 = 0, n1 = 0, n2 = 0, n3 = 0;
+				for (ssize_t w = 0; w < numWords; ++w) {
+					const uint64_t v = xi[w];
+					n0 += __builtin_popcountll(v & yj[w]);
+					n1 += __builtin_popcountll(v & yj[numWords + w]);
+					n2 += __builtin_popcountll(v & yj[2 * numWords + w]);
+					n3 += __builtin_popcountll(v & yj[3 * numWords + w]);
+				}
+				hist[i * numBins + j] = n0;
+				hist[i * numBins + j + 1] = n1;
+				hist[i * numBins + j + 2] = n2;
+				hist[i * numBins + j + 3] = n3;
+			}
+			for (; j < _numPlanes; ++j) {
+				const uint64_t* __restrict__ yj = y + j * numWords;
+				uint64_t n = 0;
+				for (ssize_t w = 0; w < numWords; ++w) {
+					n += __builtin_popcountll(xi[w] & yj[w]);
+				}
+				hist[i * numBins + j] = n;
+			}
+		}
+
+		/*the last column, then the last row from the elements per bin*/
+		const int* mx = getMarginals(a);
+		const int* my = other.getMarginals(b);
+		const int last = _numPlanes;
+		for (int i = 0; i < last; ++i) {
+			int sum = 0;
+			for (int j = 0; j < last; ++j) {
+				sum += hist[i * numBins + j];
+			}
+			hist[i * numBins + last] = mx[i] - sum;
+		}
+		for (int j = 0; j <= last; ++j) {
+			int sum = 0;
+			for (int i = 0; i < last; ++i) {
+				sum += hist[i * numBins + j];
+			}
+			hist[last * numBins + j] = my[j] - sum;
+		}
+	}
+
+private:
+	int _numVectors;
+	int _vectorSize;
+	int _numBins;
+	bool _usePlanes;
+	int _numPlanes;			/*stored planes per vector*/
+	ssize_t _numWords;		/*64-bit words per plane*/
+	uint64_t* _planes;		/*planes of the first B - 1 bins of each vector*/
+	uint8_t* _codes;		/*bin of each element, without planes*/
+	int* _marginals;		/*elements per bin of each vector*/
+	void* _storage;			/*allocated here, NULL if owned by the caller*/
+
+	/*bytes of the planes or codes, padded by 64 bytes and rounded up to 64 bytes*/
+	static inline ssize_t _getDataSize(const int numVectors, const int vectorSize,
+			const int numBins) {
+		ssize_t size = numBins <= BP_PLANE_MAX_BINS ?
+				(ssize_t) numVectors * (numBins - 1) * getNumWords(vectorSize) * sizeof(uint64_t) :
+				(ssize_t) numVectors * vectorSize;
+		return (size + 64 + 63) / 64 * 64;
+	}
+
+	inline uint64_t* _getPlanes(const int vector) const {
+		return _planes + (ssize_t) vector * _numPlanes * _numWords;
+	}
+};
+
+#endif	/*__BIN_PLANES_HPP*/
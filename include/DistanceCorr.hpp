@@ -24,6 +24,9 @@ using namespace std;
 #pragma once
 
 #include <DeviceUtils.hpp>
+#include <TriangularIndex.hpp>
+#include <TileScheduler.hpp>
+#include <ResultWriter.hpp>
 
 #ifdef WITH_MPI
 #include <mpi.h>
@@ -45,11 +48,6 @@ using namespace std;
 #define DT_MPI_TILE_DIM	8
 #define DT_MPI_TILE_SIZE	(DT_MPI_TILE_DIM * DT_MPI_TILE_DIM)
 
-/*maximum dimension size*/
-#ifndef DT_MAX_MAT_DIM
-#define DT_MAX_MAT_DIM			(1<<25)
-#endif
-
 /*maximum Xeon Phi buffer size*/
 #define DT_PHI_BUFFER_SIZE (1 << 29)
 
@@ -98,6 +96,17 @@ public:
 
 	/*transpose matrix*/
 	void transpose();
+
+	/*persisted results of the multi-threaded engine*/
+	inline void setResultOptions(const ResultOptions& options) {
+		_resultOptions = options;
+	}
+
+	/*compute only shard shard of numShards of the tile space [multi-threaded mode]*/
+	inline void setShard(const int shard, const int numShards) {
+		_shard = shard;
+		_numShards = numShards;
+	}
 private:
 	FloatType* _vectors; /*vector data. Stored consecutively and each vector contains an aligned number of elements*/
 	int _numVectors; /*number of vectors in the data*/
@@ -109,6 +118,9 @@ private:
 	int _micIndex;	/*index of MIC used by this processs*/
 	int _rank;			/*process rank*/
 	int _numProcs;	/*number of MPI processes*/
+	int _shard;			/*job-array shard of the multi-threaded engine*/
+	int _numShards;	/*number of job-array shards*/
+	ResultOptions _resultOptions;	/*output of the multi-threaded engine*/
 	int _tiledPrMatrix; /*how the pearson correlation matrix is stored*/
 	FloatType* _distanceCorr; /*pearson correlation matrix*/
 
@@ -167,24 +179,13 @@ private:
 
 	/*static function members*/
 public:
-	/*when matrix dimension size is large than 2^21, we should use long double instead of double*/
+	/*exact integer mappings, see TriangularIndex.hpp*/
 #ifdef WITH_PHI
 	__attribute__((target(mic)))
 #endif
 	inline void getCoordinate(const ssize_t globalIndex,
 			const ssize_t matrixDimSize, int& row, int& col) {
-#if DT_MAX_MAT_DIM < (1 << 25)
-		typedef double mydouble;
-#else
-		typedef long double mydouble;
-#endif
-		mydouble p, q;
-		p = static_cast<mydouble>(matrixDimSize - 1);
-		q = static_cast<mydouble>(globalIndex);
-		row = (int) ceil(p - 0.5 - sqrt(p * p + p - 2 * (q + 1) + 0.25));
-		col = row
-				+ (globalIndex - (2 * (matrixDimSize - 1) - row + 1) * row / 2)
-				+ 1;
+		TriangularIndex::getStrictCoordinate(globalIndex, matrixDimSize, row, col);
 	}
 
 	/*conditions: row < col*/
@@ -193,16 +194,7 @@ public:
 #endif
 	inline ssize_t getGlobalIndex(const ssize_t matrixDimSize, const int row,
 			const int col) {
-#if DT_MAX_MAT_DIM < (1 << 25)
-		typedef double mydouble;
-#else
-		typedef long double mydouble;
-#endif
-
-		mydouble p, q;
-		p = static_cast<mydouble>(matrixDimSize);
-
-		return (ssize_t) ((p - 1 - 0.5 * (row - 1)) * row + col - (row + 1));
+		return TriangularIndex::getStrictIndex(matrixDimSize, row, col);
 	}
 
 #ifdef WITH_PHI
@@ -210,16 +202,7 @@ public:
 #endif
 	inline void getTileCoordinate(const ssize_t globalIndex,
 			const ssize_t tileDim, int& row, int& col) {
-#if DT_MAX_MAT_DIM < (1 << 25)
-		typedef double mydouble;
-#else
-		typedef long double mydouble;
-#endif
-		mydouble p, q;
-		p = static_cast<mydouble>(tileDim);
-		q = static_cast<mydouble>(globalIndex);
-		row = (int) ceil(p - 0.5 - sqrt(p * p + p - 2 * (q + 1) + 0.25));
-		col = row + (globalIndex - (2 * tileDim - row + 1) * row / 2);
+		TriangularIndex::getUpperCoordinate(globalIndex, tileDim, row, col);
 	}
 
 	/*conditions: row <= col*/
@@ -228,16 +211,7 @@ public:
 #endif
 	inline ssize_t getTileGlobalIndex(const ssize_t matrixDimSize, const int row,
 		const int col) {
-#if DT_MAX_MAT_DIM < (1 << 25)
-    typedef double mydouble;
-#else
-    typedef long double mydouble;
-#endif
-
-    mydouble p, q;
-    p = static_cast<mydouble>(matrixDimSize);
-
-    return (ssize_t) ((p - 0.5 * (row - 1)) * row + col - row);
+		return TriangularIndex::getUpperIndex(matrixDimSize, row, col);
 	}
 #ifdef WITH_PHI
 __attribute__((target(mic)))
@@ -282,14 +256,8 @@ DistanceCorr<FloatType>::DistanceCorr(int numVectors, int vectorSize, int numCPU
 	_micIndex = micIndex; /*index of mic device*/
 	_rank = rank;
 	_numProcs = numProcs;
-
-	/*check the number of vectors*/
-	if (_numVectors > DT_MAX_MAT_DIM) {
-		fprintf(stderr,
-				"The number of vectors exceeds the maximum limit (%ld)\n",
-				(ssize_t) DT_MAX_MAT_DIM);
-		exit(-1);
-	}
+	_shard = 0;
+	_numShards = 1;
 
 	/*allocate space*/
 	_distanceCorr = NULL;
@@ -494,10 +462,25 @@ void DistanceCorr<FloatType>::runMultiThreaded() {
 	}
 	omp_set_num_threads(_numCPUThreads);
 	
+	/*dynamic tile scheduler*/
+	TileScheduler scheduler(numTiles, _numCPUThreads);
+
+	/*job-array shard: a balanced slice of the tile space*/
+	ssize_t firstTile, lastTile;
+	TileScheduler::getShardRange(numTiles, _shard, _numShards, firstTile, lastTile);
+	scheduler.setRange(firstTile, lastTile);
+
+	/*persisted results of the shard*/
+	ResultWriter<FloatType>* writer = NULL;
+	if (_resultOptions.enabled()) {
+		writer = new ResultWriter<FloatType>(_resultOptions, "distance", _shard,
+				_numShards, _numVectors, _vectorSize, DT_MT_TILE_DIM, _numCPUThreads);
+	}
+
 	/*entering the core loop*/
 #pragma omp parallel reduction(+:totalNumPairs)
 	{
-		ssize_t chunkSize;
+		ssize_t tileStart, tileEnd;
 		int row, col;
 		int loRowRange, hiRowRange;
 		int loColRange, hiColRange;
@@ -507,51 +490,52 @@ void DistanceCorr<FloatType>::runMultiThreaded() {
 		FloatType* __restrict__ vecX;
 		FloatType* __restrict__ vecY;
 		const int tid = omp_get_thread_num();
-		const int nthreads = omp_get_num_threads();
 
 		/*compute pairwise correlation coefficient*/
-		chunkSize = (numTiles + nthreads - 1) / nthreads;
-		loRowRange = loColRange = tileDim + 1;
-		if (tid * chunkSize < numTiles) {
-			getTileCoordinate(tid * chunkSize, tileDim, loRowRange, loColRange);
-		}
-		hiRowRange = hiColRange = tileDim;
-		if ((tid + 1) * chunkSize <= numTiles) {
-			getTileCoordinate((tid + 1) * chunkSize - 1, tileDim, hiRowRange,
-					hiColRange);
-		}
 
   	FloatType* meanX = (FloatType*)mm_malloc(_vectorSize * sizeof(FloatType), 64);
   	FloatType* meanY = (FloatType*)mm_malloc(_vectorSize * sizeof(FloatType), 64);
-		for (int tileRow = loRowRange; tileRow <= hiRowRange; tileRow++) {
-			/*compute the effective range per row*/
-			startColPerRow = (tileRow == loRowRange) ? loColRange : tileRow;
-			endColPerRow = (tileRow == hiRowRange) ? hiColRange : tileDim - 1;
-
-			rowStart = tileRow * DT_MT_TILE_DIM;
-			rowEnd = min(_numVectors, rowStart + DT_MT_TILE_DIM);
-			for (int tileCol = startColPerRow; tileCol <= endColPerRow;
-					++tileCol) {
-				colStart = tileCol * DT_MT_TILE_DIM;
-				colEnd = min(_numVectors, colStart + DT_MT_TILE_DIM);
-				/*compute the tile*/
-				vecX = _vectors + rowStart * _vectorSizeAligned;
-				for (row = rowStart; row < rowEnd; ++row, vecX +=
-						_vectorSizeAligned) {
-					vecY = _vectors + colStart * _vectorSizeAligned;
-					for (col = colStart; col < colEnd; ++col, vecY +=
+		scheduler.threadStart(tid);
+		while (scheduler.nextChunk(tid, tileStart, tileEnd)) {
+			getTileCoordinate(tileStart, tileDim, loRowRange, loColRange);
+			getTileCoordinate(tileEnd - 1, tileDim, hiRowRange, hiColRange);
+			for (int tileRow = loRowRange; tileRow <= hiRowRange; tileRow++) {
+				/*compute the effective range per row*/
+				startColPerRow = (tileRow == loRowRange) ? loColRange : tileRow;
+				endColPerRow = (tileRow == hiRowRange) ? hiColRange : tileDim - 1;
+
+				rowStart = tileRow * DT_MT_TILE_DIM;
+				rowEnd = min(_numVectors, rowStart + DT_MT_TILE_DIM);
+				for (int tileCol = startColPerRow; tileCol <= endColPerRow;
+						++tileCol) {
+					colStart = tileCol * DT_MT_TILE_DIM;
+					colEnd = min(_numVectors, colStart + DT_MT_TILE_DIM);
+					/*compute the tile*/
+					vecX = _vectors + rowStart * _vectorSizeAligned;
+					for (row = rowStart; row < rowEnd; ++row, vecX +=
 							_vectorSizeAligned) {
-
-						if(row <= col){
-							++numPairsProcessed;	/*statistics*/
-							FloatType corr = _computeDistCorr(meanX, meanY, vecX, vecY, _vectorSize);
-							_distanceCorr[(ssize_t)row * _numVectors + col] = corr;
-							_distanceCorr[(ssize_t)col * _numVectors + row] = corr;
+						vecY = _vectors + colStart * _vectorSizeAligned;
+						for (col = colStart; col < colEnd; ++col, vecY +=
+								_vectorSizeAligned) {
+
+							if(row <= col){
+								++numPairsProcessed;	/*statistics*/
+								FloatType corr = _computeDistCorr(meanX, meanY, vecX, vecY, _vectorSize);
+								_distanceCorr[(ssize_t)row * _numVectors + col] = corr;
+								_distanceCorr[(ssize_t)col * _numVectors + row] = corr;
+							}
 						}
 					}
+					if (writer) {
+						writer->addTile(getTileGlobalIndex(tileDim, tileRow, tileCol),
+								rowStart, rowEnd, colStart, colEnd,
+								_distanceCorr + (ssize_t) rowStart * _numVectors + colStart,
+								_numVectors, NULL, 0, tid);
+					}
 				}
 			}
 		}
+		scheduler.threadFinish(tid);
 		mm_free(meanX);
 		mm_free(meanY);
 
@@ -559,11 +543,23 @@ void DistanceCorr<FloatType>::runMultiThreaded() {
 		totalNumPairs += numPairsProcessed;
 	} /*#pragma omp parallel*/
 
+	if (writer) {
+		writer->close();
+		delete writer;
+	}
+
 	/*recored the system time*/
 	etime = getSysTime();
 	fprintf(stderr, "Overall time (%ld pairs): %f seconds\n", totalNumPairs,
 			etime - stime);
 
+	/*report load balance*/
+#ifdef VERBOSE
+	scheduler.report(stderr, true);
+#else
+	scheduler.report(stderr, false);
+#endif
+
 #if 0
   for(int i = 0; i < _numVectors; ++i){
     for(int j = i; j < _numVectors; ++j){
@@ -0,0 +1,174 @@
+/*
+ * DotKernel.hpp
+ *
+ *  Register-blocked dot-product kernel for the tiled correlation engines.
+ *  Instead of computing each pair of a tile as an independent dot product,
+ *  which reloads both vectors for every pair, a block of DK_BLOCK_ROWS x
+ *  DK_BLOCK_COLS vectors is processed at a time so that each loaded element
+ *  is reused DK_BLOCK_ROWS (or DK_BLOCK_COLS) times from registers. The
+ *  vector dimension is split into blocks of DK_K_BLOCK elements so that the
+ *  row and column panels of a tile stay resident in L1/L2.
+ */
+
+#ifndef __DOT_KERNEL_HPP
+#define __DOT_KERNEL_HPP
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+/*register block size. 4x4 uses 16 vector accumulators*/
+#define DK_BLOCK_ROWS	4
+#define DK_BLOCK_COLS	4
+
+/*default number of elements per K-block (multiple of 16 to keep alignment)*/
+#ifndef DK_K_BLOCK
+#define DK_K_BLOCK		256
+#endif
+
+template<typename FloatType>
+struct DotKernel
+{
+	/*compute the dot products of vectors [rowStart, rowEnd) against vectors [colStart, colEnd).
+	 *results are stored in tile[(row - rowStart) * ld + (col - colStart)].
+	 *register blocks lying entirely below the diagonal (row > col) are skipped.
+	 *kBlock must be a multiple of 16 to keep the alignment of each K-block.
+	 */
+	static void computeTile(const FloatType* __restrict__ vectors,
+			const int vectorSize, const int vectorSizeAligned,
+			const int rowStart, const int rowEnd, const int colStart,
+			const int colEnd, FloatType* __restrict__ tile, const int ld,
+			const int kBlock = DK_K_BLOCK)
+	{
+		computeTile(vectors + (ssize_t) rowStart * vectorSizeAligned, rowStart,
+				rowEnd, vectors + (ssize_t) colStart * vectorSizeAligned, colStart,
+				colEnd, vectorSize, vectorSizeAligned, tile, ld, kBlock);
+	}
+
+	/*the same with the row and column vectors in separate panels.
+	 *rowVectors points to vector rowStart and colVectors to vector colStart.
+	 *row and column indices are global, so that the diagonal can be detected*/
+	static void computeTile(const FloatType* __restrict__ rowVectors,
+			const int rowStart, const int rowEnd,
+			const FloatType* __restrict__ colVectors, const int colStart,
+			const int colEnd, const int vectorSize, const int vectorSizeAligned,
+			FloatType* __restrict__ tile, const int ld,
+			const int kBlock = DK_K_BLOCK)
+	{
+		int r, c, kk, kend;
+
+		/*clear the output tile*/
+		for (r = 0; r < rowEnd - rowStart; ++r) {
+			for (c = 0; c < colEnd - colStart; ++c) {
+				tile[r * ld + c] = 0;
+			}
+		}
+
+		/*K-blocking*/
+		for (kk = 0; kk < vectorSize; kk += kBlock) {
+			kend = kk + kBlock;
+			if (kend > vectorSize) {
+				kend = vectorSize;
+			}
+			for (r = rowStart; r < rowEnd; r += DK_BLOCK_ROWS) {
+				for (c = colStart; c < colEnd; c += DK_BLOCK_COLS) {
+					/*the whole block is below the diagonal*/
+					if (r > c + DK_BLOCK_COLS - 1) {
+						continue;
+					}
+					if (r + DK_BLOCK_ROWS <= rowEnd && c + DK_BLOCK_COLS <= colEnd) {
+						_block4x4(rowVectors + (ssize_t) (r - rowStart) * vectorSizeAligned,
+								colVectors + (ssize_t) (c - colStart) * vectorSizeAligned,
+								vectorSizeAligned, kk, kend,
+								tile + (r - rowStart) * ld + (c - colStart), ld);
+					} else {
+						_blockEdge(rowVectors + (ssize_t) (r - rowStart) * vectorSizeAligned,
+								min2(r + DK_BLOCK_ROWS, rowEnd) - r,
+								colVectors + (ssize_t) (c - colStart) * vectorSizeAligned,
+								min2(c + DK_BLOCK_COLS, colEnd) - c, vectorSizeAligned,
+								kk, kend, tile + (r - rowStart) * ld + (c - colStart), ld);
+					}
+				}
+			}
+		}
+	}
+
+private:
+	static inline int min2(const int a, const int b)
+	{
+		return a < b ? a : b;
+	}
+
+	/*full 4x4 register block: 8 loads feed 16 multiply-adds per element*/
+	static inline void _block4x4(const FloatType* __restrict__ rowVectors,
+			const FloatType* __restrict__ colVectors, const int vectorSizeAligned,
+			const int kk, const int kend, FloatType* __restrict__ out,
+			const int ld)
+	{
+		const FloatType* __restrict__ x0 = rowVectors;
+		const FloatType* __restrict__ x1 = x0 + vectorSizeAligned;
+		const FloatType* __restrict__ x2 = x1 + vectorSizeAligned;
+		const FloatType* __restrict__ x3 = x2 + vectorSizeAligned;
+		const FloatType* __restrict__ y0 = colVectors;
+		const FloatType* __restrict__ y1 = y0 + vectorSizeAligned;
+		const FloatType* __restrict__ y2 = y1 + vectorSizeAligned;
+		const FloatType* __restrict__ y3 = y2 + vectorSizeAligned;
+		FloatType s00 = 0, s01 = 0, s02 = 0, s03 = 0;
+		FloatType s10 = 0, s11 = 0, s12 = 0, s13 = 0;
+		FloatType s20 = 0, s21 = 0, s22 = 0, s23 = 0;
+		FloatType s30 = 0, s31 = 0, s32 = 0, s33 = 0;
+		FloatType a0, a1, a2, a3, b0, b1, b2, b3;
+
+#pragma vector aligned
+#pragma simd reduction(+:s00,s01,s02,s03,s10,s11,s12,s13,s20,s21,s22,s23,s30,s31,s32,s33)
+		for (int k = kk; k < kend; ++k) {
+			a0 = x0[k];
+			a1 = x1[k];
+			a2 = x2[k];
+			a3 = x3[k];
+			b0 = y0[k];
+			b1 = y1[k];
+			b2 = y2[k];
+			b3 = y3[k];
+			s00 += a0 * b0; s01 += a0 * b1; s02 += a0 * b2; s03 += a0 * b3;
+			s10 += a1 * b0; s11 += a1 * b1; s12 += a1 * b2; s13 += a1 * b3;
+			s20 += a2 * b0; s21 += a2 * b1; s22 += a2 * b2; s23 += a2 * b3;
+			s30 += a3 * b0; s31 += a3 * b1; s32 += a3 * b2; s33 += a3 * b3;
+		}
+		out[0] += s00; out[1] += s01; out[2] += s02; out[3] += s03;
+		out += ld;
+		out[0] += s10; out[1] += s11; out[2] += s12; out[3] += s13;
+		out += ld;
+		out[0] += s20; out[1] += s21; out[2] += s22; out[3] += s23;
+		out += ld;
+		out[0] += s30; out[1] += s31; out[2] += s32; out[3] += s33;
+	}
+
+	/*ragged block at the matrix edge*/
+	static inline void _blockEdge(const FloatType* __restrict__ rowVectors,
+			const int numRows, const FloatType* __restrict__ colVectors,
+			const int numCols, const int vectorSizeAligned, const int kk,
+			const int kend, FloatType* __restrict__ out, const int ld)
+	{
+		FloatType prod;
+		const FloatType* __restrict__ vecX;
+		const FloatType* __restrict__ vecY;
+
+		for (int row = 0; row < numRows; ++row) {
+			vecX = rowVectors + (ssize_t) row * vectorSizeAligned;
+			for (int col = 0; col < numCols; ++col) {
+				vecY = colVectors + (ssize_t) col * vectorSizeAligned;
+				prod = 0;
+#pragma vector aligned
+#pragma simd reduction(+:prod)
+				for (int k = kk; k < kend; ++k) {
+					prod += vecX[k] * vecY[k];
+				}
+				out[row * ld + col] += prod;
+			}
+		}
+	}
+};
+
+#endif	/*__DOT_KERNEL_HPP*/
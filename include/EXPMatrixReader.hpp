@@ -14,6 +14,13 @@
 #include <string>
 #include <vector>
 #include <Utilities.h>
+#include <sys/types.h>
+#ifdef WITH_MPI
+#include <stdint.h>
+#include <typeinfo>
+#include <algorithm>
+#include <mpi.h>
+#endif
 
 using namespace std;
 
@@ -22,17 +29,133 @@ using namespace std;
 #endif
 
 
-/*use the same format with ARACNE*/
+/*use the same format with ARACNE.
+ *with WITH_MPI and more than one process, getMatrixSize and loadMatrixData are
+ *collective over MPI_COMM_WORLD and parse the file in parallel (see the MPI variants)*/
 template<typename FloatType>
 class EXPMatrixReader {
 public:
 	/*get gene expression matrix size*/
 	static bool getMatrixSize(string& fileName, int& numVectors, int& vectorSize, const bool skip = EXP_SKIP_TWO_ROWS);
 
-	/*get the matrix data*/
+	/*get the matrix data. Only rows [rowStart, rowEnd) are stored, row i at
+	 *vectors + (i - rowStart) * vectorSizeAligned. rowEnd < 0 means all rows*/
 	static bool loadMatrixData(string& fileName, vector<string>& genes,
 			vector<string>& samples, FloatType* vectors, const int numVectors,
-			const int vectorSize, const int vectorSizeAligned, const bool skip = EXP_SKIP_TWO_ROWS);
+			const int vectorSize, const int vectorSizeAligned, const bool skip = EXP_SKIP_TWO_ROWS,
+			const int rowStart = 0, const int rowEnd = -1);
+
+#ifdef WITH_MPI
+	/*collective over comm. Each process parses one byte range of the file,
+	 *aligned to line boundaries, so the file is parsed once in aggregate.
+	 *Lines end with \n or \r\n*/
+	static bool getMatrixSizeMPI(string& fileName, int& numVectors,
+			int& vectorSize, MPI_Comm comm, const bool skip = EXP_SKIP_TWO_ROWS);
+
+	/*collective over comm. Each process parses its byte range, the global row
+	 *numbers come from a prefix scan of the row counts, and the parsed rows are
+	 *exchanged so that a process receives only rows [rowStart, rowEnd) into vectors,
+	 *row i at vectors + (i - rowStart) * vectorSizeAligned. rowEnd < 0 means all rows.
+	 *genes and samples are filled in completely on every process*/
+	static bool loadMatrixDataMPI(string& fileName, vector<string>& genes,
+			vector<string>& samples, FloatType* vectors, const int numVectors,
+			const int vectorSize, const int vectorSizeAligned, MPI_Comm comm,
+			const bool skip = EXP_SKIP_TWO_ROWS, const int rowStart = 0,
+			const int rowEnd = -1);
+
+private:
+	/*the lines of the file starting within one byte range*/
+	class RangeReader {
+	public:
+		RangeReader() {
+			_file = NULL;
+			_pos = _end = 0;
+		}
+		~RangeReader() {
+			close();
+		}
+		bool open(const char* fileName, const int64_t begin, const int64_t end,
+				const int64_t dataStart) {
+			int ch;
+
+			_file = fopen(fileName, "rb");
+			if (!_file) {
+				return false;
+			}
+			_pos = begin;
+			_end = end;
+			if (begin >= end) {
+				return true;
+			}
+			/*a line belongs to the range holding its first byte*/
+			if (begin > dataStart) {
+				if (fseeko(_file, begin - 1, SEEK_SET)) {
+					return false;
+				}
+				if ((ch = fgetc(_file)) != '\n') {
+					while ((ch = fgetc(_file)) != EOF && ch != '\n') {
+						_pos++;
+					}
+					_pos++;
+				}
+			} else if (fseeko(_file, begin, SEEK_SET)) {
+				return false;
+			}
+			return true;
+		}
+		void close() {
+			if (_file) {
+				fclose(_file);
+				_file = NULL;
+			}
+		}
+		/*same as CustomFileReader::getline, but -1 after the end of the range*/
+		inline ssize_t getline(char** buffer, size_t* bufferSize) {
+			ssize_t length;
+
+			if (_pos >= _end || (length = ::getline(buffer, bufferSize, _file)) == -1) {
+				return -1;
+			}
+			_pos += length;
+			while (length > 0 && ((*buffer)[length - 1] == '\n' || (*buffer)[length - 1] == '\r')) {
+				(*buffer)[--length] = '\0';
+			}
+			return length;
+		}
+	private:
+		FILE* _file;
+		int64_t _pos;
+		int64_t _end;
+	};
+
+	/*collective: rank 0 reads the header, the byte offset of the first data line and the file size*/
+	static bool _readHeaderMPI(string& fileName, string& header,
+			int64_t& dataStart, int64_t& fileSize, MPI_Comm comm, const bool skip);
+
+	/*byte range [begin, end) of the data lines parsed by rank*/
+	static inline void _getRange(const int64_t dataStart, const int64_t fileSize,
+			const int rank, const int numProcs, int64_t& begin, int64_t& end) {
+		begin = dataStart + (fileSize - dataStart) * rank / numProcs;
+		end = dataStart + (fileSize - dataStart) * (rank + 1) / numProcs;
+	}
+
+	/*the parallel reader is used when more than one process is running*/
+	static inline bool _useMPI() {
+#ifdef COMPRESSED_INPUT
+		/*compressed streams cannot be split at byte offsets*/
+		return false;
+#else
+		int initialized, finalized, numProcs;
+		MPI_Initialized(&initialized);
+		MPI_Finalized(&finalized);
+		if (!initialized || finalized) {
+			return false;
+		}
+		MPI_Comm_size(MPI_COMM_WORLD, &numProcs);
+		return numProcs > 1;
+#endif
+	}
+#endif	/*WITH_MPI*/
 };
 
 template<typename FloatType>
@@ -44,6 +167,12 @@ bool EXPMatrixReader<FloatType>::getMatrixSize(string& fileName, int& numVectors
 	const char delim[] = ",";
 	CustomFileReader fileReader;
 
+#ifdef WITH_MPI
+	if (_useMPI()) {
+		return getMatrixSizeMPI(fileName, numVectors, vectorSize, MPI_COMM_WORLD, skip);
+	}
+#endif
+
 	/*open the file*/
 	if (!fileReader.open(fileName.c_str(), "rb")) {
 		fprintf(stderr, "Failed to open file %s\n", fileName.c_str());
@@ -99,14 +228,23 @@ template<typename FloatType>
 bool EXPMatrixReader<FloatType>::loadMatrixData(string& fileName,
 		vector<string>& genes, vector<string>& samples, FloatType* vectors,
 		const int numVectors, const int vectorSize,
-		const int vectorSizeAligned, const bool skip) {
+		const int vectorSizeAligned, const bool skip, const int rowStart,
+		const int rowEnd) {
 	char* buffer = NULL, *tok;
 	size_t bufferSize = 0;
 	int numChars, index;
 	bool firstEntry;
 	const char delim[] = ",";
+	const int lastRow = rowEnd < 0 ? numVectors : rowEnd;
 	CustomFileReader fileReader;
 
+#ifdef WITH_MPI
+	if (_useMPI()) {
+		return loadMatrixDataMPI(fileName, genes, samples, vectors, numVectors,
+				vectorSize, vectorSizeAligned, MPI_COMM_WORLD, skip, rowStart, rowEnd);
+	}
+#endif
+
 	/*open the file*/
 	if (!fileReader.open(fileName.c_str(), "rb")) {
 		fprintf(stderr, "Failed to open file %s\n", fileName.c_str());
@@ -191,6 +329,12 @@ bool EXPMatrixReader<FloatType>::loadMatrixData(string& fileName,
 		}
 		/*save the entity id*/
 		genes.push_back(string(tok));
+
+		/*rows outside the range are counted only*/
+		if (numGenes < rowStart || numGenes >= lastRow) {
+			++numGenes;
+			continue;
+		}
  
                 /* riversj
 		tok = strtok(NULL, delim);
@@ -213,7 +357,7 @@ bool EXPMatrixReader<FloatType>::loadMatrixData(string& fileName,
 	
 			/*save the value*/
                         //fprintf(stderr,	"token:%s\n",tok);
-			*(vectors + numGenes * vectorSizeAligned + index) = atof(tok);
+			*(vectors + (ssize_t) (numGenes - rowStart) * vectorSizeAligned + index) = atof(tok);
 
 			/*increase the index*/
 			++index;
@@ -235,4 +379,263 @@ bool EXPMatrixReader<FloatType>::loadMatrixData(string& fileName,
 	return true;
 }
 
+#ifdef WITH_MPI
+template<typename FloatType>
+bool EXPMatrixReader<FloatType>::_readHeaderMPI(string& fileName,
+		string& header, int64_t& dataStart, int64_t& fileSize, MPI_Comm comm,
+		const bool skip) {
+	char* buffer = NULL;
+	size_t bufferSize = 0;
+	ssize_t numChars;
+	int rank, status = 0, length = 0;
+	int64_t offsets[2] = { 0, 0 };
+
+	MPI_Comm_rank(comm, &rank);
+	if (rank == 0) {
+		FILE* file = fopen(fileName.c_str(), "rb");
+		if (!file) {
+			fprintf(stderr, "Failed to open file %s\n", fileName.c_str());
+			status = 1;
+		} else {
+			/*the header, and the second and third rows if skipped*/
+			for (int row = 0; row < (skip ? 3 : 1); ++row) {
+				numChars = ::getline(&buffer, &bufferSize, file);
+				while (numChars > 0 && (buffer[numChars - 1] == '\n' || buffer[numChars - 1] == '\r')) {
+					buffer[--numChars] = '\0';
+				}
+				if (numChars <= 0) {
+					fprintf(stderr, "EXP file is incomplete at row %d\n", row + 1);
+					status = 1;
+					break;
+				}
+				if (row == 0) {
+					header = buffer;
+				}
+			}
+			offsets[0] = ftello(file);
+			fseeko(file, 0, SEEK_END);
+			offsets[1] = ftello(file);
+			fclose(file);
+			length = header.length();
+		}
+		if (buffer) {
+			free(buffer);
+		}
+	}
+
+	MPI_Bcast(&status, 1, MPI_INT, 0, comm);
+	if (status) {
+		return false;
+	}
+	MPI_Bcast(offsets, 2, MPI_INT64_T, 0, comm);
+	MPI_Bcast(&length, 1, MPI_INT, 0, comm);
+	header.resize(length);
+	if (length > 0) {
+		MPI_Bcast(&header[0], length, MPI_CHAR, 0, comm);
+	}
+	dataStart = offsets[0];
+	fileSize = offsets[1];
+	return true;
+}
+
+template<typename FloatType>
+bool EXPMatrixReader<FloatType>::getMatrixSizeMPI(string& fileName,
+		int& numVectors, int& vectorSize, MPI_Comm comm, const bool skip) {
+	char* buffer = NULL, *tok;
+	size_t bufferSize = 0;
+	ssize_t numChars;
+	int rank, numProcs, status, numLocalVectors = 0;
+	int64_t dataStart, fileSize, begin, end;
+	const char delim[] = ",";
+	string header;
+	RangeReader reader;
+
+	MPI_Comm_rank(comm, &rank);
+	MPI_Comm_size(comm, &numProcs);
+	numVectors = vectorSize = 0;
+	if (!_readHeaderMPI(fileName, header, dataStart, fileSize, comm, skip)) {
+		return false;
+	}
+
+	/*analyze the header on the first row*/
+	for (tok = strtok(&header[0], delim); tok != NULL; tok = strtok(NULL, delim)) {
+		vectorSize++;
+	}
+	vectorSize -= 1; /*exclude the first columns of the header: compound id*/
+
+	/*count the non-empty lines of the own byte range*/
+	_getRange(dataStart, fileSize, rank, numProcs, begin, end);
+	status = reader.open(fileName.c_str(), begin, end, dataStart) ? 1 : 0;
+	if (status) {
+		while ((numChars = reader.getline(&buffer, &bufferSize)) != -1) {
+			if (numChars > 0) {
+				++numLocalVectors;
+			}
+		}
+	} else {
+		fprintf(stderr, "Failed to open file %s\n", fileName.c_str());
+	}
+	reader.close();
+	if (buffer) {
+		free(buffer);
+	}
+
+	MPI_Allreduce(MPI_IN_PLACE, &status, 1, MPI_INT, MPI_MIN, comm);
+	if (!status) {
+		return false;
+	}
+	MPI_Allreduce(&numLocalVectors, &numVectors, 1, MPI_INT, MPI_SUM, comm);
+	if (rank == 0) {
+		fprintf(stderr, "Number of samples: %d\n", vectorSize);
+		fprintf(stderr, "Number of compound id profiles: %d\n", numVectors);
+	}
+	return true;
+}
+
+template<typename FloatType>
+bool EXPMatrixReader<FloatType>::loadMatrixDataMPI(string& fileName,
+		vector<string>& genes, vector<string>& samples, FloatType* vectors,
+		const int numVectors, const int vectorSize, const int vectorSizeAligned,
+		MPI_Comm comm, const bool skip, const int rowStart, const int rowEnd) {
+	char* buffer = NULL, *tok;
+	size_t bufferSize = 0;
+	ssize_t numChars;
+	int rank, numProcs, status = 1, index, numLocalVectors = 0, firstRow = 0;
+	int numSamples = 0;
+	int64_t dataStart, fileSize, begin, end;
+	const char delim[] = ",";
+	string header, names;
+	vector<FloatType> values;
+	RangeReader reader;
+
+	MPI_Comm_rank(comm, &rank);
+	MPI_Comm_size(comm, &numProcs);
+	if (!_readHeaderMPI(fileName, header, dataStart, fileSize, comm, skip)) {
+		return false;
+	}
+
+	/*save sample names*/
+	tok = strtok(&header[0], delim);
+	if (tok == NULL) {
+		if (rank == 0) {
+			fprintf(stderr, "Incomplete header at line %d\n", __LINE__);
+		}
+		return false;
+	}
+	for (tok = strtok(NULL, delim); tok != NULL; tok = strtok(NULL, delim)) {
+		samples.push_back(string(tok));
+		numSamples++;
+	}
+	if (numSamples != vectorSize) {
+		if (rank == 0) {
+			fprintf(stderr,
+					"The number of samples (%d) not equal to vector size (%d)\n",
+					numSamples, vectorSize);
+		}
+		return false;
+	}
+
+	/*parse the own byte range. Entity ids are kept '\0'-separated in names*/
+	_getRange(dataStart, fileSize, rank, numProcs, begin, end);
+	if (!reader.open(fileName.c_str(), begin, end, dataStart)) {
+		fprintf(stderr, "Failed to open file %s\n", fileName.c_str());
+		status = 0;
+	}
+	while (status && (numChars = reader.getline(&buffer, &bufferSize)) != -1) {
+		/*empty line*/
+		if (numChars == 0) {
+			continue;
+		}
+		tok = strtok_single(buffer, delim);
+		if (tok == NULL) {
+			fprintf(stderr, "incomplete file at line %d\n", __LINE__);
+			status = 0;
+			break;
+		}
+		names.append(tok);
+		names.push_back('\0');
+
+		/*extract gene expression values*/
+		values.resize(values.size() + vectorSizeAligned, 0);
+		FloatType* row = &values[(size_t) numLocalVectors * vectorSizeAligned];
+		index = 0;
+		for (tok = strtok_single(NULL, delim); tok != NULL;
+				tok = strtok_single(NULL, delim)) {
+			if (index >= vectorSize) {
+				fprintf(stderr,
+						"Error: number of entity id values is inconsistent with others\n");
+				status = 0;
+				break;
+			}
+			row[index++] = atof(tok);
+		}
+		++numLocalVectors;
+	}
+	reader.close();
+	if (buffer) {
+		free(buffer);
+	}
+	MPI_Allreduce(MPI_IN_PLACE, &status, 1, MPI_INT, MPI_MIN, comm);
+	if (!status) {
+		return false;
+	}
+
+	/*global row numbers: prefix scan of the row counts*/
+	MPI_Exscan(&numLocalVectors, &firstRow, 1, MPI_INT, MPI_SUM, comm);
+	if (rank == 0) {
+		firstRow = 0;
+	}
+	int local[4] = { firstRow, numLocalVectors, rowStart, rowEnd < 0 ? numVectors : rowEnd };
+	vector<int> all(4 * numProcs);
+	MPI_Allgather(local, 4, MPI_INT, &all[0], 4, MPI_INT, comm);
+	if (all[4 * (numProcs - 1)] + all[4 * (numProcs - 1) + 1] != numVectors) {
+		if (rank == 0) {
+			fprintf(stderr,
+					"Error: number of entity ids (%d) is inconsistent with number of vectors (%d)\n",
+					all[4 * (numProcs - 1)] + all[4 * (numProcs - 1) + 1], numVectors);
+		}
+		return false;
+	}
+
+	/*send the parsed rows to the processes wanting them, counted in rows*/
+	vector<int> sendCounts(numProcs), sendDispls(numProcs), recvCounts(numProcs), recvDispls(numProcs);
+	for (int i = 0; i < numProcs; ++i) {
+		int lo = max(firstRow, all[4 * i + 2]);
+		int hi = min(firstRow + numLocalVectors, all[4 * i + 3]);
+		sendCounts[i] = max(0, hi - lo);
+		sendDispls[i] = sendCounts[i] > 0 ? lo - firstRow : 0;
+
+		lo = max(all[4 * i], local[2]);
+		hi = min(all[4 * i] + all[4 * i + 1], local[3]);
+		recvCounts[i] = max(0, hi - lo);
+		recvDispls[i] = recvCounts[i] > 0 ? lo - local[2] : 0;
+	}
+	MPI_Datatype rowType;
+	MPI_Type_contiguous(vectorSizeAligned,
+			typeid(FloatType) == typeid(float) ? MPI_FLOAT : MPI_DOUBLE, &rowType);
+	MPI_Type_commit(&rowType);
+	MPI_Alltoallv(values.empty() ? NULL : &values[0], &sendCounts[0], &sendDispls[0],
+			rowType, vectors, &recvCounts[0], &recvDispls[0], rowType, comm);
+	MPI_Type_free(&rowType);
+
+	/*every process gets all entity ids, in global row order*/
+	int nameLength = names.length();
+	vector<int> nameLengths(numProcs), nameDispls(numProcs);
+	MPI_Allgather(&nameLength, 1, MPI_INT, &nameLengths[0], 1, MPI_INT, comm);
+	int totalLength = 0;
+	for (int i = 0; i < numProcs; ++i) {
+		nameDispls[i] = totalLength;
+		totalLength += nameLengths[i];
+	}
+	vector<char> allNames(totalLength + 1);
+	MPI_Allgatherv(names.empty() ? NULL : &names[0], nameLength, MPI_CHAR,
+			&allNames[0], &nameLengths[0], &nameDispls[0], MPI_CHAR, comm);
+	for (int offset = 0; offset < totalLength; offset += strlen(&allNames[offset]) + 1) {
+		genes.push_back(string(&allNames[offset]));
+	}
+
+	return true;
+}
+#endif	/*WITH_MPI*/
+
 #endif /* INCLUDE_EXPMATRIXREADER_HPP_ */
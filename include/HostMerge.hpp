@@ -0,0 +1,683 @@
+/*
+ * HostMerge.hpp
+ *
+ *  Merge sort and merge sort with inversion counting (Knight's algorithm) of
+ *  32-bit and 64-bit unsigned keys for host CPUs. The merges of two sorted
+ *  segments use an in-register bitonic merge network of 8 (AVX2) or 16
+ *  (AVX-512) 32-bit keys per step, or 4 and 8 64-bit keys. AVX2 has no unsigned
+ *  64-bit min and max: the keys are compared as signed with the sign bit
+ *  flipped. Short runs are sorted by insertion, whose number of shifts is their
+ *  number of inversions.
+ *
+ *  Inversions with SIMD merges: the keys are shifted left by one bit and the
+ *  low bit tags the segment, 0 for the left and 1 for the right one, so equal
+ *  keys keep the left one first. If the right keys land at the output positions
+ *  p_0 < .. < p_{nR-1} of the merged segment, the number of left keys after the
+ *  j-th right key is nL - (p_j - j), and the merge has
+ *	nL * nR - (sum(p_j) - nR * (nR - 1) / 2)
+ *  inversions. Tagging and the position sum are streaming vector passes. Keys
+ *  with the top bit set leave no room for the tag and use the scalar merge.
+ *
+ *  The kernel is selected at run time from the CPUID flags of the host, with a
+ *  scalar fallback on processors without AVX2. The Xeon Phi build keeps the
+ *  AVX-512 merges of PackedInt.
+ */
+
+#ifndef __HOST_MERGE_HPP
+#define __HOST_MERGE_HPP
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <immintrin.h>
+
+#if !defined(__MIC__) && defined(__x86_64__)
+#define HM_SIMD	/*compile the AVX2 and AVX-512 kernels with per-function target attributes*/
+#endif
+
+/*merge kernels*/
+#define HM_SCALAR	0
+#define HM_AVX2		1
+#define HM_AVX512	2
+
+#define HM_RUN	16	/*run length sorted by insertion*/
+
+class HostMerge
+{
+public:
+	/*best kernel supported by this processor, unless set by setKernel()*/
+	static inline int getKernel() {
+		int& kernel = _kernel();
+		if (kernel < 0) {
+			kernel = HM_SCALAR;
+#ifdef HM_SIMD
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx512f")) {
+				kernel = HM_AVX512;
+			} else if (__builtin_cpu_supports("avx2")) {
+				kernel = HM_AVX2;
+			}
+#endif
+		}
+		return kernel;
+	}
+	/*force a kernel, e.g. for benchmarking. Kernels the processor lacks are ignored*/
+	static inline void setKernel(const int kernel) {
+		_kernel() = -1;
+		if (kernel > getKernel()) {
+			return;
+		}
+		_kernel() = kernel;
+	}
+	static inline const char* getKernelName(const int kernel) {
+		switch (kernel) {
+		case HM_AVX512:
+			return "AVX-512";
+		case HM_AVX2:
+			return "AVX2";
+		}
+		return "scalar";
+	}
+
+	/*sort data in ascending order. mergeBuffer holds numElems keys*/
+	static void mergeSort(uint32_t* data, uint32_t* mergeBuffer, const int numElems) {
+		_sort(data, mergeBuffer, numElems, false);
+	}
+	/*sort data in ascending order and return the number of inversions*/
+	static ssize_t knightMergeSort(uint32_t* data, uint32_t* mergeBuffer, const int numElems) {
+		return _sort(data, mergeBuffer, numElems, true);
+	}
+	static void mergeSort(uint64_t* data, uint64_t* mergeBuffer, const int numElems) {
+		_sort(data, mergeBuffer, numElems, false);
+	}
+	static ssize_t knightMergeSort(uint64_t* data, uint64_t* mergeBuffer, const int numElems) {
+		return _sort(data, mergeBuffer, numElems, true);
+	}
+
+	/*insertion sort of [left, right), returns the number of shifts*/
+	template<typename Key>
+	static inline ssize_t insertionSort(Key* data, const int left, const int right) {
+		ssize_t numShifts = 0;
+		for (int l = left + 1; l < right; ++l) {
+			const Key curr = data[l];
+			int r = l;
+			while (r > left && data[r - 1] > curr) {
+				data[r] = data[r - 1];
+				--r;
+			}
+			numShifts += l - r;
+			data[r] = curr;
+		}
+		return numShifts;
+	}
+
+	template<typename Key>
+	static void mergeScalar(Key* input, Key* output, int left, int mid, int right) {
+		_mergeTail(input, output, left, mid, mid, right, left);
+	}
+
+	/*merge and return the number of inversions*/
+	template<typename Key>
+	static ssize_t knightMergeScalar(Key* input, Key* output, int left, int mid, int right) {
+		int l = left, r = mid, p = left;
+		ssize_t numDiscordantPairs = 0;
+
+		while (l < mid && r < right) {
+			if (input[r] < input[l]) {
+				/*every key left in the left segment is discordant with input[r]*/
+				numDiscordantPairs += mid - l;
+				output[p++] = input[r++];
+			} else {
+				output[p++] = input[l++];
+			}
+		}
+		if (l < mid) {
+			memcpy(output + p, input + l, (mid - l) * sizeof(Key));
+		} else if (r < right) {
+			memcpy(output + p, input + r, (right - r) * sizeof(Key));
+		}
+		return numDiscordantPairs;
+	}
+
+#ifdef HM_SIMD
+	/*sorted a and b into the lower (a) and upper (b) halves of their union, both sorted*/
+	__attribute__((target("avx2")))
+	static inline void bitonicMerge8(__m256i& a, __m256i& b) {
+		b = _mm256_permutevar8x32_epi32(b, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+		__m256i lo = _mm256_min_epu32(a, b);
+		__m256i hi = _mm256_max_epu32(a, b);
+
+		/*compare-exchange at distance 4, 2 and 1*/
+		a = _bitonicStep8(lo, _mm256_setr_epi32(4, 5, 6, 7, 0, 1, 2, 3), 0xf0);
+		b = _bitonicStep8(hi, _mm256_setr_epi32(4, 5, 6, 7, 0, 1, 2, 3), 0xf0);
+		a = _bitonicStep8(a, _mm256_setr_epi32(2, 3, 0, 1, 6, 7, 4, 5), 0xcc);
+		b = _bitonicStep8(b, _mm256_setr_epi32(2, 3, 0, 1, 6, 7, 4, 5), 0xcc);
+		a = _bitonicStep8(a, _mm256_setr_epi32(1, 0, 3, 2, 5, 4, 7, 6), 0xaa);
+		b = _bitonicStep8(b, _mm256_setr_epi32(1, 0, 3, 2, 5, 4, 7, 6), 0xaa);
+	}
+	__attribute__((target("avx2")))
+	static void mergeAVX2(uint32_t* input, uint32_t* output, int left, int mid, int right) {
+		int l = left, r = mid, p = left;
+
+		if (mid - left < 8 || right - mid < 8) {
+			mergeScalar(input, output, left, mid, right);
+			return;
+		}
+		__m256i vecL = _mm256_loadu_si256((const __m256i*) (input + l));
+		__m256i vecH = _mm256_loadu_si256((const __m256i*) (input + r));
+		l += 8;
+		r += 8;
+		while (1) {
+			bitonicMerge8(vecL, vecH);
+			_mm256_storeu_si256((__m256i*) (output + p), vecL);
+			p += 8;
+
+			/*next block from the segment with the smaller head*/
+			if (l + 8 <= mid && (r >= right || input[l] <= input[r])) {
+				vecL = _mm256_loadu_si256((const __m256i*) (input + l));
+				l += 8;
+			} else if (r + 8 <= right && (l >= mid || input[r] < input[l])) {
+				vecL = _mm256_loadu_si256((const __m256i*) (input + r));
+				r += 8;
+			} else {
+				break;
+			}
+		}
+		/*put vecH back into consumed slots: in an exhausted segment, or in front of the segment
+		 *with the larger head, which no key of vecH exceeds. Then merge the tails*/
+		if (l >= mid || (r < right && input[r] < input[l])) {
+			l = (l >= mid ? mid : l) - 8;
+			_mm256_storeu_si256((__m256i*) (input + l), vecH);
+		} else {
+			r = (r >= right ? right : r) - 8;
+			_mm256_storeu_si256((__m256i*) (input + r), vecH);
+		}
+		_mergeTail(input, output, l, mid, r, right, p);
+	}
+
+	__attribute__((target("avx512f")))
+	static inline void bitonicMerge16(__m512i& a, __m512i& b) {
+		b = _mm512_permutexvar_epi32(_mm512_setr_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0), b);
+		__m512i lo = _mm512_min_epu32(a, b);
+		__m512i hi = _mm512_max_epu32(a, b);
+
+		/*compare-exchange at distance 8, 4, 2 and 1*/
+		const __m512i index8 = _mm512_setr_epi32(8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7);
+		const __m512i index4 = _mm512_setr_epi32(4, 5, 6, 7, 0, 1, 2, 3, 12, 13, 14, 15, 8, 9, 10, 11);
+		const __m512i index2 = _mm512_setr_epi32(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+		const __m512i index1 = _mm512_setr_epi32(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+		a = _bitonicStep16(lo, index8, 0xff00);
+		b = _bitonicStep16(hi, index8, 0xff00);
+		a = _bitonicStep16(a, index4, 0xf0f0);
+		b = _bitonicStep16(b, index4, 0xf0f0);
+		a = _bitonicStep16(a, index2, 0xcccc);
+		b = _bitonicStep16(b, index2, 0xcccc);
+		a = _bitonicStep16(a, index1, 0xaaaa);
+		b = _bitonicStep16(b, index1, 0xaaaa);
+	}
+	__attribute__((target("avx512f")))
+	static void mergeAVX512(uint32_t* input, uint32_t* output, int left, int mid, int right) {
+		int l = left, r = mid, p = left;
+
+		if (mid - left < 16 || right - mid < 16) {
+			mergeScalar(input, output, left, mid, right);
+			return;
+		}
+		__m512i vecL = _mm512_loadu_si512(input + l);
+		__m512i vecH = _mm512_loadu_si512(input + r);
+		l += 16;
+		r += 16;
+		while (1) {
+			bitonicMerge16(vecL, vecH);
+			_mm512_storeu_si512(output + p, vecL);
+			p += 16;
+
+			/*next block from the segment with the smaller head*/
+			if (l + 16 <= mid && (r >= right || input[l] <= input[r])) {
+				vecL = _mm512_loadu_si512(input + l);
+				l += 16;
+			} else if (r + 16 <= right && (l >= mid || input[r] < input[l])) {
+				vecL = _mm512_loadu_si512(input + r);
+				r += 16;
+			} else {
+				break;
+			}
+		}
+		/*put vecH back into consumed slots: in an exhausted segment, or in front of the segment
+		 *with the larger head, which no key of vecH exceeds. Then merge the tails*/
+		if (l >= mid || (r < right && input[r] < input[l])) {
+			l = (l >= mid ? mid : l) - 16;
+			_mm512_storeu_si512(input + l, vecH);
+		} else {
+			r = (r >= right ? right : r) - 16;
+			_mm512_storeu_si512(input + r, vecH);
+		}
+		_mergeTail(input, output, l, mid, r, right, p);
+	}
+
+	/*set the low bit of the keys of [mid, right) and clear it in [left, mid)*/
+	__attribute__((target("avx2")))
+	static void tagAVX2(uint32_t* data, const int left, const int mid, const int right) {
+		const __m256i one = _mm256_set1_epi32(1);
+		int i = left;
+		for (; i + 8 <= mid; i += 8) {
+			__m256i v = _mm256_loadu_si256((const __m256i*) (data + i));
+			_mm256_storeu_si256((__m256i*) (data + i), _mm256_andnot_si256(one, v));
+		}
+		for (; i < mid; ++i) {
+			data[i] &= ~1u;
+		}
+		for (; i + 8 <= right; i += 8) {
+			__m256i v = _mm256_loadu_si256((const __m256i*) (data + i));
+			_mm256_storeu_si256((__m256i*) (data + i), _mm256_or_si256(one, v));
+		}
+		for (; i < right; ++i) {
+			data[i] |= 1;
+		}
+	}
+	/*sum of the positions of the tagged keys of data[0 .. numElems - 1]*/
+	__attribute__((target("avx2,popcnt")))
+	static ssize_t sumTaggedAVX2(const uint32_t* data, const int numElems) {
+		ssize_t sum = 0;
+		int i = 0;
+		for (; i + 8 <= numElems; i += 8) {
+			__m256i v = _mm256_loadu_si256((const __m256i*) (data + i));
+			const unsigned mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_slli_epi32(v, 31)));
+			sum += (ssize_t) i * _mm_popcnt_u32(mask) + _sumBitPositions(mask);
+		}
+		for (; i < numElems; ++i) {
+			sum += (data[i] & 1) ? i : 0;
+		}
+		return sum;
+	}
+
+	__attribute__((target("avx512f")))
+	static void tagAVX512(uint32_t* data, const int left, const int mid, const int right) {
+		const __m512i one = _mm512_set1_epi32(1);
+		int i = left;
+		for (; i + 16 <= mid; i += 16) {
+			_mm512_storeu_si512(data + i, _mm512_andnot_si512(one, _mm512_loadu_si512(data + i)));
+		}
+		for (; i < mid; ++i) {
+			data[i] &= ~1u;
+		}
+		for (; i + 16 <= right; i += 16) {
+			_mm512_storeu_si512(data + i, _mm512_or_si512(one, _mm512_loadu_si512(data + i)));
+		}
+		for (; i < right; ++i) {
+			data[i] |= 1;
+		}
+	}
+	__attribute__((target("avx512f,popcnt")))
+	static ssize_t sumTaggedAVX512(const uint32_t* data, const int numElems) {
+		const __m512i one = _mm512_set1_epi32(1);
+		ssize_t sum = 0;
+		int i = 0;
+		for (; i + 16 <= numElems; i += 16) {
+			const unsigned mask = _mm512_test_epi32_mask(_mm512_loadu_si512(data + i), one);
+			sum += (ssize_t) i * _mm_popcnt_u32(mask) + _sumBitPositions(mask);
+		}
+		for (; i < numElems; ++i) {
+			sum += (data[i] & 1) ? i : 0;
+		}
+		return sum;
+	}
+
+	/*64-bit keys: sorted a and b into the lower (a) and upper (b) halves of their union*/
+	__attribute__((target("avx2")))
+	static inline void bitonicMerge4x64(__m256i& a, __m256i& b) {
+		const __m256i upper2 = _mm256_setr_epi64x(0, 0, -1, -1);
+		const __m256i upper1 = _mm256_setr_epi64x(0, -1, 0, -1);
+		__m256i lo, hi;
+
+		b = _mm256_permute4x64_epi64(b, 0x1b);
+		_minMax4x64(a, b, lo, hi);
+
+		/*compare-exchange at distance 2 and 1*/
+		a = _bitonicStep4x64(lo, _mm256_permute4x64_epi64(lo, 0x4e), upper2);
+		b = _bitonicStep4x64(hi, _mm256_permute4x64_epi64(hi, 0x4e), upper2);
+		a = _bitonicStep4x64(a, _mm256_permute4x64_epi64(a, 0xb1), upper1);
+		b = _bitonicStep4x64(b, _mm256_permute4x64_epi64(b, 0xb1), upper1);
+	}
+	__attribute__((target("avx2")))
+	static void mergeAVX2(uint64_t* input, uint64_t* output, int left, int mid, int right) {
+		int l = left, r = mid, p = left;
+
+		if (mid - left < 4 || right - mid < 4) {
+			mergeScalar(input, output, left, mid, right);
+			return;
+		}
+		__m256i vecL = _mm256_loadu_si256((const __m256i*) (input + l));
+		__m256i vecH = _mm256_loadu_si256((const __m256i*) (input + r));
+		l += 4;
+		r += 4;
+		while (1) {
+			bitonicMerge4x64(vecL, vecH);
+			_mm256_storeu_si256((__m256i*) (output + p), vecL);
+			p += 4;
+
+			/*next block from the segment with the smaller head*/
+			if (l + 4 <= mid && (r >= right || input[l] <= input[r])) {
+				vecL = _mm256_loadu_si256((const __m256i*) (input + l));
+				l += 4;
+			} else if (r + 4 <= right && (l >= mid || input[r] < input[l])) {
+				vecL = _mm256_loadu_si256((const __m256i*) (input + r));
+				r += 4;
+			} else {
+				break;
+			}
+		}
+		/*put vecH back into consumed slots, then merge the tails*/
+		if (l >= mid || (r < right && input[r] < input[l])) {
+			l = (l >= mid ? mid : l) - 4;
+			_mm256_storeu_si256((__m256i*) (input + l), vecH);
+		} else {
+			r = (r >= right ? right : r) - 4;
+			_mm256_storeu_si256((__m256i*) (input + r), vecH);
+		}
+		_mergeTail(input, output, l, mid, r, right, p);
+	}
+
+	__attribute__((target("avx512f")))
+	static inline void bitonicMerge8x64(__m512i& a, __m512i& b) {
+		b = _mm512_permutexvar_epi64(_mm512_setr_epi64(7, 6, 5, 4, 3, 2, 1, 0), b);
+		__m512i lo = _mm512_min_epu64(a, b);
+		__m512i hi = _mm512_max_epu64(a, b);
+
+		/*compare-exchange at distance 4, 2 and 1*/
+		const __m512i index4 = _mm512_setr_epi64(4, 5, 6, 7, 0, 1, 2, 3);
+		const __m512i index2 = _mm512_setr_epi64(2, 3, 0, 1, 6, 7, 4, 5);
+		const __m512i index1 = _mm512_setr_epi64(1, 0, 3, 2, 5, 4, 7, 6);
+		a = _bitonicStep8x64(lo, index4, 0xf0);
+		b = _bitonicStep8x64(hi, index4, 0xf0);
+		a = _bitonicStep8x64(a, index2, 0xcc);
+		b = _bitonicStep8x64(b, index2, 0xcc);
+		a = _bitonicStep8x64(a, index1, 0xaa);
+		b = _bitonicStep8x64(b, index1, 0xaa);
+	}
+	__attribute__((target("avx512f")))
+	static void mergeAVX512(uint64_t* input, uint64_t* output, int left, int mid, int right) {
+		int l = left, r = mid, p = left;
+
+		if (mid - left < 8 || right - mid < 8) {
+			mergeScalar(input, output, left, mid, right);
+			return;
+		}
+		__m512i vecL = _mm512_loadu_si512(input + l);
+		__m512i vecH = _mm512_loadu_si512(input + r);
+		l += 8;
+		r += 8;
+		while (1) {
+			bitonicMerge8x64(vecL, vecH);
+			_mm512_storeu_si512(output + p, vecL);
+			p += 8;
+
+			/*next block from the segment with the smaller head*/
+			if (l + 8 <= mid && (r >= right || input[l] <= input[r])) {
+				vecL = _mm512_loadu_si512(input + l);
+				l += 8;
+			} else if (r + 8 <= right && (l >= mid || input[r] < input[l])) {
+				vecL = _mm512_loadu_si512(input + r);
+				r += 8;
+			} else {
+				break;
+			}
+		}
+		/*put vecH back into consumed slots, then merge the tails*/
+		if (l >= mid || (r < right && input[r] < input[l])) {
+			l = (l >= mid ? mid : l) - 8;
+			_mm512_storeu_si512(input + l, vecH);
+		} else {
+			r = (r >= right ? right : r) - 8;
+			_mm512_storeu_si512(input + r, vecH);
+		}
+		_mergeTail(input, output, l, mid, r, right, p);
+	}
+
+	__attribute__((target("avx2")))
+	static void tagAVX2(uint64_t* data, const int left, const int mid, const int right) {
+		const __m256i one = _mm256_set1_epi64x(1);
+		int i = left;
+		for (; i + 4 <= mid; i += 4) {
+			__m256i v = _mm256_loadu_si256((const __m256i*) (data + i));
+			_mm256_storeu_si256((__m256i*) (data + i), _mm256_andnot_si256(one, v));
+		}
+		for (; i < mid; ++i) {
+			data[i] &= ~(uint64_t) 1;
+		}
+		for (; i + 4 <= right; i += 4) {
+			__m256i v = _mm256_loadu_si256((const __m256i*) (data + i));
+			_mm256_storeu_si256((__m256i*) (data + i), _mm256_or_si256(one, v));
+		}
+		for (; i < right; ++i) {
+			data[i] |= 1;
+		}
+	}
+	__attribute__((target("avx2,popcnt")))
+	static ssize_t sumTaggedAVX2(const uint64_t* data, const int numElems) {
+		ssize_t sum = 0;
+		int i = 0;
+		for (; i + 4 <= numElems; i += 4) {
+			__m256i v = _mm256_loadu_si256((const __m256i*) (data + i));
+			const unsigned mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_slli_epi64(v, 63)));
+			sum += (ssize_t) i * _mm_popcnt_u32(mask) + _sumBitPositions(mask);
+		}
+		for (; i < numElems; ++i) {
+			sum += (data[i] & 1) ? i : 0;
+		}
+		return sum;
+	}
+
+	__attribute__((target("avx512f")))
+	static void tagAVX512(uint64_t* data, const int left, const int mid, const int right) {
+		const __m512i one = _mm512_set1_epi64(1);
+		int i = left;
+		for (; i + 8 <= mid; i += 8) {
+			_mm512_storeu_si512(data + i, _mm512_andnot_si512(one, _mm512_loadu_si512(data + i)));
+		}
+		for (; i < mid; ++i) {
+			data[i] &= ~(uint64_t) 1;
+		}
+		for (; i + 8 <= right; i += 8) {
+			_mm512_storeu_si512(data + i, _mm512_or_si512(one, _mm512_loadu_si512(data + i)));
+		}
+		for (; i < right; ++i) {
+			data[i] |= 1;
+		}
+	}
+	__attribute__((target("avx512f,popcnt")))
+	static ssize_t sumTaggedAVX512(const uint64_t* data, const int numElems) {
+		const __m512i one = _mm512_set1_epi64(1);
+		ssize_t sum = 0;
+		int i = 0;
+		for (; i + 8 <= numElems; i += 8) {
+			const unsigned mask = _mm512_test_epi64_mask(_mm512_loadu_si512(data + i), one);
+			sum += (ssize_t) i * _mm_popcnt_u32(mask) + _sumBitPositions(mask);
+		}
+		for (; i < numElems; ++i) {
+			sum += (data[i] & 1) ? i : 0;
+		}
+		return sum;
+	}
+#endif	/*HM_SIMD*/
+
+private:
+	static inline int& _kernel() {
+		static int kernel = -1;
+		return kernel;
+	}
+
+#ifdef HM_SIMD
+	__attribute__((target("avx2")))
+	static inline __m256i _bitonicStep8(const __m256i v, const __m256i partner, const int maxMask) {
+		const __m256i w = _mm256_permutevar8x32_epi32(v, partner);
+		const __m256i lo = _mm256_min_epu32(v, w);
+		const __m256i hi = _mm256_max_epu32(v, w);
+		return _mm256_blendv_epi8(lo, hi, _mm256_setr_epi32(
+				maxMask & 1 ? -1 : 0, maxMask & 2 ? -1 : 0, maxMask & 4 ? -1 : 0,
+				maxMask & 8 ? -1 : 0, maxMask & 16 ? -1 : 0, maxMask & 32 ? -1 : 0,
+				maxMask & 64 ? -1 : 0, maxMask & 128 ? -1 : 0));
+	}
+	__attribute__((target("avx512f")))
+	static inline __m512i _bitonicStep16(const __m512i v, const __m512i partner, const __mmask16 maxMask) {
+		const __m512i w = _mm512_permutexvar_epi32(partner, v);
+		return _mm512_mask_blend_epi32(maxMask, _mm512_min_epu32(v, w), _mm512_max_epu32(v, w));
+	}
+
+	/*unsigned 64-bit min and max from the signed comparison with the sign bits flipped*/
+	__attribute__((target("avx2")))
+	static inline void _minMax4x64(const __m256i a, const __m256i b, __m256i& lo, __m256i& hi) {
+		const __m256i sign = _mm256_set1_epi64x((long long) 0x8000000000000000ULL);
+		const __m256i greater = _mm256_cmpgt_epi64(_mm256_xor_si256(a, sign), _mm256_xor_si256(b, sign));
+		lo = _mm256_blendv_epi8(a, b, greater);
+		hi = _mm256_blendv_epi8(b, a, greater);
+	}
+	/*min of v and its partners w, max in the lanes of maxLanes*/
+	__attribute__((target("avx2")))
+	static inline __m256i _bitonicStep4x64(const __m256i v, const __m256i w, const __m256i maxLanes) {
+		__m256i lo, hi;
+		_minMax4x64(v, w, lo, hi);
+		return _mm256_blendv_epi8(lo, hi, maxLanes);
+	}
+	__attribute__((target("avx512f")))
+	static inline __m512i _bitonicStep8x64(const __m512i v, const __m512i partner, const __mmask8 maxMask) {
+		const __m512i w = _mm512_permutexvar_epi64(partner, v);
+		return _mm512_mask_blend_epi64(maxMask, _mm512_min_epu64(v, w), _mm512_max_epu64(v, w));
+	}
+#endif
+
+#ifdef HM_SIMD
+	/*sum of the indices of the set bits of a 16-bit mask*/
+	__attribute__((target("popcnt")))
+	static inline int _sumBitPositions(const unsigned mask) {
+		return _mm_popcnt_u32(mask & 0xaaaa) + 2 * _mm_popcnt_u32(mask & 0xcccc)
+				+ 4 * _mm_popcnt_u32(mask & 0xf0f0) + 8 * _mm_popcnt_u32(mask & 0xff00);
+	}
+	/*inversions of the tagged merge of [left, mid) and [mid, right) into output*/
+	template<typename Key>
+	static inline ssize_t _knightMergeTagged(const int kernel, Key* input, Key* output,
+			const int left, const int mid, const int right) {
+		const ssize_t numLeft = mid - left, numRight = right - mid;
+		ssize_t sum;
+
+		if (kernel == HM_AVX512) {
+			tagAVX512(input, left, mid, right);
+			mergeAVX512(input, output, left, mid, right);
+			sum = sumTaggedAVX512(output + left, right - left);
+		} else {
+			tagAVX2(input, left, mid, right);
+			mergeAVX2(input, output, left, mid, right);
+			sum = sumTaggedAVX2(output + left, right - left);
+		}
+		return numLeft * numRight - (sum - numRight * (numRight - 1) / 2);
+	}
+#endif
+
+	/*merge the tails [l, mid) and [r, right) to output + p*/
+	template<typename Key>
+	static inline void _mergeTail(Key* input, Key* output, int l,
+			const int mid, int r, const int right, int p) {
+		while (l < mid && r < right) {
+			const Key a = input[l];
+			const Key b = input[r];
+			const int takeRight = b < a;
+			output[p++] = takeRight ? b : a;
+			r += takeRight;
+			l += 1 - takeRight;
+		}
+		if (l < mid) {
+			memcpy(output + p, input + l, (mid - l) * sizeof(Key));
+		} else if (r < right) {
+			memcpy(output + p, input + r, (right - r) * sizeof(Key));
+		}
+	}
+
+	template<typename Key>
+	static inline void _merge(const int kernel, Key* input, Key* output,
+			const int left, const int mid, const int right) {
+#ifdef HM_SIMD
+		if (kernel == HM_AVX512) {
+			mergeAVX512(input, output, left, mid, right);
+			return;
+		}
+		if (kernel == HM_AVX2) {
+			mergeAVX2(input, output, left, mid, right);
+			return;
+		}
+#endif
+		mergeScalar(input, output, left, mid, right);
+	}
+
+	template<typename Key>
+	static ssize_t _sort(Key* data, Key* mergeBuffer, const int numElems,
+			const bool countInversions) {
+		const Key topBit = (Key) 1 << (8 * sizeof(Key) - 1);
+		int kernel = getKernel();
+		ssize_t numDiscordantPairs = 0;
+		Key* input = data;
+		Key* output = mergeBuffer;
+		bool tagged = false;
+		int mid, right;
+
+		/*room for the segment tag of the SIMD inversion count*/
+		if (countInversions && kernel != HM_SCALAR) {
+			Key keys = 0;
+			for (int i = 0; i < numElems; ++i) {
+				keys |= data[i];
+			}
+			if (keys & topBit) {
+				kernel = HM_SCALAR;
+			} else {
+				for (int i = 0; i < numElems; ++i) {
+					data[i] <<= 1;
+				}
+				tagged = true;
+			}
+		}
+
+		/*sort the short runs in place*/
+		for (int left = 0; left < numElems; left += HM_RUN) {
+			right = left + HM_RUN;
+			numDiscordantPairs += insertionSort(data, left, right < numElems ? right : numElems);
+		}
+		for (int stride = HM_RUN; stride < numElems; stride *= 2) {
+			for (int left = 0; left < numElems; left += 2 * stride) {
+				mid = left + stride;
+				if (mid >= numElems) {
+					/*a single segment is copied*/
+					memcpy(output + left, input + left, (numElems - left) * sizeof(Key));
+					continue;
+				}
+				right = left + 2 * stride;
+				if (right > numElems) {
+					right = numElems;
+				}
+#ifdef HM_SIMD
+				if (tagged) {
+					numDiscordantPairs += _knightMergeTagged(kernel, input, output, left, mid, right);
+					continue;
+				}
+#endif
+				if (countInversions) {
+					numDiscordantPairs += knightMergeScalar(input, output, left, mid, right);
+				} else {
+					_merge(kernel, input, output, left, mid, right);
+				}
+			}
+			/*swap the buffer pointers*/
+			Key* tmp = input;
+			input = output;
+			output = tmp;
+		}
+		if (data != input) {
+			memcpy(data, input, numElems * sizeof(Key));
+		}
+		if (tagged) {
+			for (int i = 0; i < numElems; ++i) {
+				data[i] >>= 1;
+			}
+		}
+		return countInversions ? numDiscordantPairs : 0;
+	}
+};
+
+#endif	/*__HOST_MERGE_HPP*/
@@ -0,0 +1,312 @@
+/*
+ * KNNGrid.hpp
+ *
+ *  Nearest neighbours in the max-norm for the Kraskov-Stoegbauer-Grassberger
+ *  mutual information (see MIKSG).
+ *
+ *  SortedVectors keeps the values of each vector in sorted order and the
+ *  position of each element in it, from the radix sort of RankTransform. It
+ *  is built once per vector and shared by all pairs of the vector, and counts
+ *  the elements within a distance of an element by galloping from its
+ *  position.
+ *
+ *  KNNGrid holds the points (x_i, y_i) of one vector pair in a G x G grid over
+ *  the positions of x and y, so each cell holds about k points whatever the
+ *  distributions of the values. The k nearest neighbours of a point are
+ *  searched in rings of cells around its own, until the value gap to the next
+ *  ring is no smaller than the current k-th distance.
+ */
+
+#ifndef __KNN_GRID_HPP
+#define __KNN_GRID_HPP
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <sys/types.h>
+#include <mm_malloc.h>
+#include <algorithm>
+#include <RankTransform.hpp>
+
+template<typename FloatType>
+class SortedVectors
+{
+public:
+	/*storage holds getStorageSize() bytes owned by the caller [e.g. shared by the processes
+	 *of a node], or is allocated here if NULL*/
+	SortedVectors(const int numVectors, const int vectorSize, void* storage = NULL) {
+		_numVectors = numVectors;
+		_vectorSize = vectorSize;
+		_storage = NULL;
+		if (!storage) {
+			storage = _storage = _mm_malloc(getStorageSize(numVectors, vectorSize), 64);
+			if (!_storage) {
+				fprintf(stderr, "Memory allocation failed\n");
+				exit(-1);
+			}
+		}
+		_sorted = (FloatType*) storage;
+		_positions = (int*) ((char*) storage + _getSortedSize(numVectors, vectorSize));
+	}
+	~SortedVectors() {
+		if (_storage) {
+			_mm_free(_storage);
+		}
+	}
+
+	/*bytes of the sorted values and positions of numVectors vectors*/
+	static inline ssize_t getStorageSize(const int numVectors, const int vectorSize) {
+		return _getSortedSize(numVectors, vectorSize)
+				+ (ssize_t) numVectors * vectorSize * sizeof(int) + 64;
+	}
+
+	inline const FloatType* getSorted(const int vector) const {
+		return _sorted + (ssize_t) vector * _vectorSize;
+	}
+	/*position of each element in the sorted values, ties in index order*/
+	inline const int* getPositions(const int vector) const {
+		return _positions + (ssize_t) vector * _vectorSize;
+	}
+
+	/*sort a vector. Different vectors may be built concurrently with their own buffers*/
+	void build(const int vector, const FloatType* vec, RankBuffer<FloatType>& buffer) {
+		FloatType* sorted = _sorted + (ssize_t) vector * _vectorSize;
+		int* positions = _positions + (ssize_t) vector * _vectorSize;
+
+		/*the ranks from zero of the first-seen order are the positions*/
+		memcpy(sorted, vec, _vectorSize * sizeof(FloatType));
+		RankTransform::rankVector(sorted, _vectorSize, RT_TIES_FIRST, buffer, false, 0);
+		for (int i = 0; i < _vectorSize; ++i) {
+			positions[i] = (int) sorted[i];
+		}
+		for (int i = 0; i < _vectorSize; ++i) {
+			sorted[positions[i]] = vec[i];
+		}
+	}
+
+	/*elements other than the one at position p whose distance to it is below d*/
+	inline int countWithin(const int vector, const int p, const FloatType d) const {
+		const FloatType* sorted = getSorted(vector);
+		const FloatType v = sorted[p];
+
+		/*first position above p at distance d or more, and the last one below*/
+		const int hi = _gallop(sorted, p, v, d, 1);
+		const int lo = _gallop(sorted, p, v, d, -1);
+		return hi - lo - 2;
+	}
+
+private:
+	int _numVectors;
+	int _vectorSize;
+	FloatType* _sorted;	/*sorted values of each vector*/
+	int* _positions;		/*position of each element in _sorted*/
+	void* _storage;			/*allocated here, NULL if owned by the caller*/
+
+	/*bytes of the sorted values, padded by 64 bytes and rounded up to 64 bytes*/
+	static inline ssize_t _getSortedSize(const int numVectors, const int vectorSize) {
+		return ((ssize_t) numVectors * vectorSize * sizeof(FloatType) + 64 + 63) / 64 * 64;
+	}
+
+	/*the first position from p in direction dir at distance d or more from v,
+	 *or one past the end: doubling steps, then a binary search*/
+	inline int _gallop(const FloatType* sorted, const int p, const FloatType v,
+			const FloatType d, const int dir) const {
+		int inside = p, step = 1, outside;
+
+		for (;;) {
+			outside = p + dir * step;
+			if (outside < 0 || outside >= _vectorSize) {
+				outside = dir > 0 ? _vectorSize : -1;
+				break;
+			}
+			if (dir * (sorted[outside] - v) >= d) {
+				break;
+			}
+			inside = outside;
+			step <<= 1;
+		}
+		while (dir * (outside - inside) > 1) {
+			const int mid = (inside + outside) / 2;
+			if (dir * (sorted[mid] - v) >= d) {
+				outside = mid;
+			} else {
+				inside = mid;
+			}
+		}
+		return outside;
+	}
+};
+
+template<typename FloatType>
+class KNNGrid
+{
+public:
+	/*buffers for vectors of vectorSize elements and k neighbours*/
+	KNNGrid(const int vectorSize, const int k) {
+		_vectorSize = vectorSize;
+		_k = k;
+		for (_gridDim = 1; (_gridDim + 1) * (_gridDim + 1) * k <= vectorSize; ++_gridDim);
+		_cellWidth = (vectorSize + _gridDim - 1) / _gridDim;
+
+		const ssize_t numCells = (ssize_t) _gridDim * _gridDim;
+		_cellStart = (int*) _mm_malloc((numCells + 1) * sizeof(int), 64);
+		_x = (FloatType*) _mm_malloc((vectorSize + 16) * sizeof(FloatType), 64);
+		_y = (FloatType*) _mm_malloc((vectorSize + 16) * sizeof(FloatType), 64);
+		_index = (int*) _mm_malloc((vectorSize + 16) * sizeof(int), 64);
+		_xBounds = (FloatType*) _mm_malloc(2 * _gridDim * sizeof(FloatType), 64);
+		_yBounds = (FloatType*) _mm_malloc(2 * _gridDim * sizeof(FloatType), 64);
+		_best = (FloatType*) _mm_malloc((k + 1) * sizeof(FloatType), 64);
+		if (!_cellStart || !_x || !_y || !_index || !_xBounds || !_yBounds || !_best) {
+			fprintf(stderr, "Memory allocation failed\n");
+			exit(-1);
+		}
+	}
+	~KNNGrid() {
+		_mm_free(_cellStart);
+		_mm_free(_x);
+		_mm_free(_y);
+		_mm_free(_index);
+		_mm_free(_xBounds);
+		_mm_free(_yBounds);
+		_mm_free(_best);
+	}
+
+	/*bucket the points of vector a of X and vector b of Y*/
+	void build(const SortedVectors<FloatType>& X, const int a,
+			const SortedVectors<FloatType>& Y, const int b) {
+		const int numCells = _gridDim * _gridDim;
+		const int* __restrict__ px = X.getPositions(a);
+		const int* __restrict__ py = Y.getPositions(b);
+		const FloatType* sx = X.getSorted(a);
+		const FloatType* sy = Y.getSorted(b);
+
+		_px = px;
+		_py = py;
+		_sx = sx;
+		_sy = sy;
+
+		/*counting sort of the points by cell*/
+		memset(_cellStart, 0, (numCells + 1) * sizeof(int));
+		for (int i = 0; i < _vectorSize; ++i) {
+			_cellStart[_getCell(px[i], py[i]) + 1]++;
+		}
+		for (int c = 1; c <= numCells; ++c) {
+			_cellStart[c] += _cellStart[c - 1];
+		}
+		for (int i = 0; i < _vectorSize; ++i) {
+			const int pos = _cellStart[_getCell(px[i], py[i])]++;
+			_x[pos] = sx[px[i]];
+			_y[pos] = sy[py[i]];
+			_index[pos] = i;
+		}
+		for (int c = numCells; c > 0; --c) {
+			_cellStart[c] = _cellStart[c - 1];
+		}
+		_cellStart[0] = 0;
+
+		/*smallest and largest value of each grid column and row*/
+		for (int c = 0; c < _gridDim; ++c) {
+			const int first = c * _cellWidth;
+			const int last = std::min(_vectorSize, first + _cellWidth) - 1;
+			_xBounds[2 * c] = first <= last ? sx[first] : FLT_MAX;
+			_xBounds[2 * c + 1] = first <= last ? sx[last] : -FLT_MAX;
+			_yBounds[2 * c] = first <= last ? sy[first] : FLT_MAX;
+			_yBounds[2 * c + 1] = first <= last ? sy[last] : -FLT_MAX;
+		}
+	}
+
+	/*max-norm distance of point i to its k-th nearest neighbour*/
+	FloatType kthDistance(const int i) {
+		const int cx = _px[i] / _cellWidth;
+		const int cy = _py[i] / _cellWidth;
+		const FloatType x = _sx[_px[i]];
+		const FloatType y = _sy[_py[i]];
+
+		for (int j = 0; j < _k; ++j) {
+			_best[j] = FLT_MAX;
+		}
+		for (int r = 0; ; ++r) {
+			const int x1 = std::max(0, cx - r), x2 = std::min(_gridDim - 1, cx + r);
+			const int y1 = std::max(0, cy - r), y2 = std::min(_gridDim - 1, cy + r);
+
+			/*the cells at ring distance r*/
+			for (int gy = y1; gy <= y2; ++gy) {
+				if (gy == cy - r || gy == cy + r) {
+					_searchCells(gy * _gridDim + x1, gy * _gridDim + x2, i, x, y);
+				} else {
+					if (cx - r >= 0) {
+						_searchCells(gy * _gridDim + cx - r, gy * _gridDim + cx - r, i, x, y);
+					}
+					if (cx + r < _gridDim) {
+						_searchCells(gy * _gridDim + cx + r, gy * _gridDim + cx + r, i, x, y);
+					}
+				}
+			}
+
+			/*points beyond the ring are at least the value gap to the next ring away*/
+			FloatType gap = FLT_MAX;
+			if (cx + r + 1 < _gridDim) {
+				gap = std::min(gap, _xBounds[2 * (cx + r + 1)] - x);
+			}
+			if (cx - r - 1 >= 0) {
+				gap = std::min(gap, x - _xBounds[2 * (cx - r - 1) + 1]);
+			}
+			if (cy + r + 1 < _gridDim) {
+				gap = std::min(gap, _yBounds[2 * (cy + r + 1)] - y);
+			}
+			if (cy - r - 1 >= 0) {
+				gap = std::min(gap, y - _yBounds[2 * (cy - r - 1) + 1]);
+			}
+			if (gap == FLT_MAX || _best[_k - 1] <= gap) {
+				break;
+			}
+		}
+		return _best[_k - 1];
+	}
+
+private:
+	int _vectorSize;
+	int _k;
+	int _gridDim;		/*G cells per dimension*/
+	int _cellWidth;	/*positions per cell and dimension*/
+	int* _cellStart;	/*first point of each cell, row-major over (y, x)*/
+	FloatType* _x;		/*points in cell order*/
+	FloatType* _y;
+	int* _index;		/*element of each point*/
+	FloatType* _xBounds;	/*smallest and largest x of each grid column*/
+	FloatType* _yBounds;	/*smallest and largest y of each grid row*/
+	FloatType* _best;	/*k smallest distances found, ascending*/
+	const int* _px;
+	const int* _py;
+	const FloatType* _sx;
+	const FloatType* _sy;
+
+	inline int _getCell(const int px, const int py) const {
+		return (py / _cellWidth) * _gridDim + px / _cellWidth;
+	}
+
+	/*offer the points of the cells [first, last] other than element i*/
+	inline void _searchCells(const int first, const int last, const int i,
+			const FloatType x, const FloatType y) {
+		const int end = _cellStart[last + 1];
+		FloatType kth = _best[_k - 1];
+
+		for (int p = _cellStart[first]; p < end; ++p) {
+			const FloatType d = std::max(fabs(_x[p] - x), fabs(_y[p] - y));
+			if (d >= kth || _index[p] == i) {
+				continue;
+			}
+			/*insertion into the sorted k best*/
+			int j = _k - 1;
+			for (; j > 0 && _best[j - 1] > d; --j) {
+				_best[j] = _best[j - 1];
+			}
+			_best[j] = d;
+			kth = _best[_k - 1];
+		}
+	}
+};
+
+#endif	/*__KNN_GRID_HPP*/
@@ -0,0 +1,784 @@
+/*
+ * MIBinned.hpp
+ *
+ *  Fixed-bin mutual information of equal-frequency discretised vectors. Each
+ *  vector is cut into B bins by its average ranks, so tied values share a bin,
+ *  and stored as one-hot bitplanes (see BinPlanes.hpp). The B x B joint
+ *  histograms of a tile are popcount products of the planes, and the entropy
+ *  epilogue turns each histogram into
+ *	MI = (sum n_ab log n_ab - sum n_a log n_a - sum n_b log n_b + n log n) / n
+ *  in nats, from a table of k log k. The Miller-Madow correction adds
+ *  (m_a + m_b - m_ab - 1) / 2n for the numbers m of occupied bins, and the
+ *  normalised MI is divided by log B.
+ *
+ *  It trades the exactness of MIAdaptive for the speed of the dot-product
+ *  engines, so MIAdaptive can refine the pairs it reports.
+ */
+
+#ifndef MI_BINNED_HPP_
+#define MI_BINNED_HPP_
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <vector>
+#include <omp.h>
+using namespace std;
+#pragma once
+
+#include <TriangularIndex.hpp>
+#include <RankTransform.hpp>
+#include <BinPlanes.hpp>
+#include <TileScheduler.hpp>
+#include <ResultWriter.hpp>
+#include <MPITileScheduler.hpp>
+#include <MPIRing.hpp>
+#include <NodeSharedMatrix.hpp>
+
+#ifdef WITH_MPI
+#include <mpi.h>
+#endif	/*with mpi*/
+
+/*tile size*/
+#define MI_BINNED_TILE_DIM			16
+#define MI_BINNED_MPI_TILE_DIM	16
+#define MI_BINNED_MPI_TILE_SIZE (MI_BINNED_MPI_TILE_DIM * MI_BINNED_MPI_TILE_DIM)
+
+/*template class*/
+template<typename FloatType>
+class MIBinned {
+public:
+	MIBinned(int numVectors, int vectorSize, int numCPUThreads, int rank,
+			int numProcs, int numBins = 0, bool ringBlock = false);
+	~MIBinned();
+
+	inline FloatType* getVectors() {
+		return _vectors;
+	}
+	inline int getNumVectors() {
+		return _numVectors;
+	}
+	inline int getVectorSize() {
+		return _vectorSize;
+	}
+	inline int getVectorSizeAligned() {
+		return _vectorSizeAligned;
+	}
+	inline int getNumBins() {
+		return _numBins;
+	}
+
+	/*bins per vector: about the cube root of the vector size by default*/
+	static int getDefaultNumBins(const int vectorSize) {
+		int numBins = (int) (cbrt((double) vectorSize) + 0.5);
+		return max(2, min(BP_MAX_BINS, min(numBins, vectorSize)));
+	}
+
+	/*Miller-Madow bias correction of the entropies*/
+	inline void setMillerMadow(const bool millerMadow) {
+		_millerMadow = millerMadow;
+	}
+
+	/*divide by log B, the largest MI of B equal-frequency bins*/
+	inline void setNormalize(const bool normalize) {
+		_normalize = normalize;
+	}
+
+	/*generate random data*/
+	void generateRandomData(const int seed = 11);
+
+	/*single threaded implementation*/
+	void runSingleThreaded();
+
+	/*multiple threads with optimized*/
+	void runMultiThreaded();
+
+	/*MPI*/
+#ifdef WITH_MPI
+	void runMPICPU();
+	void runMPICPURing();	/*ring distribution: O(N/p) vectors per process*/
+	/*rows [rowStart, rowEnd) of the input read in by this process before runMPICPU or
+	 *runMPICPURing, and where row rowStart goes. Collective*/
+	FloatType* getInputRows(int& rowStart, int& rowEnd);
+#endif	/*with mpi*/
+
+	/*persisted results*/
+	inline void setResultOptions(const ResultOptions& options) {
+		_resultOptions = options;
+	}
+
+	/*compute only shard shard of numShards of the tile space [multi-threaded mode]*/
+	inline void setShard(const int shard, const int numShards) {
+		_shard = shard;
+		_numShards = numShards;
+	}
+
+protected:
+	FloatType* _vectors; /*vector data. Stored consecutively and each vector contains an aligned number of elements*/
+	int _numVectors; /*number of vectors in the data*/
+	int _rowStart;	/*_vectors holds rows [_rowStart, _rowEnd), row i at (i - _rowStart) * _vectorSizeAligned*/
+	int _rowEnd;
+	bool _ringBlock;	/*only the own block of the ring is held [CPU_MPI_RING]*/
+	int _vectorSize; /*effective vector size, i.e. the real number of elements per vector*/
+	int _vectorSizeAligned; /*aligned to vector size to 16 so that the address is aligned to 64 byte boundary*/
+	int _numCPUThreads; /*the number of CPU threads*/
+	int _rank;			/*process rank*/
+	int _numProcs;	/*number of MPI processes*/
+	int _shard;			/*job-array shard of the multi-threaded engine*/
+	int _numShards;	/*number of job-array shards*/
+	int _numBins;		/*bins per vector*/
+	bool _millerMadow;	/*Miller-Madow correction*/
+	bool _normalize;	/*MI / log B*/
+	double* _xlogx;	/*k log k for k = 0 .. _vectorSize*/
+	FloatType* _mutualInfo; /*mutual information matrix*/
+	ResultOptions _resultOptions;	/*persisted results*/
+#ifdef WITH_MPI
+	NodeSharedMatrix<FloatType>* _sharedVectors;	/*node-local shared input of the MPI engine*/
+#endif
+
+	/*replace the elements of numVectors vectors by their equal-frequency bins 0 .. B - 1*/
+	void _discretise(FloatType* vectors, const int numVectors, int numThreads);
+
+	/*planes first, first + 1, ... of numVectors discretised vectors starting at vectors*/
+	void _buildPlanes(BinPlanes& planes, FloatType* vectors, const int numVectors,
+			const int numThreads, const int first = 0);
+
+	/*entropy epilogue of a joint histogram with the bins per element mx and my*/
+	inline FloatType _computeMI(const int* __restrict__ hist, const int* __restrict__ mx,
+			const int* __restrict__ my) {
+		double sum = 0;
+		int numOccupied = 0, numOccupiedX = 0, numOccupiedY = 0;
+
+		for (int i = 0; i < _numBins * _numBins; ++i) {
+			sum += _xlogx[hist[i]];
+			numOccupied += hist[i] > 0;
+		}
+		for (int i = 0; i < _numBins; ++i) {
+			sum -= _xlogx[mx[i]] + _xlogx[my[i]];
+			numOccupiedX += mx[i] > 0;
+			numOccupiedY += my[i] > 0;
+		}
+		double mi = (sum + _xlogx[_vectorSize]) / _vectorSize;
+		if (_millerMadow) {
+			mi += (double) (numOccupiedX + numOccupiedY - numOccupied - 1) / (2 * _vectorSize);
+		}
+		if (_normalize) {
+			mi /= log((double) _numBins);
+		}
+		return mi;
+	}
+
+	/*MI of the pairs row <= col of the rows [rowStart, rowEnd) of rowPlanes and the columns
+	 *[colStart, colEnd) of colPlanes, whose first vectors are rowFirst and colFirst. The
+	 *value of (row, col) goes to tile[(row - rowStart) * ld + col - colStart]*/
+	inline void _computeTile(const BinPlanes& rowPlanes, const int rowFirst, const int rowStart,
+			const int rowEnd, const BinPlanes& colPlanes, const int colFirst, const int colStart,
+			const int colEnd, FloatType* tile, const int ld, int* hist) {
+		for (int row = rowStart; row < rowEnd; ++row) {
+			const int* mx = rowPlanes.getMarginals(row - rowFirst);
+			for (int col = max(row, colStart); col < colEnd; ++col) {
+				rowPlanes.count(row - rowFirst, colPlanes, col - colFirst, hist);
+				tile[(row - rowStart) * ld + col - colStart] = _computeMI(hist, mx,
+						colPlanes.getMarginals(col - colFirst));
+			}
+		}
+	}
+
+	/*table of k log k*/
+	inline void _initEntropyTable() {
+		if (_xlogx) {
+			return;
+		}
+		_xlogx = (double*) mm_malloc((_vectorSize + 1) * sizeof(double), 64);
+		if (!_xlogx) {
+			fprintf(stderr, "Memory allocation failed\n");
+			exit(-1);
+		}
+		_xlogx[0] = 0;
+		for (int k = 1; k <= _vectorSize; ++k) {
+			_xlogx[k] = k * log((double) k);
+		}
+	}
+
+	/*histogram buffer of a thread*/
+	inline int* _allocHistogram() {
+		int* hist = (int*) mm_malloc(_numBins * _numBins * sizeof(int), 64);
+		if (!hist) {
+			fprintf(stderr, "Memory allocation failed\n");
+			exit(-1);
+		}
+		return hist;
+	}
+
+	/*static function members*/
+public:
+	inline void getTileCoordinate(const ssize_t globalIndex,
+			const ssize_t tileDim, int& row, int& col) {
+		TriangularIndex::getUpperCoordinate(globalIndex, tileDim, row, col);
+	}
+
+	/*conditions: row <= col*/
+	inline ssize_t getTileGlobalIndex(const ssize_t matrixDimSize, const int row,
+		const int col) {
+		return TriangularIndex::getUpperIndex(matrixDimSize, row, col);
+	}
+	inline double getSysTime() {
+		double dtime;
+		struct timeval tv;
+
+		gettimeofday(&tv, NULL);
+
+		dtime = (double) tv.tv_sec;
+		dtime += (double) (tv.tv_usec) / 1000000.0;
+
+		return dtime;
+	}
+	inline void* mm_malloc(ssize_t size, ssize_t alignment)
+	{
+		return _mm_malloc(size, alignment);
+	}
+	inline void mm_free(void* buffer)
+	{
+		_mm_free(buffer);
+	}
+};
+
+template<typename FloatType>
+MIBinned<FloatType>::MIBinned(int numVectors, int vectorSize, int numCPUThreads,
+		int rank, int numProcs, int numBins, bool ringBlock) {
+	int alignment = 64 / sizeof(FloatType);	/*align to 64 byte boundary*/
+	_numVectors = numVectors;
+	_vectorSize = vectorSize;
+	_vectorSizeAligned = (_vectorSize + alignment - 1) / alignment * alignment;
+	_numCPUThreads = numCPUThreads;
+	_rank = rank;
+	_numProcs = numProcs;
+	_shard = 0;
+	_numShards = 1;
+	_numBins = numBins > 0 ? min(numBins, BP_MAX_BINS) : getDefaultNumBins(vectorSize);
+	_millerMadow = false;
+	_normalize = false;
+	_xlogx = NULL;
+#ifdef WITH_MPI
+	_sharedVectors = NULL;
+#endif
+
+	/*allocate space*/
+	_mutualInfo = NULL;
+
+	/*all vectors, or only the own block of the ring*/
+	_ringBlock = ringBlock;
+	_rowStart = 0;
+	_rowEnd = _numVectors;
+#ifdef WITH_MPI
+	if (_ringBlock) {
+		MPIRing<FloatType>::getBlockRange(_numVectors, MPIRing<FloatType>::getBlockSize(
+				_numVectors, _numProcs, MI_BINNED_MPI_TILE_DIM), _rank, _rowStart, _rowEnd);
+	}
+#endif
+
+	/*align each vector*/
+	_vectors = (FloatType*) mm_malloc(
+			(ssize_t)max(1, _rowEnd - _rowStart) * _vectorSizeAligned * sizeof(FloatType), 64);
+	if (!_vectors) {
+		fprintf(stderr, "Memory allocation failed at line %d in file %s\n",
+		__LINE__, __FILE__);
+		exit(-1);
+	}
+}
+
+template<typename FloatType>
+MIBinned<FloatType>::~MIBinned() {
+#ifdef WITH_MPI
+	if (_sharedVectors) {
+		/*_vectors points into the shared window*/
+		delete _sharedVectors;
+		_vectors = NULL;
+	}
+#endif
+	if (_vectors) {
+		mm_free(_vectors);
+	}
+	if (_mutualInfo) {
+		mm_free(_mutualInfo);
+	}
+	if (_xlogx) {
+		mm_free(_xlogx);
+	}
+}
+
+template<typename FloatType>
+void MIBinned<FloatType>::generateRandomData(const int seed) {
+	srand48(11);
+	/*rows before the held ones still draw their numbers, so that a ring block gets the rows of the full matrix*/
+	for (ssize_t i = 0; i < (ssize_t) _rowStart * _vectorSize; ++i) {
+		drand48();
+	}
+	for (int i = _rowStart; i < _rowEnd; ++i) {
+		FloatType* __restrict__ dst = _vectors + (ssize_t) (i - _rowStart) * _vectorSizeAligned;
+		for (int j = 0; j < _vectorSize; ++j) {
+			dst[j] = drand48();
+		}
+	}
+}
+
+template<typename FloatType>
+void MIBinned<FloatType>::_discretise(FloatType* vectors, const int numVectors, int numThreads) {
+	if (numThreads < 1) {
+		numThreads = omp_get_num_procs();
+	}
+
+	/*average ranks from zero, so tied values fall into the same bin*/
+	RankTransform::rankMatrix(vectors, numVectors, _vectorSize, _vectorSizeAligned,
+			RT_TIES_AVERAGE, numThreads, false, 0);
+
+#pragma omp parallel for num_threads(numThreads) schedule(dynamic, 64)
+	for (int v = 0; v < numVectors; ++v) {
+		FloatType* __restrict__ vec = vectors + (ssize_t) v * _vectorSizeAligned;
+		for (int i = 0; i < _vectorSize; ++i) {
+			vec[i] = min(_numBins - 1, (int) ((double) vec[i] * _numBins / _vectorSize));
+		}
+	}
+}
+
+template<typename FloatType>
+void MIBinned<FloatType>::_buildPlanes(BinPlanes& planes, FloatType* vectors,
+		const int numVectors, int numThreads, const int first) {
+	if (numThreads < 1) {
+		numThreads = omp_get_num_procs();
+	}
+#pragma omp parallel for num_threads(numThreads) schedule(dynamic, 64)
+	for (int v = 0; v < numVectors; ++v) {
+		planes.build(first + v, vectors + (ssize_t) v * _vectorSizeAligned);
+	}
+}
+
+template<typename FloatType>
+void MIBinned<FloatType>::runSingleThreaded() {
+	double stime, etime;
+#ifdef VERBOSE
+	fprintf(stderr, "execute function %s\n", __FUNCTION__);
+#endif
+
+	/*output matrix*/
+	_mutualInfo = (FloatType*) mm_malloc(
+			(ssize_t) _numVectors * _numVectors * sizeof(FloatType), 64);
+	if (!_mutualInfo) {
+		fprintf(stderr, "Memory allocation failed\n");
+		exit(-1);
+	}
+
+	/*record the system time*/
+	stime = getSysTime();
+
+	/*discretise the vectors*/
+	double t1 = getSysTime();
+	_discretise(_vectors, _numVectors, 1);
+	BinPlanes planes(_numVectors, _vectorSize, _numBins);
+	_buildPlanes(planes, _vectors, _numVectors, 1);
+	_initEntropyTable();
+	double t2 = getSysTime();
+	fprintf(stderr, "time for discretisation into %d bins: %f seconds\n", _numBins, t2 - t1);
+
+	/*compute pairwise mutual information*/
+	int* hist = _allocHistogram();
+	for (int row = 0; row < _numVectors; ++row) {
+		const int* mx = planes.getMarginals(row);
+		for (int col = row; col < _numVectors; ++col) {
+			planes.count(row, planes, col, hist);
+			FloatType mi = _computeMI(hist, mx, planes.getMarginals(col));
+			_mutualInfo[(ssize_t)row * _numVectors + col] = mi;
+			_mutualInfo[(ssize_t)col * _numVectors + row] = mi;
+		}
+	}
+	mm_free(hist);
+
+	/*recored the system time*/
+	etime = getSysTime();
+	fprintf(stderr, "Overall time: %f seconds\n",
+			etime - stime);
+}
+
+template<typename FloatType>
+void MIBinned<FloatType>::runMultiThreaded() {
+	double stime, etime;
+	const int tileDim = (_numVectors + MI_BINNED_TILE_DIM - 1) / MI_BINNED_TILE_DIM;
+	const ssize_t numTiles = (ssize_t) (tileDim + 1) * tileDim / 2;
+	ssize_t totalNumPairs = 0;
+
+#ifdef VERBOSE
+	fprintf(stderr, "execute function %s\n", __FUNCTION__);
+#endif
+
+	/*record system time*/
+	stime = getSysTime();
+
+	/*allocate space*/
+	_mutualInfo = (FloatType*) mm_malloc(
+			(ssize_t) _numVectors * _numVectors * sizeof(FloatType), 64);
+	if (!_mutualInfo) {
+		fprintf(stderr, "Memory allocation failed\n");
+		exit(-1);
+	}
+
+	/*enter the core computation*/
+	if (_numCPUThreads < 1) {
+		_numCPUThreads = omp_get_num_procs();
+	}
+	omp_set_num_threads(_numCPUThreads);
+
+	/*dynamic tile scheduler*/
+	TileScheduler scheduler(numTiles, _numCPUThreads);
+
+	/*job-array shard: a balanced slice of the tile space*/
+	ssize_t firstTile, lastTile;
+	TileScheduler::getShardRange(numTiles, _shard, _numShards, firstTile, lastTile);
+	scheduler.setRange(firstTile, lastTile);
+
+	/*persisted results of the shard*/
+	ResultWriter<FloatType>* writer = NULL;
+	if (_resultOptions.enabled()) {
+		writer = new ResultWriter<FloatType>(_resultOptions, "mibinned", _shard,
+				_numShards, _numVectors, _vectorSize, MI_BINNED_TILE_DIM,
+				_numCPUThreads);
+	}
+
+	/*discretise the vectors*/
+	double t1 = getSysTime();
+	_discretise(_vectors, _numVectors, _numCPUThreads);
+	BinPlanes planes(_numVectors, _vectorSize, _numBins);
+	_buildPlanes(planes, _vectors, _numVectors, _numCPUThreads);
+	_initEntropyTable();
+	fprintf(stderr, "time for discretisation into %d bins: %f seconds\n", _numBins, getSysTime() - t1);
+
+	/*entering the core loop*/
+#pragma omp parallel reduction(+:totalNumPairs)
+	{
+		ssize_t tileStart, tileEnd;
+		int rowStart, rowEnd, colStart, colEnd;
+		ssize_t numPairsProcessed = 0;
+		const int tid = omp_get_thread_num();
+		int* hist = _allocHistogram();
+
+		/*per-thread tile buffer*/
+		FloatType* __restrict__ tile = (FloatType*) mm_malloc(
+				MI_BINNED_TILE_DIM * MI_BINNED_TILE_DIM * sizeof(FloatType), 64);
+		if (!tile) {
+			fprintf(stderr, "Memory allocation failed\n");
+			exit(-1);
+		}
+
+		/*dynamic distribution of tiles over threads*/
+		scheduler.threadStart(tid);
+		while (scheduler.nextChunk(tid, tileStart, tileEnd)) {
+			/*one coordinate lookup per chunk, then step through the tiles*/
+			TriangularIterator tiles(tileDim, tileStart);
+			for (ssize_t t = tileStart; t < tileEnd; ++t, tiles.next()) {
+				rowStart = tiles.row() * MI_BINNED_TILE_DIM;
+				rowEnd = min(_numVectors, rowStart + MI_BINNED_TILE_DIM);
+				colStart = tiles.col() * MI_BINNED_TILE_DIM;
+				colEnd = min(_numVectors, colStart + MI_BINNED_TILE_DIM);
+
+				/*joint histograms and entropy epilogue of the tile*/
+				_computeTile(planes, 0, rowStart, rowEnd, planes, 0, colStart, colEnd,
+						tile, MI_BINNED_TILE_DIM, hist);
+				if (writer) {
+					writer->addTile(t, rowStart, rowEnd, colStart, colEnd, tile,
+							MI_BINNED_TILE_DIM, NULL, 0, tid);
+				}
+				for (int row = rowStart; row < rowEnd; ++row) {
+					for (int col = max(row, colStart); col < colEnd; ++col) {
+						/*statistics*/
+						++numPairsProcessed;
+
+						FloatType mi = tile[(row - rowStart) * MI_BINNED_TILE_DIM + col - colStart];
+						_mutualInfo[(ssize_t)row * _numVectors + col] = mi;
+						_mutualInfo[(ssize_t)col * _numVectors + row] = mi;
+					}
+				}
+			}
+		}
+		scheduler.threadFinish(tid);
+		mm_free(tile);
+		mm_free(hist);
+
+		/*reduction*/
+		totalNumPairs += numPairsProcessed;
+	} /*#pragma omp parallel*/
+
+	if (writer) {
+		writer->close();
+		delete writer;
+	}
+
+	/*recored the system time*/
+	etime = getSysTime();
+	fprintf(stderr, "Overall time (%ld pairs): %f seconds\n", totalNumPairs,
+			etime - stime);
+
+	/*report load balance*/
+#ifdef VERBOSE
+	scheduler.report(stderr, true);
+#else
+	scheduler.report(stderr, false);
+#endif
+}
+
+#ifdef WITH_MPI
+template<typename FloatType>
+FloatType* MIBinned<FloatType>::getInputRows(int& rowStart, int& rowEnd) {
+	/*the own block of the ring*/
+	if (_ringBlock) {
+		rowStart = _rowStart;
+		rowEnd = _rowEnd;
+		return _vectors;
+	}
+
+	/*the own rows are read straight into the node-local shared copy*/
+	if (!_sharedVectors) {
+		_sharedVectors = new NodeSharedMatrix<FloatType>(MPI_COMM_WORLD,
+				_numVectors, _vectorSizeAligned);
+		mm_free(_vectors);
+		_vectors = _sharedVectors->getVectors();
+	}
+	_sharedVectors->getRowRange(rowStart, rowEnd);
+	return _vectors + (ssize_t) rowStart * _vectorSizeAligned;
+}
+
+template<typename FloatType>
+void MIBinned<FloatType>::runMPICPU() {
+	double stime, etime;
+	const int tileDim = (_numVectors + MI_BINNED_MPI_TILE_DIM - 1) / MI_BINNED_MPI_TILE_DIM;
+	const ssize_t numTiles = (ssize_t)(tileDim + 1) * tileDim / 2;
+	ssize_t numPairsProcessed = 0, totalNumPairs;
+
+#ifdef VERBOSE
+	if(_rank == 0){
+		fprintf(stderr, "execute function %s\n", __FUNCTION__);
+	}
+#endif
+
+	/*record the system time*/
+	MPI_Barrier(MPI_COMM_WORLD);
+	stime = getSysTime();
+
+	int row;
+	int loRowRange, hiRowRange;
+	int rowStart, rowEnd, colStart, colEnd;
+	ssize_t offset = 0;
+	FloatType* __restrict__ vecX;
+
+	/*allocate buffer*/
+	ssize_t chunkSize = (numTiles + _numProcs - 1) / _numProcs;
+	ssize_t capacity = chunkSize * MI_BINNED_MPI_TILE_SIZE;
+	_mutualInfo = (FloatType*)mm_malloc(capacity * sizeof(FloatType), 64);
+	if(!_mutualInfo) {
+		fprintf(stderr, "Memory allocation failed\n");
+		exit(-1);
+	}
+
+	/*discretise the own rows*/
+	if (!_sharedVectors) {
+		_sharedVectors = new NodeSharedMatrix<FloatType>(MPI_COMM_WORLD,
+				_numVectors, _vectorSizeAligned);
+	}
+	/*rows of the processes of a node are contiguous*/
+	_sharedVectors->getRowRange(loRowRange, hiRowRange);
+	vecX = _vectors + (ssize_t) loRowRange * _vectorSizeAligned;
+	_discretise(vecX, hiRowRange - loRowRange, _numCPUThreads);
+
+	/*publish the own rows into the node-local shared copy and gather the rows of the other nodes.
+	 *the private copy is released*/
+	vecX = _sharedVectors->gather(_vectors);
+	if (vecX != _vectors) {
+		mm_free(_vectors);
+		_vectors = vecX;
+	}
+	MPI_Barrier(MPI_COMM_WORLD);
+
+	/*planes of all vectors, one copy per node next to the shared vectors. The processes
+	 *of the node build one slice each*/
+	NodeSharedWindow planesWindow(_sharedVectors->getNodeComm(),
+			BinPlanes::getStorageSize(_numVectors, _vectorSize, _numBins));
+	BinPlanes planes(_numVectors, _vectorSize, _numBins, planesWindow.getBase());
+	const int nodeChunkSize = (_numVectors + _sharedVectors->getNodeSize() - 1)
+			/ _sharedVectors->getNodeSize();
+	loRowRange = min(_numVectors, _sharedVectors->getNodeRank() * nodeChunkSize);
+	hiRowRange = min(_numVectors, loRowRange + nodeChunkSize);
+	_buildPlanes(planes, _vectors + (ssize_t) loRowRange * _vectorSizeAligned,
+			hiRowRange - loRowRange, _numCPUThreads, loRowRange);
+	planesWindow.sync();
+	_initEntropyTable();
+	int* hist = _allocHistogram();
+
+	/*dynamic distribution of the tiles*/
+	MPITileScheduler scheduler(numTiles, MPI_COMM_WORLD);
+	ssize_t chunkStart, chunkEnd, tileIndex;
+	int tileRow, tileCol;
+
+	/*persisted results*/
+	ResultWriter<FloatType>* writer = NULL;
+	if (_resultOptions.enabled()) {
+		writer = new ResultWriter<FloatType>(_resultOptions, "mibinned", _rank,
+				_numProcs, _numVectors, _vectorSize, MI_BINNED_MPI_TILE_DIM);
+	}
+	while (scheduler.nextChunk(chunkStart, chunkEnd)) {
+		/*the buffer holds all tiles computed by this process*/
+		_mutualInfo = MPITileScheduler::reserve(_mutualInfo, offset, capacity,
+				offset + (chunkEnd - chunkStart) * MI_BINNED_MPI_TILE_SIZE);
+		getTileCoordinate(chunkStart, tileDim, tileRow, tileCol);
+		for (tileIndex = chunkStart; tileIndex < chunkEnd; ++tileIndex) {
+			rowStart = tileRow * MI_BINNED_MPI_TILE_DIM;
+			rowEnd = min(_numVectors, rowStart + MI_BINNED_MPI_TILE_DIM);
+			colStart = tileCol * MI_BINNED_MPI_TILE_DIM;
+			colEnd = min(_numVectors, colStart + MI_BINNED_MPI_TILE_DIM);
+
+			/*joint histograms and entropy epilogue of the tile*/
+			_computeTile(planes, 0, rowStart, rowEnd, planes, 0, colStart, colEnd,
+					_mutualInfo + offset, MI_BINNED_MPI_TILE_DIM, hist);
+			for (row = rowStart; row < rowEnd; ++row) {
+				numPairsProcessed += colEnd - max(row, colStart);
+			}
+			if (writer) {
+				writer->addTile(tileIndex, rowStart, rowEnd, colStart, colEnd,
+						_mutualInfo + offset, MI_BINNED_MPI_TILE_DIM);
+			}
+
+			/*move to the next tile*/
+			offset += MI_BINNED_MPI_TILE_SIZE;
+			if (++tileCol == tileDim) {
+				tileRow++;
+				tileCol = tileRow;
+			}
+		}
+	}
+	scheduler.finish();
+	mm_free(hist);
+
+	if (writer) {
+		writer->close();
+		delete writer;
+	}
+
+	/*compute the total number of edges*/
+	MPI_Reduce(&numPairsProcessed, &totalNumPairs, 1, MPI_INT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+
+	/*recored the system time*/
+	etime = getSysTime();
+	if (_rank == 0) {
+		fprintf(stderr, "Overall time (%ld pairs): %f seconds\n", totalNumPairs, etime - stime);
+	}
+	scheduler.report();
+}
+
+/*systolic ring: each process owns one block of vectors and pairs it with the blocks passing through.
+ *The blocks travel as bin indices, and the planes of the visiting block are built on arrival*/
+template<typename FloatType>
+void MIBinned<FloatType>::runMPICPURing() {
+	double stime, etime, waitTime, maxWaitTime;
+	const int tileDim = (_numVectors + MI_BINNED_MPI_TILE_DIM - 1) / MI_BINNED_MPI_TILE_DIM;
+	const int blockSize = MPIRing<FloatType>::getBlockSize(_numVectors, _numProcs, MI_BINNED_MPI_TILE_DIM);
+	ssize_t numPairsProcessed = 0, totalNumPairs;
+
+#ifdef VERBOSE
+	if(_rank == 0) fprintf(stderr, "execute function %s\n", __FUNCTION__);
+#endif
+
+	/*record the system time*/
+	MPI_Barrier(MPI_COMM_WORLD);
+	stime = getSysTime();
+
+	int row;
+	int loRowRange, hiRowRange;
+	int rowStart, rowEnd, colStart, colEnd;
+
+	/*discretise the own block*/
+	MPIRing<FloatType>::getBlockRange(_numVectors, blockSize, _rank, loRowRange, hiRowRange);
+	_discretise(_vectors + (ssize_t) (loRowRange - _rowStart) * _vectorSizeAligned,
+			hiRowRange - loRowRange, _numCPUThreads);
+
+	/*the own block is copied into the ring, which holds all vectors used from here on*/
+	MPIRing<FloatType> ring(MPI_COMM_WORLD, _vectors + (ssize_t) (loRowRange - _rowStart) * _vectorSizeAligned,
+			_numVectors, _vectorSizeAligned, blockSize);
+	RingBlock<FloatType> rows, cols;
+	mm_free(_vectors);
+	_vectors = NULL;
+
+	/*planes of the own block and of the visiting one*/
+	BinPlanes rowPlanes(blockSize, _vectorSize, _numBins);
+	BinPlanes colPlanes(blockSize, _vectorSize, _numBins);
+	int rowPlanesStart = -1;
+	_initEntropyTable();
+	int* hist = _allocHistogram();
+
+	/*tile buffer*/
+	FloatType* __restrict__ tile = (FloatType*) mm_malloc(MI_BINNED_MPI_TILE_SIZE * sizeof(FloatType), 64);
+	if (!tile) {
+		fprintf(stderr, "Memory allocation failed\n");
+		exit(-1);
+	}
+
+	/*persisted results*/
+	ResultWriter<FloatType>* writer = NULL;
+	if (_resultOptions.enabled()) {
+		writer = new ResultWriter<FloatType>(_resultOptions, "mibinned", _rank,
+				_numProcs, _numVectors, _vectorSize, MI_BINNED_MPI_TILE_DIM);
+	}
+
+	while (ring.next(rows, cols)) {
+		if (rows._start != rowPlanesStart) {
+			_buildPlanes(rowPlanes, rows._vectors, rows._end - rows._start, _numCPUThreads);
+			rowPlanesStart = rows._start;
+		}
+		const bool diagonal = rows._start == cols._start;
+		if (!diagonal) {
+			_buildPlanes(colPlanes, cols._vectors, cols._end - cols._start, _numCPUThreads);
+		}
+		const BinPlanes& planes = diagonal ? rowPlanes : colPlanes;
+
+		/*blocks start at tile boundaries, so each tile of the block pair is a global tile*/
+		for (rowStart = rows._start; rowStart < rows._end; rowStart += MI_BINNED_MPI_TILE_DIM) {
+			rowEnd = min(rows._end, rowStart + MI_BINNED_MPI_TILE_DIM);
+			colStart = diagonal ? rowStart : cols._start;
+			for (; colStart < cols._end; colStart += MI_BINNED_MPI_TILE_DIM) {
+				colEnd = min(cols._end, colStart + MI_BINNED_MPI_TILE_DIM);
+
+				/*joint histograms and entropy epilogue of the tile*/
+				_computeTile(rowPlanes, rows._start, rowStart, rowEnd, planes, cols._start,
+						colStart, colEnd, tile, MI_BINNED_MPI_TILE_DIM, hist);
+				for (row = rowStart; row < rowEnd; ++row) {
+					numPairsProcessed += max(0, colEnd - max(row, colStart));
+				}
+
+				if (writer) {
+					writer->addTile(getTileGlobalIndex(tileDim, rowStart / MI_BINNED_MPI_TILE_DIM, colStart / MI_BINNED_MPI_TILE_DIM),
+							rowStart, rowEnd, colStart, colEnd, tile, MI_BINNED_MPI_TILE_DIM);
+				}
+			}
+		}
+	}
+	mm_free(tile);
+	mm_free(hist);
+
+	if (writer) {
+		writer->close();
+		delete writer;
+	}
+
+	/*compute the total number of edges*/
+	MPI_Reduce(&numPairsProcessed, &totalNumPairs, 1, MPI_INT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+	waitTime = ring.getWaitTime();
+	MPI_Reduce(&waitTime, &maxWaitTime, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+	/*recored the system time*/
+	etime = getSysTime();
+	if (_rank == 0) {
+		fprintf(stderr, "Overall time (%ld pairs): %f seconds\n", totalNumPairs, etime - stime);
+		fprintf(stderr, "Ring communication wait (maximum over processes): %f seconds\n", maxWaitTime);
+	}
+}
+#endif	/*with mpi*/
+
+#endif /* MI_BINNED_HPP_ */
@@ -0,0 +1,716 @@
+/*
+ * MIKSG.hpp
+ *
+ *  Kraskov-Stoegbauer-Grassberger mutual information (estimator 1 of Kraskov
+ *  et al. (2004) Estimating mutual information. Physical review E 69, 066138)
+ *
+ *	MI = psi(k) + psi(n) - <psi(n_x + 1) + psi(n_y + 1)>
+ *
+ *  where the k-th nearest neighbour of sample i in the max-norm is at distance
+ *  e_i, and n_x and n_y count the other samples closer than e_i in x and in y.
+ *  The sorted values of each vector are built once by RankTransform and shared
+ *  by all pairs of a tile (see KNNGrid.hpp): n_x and n_y are galloping searches
+ *  in them, and the neighbours of a pair are searched in a grid over the sorted
+ *  positions. Unlike the rank-based estimators, the distances are those of the
+ *  values; tied samples are at distance 0 and are best broken by a little
+ *  noise in the input.
+ */
+
+#ifndef MI_KSG_HPP_
+#define MI_KSG_HPP_
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <vector>
+#include <omp.h>
+using namespace std;
+#pragma once
+
+#include <TriangularIndex.hpp>
+#include <RankTransform.hpp>
+#include <KNNGrid.hpp>
+#include <TileScheduler.hpp>
+#include <ResultWriter.hpp>
+#include <MPITileScheduler.hpp>
+#include <MPIRing.hpp>
+#include <NodeSharedMatrix.hpp>
+
+#ifdef WITH_MPI
+#include <mpi.h>
+#endif	/*with mpi*/
+
+/*tile size*/
+#define MI_KSG_TILE_DIM			8
+#define MI_KSG_MPI_TILE_DIM	8
+#define MI_KSG_MPI_TILE_SIZE (MI_KSG_MPI_TILE_DIM * MI_KSG_MPI_TILE_DIM)
+
+/*default number of neighbours*/
+#define MI_KSG_NUM_NEIGHBORS	3
+
+/*template class*/
+template<typename FloatType>
+class MIKSG {
+public:
+	MIKSG(int numVectors, int vectorSize, int numCPUThreads, int rank,
+			int numProcs, int numNeighbors = MI_KSG_NUM_NEIGHBORS, bool ringBlock = false);
+	~MIKSG();
+
+	inline FloatType* getVectors() {
+		return _vectors;
+	}
+	inline int getNumVectors() {
+		return _numVectors;
+	}
+	inline int getVectorSize() {
+		return _vectorSize;
+	}
+	inline int getVectorSizeAligned() {
+		return _vectorSizeAligned;
+	}
+	inline int getNumNeighbors() {
+		return _numNeighbors;
+	}
+
+	/*generate random data*/
+	void generateRandomData(const int seed = 11);
+
+	/*single threaded implementation*/
+	void runSingleThreaded();
+
+	/*multiple threads with optimized*/
+	void runMultiThreaded();
+
+	/*MPI*/
+#ifdef WITH_MPI
+	void runMPICPU();
+	void runMPICPURing();	/*ring distribution: O(N/p) vectors per process*/
+	/*rows [rowStart, rowEnd) of the input read in by this process before runMPICPU or
+	 *runMPICPURing, and where row rowStart goes. Collective*/
+	FloatType* getInputRows(int& rowStart, int& rowEnd);
+#endif	/*with mpi*/
+
+	/*persisted results*/
+	inline void setResultOptions(const ResultOptions& options) {
+		_resultOptions = options;
+	}
+
+	/*compute only shard shard of numShards of the tile space [multi-threaded mode]*/
+	inline void setShard(const int shard, const int numShards) {
+		_shard = shard;
+		_numShards = numShards;
+	}
+
+protected:
+	FloatType* _vectors; /*vector data. Stored consecutively and each vector contains an aligned number of elements*/
+	int _numVectors; /*number of vectors in the data*/
+	int _rowStart;	/*_vectors holds rows [_rowStart, _rowEnd), row i at (i - _rowStart) * _vectorSizeAligned*/
+	int _rowEnd;
+	bool _ringBlock;	/*only the own block of the ring is held [CPU_MPI_RING]*/
+	int _vectorSize; /*effective vector size, i.e. the real number of elements per vector*/
+	int _vectorSizeAligned; /*aligned to vector size to 16 so that the address is aligned to 64 byte boundary*/
+	int _numCPUThreads; /*the number of CPU threads*/
+	int _rank;			/*process rank*/
+	int _numProcs;	/*number of MPI processes*/
+	int _shard;			/*job-array shard of the multi-threaded engine*/
+	int _numShards;	/*number of job-array shards*/
+	int _numNeighbors;	/*k*/
+	double* _psi;		/*digamma of 0 .. _vectorSize*/
+	FloatType* _mutualInfo; /*mutual information matrix*/
+	ResultOptions _resultOptions;	/*persisted results*/
+#ifdef WITH_MPI
+	NodeSharedMatrix<FloatType>* _sharedVectors;	/*node-local shared input of the MPI engine*/
+#endif
+
+	/*sorted values of numVectors vectors starting at vectors*/
+	void _sortVectors(SortedVectors<FloatType>& sorted, FloatType* vectors,
+			const int numVectors, int numThreads, const int first = 0);
+
+	/*mutual information of vector a of X and vector b of Y*/
+	inline FloatType _computeMI(KNNGrid<FloatType>& grid, const SortedVectors<FloatType>& X,
+			const int a, const SortedVectors<FloatType>& Y, const int b) {
+		const int* __restrict__ px = X.getPositions(a);
+		const int* __restrict__ py = Y.getPositions(b);
+		double sum = 0;
+
+		grid.build(X, a, Y, b);
+		for (int i = 0; i < _vectorSize; ++i) {
+			const FloatType e = grid.kthDistance(i);
+			sum += _psi[X.countWithin(a, px[i], e) + 1] + _psi[Y.countWithin(b, py[i], e) + 1];
+		}
+		return _psi[_numNeighbors] + _psi[_vectorSize] - sum / _vectorSize;
+	}
+
+	/*MI of the pairs row <= col of the rows [rowStart, rowEnd) of X and the columns
+	 *[colStart, colEnd) of Y, whose first vectors are rowFirst and colFirst. The
+	 *value of (row, col) goes to tile[(row - rowStart) * ld + col - colStart]*/
+	inline void _computeTile(KNNGrid<FloatType>& grid, const SortedVectors<FloatType>& X,
+			const int rowFirst, const int rowStart, const int rowEnd,
+			const SortedVectors<FloatType>& Y, const int colFirst, const int colStart,
+			const int colEnd, FloatType* tile, const int ld) {
+		for (int row = rowStart; row < rowEnd; ++row) {
+			for (int col = max(row, colStart); col < colEnd; ++col) {
+				tile[(row - rowStart) * ld + col - colStart] = _computeMI(grid, X,
+						row - rowFirst, Y, col - colFirst);
+			}
+		}
+	}
+
+	/*table of the digamma function of the integers*/
+	inline void _initDigammaTable() {
+		if (_psi) {
+			return;
+		}
+		_psi = (double*) mm_malloc((_vectorSize + 1) * sizeof(double), 64);
+		if (!_psi) {
+			fprintf(stderr, "Memory allocation failed\n");
+			exit(-1);
+		}
+		_psi[0] = 0;	/*unused*/
+		_psi[1] = -0.57721566490153286061;	/*minus the Euler-Mascheroni constant*/
+		for (int k = 2; k <= _vectorSize; ++k) {
+			_psi[k] = _psi[k - 1] + 1.0 / (k - 1);
+		}
+	}
+
+	/*static function members*/
+public:
+	inline void getTileCoordinate(const ssize_t globalIndex,
+			const ssize_t tileDim, int& row, int& col) {
+		TriangularIndex::getUpperCoordinate(globalIndex, tileDim, row, col);
+	}
+
+	/*conditions: row <= col*/
+	inline ssize_t getTileGlobalIndex(const ssize_t matrixDimSize, const int row,
+		const int col) {
+		return TriangularIndex::getUpperIndex(matrixDimSize, row, col);
+	}
+	inline double getSysTime() {
+		double dtime;
+		struct timeval tv;
+
+		gettimeofday(&tv, NULL);
+
+		dtime = (double) tv.tv_sec;
+		dtime += (double) (tv.tv_usec) / 1000000.0;
+
+		return dtime;
+	}
+	inline void* mm_malloc(ssize_t size, ssize_t alignment)
+	{
+		return _mm_malloc(size, alignment);
+	}
+	inline void mm_free(void* buffer)
+	{
+		_mm_free(buffer);
+	}
+};
+
+template<typename FloatType>
+MIKSG<FloatType>::MIKSG(int numVectors, int vectorSize, int numCPUThreads,
+		int rank, int numProcs, int numNeighbors, bool ringBlock) {
+	int alignment = 64 / sizeof(FloatType);	/*align to 64 byte boundary*/
+	_numVectors = numVectors;
+	_vectorSize = vectorSize;
+	_vectorSizeAligned = (_vectorSize + alignment - 1) / alignment * alignment;
+	_numCPUThreads = numCPUThreads;
+	_rank = rank;
+	_numProcs = numProcs;
+	_shard = 0;
+	_numShards = 1;
+	_numNeighbors = max(1, min(numNeighbors, vectorSize - 1));
+	_psi = NULL;
+#ifdef WITH_MPI
+	_sharedVectors = NULL;
+#endif
+
+	/*allocate space*/
+	_mutualInfo = NULL;
+
+	/*all vectors, or only the own block of the ring*/
+	_ringBlock = ringBlock;
+	_rowStart = 0;
+	_rowEnd = _numVectors;
+#ifdef WITH_MPI
+	if (_ringBlock) {
+		MPIRing<FloatType>::getBlockRange(_numVectors, MPIRing<FloatType>::getBlockSize(
+				_numVectors, _numProcs, MI_KSG_MPI_TILE_DIM), _rank, _rowStart, _rowEnd);
+	}
+#endif
+
+	/*align each vector*/
+	_vectors = (FloatType*) mm_malloc(
+			(ssize_t)max(1, _rowEnd - _rowStart) * _vectorSizeAligned * sizeof(FloatType), 64);
+	if (!_vectors) {
+		fprintf(stderr, "Memory allocation failed at line %d in file %s\n",
+		__LINE__, __FILE__);
+		exit(-1);
+	}
+}
+
+template<typename FloatType>
+MIKSG<FloatType>::~MIKSG() {
+#ifdef WITH_MPI
+	if (_sharedVectors) {
+		/*_vectors points into the shared window*/
+		delete _sharedVectors;
+		_vectors = NULL;
+	}
+#endif
+	if (_vectors) {
+		mm_free(_vectors);
+	}
+	if (_mutualInfo) {
+		mm_free(_mutualInfo);
+	}
+	if (_psi) {
+		mm_free(_psi);
+	}
+}
+
+template<typename FloatType>
+void MIKSG<FloatType>::generateRandomData(const int seed) {
+	srand48(11);
+	/*rows before the held ones still draw their numbers, so that a ring block gets the rows of the full matrix*/
+	for (ssize_t i = 0; i < (ssize_t) _rowStart * _vectorSize; ++i) {
+		drand48();
+	}
+	for (int i = _rowStart; i < _rowEnd; ++i) {
+		FloatType* __restrict__ dst = _vectors + (ssize_t) (i - _rowStart) * _vectorSizeAligned;
+		for (int j = 0; j < _vectorSize; ++j) {
+			dst[j] = drand48();
+		}
+	}
+}
+
+template<typename FloatType>
+void MIKSG<FloatType>::_sortVectors(SortedVectors<FloatType>& sorted, FloatType* vectors,
+		const int numVectors, int numThreads, const int first) {
+	if (numThreads < 1) {
+		numThreads = omp_get_num_procs();
+	}
+#pragma omp parallel num_threads(numThreads)
+	{
+		RankBuffer<FloatType> buffer(_vectorSize);
+#pragma omp for schedule(dynamic, 64)
+		for (int v = 0; v < numVectors; ++v) {
+			sorted.build(first + v, vectors + (ssize_t) v * _vectorSizeAligned, buffer);
+		}
+	}
+}
+
+template<typename FloatType>
+void MIKSG<FloatType>::runSingleThreaded() {
+	double stime, etime;
+#ifdef VERBOSE
+	fprintf(stderr, "execute function %s\n", __FUNCTION__);
+#endif
+
+	/*output matrix*/
+	_mutualInfo = (FloatType*) mm_malloc(
+			(ssize_t) _numVectors * _numVectors * sizeof(FloatType), 64);
+	if (!_mutualInfo) {
+		fprintf(stderr, "Memory allocation failed\n");
+		exit(-1);
+	}
+
+	/*record the system time*/
+	stime = getSysTime();
+
+	/*sort the vectors*/
+	double t1 = getSysTime();
+	SortedVectors<FloatType> sorted(_numVectors, _vectorSize);
+	_sortVectors(sorted, _vectors, _numVectors, 1);
+	_initDigammaTable();
+	double t2 = getSysTime();
+	fprintf(stderr, "time for sorting: %f seconds\n", t2 - t1);
+
+	/*compute pairwise mutual information*/
+	KNNGrid<FloatType> grid(_vectorSize, _numNeighbors);
+	for (int row = 0; row < _numVectors; ++row) {
+		for (int col = row; col < _numVectors; ++col) {
+			FloatType mi = _computeMI(grid, sorted, row, sorted, col);
+			_mutualInfo[(ssize_t)row * _numVectors + col] = mi;
+			_mutualInfo[(ssize_t)col * _numVectors + row] = mi;
+		}
+	}
+
+	/*recored the system time*/
+	etime = getSysTime();
+	fprintf(stderr, "Overall time: %f seconds\n",
+			etime - stime);
+}
+
+template<typename FloatType>
+void MIKSG<FloatType>::runMultiThreaded() {
+	double stime, etime;
+	const int tileDim = (_numVectors + MI_KSG_TILE_DIM - 1) / MI_KSG_TILE_DIM;
+	const ssize_t numTiles = (ssize_t) (tileDim + 1) * tileDim / 2;
+	ssize_t totalNumPairs = 0;
+
+#ifdef VERBOSE
+	fprintf(stderr, "execute function %s\n", __FUNCTION__);
+#endif
+
+	/*record system time*/
+	stime = getSysTime();
+
+	/*allocate space*/
+	_mutualInfo = (FloatType*) mm_malloc(
+			(ssize_t) _numVectors * _numVectors * sizeof(FloatType), 64);
+	if (!_mutualInfo) {
+		fprintf(stderr, "Memory allocation failed\n");
+		exit(-1);
+	}
+
+	/*enter the core computation*/
+	if (_numCPUThreads < 1) {
+		_numCPUThreads = omp_get_num_procs();
+	}
+	omp_set_num_threads(_numCPUThreads);
+
+	/*dynamic tile scheduler*/
+	TileScheduler scheduler(numTiles, _numCPUThreads);
+
+	/*job-array shard: a balanced slice of the tile space*/
+	ssize_t firstTile, lastTile;
+	TileScheduler::getShardRange(numTiles, _shard, _numShards, firstTile, lastTile);
+	scheduler.setRange(firstTile, lastTile);
+
+	/*persisted results of the shard*/
+	ResultWriter<FloatType>* writer = NULL;
+	if (_resultOptions.enabled()) {
+		writer = new ResultWriter<FloatType>(_resultOptions, "miksg", _shard,
+				_numShards, _numVectors, _vectorSize, MI_KSG_TILE_DIM,
+				_numCPUThreads);
+	}
+
+	/*sort the vectors*/
+	double t1 = getSysTime();
+	SortedVectors<FloatType> sorted(_numVectors, _vectorSize);
+	_sortVectors(sorted, _vectors, _numVectors, _numCPUThreads);
+	_initDigammaTable();
+	fprintf(stderr, "time for sorting: %f seconds\n", getSysTime() - t1);
+
+	/*entering the core loop*/
+#pragma omp parallel reduction(+:totalNumPairs)
+	{
+		ssize_t tileStart, tileEnd;
+		int rowStart, rowEnd, colStart, colEnd;
+		ssize_t numPairsProcessed = 0;
+		const int tid = omp_get_thread_num();
+		KNNGrid<FloatType> grid(_vectorSize, _numNeighbors);
+
+		/*per-thread tile buffer*/
+		FloatType* __restrict__ tile = (FloatType*) mm_malloc(
+				MI_KSG_TILE_DIM * MI_KSG_TILE_DIM * sizeof(FloatType), 64);
+		if (!tile) {
+			fprintf(stderr, "Memory allocation failed\n");
+			exit(-1);
+		}
+
+		/*dynamic distribution of tiles over threads*/
+		scheduler.threadStart(tid);
+		while (scheduler.nextChunk(tid, tileStart, tileEnd)) {
+			/*one coordinate lookup per chunk, then step through the tiles*/
+			TriangularIterator tiles(tileDim, tileStart);
+			for (ssize_t t = tileStart; t < tileEnd; ++t, tiles.next()) {
+				rowStart = tiles.row() * MI_KSG_TILE_DIM;
+				rowEnd = min(_numVectors, rowStart + MI_KSG_TILE_DIM);
+				colStart = tiles.col() * MI_KSG_TILE_DIM;
+				colEnd = min(_numVectors, colStart + MI_KSG_TILE_DIM);
+
+				/*pairs of the tile from the shared sorted values*/
+				_computeTile(grid, sorted, 0, rowStart, rowEnd, sorted, 0, colStart, colEnd,
+						tile, MI_KSG_TILE_DIM);
+				if (writer) {
+					writer->addTile(t, rowStart, rowEnd, colStart, colEnd, tile,
+							MI_KSG_TILE_DIM, NULL, 0, tid);
+				}
+				for (int row = rowStart; row < rowEnd; ++row) {
+					for (int col = max(row, colStart); col < colEnd; ++col) {
+						/*statistics*/
+						++numPairsProcessed;
+
+						FloatType mi = tile[(row - rowStart) * MI_KSG_TILE_DIM + col - colStart];
+						_mutualInfo[(ssize_t)row * _numVectors + col] = mi;
+						_mutualInfo[(ssize_t)col * _numVectors + row] = mi;
+					}
+				}
+			}
+		}
+		scheduler.threadFinish(tid);
+		mm_free(tile);
+
+		/*reduction*/
+		totalNumPairs += numPairsProcessed;
+	} /*#pragma omp parallel*/
+
+	if (writer) {
+		writer->close();
+		delete writer;
+	}
+
+	/*recored the system time*/
+	etime = getSysTime();
+	fprintf(stderr, "Overall time (%ld pairs): %f seconds\n", totalNumPairs,
+			etime - stime);
+
+	/*report load balance*/
+#ifdef VERBOSE
+	scheduler.report(stderr, true);
+#else
+	scheduler.report(stderr, false);
+#endif
+}
+
+#ifdef WITH_MPI
+template<typename FloatType>
+FloatType* MIKSG<FloatType>::getInputRows(int& rowStart, int& rowEnd) {
+	/*the own block of the ring*/
+	if (_ringBlock) {
+		rowStart = _rowStart;
+		rowEnd = _rowEnd;
+		return _vectors;
+	}
+
+	/*the own rows are read straight into the node-local shared copy*/
+	if (!_sharedVectors) {
+		_sharedVectors = new NodeSharedMatrix<FloatType>(MPI_COMM_WORLD,
+				_numVectors, _vectorSizeAligned);
+		mm_free(_vectors);
+		_vectors = _sharedVectors->getVectors();
+	}
+	_sharedVectors->getRowRange(rowStart, rowEnd);
+	return _vectors + (ssize_t) rowStart * _vectorSizeAligned;
+}
+
+template<typename FloatType>
+void MIKSG<FloatType>::runMPICPU() {
+	double stime, etime;
+	const int tileDim = (_numVectors + MI_KSG_MPI_TILE_DIM - 1) / MI_KSG_MPI_TILE_DIM;
+	const ssize_t numTiles = (ssize_t)(tileDim + 1) * tileDim / 2;
+	ssize_t numPairsProcessed = 0, totalNumPairs;
+
+#ifdef VERBOSE
+	if(_rank == 0){
+		fprintf(stderr, "execute function %s\n", __FUNCTION__);
+	}
+#endif
+
+	/*record the system time*/
+	MPI_Barrier(MPI_COMM_WORLD);
+	stime = getSysTime();
+
+	int row;
+	int loRowRange, hiRowRange;
+	int rowStart, rowEnd, colStart, colEnd;
+	ssize_t offset = 0;
+	FloatType* __restrict__ vecX;
+
+	/*allocate buffer*/
+	ssize_t chunkSize = (numTiles + _numProcs - 1) / _numProcs;
+	ssize_t capacity = chunkSize * MI_KSG_MPI_TILE_SIZE;
+	_mutualInfo = (FloatType*)mm_malloc(capacity * sizeof(FloatType), 64);
+	if(!_mutualInfo) {
+		fprintf(stderr, "Memory allocation failed\n");
+		exit(-1);
+	}
+
+	/*share the input per node*/
+	if (!_sharedVectors) {
+		_sharedVectors = new NodeSharedMatrix<FloatType>(MPI_COMM_WORLD,
+				_numVectors, _vectorSizeAligned);
+	}
+	/*rows of the processes of a node are contiguous*/
+	_sharedVectors->getRowRange(loRowRange, hiRowRange);
+	/*publish the own rows into the node-local shared copy and gather the rows of the other nodes.
+	 *the private copy is released*/
+	vecX = _sharedVectors->gather(_vectors);
+	if (vecX != _vectors) {
+		mm_free(_vectors);
+		_vectors = vecX;
+	}
+	MPI_Barrier(MPI_COMM_WORLD);
+
+	/*sorted values of all vectors, one copy per node next to the shared vectors. The
+	 *processes of the node sort one slice each*/
+	NodeSharedWindow sortedWindow(_sharedVectors->getNodeComm(),
+			SortedVectors<FloatType>::getStorageSize(_numVectors, _vectorSize));
+	SortedVectors<FloatType> sorted(_numVectors, _vectorSize, sortedWindow.getBase());
+	const int nodeChunkSize = (_numVectors + _sharedVectors->getNodeSize() - 1)
+			/ _sharedVectors->getNodeSize();
+	loRowRange = min(_numVectors, _sharedVectors->getNodeRank() * nodeChunkSize);
+	hiRowRange = min(_numVectors, loRowRange + nodeChunkSize);
+	_sortVectors(sorted, _vectors + (ssize_t) loRowRange * _vectorSizeAligned,
+			hiRowRange - loRowRange, _numCPUThreads, loRowRange);
+	sortedWindow.sync();
+	_initDigammaTable();
+	KNNGrid<FloatType> grid(_vectorSize, _numNeighbors);
+
+	/*dynamic distribution of the tiles*/
+	MPITileScheduler scheduler(numTiles, MPI_COMM_WORLD);
+	ssize_t chunkStart, chunkEnd, tileIndex;
+	int tileRow, tileCol;
+
+	/*persisted results*/
+	ResultWriter<FloatType>* writer = NULL;
+	if (_resultOptions.enabled()) {
+		writer = new ResultWriter<FloatType>(_resultOptions, "miksg", _rank,
+				_numProcs, _numVectors, _vectorSize, MI_KSG_MPI_TILE_DIM);
+	}
+	while (scheduler.nextChunk(chunkStart, chunkEnd)) {
+		/*the buffer holds all tiles computed by this process*/
+		_mutualInfo = MPITileScheduler::reserve(_mutualInfo, offset, capacity,
+				offset + (chunkEnd - chunkStart) * MI_KSG_MPI_TILE_SIZE);
+		getTileCoordinate(chunkStart, tileDim, tileRow, tileCol);
+		for (tileIndex = chunkStart; tileIndex < chunkEnd; ++tileIndex) {
+			rowStart = tileRow * MI_KSG_MPI_TILE_DIM;
+			rowEnd = min(_numVectors, rowStart + MI_KSG_MPI_TILE_DIM);
+			colStart = tileCol * MI_KSG_MPI_TILE_DIM;
+			colEnd = min(_numVectors, colStart + MI_KSG_MPI_TILE_DIM);
+
+			/*pairs of the tile from the shared sorted values*/
+			_computeTile(grid, sorted, 0, rowStart, rowEnd, sorted, 0, colStart, colEnd,
+					_mutualInfo + offset, MI_KSG_MPI_TILE_DIM);
+			for (row = rowStart; row < rowEnd; ++row) {
+				numPairsProcessed += colEnd - max(row, colStart);
+			}
+			if (writer) {
+				writer->addTile(tileIndex, rowStart, rowEnd, colStart, colEnd,
+						_mutualInfo + offset, MI_KSG_MPI_TILE_DIM);
+			}
+
+			/*move to the next tile*/
+			offset += MI_KSG_MPI_TILE_SIZE;
+			if (++tileCol == tileDim) {
+				tileRow++;
+				tileCol = tileRow;
+			}
+		}
+	}
+	scheduler.finish();
+
+	if (writer) {
+		writer->close();
+		delete writer;
+	}
+
+	/*compute the total number of edges*/
+	MPI_Reduce(&numPairsProcessed, &totalNumPairs, 1, MPI_INT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+
+	/*recored the system time*/
+	etime = getSysTime();
+	if (_rank == 0) {
+		fprintf(stderr, "Overall time (%ld pairs): %f seconds\n", totalNumPairs, etime - stime);
+	}
+	scheduler.report();
+}
+
+/*systolic ring: each process owns one block of vectors and pairs it with the blocks passing through.
+ *The sorted values of the visiting block are built on arrival*/
+template<typename FloatType>
+void MIKSG<FloatType>::runMPICPURing() {
+	double stime, etime, waitTime, maxWaitTime;
+	const int tileDim = (_numVectors + MI_KSG_MPI_TILE_DIM - 1) / MI_KSG_MPI_TILE_DIM;
+	const int blockSize = MPIRing<FloatType>::getBlockSize(_numVectors, _numProcs, MI_KSG_MPI_TILE_DIM);
+	ssize_t numPairsProcessed = 0, totalNumPairs;
+
+#ifdef VERBOSE
+	if(_rank == 0) fprintf(stderr, "execute function %s\n", __FUNCTION__);
+#endif
+
+	/*record the system time*/
+	MPI_Barrier(MPI_COMM_WORLD);
+	stime = getSysTime();
+
+	int row;
+	int loRowRange, hiRowRange;
+	int rowStart, rowEnd, colStart, colEnd;
+
+	MPIRing<FloatType>::getBlockRange(_numVectors, blockSize, _rank, loRowRange, hiRowRange);
+
+	/*the own block is copied into the ring, which holds all vectors used from here on*/
+	MPIRing<FloatType> ring(MPI_COMM_WORLD, _vectors + (ssize_t) (loRowRange - _rowStart) * _vectorSizeAligned,
+			_numVectors, _vectorSizeAligned, blockSize);
+	RingBlock<FloatType> rows, cols;
+	mm_free(_vectors);
+	_vectors = NULL;
+
+	/*sorted values of the own block and of the visiting one*/
+	SortedVectors<FloatType> rowSorted(blockSize, _vectorSize);
+	SortedVectors<FloatType> colSorted(blockSize, _vectorSize);
+	int rowSortedStart = -1;
+	_initDigammaTable();
+	KNNGrid<FloatType> grid(_vectorSize, _numNeighbors);
+
+	/*tile buffer*/
+	FloatType* __restrict__ tile = (FloatType*) mm_malloc(MI_KSG_MPI_TILE_SIZE * sizeof(FloatType), 64);
+	if (!tile) {
+		fprintf(stderr, "Memory allocation failed\n");
+		exit(-1);
+	}
+
+	/*persisted results*/
+	ResultWriter<FloatType>* writer = NULL;
+	if (_resultOptions.enabled()) {
+		writer = new ResultWriter<FloatType>(_resultOptions, "miksg", _rank,
+				_numProcs, _numVectors, _vectorSize, MI_KSG_MPI_TILE_DIM);
+	}
+
+	while (ring.next(rows, cols)) {
+		if (rows._start != rowSortedStart) {
+			_sortVectors(rowSorted, rows._vectors, rows._end - rows._start, _numCPUThreads);
+			rowSortedStart = rows._start;
+		}
+		const bool diagonal = rows._start == cols._start;
+		if (!diagonal) {
+			_sortVectors(colSorted, cols._vectors, cols._end - cols._start, _numCPUThreads);
+		}
+		const SortedVectors<FloatType>& sorted = diagonal ? rowSorted : colSorted;
+
+		/*blocks start at tile boundaries, so each tile of the block pair is a global tile*/
+		for (rowStart = rows._start; rowStart < rows._end; rowStart += MI_KSG_MPI_TILE_DIM) {
+			rowEnd = min(rows._end, rowStart + MI_KSG_MPI_TILE_DIM);
+			colStart = diagonal ? rowStart : cols._start;
+			for (; colStart < cols._end; colStart += MI_KSG_MPI_TILE_DIM) {
+				colEnd = min(cols._end, colStart + MI_KSG_MPI_TILE_DIM);
+
+				/*pairs of the tile from the sorted values of the two blocks*/
+				_computeTile(grid, rowSorted, rows._start, rowStart, rowEnd, sorted, cols._start,
+						colStart, colEnd, tile, MI_KSG_MPI_TILE_DIM);
+				for (row = rowStart; row < rowEnd; ++row) {
+					numPairsProcessed += max(0, colEnd - max(row, colStart));
+				}
+
+				if (writer) {
+					writer->addTile(getTileGlobalIndex(tileDim, rowStart / MI_KSG_MPI_TILE_DIM, colStart / MI_KSG_MPI_TILE_DIM),
+							rowStart, rowEnd, colStart, colEnd, tile, MI_KSG_MPI_TILE_DIM);
+				}
+			}
+		}
+	}
+	mm_free(tile);
+
+	if (writer) {
+		writer->close();
+		delete writer;
+	}
+
+	/*compute the total number of edges*/
+	MPI_Reduce(&numPairsProcessed, &totalNumPairs, 1, MPI_INT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+	waitTime = ring.getWaitTime();
+	MPI_Reduce(&waitTime, &maxWaitTime, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+	/*recored the system time*/
+	etime = getSysTime();
+	if (_rank == 0) {
+		fprintf(stderr, "Overall time (%ld pairs): %f seconds\n", totalNumPairs, etime - stime);
+		fprintf(stderr, "Ring communication wait (maximum over processes): %f seconds\n", maxWaitTime);
+	}
+}
+#endif	/*with mpi*/
+
+#endif /* MI_KSG_HPP_ */
@@ -0,0 +1,196 @@
+/*
+ * MPIRing.hpp
+ *
+ *  Systolic ring distribution of the vectors for the MPI engines. Instead of
+ *  replicating the whole matrix on every process with MPI_Allgatherv, process
+ *  r owns only block r (blockSize consecutive vectors). Blocks travel around
+ *  the ring, one neighbor per step, and each process pairs its own block with
+ *  the visiting one. The symmetry of the correlation matrix means that
+ *  numProcs / 2 + 1 steps cover all block pairs. The transfer of the next
+ *  block is posted with non-blocking calls before the current block pair is
+ *  computed, so communication overlaps computation.
+ *
+ *  Memory per process is three blocks: the own block and two ring buffers.
+ *  The engines load only their own block (getBlockRange) and release it once
+ *  it is copied into the ring.
+ */
+
+#ifndef __MPI_RING_HPP
+#define __MPI_RING_HPP
+#ifdef WITH_MPI
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <typeinfo>
+#include <mpi.h>
+#include <mm_malloc.h>
+
+/*a block of consecutive vectors [_start, _end). Vector i is at _vectors + (i - _start) * vectorSizeAligned*/
+template<typename FloatType>
+struct RingBlock
+{
+	FloatType* _vectors;
+	int _start;
+	int _end;
+};
+
+template<typename FloatType>
+class MPIRing
+{
+public:
+	/*number of vectors per block, rounded up to a multiple of tileDim so that block pairs consist of whole tiles*/
+	static int getBlockSize(const int numVectors, const int numProcs,
+			const int tileDim) {
+		int blockSize = (numVectors + numProcs - 1) / numProcs;
+		return (blockSize + tileDim - 1) / tileDim * tileDim;
+	}
+	/*vectors [start, end) of the block of owner*/
+	static void getBlockRange(const int numVectors, const int blockSize,
+			const int owner, int& start, int& end) {
+		start = (ssize_t) owner * blockSize < numVectors ? owner * blockSize : numVectors;
+		end = (ssize_t) (owner + 1) * blockSize < numVectors ? (owner + 1) * blockSize : numVectors;
+	}
+
+	/*collective over comm. local holds the vectors owned by this process, i.e. [rank * blockSize, (rank + 1) * blockSize)*/
+	MPIRing(MPI_Comm comm, const FloatType* local, const int numVectors,
+			const int vectorSizeAligned, const int blockSize) {
+		_comm = comm;
+		MPI_Comm_rank(_comm, &_rank);
+		MPI_Comm_size(_comm, &_numProcs);
+		_numVectors = numVectors;
+		_vectorSizeAligned = vectorSizeAligned;
+		_blockSize = blockSize;
+		_blockElements = (ssize_t) blockSize * vectorSizeAligned;
+		_numSteps = _numProcs / 2 + 1;
+		_step = -1;
+		_current = 0;
+		_numRequests = 0;
+		_waitTime = 0;
+		if (typeid(FloatType) == typeid(float)) {
+			_datatype = MPI_FLOAT;
+		} else {
+			_datatype = MPI_DOUBLE;
+		}
+		if (_blockElements > 0x7fffffff) {
+			fprintf(stderr, "The block of %d vectors is too large for a single message\n", blockSize);
+			exit(-1);
+		}
+
+		/*own block, padded with zeros*/
+		_own = (FloatType*) _mm_malloc(3 * _blockElements * sizeof(FloatType), 64);
+		if (!_own) {
+			fprintf(stderr, "Memory allocation failed\n");
+			exit(-1);
+		}
+		_buffers[0] = _own + _blockElements;
+		_buffers[1] = _buffers[0] + _blockElements;
+		memset(_own, 0, _blockElements * sizeof(FloatType));
+		if (blockStart(_rank) < blockEnd(_rank)) {
+			memcpy(_own, local, (ssize_t) (blockEnd(_rank) - blockStart(_rank))
+					* vectorSizeAligned * sizeof(FloatType));
+		}
+	}
+	~MPIRing() {
+		_waitAll();
+		_mm_free(_own);
+	}
+
+	inline int blockStart(const int owner) const {
+		int start, end;
+		getBlockRange(_numVectors, _blockSize, owner, start, end);
+		return start;
+	}
+	inline int blockEnd(const int owner) const {
+		int start, end;
+		getBlockRange(_numVectors, _blockSize, owner, start, end);
+		return end;
+	}
+
+	/*advance to the next pair of blocks. rows._start <= cols._start.
+	 *when rows and cols are the same block, only pairs with row <= col are wanted.
+	 *return false when all steps are done*/
+	bool next(RingBlock<FloatType>& rows, RingBlock<FloatType>& cols) {
+		FloatType* visiting;
+		int owner;
+
+		while (++_step < _numSteps) {
+			/*the block for this step has arrived*/
+			_waitAll();
+			visiting = _step == 0 ? _own : _buffers[_current];
+
+			/*pass the visiting block to the left and receive the next one from the right*/
+			if (_step + 1 < _numSteps) {
+				MPI_Irecv(_buffers[_current ^ 1], _blockElements, _datatype,
+						(_rank + 1) % _numProcs, _step, _comm, _requests + _numRequests++);
+				MPI_Isend(visiting, _blockElements, _datatype,
+						(_rank + _numProcs - 1) % _numProcs, _step, _comm,
+						_requests + _numRequests++);
+				_current ^= 1;
+			}
+
+			/*with an even number of processes, the block pairs of the last step are seen twice*/
+			owner = (_rank + _step) % _numProcs;
+			if (_step > 0 && 2 * _step == _numProcs && _rank >= _numProcs / 2) {
+				continue;
+			}
+			if (blockStart(owner) >= blockEnd(owner)
+					|| blockStart(_rank) >= blockEnd(_rank)) {
+				continue;
+			}
+
+			if (owner >= _rank) {
+				_setBlock(rows, _own, _rank);
+				_setBlock(cols, visiting, owner);
+			} else {
+				_setBlock(rows, visiting, owner);
+				_setBlock(cols, _own, _rank);
+			}
+			return true;
+		}
+		_waitAll();
+		return false;
+	}
+
+	/*time spent waiting for blocks that have not arrived yet*/
+	inline double getWaitTime() const {
+		return _waitTime;
+	}
+
+private:
+	MPI_Comm _comm;
+	MPI_Datatype _datatype;
+	int _rank;
+	int _numProcs;
+	int _numVectors;
+	int _vectorSizeAligned;
+	int _blockSize;
+	ssize_t _blockElements;
+	int _numSteps;
+	int _step;
+	int _current;
+	FloatType* _own;
+	FloatType* _buffers[2];
+	MPI_Request _requests[2];
+	int _numRequests;
+	double _waitTime;
+
+	inline void _setBlock(RingBlock<FloatType>& block, FloatType* vectors,
+			const int owner) {
+		block._vectors = vectors;
+		block._start = blockStart(owner);
+		block._end = blockEnd(owner);
+	}
+	inline void _waitAll() {
+		if (_numRequests > 0) {
+			double stime = MPI_Wtime();
+			MPI_Waitall(_numRequests, _requests, MPI_STATUSES_IGNORE);
+			_waitTime += MPI_Wtime() - stime;
+			_numRequests = 0;
+		}
+	}
+};
+
+#endif	/*WITH_MPI*/
+#endif	/*__MPI_RING_HPP*/
@@ -0,0 +1,211 @@
+/*
+ * MPITileScheduler.hpp
+ *
+ *  Dynamic distribution of the triangular tile space over MPI processes.
+ *  The tile space is cut into chunks of decreasing size (guided schedule),
+ *  computed identically on every process, and processes claim chunks in order
+ *  from a global chunk counter hosted on MPITS_ROOT through one-sided atomics
+ *  (MPI_Fetch_and_op). The next chunk is prefetched while the current one is
+ *  computed, so the latency of the atomic is hidden. Faster processes simply
+ *  claim more chunks, and the run finishes at the speed of the aggregate.
+ */
+
+#ifndef __MPI_TILE_SCHEDULER_HPP
+#define __MPI_TILE_SCHEDULER_HPP
+#ifdef WITH_MPI
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <vector>
+#include <mpi.h>
+#include <mm_malloc.h>
+
+/*process hosting the chunk counter*/
+#define MPITS_ROOT					0
+
+/*each chunk is 1/(MPITS_GUIDED_FACTOR * numProcs) of the remaining tiles*/
+#define MPITS_GUIDED_FACTOR	4
+
+class MPITileScheduler
+{
+public:
+	/*collective over comm*/
+	MPITileScheduler(const ssize_t numTiles, MPI_Comm comm,
+			const ssize_t minChunk = 1) {
+		ssize_t curr, chunk;
+
+		_comm = comm;
+		MPI_Comm_rank(_comm, &_rank);
+		MPI_Comm_size(_comm, &_numProcs);
+		_numTiles = numTiles;
+		_minChunk = minChunk > 0 ? minChunk : 1;
+
+		/*the chunk boundaries of the guided schedule*/
+		for (curr = 0; curr < _numTiles; curr += chunk) {
+			_chunkStarts.push_back(curr);
+			chunk = (_numTiles - curr) / (MPITS_GUIDED_FACTOR * _numProcs);
+			if (chunk < _minChunk) {
+				chunk = _minChunk;
+			}
+		}
+		_chunkStarts.push_back(_numTiles);
+		_numChunks = _chunkStarts.size() - 1;
+
+		/*the chunk counter*/
+		MPI_Win_allocate(_rank == MPITS_ROOT ? sizeof(int64_t) : 0, sizeof(int64_t),
+				MPI_INFO_NULL, _comm, &_counter, &_win);
+		if (_rank == MPITS_ROOT) {
+			MPI_Win_lock(MPI_LOCK_EXCLUSIVE, MPITS_ROOT, 0, _win);
+			*_counter = 0;
+			MPI_Win_unlock(MPITS_ROOT, _win);
+		}
+		MPI_Barrier(_comm);
+		MPI_Win_lock_all(0, _win);
+
+		_one = 1;
+		_pending = false;
+		_finished = false;
+		_numLocalTiles = 0;
+		_numLocalChunks = 0;
+		_startTime = MPI_Wtime();
+		_finishTime = _startTime;
+	}
+	~MPITileScheduler() {
+		finish();
+		MPI_Win_free(&_win);
+	}
+
+	/*get the next chunk of tiles [start, end). Return false if no work left*/
+	bool nextChunk(ssize_t& start, ssize_t& end) {
+		int64_t chunk;
+
+		if (_finished) {
+			return false;
+		}
+		if (!_pending) {
+			_fetch();
+		}
+		MPI_Win_flush(MPITS_ROOT, _win);
+		_pending = false;
+		chunk = _fetched;
+		if (chunk >= _numChunks) {
+			return false;
+		}
+
+		/*prefetch the next chunk while this one is being computed*/
+		_fetch();
+
+		start = _chunkStarts[chunk];
+		end = _chunkStarts[chunk + 1];
+		_numLocalTiles += end - start;
+		_numLocalChunks++;
+		return true;
+	}
+
+	/*called after the last chunk has been processed*/
+	void finish() {
+		if (_finished) {
+			return;
+		}
+		_finished = true;
+		if (_pending) {
+			MPI_Win_flush(MPITS_ROOT, _win);
+			_pending = false;
+		}
+		MPI_Win_unlock_all(_win);
+		_finishTime = MPI_Wtime();
+	}
+
+	/*collective: report per-process tiles, busy time and idle time on process 0.
+	 *idle time is measured against the latest finishing process*/
+	void report(FILE* file = stderr) {
+		double local[3], *all = NULL;
+		double maxBusyTime = 0, busyTime = 0, maxIdleTime = 0, idleTime;
+
+		finish();
+		local[0] = _numLocalTiles;
+		local[1] = _numLocalChunks;
+		local[2] = _finishTime - _startTime;
+		if (_rank == 0) {
+			all = new double[3 * _numProcs];
+		}
+		MPI_Gather(local, 3, MPI_DOUBLE, all, 3, MPI_DOUBLE, 0, _comm);
+		if (_rank != 0) {
+			return;
+		}
+
+		for (int i = 0; i < _numProcs; ++i) {
+			if (all[3 * i + 2] > maxBusyTime) {
+				maxBusyTime = all[3 * i + 2];
+			}
+			busyTime += all[3 * i + 2];
+		}
+		for (int i = 0; i < _numProcs; ++i) {
+			idleTime = maxBusyTime - all[3 * i + 2];
+			if (idleTime > maxIdleTime) {
+				maxIdleTime = idleTime;
+			}
+			fprintf(file, "process %d: %ld tiles in %ld chunks, busy %f seconds, idle %f seconds\n",
+					i, (long) all[3 * i], (long) all[3 * i + 1], all[3 * i + 2], idleTime);
+		}
+		if (maxBusyTime > 0) {
+			fprintf(file, "MPI tile scheduler (%d processes, %ld chunks): average idle %.2f%%, maximum idle %.2f%%\n",
+					_numProcs, (long) _numChunks,
+					100.0 * (1.0 - busyTime / (_numProcs * maxBusyTime)),
+					100.0 * maxIdleTime / maxBusyTime);
+		}
+		delete[] all;
+	}
+
+	/*grow a per-process tile buffer holding size elements to at least required elements*/
+	template<typename T>
+	static T* reserve(T* buffer, const ssize_t size, ssize_t& capacity,
+			const ssize_t required) {
+		if (required <= capacity) {
+			return buffer;
+		}
+		capacity = required > 2 * capacity ? required : 2 * capacity;
+		T* newBuffer = (T*) _mm_malloc(capacity * sizeof(T), 64);
+		if (!newBuffer) {
+			fprintf(stderr, "Memory allocation failed\n");
+			exit(-1);
+		}
+		if (buffer) {
+			memcpy(newBuffer, buffer, size * sizeof(T));
+			_mm_free(buffer);
+		}
+		return newBuffer;
+	}
+
+private:
+	MPI_Comm _comm;
+	MPI_Win _win;
+	int64_t* _counter;
+	int64_t _one;
+	int64_t _fetched;
+	bool _pending;
+	bool _finished;
+	int _rank;
+	int _numProcs;
+	ssize_t _numTiles;
+	ssize_t _minChunk;
+	int64_t _numChunks;
+	std::vector<ssize_t> _chunkStarts;
+
+	/*statistics*/
+	ssize_t _numLocalTiles;
+	ssize_t _numLocalChunks;
+	double _startTime;
+	double _finishTime;
+
+	/*claim a chunk index. Completed by the next MPI_Win_flush*/
+	inline void _fetch() {
+		MPI_Fetch_and_op(&_one, &_fetched, MPI_INT64_T, MPITS_ROOT, 0, MPI_SUM, _win);
+		_pending = true;
+	}
+};
+
+#endif	/*WITH_MPI*/
+#endif	/*__MPI_TILE_SCHEDULER_HPP*/
@@ -0,0 +1,227 @@
+/*
+ * NodeSharedMatrix.hpp
+ *
+ *  Node-local shared copy of the replicated input matrix for the MPI engines.
+ *  The processes of a node (MPI_Comm_split_type with MPI_COMM_TYPE_SHARED)
+ *  share one MPI-3 shared-memory window holding all vectors, instead of each
+ *  keeping a private copy. Rows are assigned so that the processes of a node
+ *  own one contiguous range: each process writes its preprocessed rows into
+ *  the window directly, and only the node leaders exchange data, one
+ *  MPI_Allgatherv among nodes.
+ *
+ *  Pages of the window are first touched by all processes of the node, each
+ *  one a contiguous slice, so that the matrix is spread over the NUMA domains
+ *  of the node instead of sitting on the memory of the leader.
+ *
+ *  NodeSharedWindow is the window itself, for other per-node data derived
+ *  from the matrix, e.g. the bitplanes of MIBinned.
+ */
+
+#ifndef __NODE_SHARED_MATRIX_HPP
+#define __NODE_SHARED_MATRIX_HPP
+#ifdef WITH_MPI
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <typeinfo>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <mpi.h>
+
+/*one buffer shared by the processes of a node, allocated by the node leader*/
+class NodeSharedWindow
+{
+public:
+	/*collective over nodeComm*/
+	NodeSharedWindow(MPI_Comm nodeComm, const ssize_t size) {
+		MPI_Aint windowSize;
+		int dispUnit, nodeRank, nodeSize;
+
+		_nodeComm = nodeComm;
+		MPI_Comm_rank(_nodeComm, &nodeRank);
+		MPI_Comm_size(_nodeComm, &nodeSize);
+		MPI_Win_allocate_shared(nodeRank == 0 ? size : 0, 1, MPI_INFO_NULL,
+				_nodeComm, &_base, &_win);
+		MPI_Win_shared_query(_win, 0, &windowSize, &dispUnit, &_base);
+		/*stores of the other processes become visible through MPI_Win_sync and a barrier*/
+		MPI_Win_lock_all(MPI_MODE_NOCHECK, _win);
+
+		/*NUMA-aware first touch: each process of the node touches one slice*/
+		ssize_t slice = (size + nodeSize - 1) / nodeSize;
+		ssize_t start = std::min(size, nodeRank * slice);
+		ssize_t end = std::min(size, start + slice);
+		if (start < end) {
+			memset(_base + start, 0, end - start);
+		}
+		sync();
+	}
+	~NodeSharedWindow() {
+		MPI_Win_unlock_all(_win);
+		MPI_Win_free(&_win);
+	}
+
+	inline char* getBase() {
+		return _base;
+	}
+
+	/*collective over the node: make the stores of all processes of the node visible*/
+	inline void sync() {
+		MPI_Win_sync(_win);
+		MPI_Barrier(_nodeComm);
+		MPI_Win_sync(_win);
+	}
+
+private:
+	MPI_Comm _nodeComm;
+	MPI_Win _win;
+	char* _base;
+};
+
+template<typename FloatType>
+class NodeSharedMatrix
+{
+public:
+	/*collective over comm*/
+	NodeSharedMatrix(MPI_Comm comm, const int numVectors,
+			const int vectorSizeAligned) {
+		int nodeIndex, numNodes;
+
+		_comm = comm;
+		MPI_Comm_rank(_comm, &_rank);
+		MPI_Comm_size(_comm, &_numProcs);
+		_numVectors = numVectors;
+		_vectorSizeAligned = vectorSizeAligned;
+		_datatype = typeid(FloatType) == typeid(float) ? MPI_FLOAT : MPI_DOUBLE;
+
+		/*processes sharing memory, and one leader per node*/
+		MPI_Comm_split_type(_comm, MPI_COMM_TYPE_SHARED, _rank, MPI_INFO_NULL,
+				&_nodeComm);
+		MPI_Comm_rank(_nodeComm, &_nodeRank);
+		MPI_Comm_size(_nodeComm, &_nodeSize);
+		MPI_Comm_split(_comm, _nodeRank == 0 ? 0 : MPI_UNDEFINED, _rank,
+				&_leaderComm);
+		if (_nodeRank == 0) {
+			MPI_Comm_rank(_leaderComm, &nodeIndex);
+			MPI_Comm_size(_leaderComm, &numNodes);
+		}
+		MPI_Bcast(&nodeIndex, 1, MPI_INT, 0, _nodeComm);
+		MPI_Bcast(&numNodes, 1, MPI_INT, 0, _nodeComm);
+
+		/*order the processes by (node, rank within the node) so that the rows of a node are contiguous*/
+		int local[2] = { nodeIndex, _nodeRank };
+		std::vector<int> all(2 * _numProcs);
+		MPI_Allgather(local, 2, MPI_INT, &all[0], 2, MPI_INT, _comm);
+		std::vector<std::pair<std::pair<int, int>, int> > order(_numProcs);
+		for (int i = 0; i < _numProcs; ++i) {
+			order[i] = std::make_pair(std::make_pair(all[2 * i], all[2 * i + 1]), i);
+		}
+		std::sort(order.begin(), order.end());
+
+		/*row range of each process and of each node*/
+		const int chunkSize = (_numVectors + _numProcs - 1) / _numProcs;
+		_nodeRowStart.assign(numNodes, _numVectors);
+		_nodeRowEnd.assign(numNodes, 0);
+		for (int i = 0; i < _numProcs; ++i) {
+			int node = order[i].first.first;
+			int lo = std::min(_numVectors, i * chunkSize);
+			int hi = std::min(_numVectors, (i + 1) * chunkSize);
+			if (order[i].second == _rank) {
+				_loRow = lo;
+				_hiRow = hi;
+			}
+			_nodeRowStart[node] = std::min(_nodeRowStart[node], lo);
+			_nodeRowEnd[node] = std::max(_nodeRowEnd[node], hi);
+		}
+
+		/*the window: allocated by the leader, shared by the node*/
+		_window = new NodeSharedWindow(_nodeComm,
+				(ssize_t) _numVectors * _vectorSizeAligned * sizeof(FloatType));
+		_base = (FloatType*) _window->getBase();
+	}
+	~NodeSharedMatrix() {
+		delete _window;
+		if (_leaderComm != MPI_COMM_NULL) {
+			MPI_Comm_free(&_leaderComm);
+		}
+		MPI_Comm_free(&_nodeComm);
+	}
+
+	/*rows [lo, hi) preprocessed by this process*/
+	inline void getRowRange(int& lo, int& hi) const {
+		lo = _loRow;
+		hi = _hiRow;
+	}
+	inline FloatType* getVectors() {
+		return _base;
+	}
+	inline int getNodeSize() const {
+		return _nodeSize;
+	}
+	inline int getNodeRank() const {
+		return _nodeRank;
+	}
+	/*processes of the node sharing the window*/
+	inline MPI_Comm getNodeComm() const {
+		return _nodeComm;
+	}
+
+	/*collective: publish the own rows of vectors and fill in the rows of the other nodes. Return the shared copy*/
+	FloatType* gather(const FloatType* vectors) {
+		/*own rows go straight into the window*/
+		if (vectors != _base && _loRow < _hiRow) {
+			memcpy(_base + (ssize_t) _loRow * _vectorSizeAligned,
+					vectors + (ssize_t) _loRow * _vectorSizeAligned,
+					(ssize_t) (_hiRow - _loRow) * _vectorSizeAligned * sizeof(FloatType));
+		}
+		_sync();
+
+		/*exchange among nodes. Counts and displacements are in rows, so they do not overflow int*/
+		if (_leaderComm != MPI_COMM_NULL) {
+			int numNodes = _nodeRowStart.size();
+			if (numNodes > 1) {
+				std::vector<int> displs(numNodes), recvCounts(numNodes);
+				MPI_Datatype rowType;
+				MPI_Type_contiguous(_vectorSizeAligned, _datatype, &rowType);
+				MPI_Type_commit(&rowType);
+				for (int i = 0; i < numNodes; ++i) {
+					int rows = std::max(0, _nodeRowEnd[i] - _nodeRowStart[i]);
+					displs[i] = rows > 0 ? _nodeRowStart[i] : 0;
+					recvCounts[i] = rows;
+				}
+				MPI_Allgatherv(MPI_IN_PLACE, 0, rowType, _base, &recvCounts[0],
+						&displs[0], rowType, _leaderComm);
+				MPI_Type_free(&rowType);
+			}
+		}
+		_sync();
+		return _base;
+	}
+
+private:
+	MPI_Comm _comm;
+	MPI_Comm _nodeComm;
+	MPI_Comm _leaderComm;
+	NodeSharedWindow* _window;
+	MPI_Datatype _datatype;
+	FloatType* _base;
+	int _rank;
+	int _numProcs;
+	int _nodeRank;
+	int _nodeSize;
+	int _numVectors;
+	int _vectorSizeAligned;
+	int _loRow;
+	int _hiRow;
+	std::vector<int> _nodeRowStart;
+	std::vector<int> _nodeRowEnd;
+
+	inline void _sync() {
+		_window->sync();
+	}
+};
+
+#endif	/*WITH_MPI*/
+#endif	/*__NODE_SHARED_MATRIX_HPP*/
@@ -0,0 +1,374 @@
+/*
+ * PackedMatrix.hpp
+ *
+ *  Full correlation matrix stored as its packed upper triangle in tile-major
+ *  order, written tile by tile with pwrite and read back through mmap.
+ *
+ *  File layout:
+ *		PackedHeader (PM_HEADER_SIZE bytes)
+ *		tile t of the triangular tile space at PM_HEADER_SIZE + t * tileDim * tileDim * elementSize
+ *  Tiles are row-major with tileDim x tileDim elements, so element (i, j),
+ *  i <= j, is at TriangularIndex::getBlockedOffset(numTileRows, tileDim, i, j).
+ *  Entries below the diagonal of diagonal tiles and beyond the matrix edge hold 0.
+ *
+ *  Encodings:
+ *		PM_FLOAT		32-bit float
+ *		PM_INT16		16-bit quantized, value = offset + q * scale
+ *		PM_INT8			8-bit quantized, value = offset + q * scale
+ *  Quantized values are clamped to [minValue, maxValue] given to the writer.
+ *
+ *  Several processes (MPI ranks or job-array shards) may write their own tiles
+ *  to the same file. Each tile is encoded into a buffer of its own and written
+ *  with one pwrite at its offset, so writers never share a mapped page, which
+ *  network file systems do not keep coherent across nodes. Shard 0 sizes the
+ *  file and writes the header. The other shards only grow a file that is
+ *  still too short, so they never cut tiles already written.
+ */
+
+#ifndef __PACKED_MATRIX_HPP
+#define __PACKED_MATRIX_HPP
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <string>
+#include <vector>
+#include <TriangularIndex.hpp>
+
+#define PM_MAGIC	"PCCPACKD"
+#define PM_VERSION	1
+#define PM_HEADER_SIZE	128
+
+/*element encodings*/
+#define PM_NONE		0
+#define PM_FLOAT	1
+#define PM_INT16	2
+#define PM_INT8		3
+
+struct PackedHeader
+{
+	char _magic[8];				/*PM_MAGIC*/
+	int32_t _version;			/*PM_VERSION*/
+	int32_t _encoding;		/*PM_FLOAT, PM_INT16 or PM_INT8*/
+	int32_t _elementSize;	/*bytes per element*/
+	int32_t _tileDim;			/*number of vectors per tile side*/
+	int64_t _numVectors;	/*matrix dimension*/
+	int64_t _numTiles;		/*number of tiles in the triangular tile space*/
+	int32_t _vectorSize;	/*number of elements per vector*/
+	int32_t _reserved;
+	double _offset;				/*quantized: value = _offset + q * _scale*/
+	double _scale;
+	char _metric[16];			/*name of the correlation measure*/
+	char _padding[PM_HEADER_SIZE - 80];
+
+	inline int64_t getNumTileRows() const {
+		return (_numVectors + _tileDim - 1) / _tileDim;
+	}
+	inline int64_t getTileBytes() const {
+		return (int64_t) _tileDim * _tileDim * _elementSize;
+	}
+	inline int64_t getFileSize() const {
+		return PM_HEADER_SIZE + _numTiles * getTileBytes();
+	}
+	bool isValid() const {
+		return memcmp(_magic, PM_MAGIC, 8) == 0 && _version == PM_VERSION
+				&& _elementSize == getElementSize(_encoding) && _tileDim > 0
+				&& _numVectors >= 0;
+	}
+	static int getElementSize(const int encoding) {
+		switch (encoding) {
+		case PM_FLOAT:
+			return sizeof(float);
+		case PM_INT16:
+			return sizeof(int16_t);
+		case PM_INT8:
+			return sizeof(int8_t);
+		}
+		return 0;
+	}
+	/*largest quantized magnitude*/
+	static int getMaxLevel(const int encoding) {
+		return encoding == PM_INT16 ? 32767 : 127;
+	}
+};
+
+template<typename FloatType>
+class PackedMatrixWriter
+{
+public:
+	/*open fileName, created and sized if needed. The header is written by shard 0.
+	 *numThreads threads may add tiles concurrently*/
+	PackedMatrixWriter(const std::string& fileName, const char* metric,
+			const int shard, const int numVectors, const int vectorSize,
+			const int tileDim, const int encoding, const double minValue = -1,
+			const double maxValue = 1, const int numThreads = 1) {
+		struct stat st;
+
+		_fileName = fileName;
+		memset(&_header, 0, sizeof(PackedHeader));
+		memcpy(_header._magic, PM_MAGIC, 8);
+		_header._version = PM_VERSION;
+		_header._encoding = encoding;
+		_header._elementSize = PackedHeader::getElementSize(encoding);
+		_header._tileDim = tileDim;
+		_header._numVectors = numVectors;
+		_header._numTiles = TriangularIndex::getUpperSize(_header.getNumTileRows());
+		_header._vectorSize = vectorSize;
+		_header._offset = 0;
+		_header._scale = 1;
+		strncpy(_header._metric, metric, sizeof(_header._metric) - 1);
+		if (_header._elementSize == 0) {
+			fprintf(stderr, "Unknown packed matrix encoding %d\n", encoding);
+			exit(-1);
+		}
+		if (encoding != PM_FLOAT) {
+			_header._offset = (minValue + maxValue) / 2;
+			_header._scale = (maxValue - minValue) / (2 * PackedHeader::getMaxLevel(encoding));
+			if (!(_header._scale > 0)) {
+				fprintf(stderr, "Invalid quantization range [%g, %g]\n", minValue, maxValue);
+				exit(-1);
+			}
+		}
+		_minValue = minValue;
+		_maxValue = maxValue;
+		_invScale = 1 / _header._scale;
+
+		/*shard 0 drops the stale tail of an existing file, the others only grow it*/
+		_fd = open(fileName.c_str(), O_WRONLY | O_CREAT, 0644);
+		if (_fd < 0 || fstat(_fd, &st) != 0) {
+			fprintf(stderr, "Failed to open file %s\n", fileName.c_str());
+			exit(-1);
+		}
+		_size = _header.getFileSize();
+		if ((shard == 0 ? st.st_size != _size : st.st_size < _size)
+				&& ftruncate(_fd, _size) != 0) {
+			fprintf(stderr, "Failed to resize file %s to %ld bytes\n", fileName.c_str(),
+					(long) _size);
+			exit(-1);
+		}
+		if (shard == 0) {
+			char header[PM_HEADER_SIZE];
+			memset(header, 0, PM_HEADER_SIZE);
+			memcpy(header, &_header, sizeof(PackedHeader));
+			_write(header, PM_HEADER_SIZE, 0);
+		}
+
+		/*one encoded tile per thread*/
+		_buffers.resize(numThreads > 1 ? numThreads : 1);
+		for (size_t i = 0; i < _buffers.size(); ++i) {
+			_buffers[i].resize(_header.getTileBytes());
+		}
+	}
+	~PackedMatrixWriter() {
+		close();
+	}
+
+	/*add a computed tile. tile[(row - rowStart) * ld + col - colStart] holds the value of (row, col).
+	 *Tiles are disjoint, so concurrent calls with distinct thread indices need no synchronization*/
+	void addTile(const ssize_t tileIndex, const int rowStart, const int rowEnd,
+			const int colStart, const int colEnd, const FloatType* tile,
+			const int ld, const int thread = 0) {
+		const int tileDim = _header._tileDim;
+		char* dst = &_buffers[thread][0];
+
+		for (int r = 0; r < tileDim; ++r) {
+			const int row = rowStart + r;
+			for (int c = 0; c < tileDim; ++c) {
+				const int col = colStart + c;
+				double value = 0;
+				if (row < rowEnd && col < colEnd && row <= col) {
+					value = tile[(ssize_t) r * ld + c];
+				}
+				_store(dst, r * tileDim + c, value);
+			}
+		}
+		_write(dst, _header.getTileBytes(), PM_HEADER_SIZE + tileIndex * _header.getTileBytes());
+	}
+
+	void close() {
+		if (_fd < 0) {
+			return;
+		}
+		if (::close(_fd) != 0) {
+			fprintf(stderr, "Failed to write file %s\n", _fileName.c_str());
+		}
+		_fd = -1;
+		std::vector<std::vector<char> >().swap(_buffers);
+	}
+
+private:
+	std::string _fileName;
+	PackedHeader _header;
+	double _minValue;
+	double _maxValue;
+	double _invScale;
+	int _fd;
+	int64_t _size;
+	std::vector<std::vector<char> > _buffers;	/*encoded tile of each thread*/
+
+	/*write all bytes at offset*/
+	void _write(const char* data, int64_t numBytes, int64_t offset) {
+		while (numBytes > 0) {
+			const ssize_t written = pwrite(_fd, data, numBytes, offset);
+			if (written <= 0) {
+				fprintf(stderr, "Failed to write file %s\n", _fileName.c_str());
+				exit(-1);
+			}
+			data += written;
+			numBytes -= written;
+			offset += written;
+		}
+	}
+
+	inline void _store(char* dst, const ssize_t i, double value) {
+		if (_header._encoding == PM_FLOAT) {
+			((float*) dst)[i] = value;
+			return;
+		}
+		if (value != value) {
+			value = _header._offset;	/*NaN is stored as q = 0*/
+		} else if (value < _minValue) {
+			value = _minValue;
+		} else if (value > _maxValue) {
+			value = _maxValue;
+		}
+		long q = lrint((value - _header._offset) * _invScale);
+		if (_header._encoding == PM_INT16) {
+			((int16_t*) dst)[i] = (int16_t) q;
+		} else {
+			((int8_t*) dst)[i] = (int8_t) q;
+		}
+	}
+};
+
+/*read-only view of a packed matrix file through mmap*/
+class PackedMatrixReader
+{
+public:
+	PackedMatrixReader() {
+		_base = NULL;
+		_size = 0;
+		_fd = -1;
+	}
+	~PackedMatrixReader() {
+		close();
+	}
+
+	bool open(const std::string& fileName) {
+		struct stat st;
+
+		close();
+		_fd = ::open(fileName.c_str(), O_RDONLY);
+		if (_fd < 0) {
+			fprintf(stderr, "Failed to open file %s\n", fileName.c_str());
+			return false;
+		}
+		if (fstat(_fd, &st) != 0 || st.st_size < PM_HEADER_SIZE) {
+			fprintf(stderr, "Invalid packed matrix file %s\n", fileName.c_str());
+			close();
+			return false;
+		}
+		_size = st.st_size;
+		_base = (char*) mmap(NULL, _size, PROT_READ, MAP_SHARED, _fd, 0);
+		if (_base == MAP_FAILED) {
+			fprintf(stderr, "Failed to map file %s\n", fileName.c_str());
+			_base = NULL;
+			close();
+			return false;
+		}
+		memcpy(&_header, _base, sizeof(PackedHeader));
+		if (!_header.isValid() || _header.getFileSize() != _size) {
+			fprintf(stderr, "Invalid packed matrix file %s\n", fileName.c_str());
+			close();
+			return false;
+		}
+		_numTileRows = _header.getNumTileRows();
+		_tileSize = (int64_t) _header._tileDim * _header._tileDim;
+		_data = _base + PM_HEADER_SIZE;
+		return true;
+	}
+	void close() {
+		if (_base) {
+			munmap(_base, _size);
+			_base = NULL;
+		}
+		if (_fd >= 0) {
+			::close(_fd);
+			_fd = -1;
+		}
+	}
+
+	inline const PackedHeader& getHeader() const {
+		return _header;
+	}
+	inline int getNumVectors() const {
+		return (int) _header._numVectors;
+	}
+
+	/*value of (i, j) for any order of i and j*/
+	inline double get(int i, int j) const {
+		if (i > j) {
+			int t = i;
+			i = j;
+			j = t;
+		}
+		return _load(TriangularIndex::getBlockedOffset(_numTileRows,
+				_header._tileDim, i, j));
+	}
+
+	/*row i of the full matrix into row[0 .. numVectors - 1]*/
+	template<typename T>
+	void getRow(const int i, T* row) const {
+		const int tileDim = _header._tileDim;
+		const int numVectors = getNumVectors();
+		const int tileRow = i / tileDim;
+		const int r = i % tileDim;
+		int64_t offset;
+
+		/*j < i: column r of the tiles above the diagonal tile*/
+		for (int tile = 0; tile < tileRow; ++tile) {
+			offset = TriangularIndex::getUpperIndex(_numTileRows, tile, tileRow) * _tileSize + r;
+			for (int j = tile * tileDim; j < (tile + 1) * tileDim; ++j, offset += tileDim) {
+				row[j] = _load(offset);
+			}
+		}
+		/*j >= i: row r of the consecutive tiles of the tile row*/
+		offset = TriangularIndex::getUpperIndex(_numTileRows, tileRow, tileRow) * _tileSize
+				+ (int64_t) r * tileDim;
+		for (int j = tileRow * tileDim; j < numVectors; j += tileDim, offset += _tileSize) {
+			const int end = j + tileDim < numVectors ? j + tileDim : numVectors;
+			for (int k = j; k < end; ++k) {
+				row[k] = k >= i ? _load(offset + k - j) : _load(TriangularIndex::getBlockedOffset(
+						_numTileRows, tileDim, k, i));
+			}
+		}
+	}
+
+private:
+	PackedHeader _header;
+	char* _base;
+	const char* _data;
+	int64_t _size;
+	int64_t _numTileRows;
+	int64_t _tileSize;
+	int _fd;
+
+	inline double _load(const int64_t offset) const {
+		switch (_header._encoding) {
+		case PM_FLOAT:
+			return ((const float*) _data)[offset];
+		case PM_INT16:
+			return _header._offset + ((const int16_t*) _data)[offset] * _header._scale;
+		default:
+			return _header._offset + ((const int8_t*) _data)[offset] * _header._scale;
+		}
+	}
+};
+
+#endif	/*__PACKED_MATRIX_HPP*/
@@ -22,6 +22,14 @@
 #include <typeinfo>
 using namespace std;
 #pragma once
+#include <DotKernel.hpp>
+#include <TriangularIndex.hpp>
+#include <TileScheduler.hpp>
+#include <ResultWriter.hpp>
+#include <MPITileScheduler.hpp>
+#include <MPIRing.hpp>
+#include <NodeSharedMatrix.hpp>
+#include <TileTuner.hpp>
 
 #ifdef WITH_MPI
 #include <mpi.h>
@@ -39,15 +47,10 @@ using namespace std;
 /*tile size*/
 #define PR_PHI_TILE_DIM	4		/*must be divided by 236*/
 #define PR_PHI_TILE_SIZE	(PR_PHI_TILE_DIM * PR_PHI_TILE_DIM)
-#define MT_TILE_DIM		8
+#define MT_TILE_DIM		8		/*default; see setTileGeometry()*/
 #define MPI_TILE_DIM	8
 #define MPI_TILE_SIZE	(MPI_TILE_DIM * MPI_TILE_DIM)
 
-/*maximum dimension size*/
-#ifndef PR_MAX_MAT_DIM
-#define PR_MAX_MAT_DIM			(1<<25)
-#endif
-
 /*maximum Xeon Phi buffer size*/
 #define PR_PHI_BUFFER_SIZE (1 << 29)
 
@@ -59,7 +62,8 @@ template<typename FloatType>
 class PearsonR {
 public:
 	PearsonR(int numVectors, int vectorSize, int numCPUThreads,
-			int numMICThreads, int micIndex, int rank, int numProcs);
+			int numMICThreads, int micIndex, int rank, int numProcs,
+			bool ringBlock = false);
 	~PearsonR();
 
 	inline FloatType* getVectors() {
@@ -92,6 +96,10 @@ public:
 	/*MPI*/
 #ifdef WITH_MPI
 	void runMPICPU();
+	void runMPICPURing();	/*ring distribution: O(N/p) vectors per process*/
+	/*rows [rowStart, rowEnd) of the input read in by this process before runMPICPU or
+	 *runMPICPURing, and where row rowStart goes. Collective*/
+	FloatType* getInputRows(int& rowStart, int& rowEnd);
 #ifdef WITH_PHI
 	void runMPIXeonPhi();
 #endif	/*with phi*/
@@ -100,9 +108,57 @@ public:
 	/*transpose matrix*/
 	void transpose();
 
+	/*persisted results of the MPI engine*/
+	inline void setResultOptions(const ResultOptions& options) {
+		_resultOptions = options;
+	}
+
+	/*compute only shard shard of numShards of the tile space [multi-threaded mode]*/
+	inline void setShard(const int shard, const int numShards) {
+		_shard = shard;
+		_numShards = numShards;
+	}
+
+	/*tile geometry of the CPU engines*/
+	inline void setTileGeometry(const int tileDim, const int kBlock) {
+		if (tileDim > 0) {
+			_tileDim = tileDim;
+		}
+		if (kBlock > 0 && kBlock % 16 == 0) {
+			_kBlock = kBlock;
+		}
+	}
+	/*time candidate geometries on the loaded data (or use the per-host cache). Collective in the MPI modes*/
+	inline void autotuneTileGeometry() {
+		TileGeometry geometry;
+
+		/*only rank 0 times and touches the cache; all ranks must share one tile space*/
+		if (_rank == 0) {
+			/*rank 0 holds at least the rows from zero up to the end of its own ones*/
+			int numRows = _rowEnd;
+#ifdef WITH_MPI
+			if (_sharedVectors) {
+				int loRow;
+				_sharedVectors->getRowRange(loRow, numRows);
+			}
+#endif
+			geometry = TileTuner::tuneDotKernel<FloatType>("pearson", _vectors,
+					numRows, _vectorSize, _vectorSizeAligned, true);
+		}
+#ifdef WITH_MPI
+		int values[2] = { geometry._tileDim, geometry._kBlock };
+		MPI_Bcast(values, 2, MPI_INT, 0, MPI_COMM_WORLD);
+		geometry = TileGeometry(values[0], values[1]);
+#endif
+		setTileGeometry(geometry._tileDim, geometry._kBlock);
+	}
+
 private:
 	FloatType* _vectors; /*vector data. Stored consecutively and each vector contains an aligned number of elements*/
 	int _numVectors; /*number of vectors in the data*/
+	int _rowStart;	/*_vectors holds rows [_rowStart, _rowEnd), row i at (i - _rowStart) * _vectorSizeAligned*/
+	int _rowEnd;
+	bool _ringBlock;	/*only the own block of the ring is held [CPU_MPI_RING]*/
 	int _vectorSize; /*effective vector size, i.e. the real number of elements per vector*/
 	int _vectorSizeAligned; /*aligned to vector size to 16 so that the address is aligned to 64 byte boundary*/
 	//int _maxPartitionSize; /*maximum partition size for asynchronous mode*/
@@ -111,7 +167,15 @@ private:
 	int _micIndex;	/*index of MIC used by this processs*/
 	int _rank;			/*process rank*/
 	int _numProcs;	/*number of MPI processes*/
+	int _shard;			/*job-array shard of the multi-threaded engine*/
+	int _numShards;	/*number of job-array shards*/
 	int _tiledPrMatrix; /*how the pearson correlation matrix is stored*/
+	int _tileDim;	/*tile dimension for the CPU engines*/
+	int _kBlock;	/*K-block size of the dot-product kernel*/
+	ResultOptions _resultOptions;	/*output of the MPI engine*/
+#ifdef WITH_MPI
+	NodeSharedMatrix<FloatType>* _sharedVectors;	/*node-local shared input of the MPI engine*/
+#endif
 	FloatType* _pearsonCorr; /*pearson correlation matrix*/
 
 	/*used for software barrier*/
@@ -164,24 +228,13 @@ private:
 
 	/*static function members*/
 public:
-	/*when matrix dimension size is large than 2^21, we should use long double instead of double*/
+	/*exact integer mappings, see TriangularIndex.hpp*/
 #ifdef WITH_PHI
 	__attribute__((target(mic)))
 #endif
 	inline void getCoordinate(const ssize_t globalIndex,
 			const ssize_t matrixDimSize, int& row, int& col) {
-#if PR_MAX_MAT_DIM < (1 << 25)
-		typedef double mydouble;
-#else
-		typedef long double mydouble;
-#endif
-		mydouble p, q;
-		p = static_cast<mydouble>(matrixDimSize - 1);
-		q = static_cast<mydouble>(globalIndex);
-		row = (int) ceil(p - 0.5 - sqrt(p * p + p - 2 * (q + 1) + 0.25));
-		col = row
-				+ (globalIndex - (2 * (matrixDimSize - 1) - row + 1) * row / 2)
-				+ 1;
+		TriangularIndex::getStrictCoordinate(globalIndex, matrixDimSize, row, col);
 	}
 
 	/*conditions: row < col*/
@@ -190,16 +243,7 @@ public:
 #endif
 	inline ssize_t getGlobalIndex(const ssize_t matrixDimSize, const int row,
 			const int col) {
-#if PR_MAX_MAT_DIM < (1 << 25)
-		typedef double mydouble;
-#else
-		typedef long double mydouble;
-#endif
-
-		mydouble p, q;
-		p = static_cast<mydouble>(matrixDimSize);
-
-		return (ssize_t) ((p - 1 - 0.5 * (row - 1)) * row + col - (row + 1));
+		return TriangularIndex::getStrictIndex(matrixDimSize, row, col);
 	}
 
 #ifdef WITH_PHI
@@ -207,16 +251,7 @@ public:
 #endif
 	inline void getTileCoordinate(const ssize_t globalIndex,
 			const ssize_t tileDim, int& row, int& col) {
-#if PR_MAX_MAT_DIM < (1 << 25)
-		typedef double mydouble;
-#else
-		typedef long double mydouble;
-#endif
-		mydouble p, q;
-		p = static_cast<mydouble>(tileDim);
-		q = static_cast<mydouble>(globalIndex);
-		row = (int) ceil(p - 0.5 - sqrt(p * p + p - 2 * (q + 1) + 0.25));
-		col = row + (globalIndex - (2 * tileDim - row + 1) * row / 2);
+		TriangularIndex::getUpperCoordinate(globalIndex, tileDim, row, col);
 	}
 
 	/*conditions: row <= col*/
@@ -225,16 +260,7 @@ public:
 #endif
 	inline ssize_t getTileGlobalIndex(const ssize_t matrixDimSize, const int row,
 		const int col) {
-#if PR_MAX_MAT_DIM < (1 << 25)
-    typedef double mydouble;
-#else
-    typedef long double mydouble;
-#endif
-
-    mydouble p, q;
-    p = static_cast<mydouble>(matrixDimSize);
-
-    return (ssize_t) ((p - 0.5 * (row - 1)) * row + col - row);
+		return TriangularIndex::getUpperIndex(matrixDimSize, row, col);
 	}
 #ifdef WITH_PHI
 __attribute__((target(mic)))
@@ -270,7 +296,7 @@ __attribute__((target(mic)))
 
 template<typename FloatType>
 PearsonR<FloatType>::PearsonR(int numVectors, int vectorSize, int numCPUThreads,
-		int numMICThreads, int micIndex, int rank, int numProcs) {
+		int numMICThreads, int micIndex, int rank, int numProcs, bool ringBlock) {
 	int alignment = 64 / sizeof(FloatType);	/*align to 64 byte boundary*/
 	_numVectors = numVectors;
 	_vectorSize = vectorSize;
@@ -280,21 +306,31 @@ PearsonR<FloatType>::PearsonR(int numVectors, int vectorSize, int numCPUThreads,
 	_micIndex = micIndex; /*index of mic device*/
 	_rank = rank;
 	_numProcs = numProcs;
-
-	/*check the number of vectors*/
-	if (_numVectors > PR_MAX_MAT_DIM) {
-		fprintf(stderr,
-				"The number of vectors exceeds the maximum limit (%ld)\n",
-				(ssize_t) PR_MAX_MAT_DIM);
-		exit(-1);
-	}
+	_shard = 0;
+	_numShards = 1;
+#ifdef WITH_MPI
+	_sharedVectors = NULL;
+#endif
+	_tileDim = MT_TILE_DIM;
+	_kBlock = DK_K_BLOCK;
 
 	/*allocate space*/
 	_pearsonCorr = NULL;
 
+	/*all vectors, or only the own block of the ring*/
+	_ringBlock = ringBlock;
+	_rowStart = 0;
+	_rowEnd = _numVectors;
+#ifdef WITH_MPI
+	if (_ringBlock) {
+		MPIRing<FloatType>::getBlockRange(_numVectors, MPIRing<FloatType>::getBlockSize(
+				_numVectors, _numProcs, TT_MAX_TILE_DIM), _rank, _rowStart, _rowEnd);
+	}
+#endif
+
 	/*align each vector*/
 	_vectors = (FloatType*) mm_malloc(
-			(ssize_t)_numVectors * _vectorSizeAligned * sizeof(FloatType), 64);
+			(ssize_t)max(1, _rowEnd - _rowStart) * _vectorSizeAligned * sizeof(FloatType), 64);
 	if (!_vectors) {
 		fprintf(stderr, "Memory allocation failed at line %d in file %s\n",
 		__LINE__, __FILE__);
@@ -304,6 +340,13 @@ PearsonR<FloatType>::PearsonR(int numVectors, int vectorSize, int numCPUThreads,
 
 template<typename FloatType>
 PearsonR<FloatType>::~PearsonR() {
+#ifdef WITH_MPI
+	if (_sharedVectors) {
+		/*_vectors points into the shared window*/
+		delete _sharedVectors;
+		_vectors = NULL;
+	}
+#endif
 	if (_vectors) {
 		mm_free(_vectors);
 	}
@@ -315,8 +358,12 @@ PearsonR<FloatType>::~PearsonR() {
 template<typename FloatType>
 void PearsonR<FloatType>::generateRandomData(const int seed) {
 	srand48(11);
-	for (int i = 0; i < _numVectors; ++i) {
-		FloatType* __restrict__ dst = _vectors + i * _vectorSizeAligned;
+	/*rows before the held ones still draw their numbers, so that a ring block gets the rows of the full matrix*/
+	for (ssize_t i = 0; i < (ssize_t) _rowStart * _vectorSize; ++i) {
+		drand48();
+	}
+	for (int i = _rowStart; i < _rowEnd; ++i) {
+		FloatType* __restrict__ dst = _vectors + (ssize_t) (i - _rowStart) * _vectorSizeAligned;
 		for (int j = 0; j < _vectorSize; ++j) {
 			dst[j] = drand48();
 		}
@@ -387,27 +434,68 @@ _pearsonCorr = (FloatType*) mm_malloc(
 	}
 	double t2 = getSysTime();
 	fprintf(stderr, "time for transformation: %f seconds\n", t2 - t1);
-  double riversj;
-	/*compute pairwise correlation coefficient*/
-	vecX = _vectors;
-	for (int row = 0; row < _numVectors; ++row, vecX += _vectorSizeAligned) {
-		vecY = _vectors + row * _vectorSizeAligned;
-		for (int col = row; col < _numVectors; ++col, vecY +=
-				_vectorSizeAligned) {
-			prod = 0;
+
+	/*persisted results: compute tile by tile and hand each tile to the writer*/
+	if (_resultOptions.enabled()) {
+		const int tileDim = (_numVectors + _tileDim - 1) / _tileDim;
+		ssize_t tileIndex = 0;
+		ResultWriter<FloatType> writer(_resultOptions, "pearson", 0, 1,
+				_numVectors, _vectorSize, _tileDim);
+		FloatType* __restrict__ tile = (FloatType*) mm_malloc(
+				_tileDim * _tileDim * sizeof(FloatType), 64);
+		if (!tile) {
+			fprintf(stderr, "Memory allocation failed\n");
+			exit(-1);
+		}
+		for (int tileRow = 0; tileRow < tileDim; ++tileRow) {
+			int rowStart = tileRow * _tileDim;
+			int rowEnd = min(_numVectors, rowStart + _tileDim);
+			for (int tileCol = tileRow; tileCol < tileDim; ++tileCol, ++tileIndex) {
+				int colStart = tileCol * _tileDim;
+				int colEnd = min(_numVectors, colStart + _tileDim);
+				vecX = _vectors + (ssize_t) rowStart * _vectorSizeAligned;
+				for (int row = rowStart; row < rowEnd; ++row, vecX += _vectorSizeAligned) {
+					int col = max(row, colStart);
+					vecY = _vectors + (ssize_t) col * _vectorSizeAligned;
+					for (; col < colEnd; ++col, vecY += _vectorSizeAligned) {
+						prod = 0;
 #pragma vector aligned
 #pragma simd reduction(+:prod)
-			for (int j = 0; j < _vectorSize; ++j) {
-				prod += vecX[j] * vecY[j];
+						for (int j = 0; j < _vectorSize; ++j) {
+							prod += vecX[j] * vecY[j];
+						}
+						tile[(row - rowStart) * _tileDim + col - colStart] = prod;
+					}
+				}
+				writer.addTile(tileIndex, rowStart, rowEnd, colStart, colEnd, tile,
+						_tileDim);
 			}
-		  riversj = prod;
+		}
+		mm_free(tile);
+		writer.close();
+	} else {
+		double riversj = 0;
+		/*compute pairwise correlation coefficient*/
+		vecX = _vectors;
+		for (int row = 0; row < _numVectors; ++row, vecX += _vectorSizeAligned) {
+			vecY = _vectors + row * _vectorSizeAligned;
+			for (int col = row; col < _numVectors; ++col, vecY +=
+					_vectorSizeAligned) {
+				prod = 0;
+#pragma vector aligned
+#pragma simd reduction(+:prod)
+				for (int j = 0; j < _vectorSize; ++j) {
+					prod += vecX[j] * vecY[j];
+				}
+			  riversj = prod;
       
-      _pearsonCorr[(ssize_t)col] = prod;
-      //riversj _pearsonCorr[(ssize_t)row * _numVectors + col] = prod;
-			//riversj _pearsonCorr[(ssize_t)col * _numVectors + row] = prod;
+	      _pearsonCorr[(ssize_t)col] = prod;
+	      //riversj _pearsonCorr[(ssize_t)row * _numVectors + col] = prod;
+				//riversj _pearsonCorr[(ssize_t)col * _numVectors + row] = prod;
+			}
 		}
+		fprintf(stderr, "riversj: %f \n",riversj);
 	}
-  fprintf(stderr, "riversj: %f \n",riversj);
       
 	/*recored the system time*/
 	etime = getSysTime();
@@ -426,7 +514,7 @@ _pearsonCorr = (FloatType*) mm_malloc(
 template<typename FloatType>
 void PearsonR<FloatType>::runMultiThreaded() {
 	double stime, etime;
-	const int tileDim = (_numVectors + MT_TILE_DIM - 1) / MT_TILE_DIM;
+	const int tileDim = (_numVectors + _tileDim - 1) / _tileDim;
 	const ssize_t numTiles = (ssize_t) (tileDim + 1) * tileDim / 2;
 	ssize_t totalNumPairs = 0;
 	const FloatType avg = 1.0 / (FloatType)_vectorSize;
@@ -463,9 +551,25 @@ void PearsonR<FloatType>::runMultiThreaded() {
 		_numCPUThreads = omp_get_num_procs();
 	}
 	omp_set_num_threads(_numCPUThreads);
+
+	/*dynamic tile scheduler*/
+	TileScheduler scheduler(numTiles, _numCPUThreads);
+
+	/*job-array shard: a balanced slice of the tile space*/
+	ssize_t firstTile, lastTile;
+	TileScheduler::getShardRange(numTiles, _shard, _numShards, firstTile, lastTile);
+	scheduler.setRange(firstTile, lastTile);
+
+	/*persisted results of the shard*/
+	ResultWriter<FloatType>* writer = NULL;
+	if (_resultOptions.enabled()) {
+		writer = new ResultWriter<FloatType>(_resultOptions, "pearson", _shard,
+				_numShards, _numVectors, _vectorSize, _tileDim, _numCPUThreads);
+	}
+
 #pragma omp parallel reduction(+:totalNumPairs)
 	{
-		ssize_t chunkSize;
+		ssize_t chunkSize, tileStart, tileEnd;
 		int row, col;
 		int loRowRange, hiRowRange;
 		int loColRange, hiColRange;
@@ -474,7 +578,6 @@ void PearsonR<FloatType>::runMultiThreaded() {
 		ssize_t numPairsProcessed = 0;
 		FloatType meanX, varX, x, prod;
 		FloatType* __restrict__ vecX;
-		FloatType* __restrict__ vecY;
 		const int tid = omp_get_thread_num();
 		const int nthreads = omp_get_num_threads();
 
@@ -517,66 +620,80 @@ void PearsonR<FloatType>::runMultiThreaded() {
 		/*synchronize all threads*/
 #pragma omp barrier
 
-		/*compute pairwise correlation coefficient*/
-		chunkSize = (numTiles + nthreads - 1) / nthreads;
-		loRowRange = loColRange = tileDim + 1;
-		if (tid * chunkSize < numTiles) {
-			getTileCoordinate(tid * chunkSize, tileDim, loRowRange, loColRange);
-		}
-		hiRowRange = hiColRange = tileDim;
-		if ((tid + 1) * chunkSize <= numTiles) {
-			getTileCoordinate((tid + 1) * chunkSize - 1, tileDim, hiRowRange,
-					hiColRange);
+		/*per-thread tile buffer*/
+		FloatType* __restrict__ tile = (FloatType*) mm_malloc(
+				_tileDim * _tileDim * sizeof(FloatType), 64);
+		if (!tile) {
+			fprintf(stderr, "Memory allocation failed\n");
+			exit(-1);
 		}
-		//fprintf(stderr, "tid (%d): %d %d %d %d\n", tid, loRowRange, loColRange, hiRowRange, hiColRange);
-		for (int tileRow = loRowRange; tileRow <= hiRowRange; tileRow++) {
-			/*compute the effective range per row*/
-			startColPerRow = (tileRow == loRowRange) ? loColRange : tileRow;
-			endColPerRow = (tileRow == hiRowRange) ? hiColRange : tileDim - 1;
-
-			rowStart = tileRow * MT_TILE_DIM;
-			rowEnd = min(_numVectors, rowStart + MT_TILE_DIM);
-			for (int tileCol = startColPerRow; tileCol <= endColPerRow;
-					++tileCol) {
-				colStart = tileCol * MT_TILE_DIM;
-				colEnd = min(_numVectors, colStart + MT_TILE_DIM);
-				/*compute the tile*/
-				vecX = _vectors + rowStart * _vectorSizeAligned;
-				for (row = rowStart; row < rowEnd; ++row, vecX +=
-						_vectorSizeAligned) {
-					vecY = _vectors + colStart * _vectorSizeAligned;
-					for (col = colStart; col < colEnd; ++col, vecY +=
-							_vectorSizeAligned) {
-						if(row > col){
-							continue;
-						}
-						/*statistics*/
-						++numPairsProcessed;
 
-						prod = 0;
-#pragma vector aligned
-#pragma simd reduction(+:prod)
-						for (int j = 0; j < _vectorSize; ++j) {
-							prod += vecX[j] * vecY[j];
+		/*compute pairwise correlation coefficient*/
+		scheduler.threadStart(tid);
+		while (scheduler.nextChunk(tid, tileStart, tileEnd)) {
+			getTileCoordinate(tileStart, tileDim, loRowRange, loColRange);
+			getTileCoordinate(tileEnd - 1, tileDim, hiRowRange, hiColRange);
+			for (int tileRow = loRowRange; tileRow <= hiRowRange; tileRow++) {
+				/*compute the effective range per row*/
+				startColPerRow = (tileRow == loRowRange) ? loColRange : tileRow;
+				endColPerRow = (tileRow == hiRowRange) ? hiColRange : tileDim - 1;
+
+				rowStart = tileRow * _tileDim;
+				rowEnd = min(_numVectors, rowStart + _tileDim);
+				for (int tileCol = startColPerRow; tileCol <= endColPerRow;
+						++tileCol) {
+					colStart = tileCol * _tileDim;
+					colEnd = min(_numVectors, colStart + _tileDim);
+					/*compute the tile using the register-blocked kernel*/
+					DotKernel<FloatType>::computeTile(_vectors, _vectorSize,
+							_vectorSizeAligned, rowStart, rowEnd, colStart, colEnd, tile,
+							_tileDim, _kBlock);
+					if (writer) {
+						writer->addTile(getTileGlobalIndex(tileDim, tileRow, tileCol),
+								rowStart, rowEnd, colStart, colEnd, tile, _tileDim, NULL, 0, tid);
+					}
+					for (row = rowStart; row < rowEnd; ++row) {
+						for (col = colStart; col < colEnd; ++col) {
+							if(row > col){
+								continue;
+							}
+							/*statistics*/
+							++numPairsProcessed;
+
+							prod = tile[(row - rowStart) * _tileDim + col - colStart];
+							_pearsonCorr[(ssize_t) col] = prod;
+							//_pearsonCorr[(ssize_t)row * _numVectors + col] = prod;
+							//_pearsonCorr[(ssize_t)col * _numVectors + row] = prod;
 						}
-						
-            _pearsonCorr[(ssize_t) col] = prod;
-            //_pearsonCorr[(ssize_t)row * _numVectors + col] = prod;
-						//_pearsonCorr[(ssize_t)col * _numVectors + row] = prod;
 					}
 				}
 			}
 		}
+		scheduler.threadFinish(tid);
+
+		mm_free(tile);
 
 		/*reduction*/
 		totalNumPairs += numPairsProcessed;
 	} /*#pragma omp paralle*/
 
+	if (writer) {
+		writer->close();
+		delete writer;
+	}
+
 	/*recored the system time*/
 	etime = getSysTime();
 	fprintf(stderr, "Overall time (%ld pairs): %f seconds\n", totalNumPairs,
 			etime - stime);
 
+	/*report load balance*/
+#ifdef VERBOSE
+	scheduler.report(stderr, true);
+#else
+	scheduler.report(stderr, false);
+#endif
+
 #if 0
   for(int i = 0; i < _numVectors; ++i){
     for(int j = i; j < _numVectors; ++j){
@@ -1089,12 +1206,32 @@ __attribute__((target(mic))) void PearsonR<double>::_runSingleXeonPhiCore(
 
 
 #ifdef WITH_MPI
+template<typename FloatType>
+FloatType* PearsonR<FloatType>::getInputRows(int& rowStart, int& rowEnd) {
+	/*the own block of the ring*/
+	if (_ringBlock) {
+		rowStart = _rowStart;
+		rowEnd = _rowEnd;
+		return _vectors;
+	}
+
+	/*the own rows are read straight into the node-local shared copy*/
+	if (!_sharedVectors) {
+		_sharedVectors = new NodeSharedMatrix<FloatType>(MPI_COMM_WORLD,
+				_numVectors, _vectorSizeAligned);
+		mm_free(_vectors);
+		_vectors = _sharedVectors->getVectors();
+	}
+	_sharedVectors->getRowRange(rowStart, rowEnd);
+	return _vectors + (ssize_t) rowStart * _vectorSizeAligned;
+}
+
 template<typename FloatType>
 void PearsonR<FloatType>::runMPICPU() {
 	double stime, etime;
-	const int tileDim = (_numVectors + MPI_TILE_DIM -1) / MPI_TILE_DIM;
+	const int tileDim = (_numVectors + _tileDim -1) / _tileDim;
+	const ssize_t tileSize = (ssize_t)_tileDim * _tileDim;
 	const ssize_t numTiles = (ssize_t)(tileDim + 1) * tileDim / 2;
-	const ssize_t numPairs = (ssize_t)(_numVectors + 1) * _numVectors / 2;	/*include self-vs-self*/
 	ssize_t numPairsProcessed = 0, totalNumPairs;
 
 #ifdef VERBOSE
@@ -1106,32 +1243,22 @@ void PearsonR<FloatType>::runMPICPU() {
 	stime = getSysTime();
 
 	/*compute the mean and variance*/
-	int row, col;
+	int row;
 	int loRowRange, hiRowRange;
-	int loColRange, hiColRange;
-	int startColPerRow, endColPerRow;
 	int rowStart, rowEnd, colStart, colEnd;
-	ssize_t offset = 0, rowOffset, colOffset;
-	FloatType x, meanX, varX, prod;
+	FloatType x, meanX, varX;
 	FloatType* __restrict__ vecX;
-	FloatType* __restrict__ vecY;
 	const FloatType avg = 1.0 / (FloatType)_vectorSize;
 
-	/*allocate buffer*/
-	ssize_t chunkSize = (numTiles + _numProcs - 1) / _numProcs;
-/*riversj
-	_pearsonCorr = (FloatType*)mm_malloc( chunkSize * MPI_TILE_DIM * MPI_TILE_DIM * sizeof(FloatType), 64);
-	if(!_pearsonCorr) {
-		fprintf(stderr, "Memory allocation failed\n");
-		exit(-1);
-	}
-*/
 	_tiledPrMatrix = 1;
 
 	/*normalize the data*/
-	chunkSize = (_numVectors + _numProcs - 1) / _numProcs;
-	loRowRange = _rank * chunkSize;
-	hiRowRange = min(_numVectors, (_rank + 1) * (int) chunkSize);
+	if (!_sharedVectors) {
+		_sharedVectors = new NodeSharedMatrix<FloatType>(MPI_COMM_WORLD,
+				_numVectors, _vectorSizeAligned);
+	}
+	/*rows of the processes of a node are contiguous*/
+	_sharedVectors->getRowRange(loRowRange, hiRowRange);
 	vecX = _vectors + loRowRange * _vectorSizeAligned;
 	for (row = loRowRange; row < hiRowRange; ++row, vecX +=
 			_vectorSizeAligned) {
@@ -1162,94 +1289,210 @@ void PearsonR<FloatType>::runMPICPU() {
 		}
 	}
 
-	/*all gather to communicate the data*/
-	int* displs = (int*)mm_malloc(_numProcs * sizeof(int), 64);
-	int* recvCounts = (int*)mm_malloc(_numProcs * sizeof(int), 64);
-	row = 0;
-	for(int i = 0; i < _numProcs; ++i) {
-		displs[i] = row;
-		recvCounts[i] = min((int)chunkSize, _numVectors - row);
-		row += chunkSize;
-	}
-	const int key = loRowRange < hiRowRange ? 1 : 0;
-	MPI_Comm mycomm;
-	MPI_Comm_split(MPI_COMM_WORLD, key, _rank, &mycomm);
-	if(typeid(FloatType) == typeid(float)) {
-		if(key) {
-			MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_FLOAT, _vectors, recvCounts, displs, MPI_FLOAT, mycomm);
+	/*publish the own rows into the node-local shared copy and gather the rows of the other nodes.
+	 *the private copy is released*/
+	vecX = _sharedVectors->gather(_vectors);
+	if (vecX != _vectors) {
+		mm_free(_vectors);
+		_vectors = vecX;
+	}
+	MPI_Barrier(MPI_COMM_WORLD);
+
+	/*tile buffer*/
+	FloatType* __restrict__ tile = (FloatType*) mm_malloc(tileSize * sizeof(FloatType), 64);
+	if (!tile) {
+		fprintf(stderr, "Memory allocation failed\n");
+		exit(-1);
+	}
+
+	/*dynamic distribution of the tiles*/
+	MPITileScheduler scheduler(numTiles, MPI_COMM_WORLD);
+	ssize_t chunkStart, chunkEnd, tileIndex;
+	int tileRow, tileCol;
+	/*persisted results*/
+	ResultWriter<FloatType>* writer = NULL;
+	if (_resultOptions.enabled()) {
+		writer = new ResultWriter<FloatType>(_resultOptions, "pearson", _rank,
+				_numProcs, _numVectors, _vectorSize, _tileDim);
+	}
+	while (scheduler.nextChunk(chunkStart, chunkEnd)) {
+		getTileCoordinate(chunkStart, tileDim, tileRow, tileCol);
+		for (tileIndex = chunkStart; tileIndex < chunkEnd; ++tileIndex) {
+			rowStart = tileRow * _tileDim;
+			rowEnd = min(_numVectors, rowStart + _tileDim);
+			colStart = tileCol * _tileDim;
+			colEnd = min(_numVectors, colStart + _tileDim);
+
+			/*compute the tile using the register-blocked kernel*/
+			DotKernel<FloatType>::computeTile(_vectors, _vectorSize,
+					_vectorSizeAligned, rowStart, rowEnd, colStart, colEnd, tile,
+					_tileDim, _kBlock);
+
+			/*statistics*/
+			for (row = rowStart; row < rowEnd; row++) {
+				numPairsProcessed += colEnd - max(row, colStart);
+			}
+			if (writer) {
+				writer->addTile(tileIndex, rowStart, rowEnd, colStart, colEnd,
+						tile, _tileDim);
+			}
+
+			/*move to the next tile*/
+			if (++tileCol == tileDim) {
+				tileRow++;
+				tileCol = tileRow;
+			}
 		}
-	} else if(typeid(FloatType) == typeid(double)) {
-		if(key) {
-			MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DOUBLE, _vectors, recvCounts, displs, MPI_DOUBLE, mycomm);
+	}
+	scheduler.finish();
+
+	mm_free(tile);
+
+	if (writer) {
+		writer->close();
+		delete writer;
+	}
+
+	/*compute the total number of edges*/
+	MPI_Reduce(&numPairsProcessed, &totalNumPairs, 1, MPI_INT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+
+	/*recored the system time*/
+	etime = getSysTime();
+	if (_rank == 0) {
+		fprintf(stderr, "Overall time (%ld pairs): %f seconds\n", totalNumPairs, etime - stime);
+	}
+	scheduler.report();
+}
+
+/*systolic ring: each process owns one block of vectors and pairs it with the blocks passing through*/
+template<typename FloatType>
+void PearsonR<FloatType>::runMPICPURing() {
+	double stime, etime, waitTime, maxWaitTime;
+	const int tileDim = (_numVectors + _tileDim - 1) / _tileDim;
+	/*blocks are aligned to every tile dimension the tuner may pick, so they can be loaded before tuning*/
+	const int blockSize = MPIRing<FloatType>::getBlockSize(_numVectors, _numProcs, TT_MAX_TILE_DIM);
+	const ssize_t tileSize = (ssize_t)_tileDim * _tileDim;
+	ssize_t numPairsProcessed = 0, totalNumPairs;
+
+#ifdef VERBOSE
+	if(_rank == 0) fprintf(stderr, "execute function %s\n", __FUNCTION__);
+#endif
+	if (TT_MAX_TILE_DIM % _tileDim != 0) {
+		if (_rank == 0) {
+			fprintf(stderr, "The tile dimension must divide %d in the ring mode\n", TT_MAX_TILE_DIM);
 		}
-	} else {
-		printf("Only support floating-point values\n");
-		return;
+		exit(-1);
 	}
-	mm_free(displs);
-	mm_free(recvCounts);
-	MPI_Comm_free(&mycomm);
+
+	/*record the system time*/
 	MPI_Barrier(MPI_COMM_WORLD);
+	stime = getSysTime();
 
-	/*get the tile range*/
-	chunkSize = (numTiles + _numProcs - 1) / _numProcs;
-	loRowRange = loColRange = tileDim + 1;
-	if(_rank * chunkSize < numTiles) {
-		getTileCoordinate(_rank * chunkSize, tileDim, loRowRange, loColRange);
-	}
-	hiRowRange = hiColRange = tileDim;
-	if((_rank + 1) * chunkSize <= numTiles) {
-		getTileCoordinate((_rank + 1) * chunkSize - 1, tileDim,
-				hiRowRange, hiColRange);
-	}
-	/*global offset of tiles*/
-	offset = 0;
-	for (int tileRow = loRowRange; tileRow <= hiRowRange; tileRow++) {
-		rowStart = tileRow * MPI_TILE_DIM;
-		rowEnd = min(_numVectors, rowStart + MPI_TILE_DIM);
-		startColPerRow = (tileRow == loRowRange) ? loColRange : tileRow;
-		endColPerRow = (tileRow == hiRowRange) ? hiColRange : tileDim - 1;
-		for (int tileCol = startColPerRow; tileCol <= endColPerRow;
-				++tileCol) {
-			colStart = tileCol * MPI_TILE_DIM;
-			colEnd = min(_numVectors, colStart + MPI_TILE_DIM);
-
-			/*compute the tile*/
-			vecX = _vectors + rowStart * _vectorSizeAligned;
-			for (row = rowStart, rowOffset = offset; row < rowEnd; row++, vecX +=
-					_vectorSizeAligned, rowOffset += MPI_TILE_DIM) {
-				vecY = _vectors + colStart * _vectorSizeAligned;
-				for (col = colStart, colOffset = rowOffset; col < colEnd; ++col, vecY +=
-						_vectorSizeAligned, colOffset++) {
-					if (row > col) {
-						continue;
-					}
+	int row;
+	int loRowRange, hiRowRange;
+	int rowStart, rowEnd, colStart, colEnd;
+	FloatType x, meanX, varX;
+	FloatType* __restrict__ vecX;
+	const FloatType avg = 1.0 / (FloatType)_vectorSize;
 
-					/*statistics*/
-					numPairsProcessed++;
+	/*normalize the own block*/
+	MPIRing<FloatType>::getBlockRange(_numVectors, blockSize, _rank, loRowRange, hiRowRange);
+	vecX = _vectors + (ssize_t) (loRowRange - _rowStart) * _vectorSizeAligned;
+	for (row = loRowRange; row < hiRowRange; ++row, vecX +=
+			_vectorSizeAligned) {
+		/*compute the mean*/
+		meanX = 0;
+#pragma vector aligned
+#pragma simd reduction(+:meanX)
+		for (int j = 0; j < _vectorSize; ++j) {
+			meanX += vecX[j] * avg;
+		}
 
-					/*compute the dot product*/
-					prod = 0;
+		/*compute the variance*/
+		varX = 0;
 #pragma vector aligned
-#pragma simd reduction(+:prod)
-					for (int j = 0; j < _vectorSize; ++j) {
-						prod += vecX[j] * vecY[j];
-					}
-					//riversj _pearsonCorr[colOffset] = prod;
+#pragma simd reduction(+:varX)
+		for (int j = 0; j < _vectorSize; ++j) {
+			x = vecX[j] - meanX;
+			varX += x * x;
+		}
+		varX = 1 / sqrt(varX);
+
+		/*normalize the data*/
+#pragma vector aligned
+#pragma simd
+		for (int j = 0; j < _vectorSize; ++j) {
+			x = vecX[j] - meanX;
+			vecX[j] = x * varX;
+		}
+	}
+
+	/*the own block is copied into the ring, which holds all vectors used from here on*/
+	MPIRing<FloatType> ring(MPI_COMM_WORLD, _vectors + (ssize_t) (loRowRange - _rowStart) * _vectorSizeAligned,
+			_numVectors, _vectorSizeAligned, blockSize);
+	RingBlock<FloatType> rows, cols;
+	mm_free(_vectors);
+	_vectors = NULL;
+
+	/*tile buffer*/
+	FloatType* __restrict__ tile = (FloatType*) mm_malloc(tileSize * sizeof(FloatType), 64);
+	if (!tile) {
+		fprintf(stderr, "Memory allocation failed\n");
+		exit(-1);
+	}
+
+	/*persisted results*/
+	ResultWriter<FloatType>* writer = NULL;
+	if (_resultOptions.enabled()) {
+		writer = new ResultWriter<FloatType>(_resultOptions, "pearson", _rank,
+				_numProcs, _numVectors, _vectorSize, _tileDim);
+	}
+
+	while (ring.next(rows, cols)) {
+		/*blocks start at tile boundaries, so each tile of the block pair is a global tile*/
+		for (rowStart = rows._start; rowStart < rows._end; rowStart += _tileDim) {
+			rowEnd = min(rows._end, rowStart + _tileDim);
+			colStart = rows._start == cols._start ? rowStart : cols._start;
+			for (; colStart < cols._end; colStart += _tileDim) {
+				colEnd = min(cols._end, colStart + _tileDim);
+
+				/*compute the tile using the register-blocked kernel*/
+				DotKernel<FloatType>::computeTile(
+						rows._vectors + (ssize_t) (rowStart - rows._start) * _vectorSizeAligned,
+						rowStart, rowEnd,
+						cols._vectors + (ssize_t) (colStart - cols._start) * _vectorSizeAligned,
+						colStart, colEnd, _vectorSize, _vectorSizeAligned, tile, _tileDim,
+						_kBlock);
+
+				/*statistics*/
+				for (row = rowStart; row < rowEnd; row++) {
+					numPairsProcessed += colEnd - max(row, colStart);
+				}
+
+				if (writer) {
+					writer->addTile(getTileGlobalIndex(tileDim, rowStart / _tileDim, colStart / _tileDim),
+							rowStart, rowEnd, colStart, colEnd, tile, _tileDim);
 				}
 			}
-			/*move to the next tile*/
-			offset += MPI_TILE_SIZE;
 		}
 	}
+	mm_free(tile);
+
+	if (writer) {
+		writer->close();
+		delete writer;
+	}
 
 	/*compute the total number of edges*/
 	MPI_Reduce(&numPairsProcessed, &totalNumPairs, 1, MPI_INT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+	waitTime = ring.getWaitTime();
+	MPI_Reduce(&waitTime, &maxWaitTime, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
 
 	/*recored the system time*/
 	etime = getSysTime();
 	if (_rank == 0) {
 		fprintf(stderr, "Overall time (%ld pairs): %f seconds\n", totalNumPairs, etime - stime);
+		fprintf(stderr, "Ring communication wait (maximum over processes): %f seconds\n", maxWaitTime);
 	}
 }
 
@@ -21,6 +21,8 @@
 #include <fstream>
 #include <algorithm>
 #include <functional>
+#include <PackedMatrix.hpp>
+#include <RankTransform.hpp>
 
 using namespace std;
 //using namespace mmap_allocator_namespace;
@@ -46,6 +48,9 @@ using namespace std;
 #define PR_MKL_MIC_ALLOC_FREE alloc_if(1) free_if(1)
 #endif	/*with phi*/
 
+/*tile dimension of the packed full matrix*/
+#define PR_MKL_PACKED_TILE_DIM	64
+
 /*template functions for general matrix-matrix multiplication*/
 template<typename FloatType>
 __attribute__((target(mic))) void mygemm(const CBLAS_LAYOUT layout, const CBLAS_TRANSPOSE TransA, const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K, const FloatType alpha,
@@ -86,6 +91,24 @@ public:
 		return _vectorSizeAligned;
 	}
 
+	/*compute only shard shard of numShards of the row batches [multi-threaded mode]*/
+	inline void setShard(const int shard, const int numShards) {
+		_shard = shard;
+		_numShards = numShards;
+	}
+
+	/*write the full matrix to fileName as a packed upper triangle [single-threaded mode]*/
+	inline void setPackedOutput(const string& fileName, const int encoding) {
+		_packedName = fileName;
+		_packedEncoding = encoding;
+	}
+
+	/*correlate the average ranks of the vectors instead of their values, i.e.
+	 *Spearman's rho with ties. The multi-threaded engine ranks the observed values only*/
+	inline void setRankTransform(const bool rankTransform) {
+		_rankTransform = rankTransform;
+	}
+
 	/*generate random data*/
 	void generateRandomData(const int seed = 11);
 
@@ -126,6 +149,34 @@ private:
         FloatType _minPCC;
         FloatType _maxPCC;
         int _batchSize;
+	int _shard;			/*job-array shard of the multi-threaded engine*/
+	int _numShards;	/*number of job-array shards*/
+	string _packedName;	/*packed full matrix*/
+	int _packedEncoding;	/*PM_NONE disables*/
+	bool _rankTransform;	/*Spearman on average ranks*/
+
+	inline const char* _getName() {
+		return _rankTransform ? "spearman" : "pearson";
+	}
+	/*replace each vector by its average ranks*/
+	void _rankVectors(const bool skipMissing);
+
+	/*output file name: base.csv, or base.<shard>.csv for job-array shards*/
+	inline string _outputName(const char* base) {
+		stringstream name;
+		name << base;
+		if (_numShards > 1) {
+			name << "." << _shard;
+		}
+		name << ".csv";
+		return name.str();
+	}
+	/*first line of the shard outputs, so that each shard describes itself*/
+	inline void _writeShardHeader(ofstream& file, const int rowStart, const int rowEnd) {
+		file << "# shard " << _shard << "/" << _numShards << " " << _getName() << " vectors "
+				<< _numVectors << " samples " << _vectorSize << " rows " << rowStart
+				<< "-" << rowEnd << "\n";
+	}
 
 #ifdef WITH_PHI
   __attribute__((target(mic)))
@@ -184,6 +235,10 @@ PearsonRMKL<FloatType>::PearsonRMKL(int numVectors, int vectorSize, int numCPUTh
         _minPCC = minPCC;
         _maxPCC = maxPCC;
         _batchSize = batchSize;
+	_shard = 0;
+	_numShards = 1;
+	_packedEncoding = PM_NONE;
+	_rankTransform = false;
 	
         /*allocate space*/
 	_pearsonCorr = NULL;
@@ -219,6 +274,18 @@ void PearsonRMKL<FloatType>::generateRandomData(const int seed) {
 		}
 	}
 }
+template<typename FloatType>
+void PearsonRMKL<FloatType>::_rankVectors(const bool skipMissing) {
+	double stime = getSysTime();
+
+	if (_numCPUThreads < 1) {
+		_numCPUThreads = omp_get_num_procs();
+	}
+	RankTransform::rankMatrix(_vectors, _numVectors, _vectorSize,
+			_vectorSizeAligned, RT_TIES_AVERAGE, _numCPUThreads, skipMissing);
+	fprintf(stderr, "time for ranking: %f seconds\n", getSysTime() - stime);
+}
+
 template<typename FloatType>
 void PearsonRMKL<FloatType>::runSingleThreaded() {
 	double stime, etime;
@@ -226,17 +293,14 @@ void PearsonRMKL<FloatType>::runSingleThreaded() {
 	fprintf(stderr, "execute function %s\n", __FUNCTION__);
 #endif
 
-	/*output matrix*/
-	_pearsonCorr = (FloatType*) mm_malloc(
-			(ssize_t) _numVectors * _numVectors * sizeof(FloatType), 64);
-	if (!_pearsonCorr) {
-		fprintf(stderr, "Memory allocation failed\n");
-		exit(-1);
-	}
-
 	/*record the system time*/
 	stime = getSysTime();
 
+	/*rank transform*/
+	if (_rankTransform) {
+		_rankVectors(false);
+	}
+
 	/*allocate vectors for mean and variance*/
 	double t1 = getSysTime();
 	FloatType x, meanX, varX, prod;
@@ -276,7 +340,43 @@ void PearsonRMKL<FloatType>::runSingleThreaded() {
 
 	/*invoke the sequential Intel MKL*/
 	omp_set_num_threads(1);	/*use a single thread*/
-	mygemm<FloatType>(CblasRowMajor, CblasNoTrans, CblasTrans, _numVectors, _numVectors, _vectorSize, 1.0, _vectors, _vectorSizeAligned, _vectors, _vectorSizeAligned, 0, _pearsonCorr, _numVectors);
+	if (_packedEncoding != PM_NONE) {
+		/*one row panel of tiles at a time, written straight to the packed matrix*/
+		const int tileDim = PR_MKL_PACKED_TILE_DIM;
+		const int numTileRows = (_numVectors + tileDim - 1) / tileDim;
+		ssize_t tileIndex = 0;
+		PackedMatrixWriter<FloatType> writer(_packedName, _getName(), 0, _numVectors,
+				_vectorSize, tileDim, _packedEncoding);
+		FloatType* panel = (FloatType*) mm_malloc(
+				(ssize_t) tileDim * _numVectors * sizeof(FloatType), 64);
+		if (!panel) {
+			fprintf(stderr, "Memory allocation failed\n");
+			exit(-1);
+		}
+		for (int tileRow = 0; tileRow < numTileRows; ++tileRow) {
+			int rowStart = tileRow * tileDim;
+			int rowEnd = min(_numVectors, rowStart + tileDim);
+			int numCols = _numVectors - rowStart;
+			FloatType* rows = _vectors + (ssize_t) rowStart * _vectorSizeAligned;
+			mygemm<FloatType>(CblasRowMajor, CblasNoTrans, CblasTrans, rowEnd - rowStart, numCols, _vectorSize, 1.0, rows, _vectorSizeAligned, rows, _vectorSizeAligned, 0, panel, numCols);
+			for (int colStart = rowStart; colStart < _numVectors; colStart += tileDim, ++tileIndex) {
+				writer.addTile(tileIndex, rowStart, rowEnd, colStart,
+						min(_numVectors, colStart + tileDim), panel + colStart - rowStart,
+						numCols);
+			}
+		}
+		mm_free(panel);
+		writer.close();
+	} else {
+		/*output matrix*/
+		_pearsonCorr = (FloatType*) mm_malloc(
+				(ssize_t) _numVectors * _numVectors * sizeof(FloatType), 64);
+		if (!_pearsonCorr) {
+			fprintf(stderr, "Memory allocation failed\n");
+			exit(-1);
+		}
+		mygemm<FloatType>(CblasRowMajor, CblasNoTrans, CblasTrans, _numVectors, _numVectors, _vectorSize, 1.0, _vectors, _vectorSizeAligned, _vectors, _vectorSizeAligned, 0, _pearsonCorr, _numVectors);
+	}
 
 	/*recored the system time*/
 	etime = getSysTime();
@@ -344,6 +444,12 @@ void PearsonRMKL<FloatType>::runMultiThreaded() {
   /*record system time*/
   stime = getSysTime();
 
+  /*rank transform over the observed values: missing values stay 0 and are
+   *excluded per pair by the count matrix below*/
+  if (_rankTransform) {
+    _rankVectors(true);
+  }
+
  //int desiredBatch = 250;
  int desiredBatch = _batchSize;
  
@@ -569,7 +675,18 @@ double mtime, metime;
 double itime, ietime;
 stringstream stream;
 
-for(int xx = 0; xx < numBatches; ++xx)
+/*job-array shard: a balanced slice of the row batches*/
+int firstBatch = (int) ((ssize_t) numBatches * _shard / _numShards);
+int lastBatch = (int) ((ssize_t) numBatches * (_shard + 1) / _numShards);
+int shardRowStart = firstBatch < lastBatch ? startVec[firstBatch] : 0;
+int shardRowEnd = firstBatch < lastBatch ? endVec[lastBatch - 1] + 1 : 0;
+if (_numShards > 1) {
+	/*the neighbor file is appended per batch: start it with the header*/
+	ofstream header(_outputName("neighbors").c_str());
+	_writeShardHeader(header, shardRowStart, shardRowEnd);
+}
+
+for(int xx = firstBatch; xx < lastBatch; ++xx)
  {
   ltime = getSysTime();
   size_t mSize = endVec[xx] - startVec[xx] + 1;
@@ -748,7 +865,7 @@ fprintf(stderr,"%d:%f,", ii, tempY[ii]);
 ltime = getSysTime();
 
 ofstream myfile;
-myfile.open("neighbors.csv", std::ofstream::out |  std::ofstream::app);
+myfile.open(_outputName("neighbors").c_str(), std::ofstream::out |  std::ofstream::app);
 fprintf(stderr, "Begin neighbor sort\n");
 
 size_t pneighbor = min((size_t)numNeighbors,(size_t)_numVectors);
@@ -885,7 +1002,10 @@ for(size_t jj = 0; jj < totalThreads; jj++)
 fprintf(stderr, "Completed thread reduction step \n");
 #if 1
 ofstream myfile;
-myfile.open ("countTable.csv");
+myfile.open (_outputName("countTable").c_str());
+if (_numShards > 1) {
+	_writeShardHeader(myfile, shardRowStart, shardRowEnd);
+}
 int nPrint;
 double pcc;
 int count;
@@ -931,6 +1051,11 @@ void PearsonRMKL<FloatType>::runSingleXeonPhi() {
 	}
 	fprintf(stderr, "number of threads: %d\n", _numMICThreads);
 
+	/*rank transform on the host*/
+	if (_rankTransform) {
+		_rankVectors(false);
+	}
+
 	/*allocate output buffer and align to the tile size*/
 	_pearsonCorr = (FloatType*)mm_malloc((ssize_t)_numVectors * _numVectors * sizeof(FloatType), 64);
 	if(!_pearsonCorr) {
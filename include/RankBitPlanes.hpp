@@ -0,0 +1,136 @@
+/*
+ * RankBitPlanes.hpp
+ *
+ *  Pairwise order signs of short rank vectors as bitsets, for Kendall tau by
+ *  bitwise operations and popcounts instead of sorting.
+ *
+ *  For a vector x of n elements, bit p of a plane stands for the sample pair
+ *  (i, j), i < j, with p = TriangularIndex::getStrictIndex(n, i, j):
+ *	greater	x_j > x_i
+ *	tie			x_j == x_i
+ *  A sample pair is discordant in (x, y) if it is tied in neither vector and
+ *  the greater bits differ, so per vector pair
+ *	discordant	= popcount((gx ^ gy) & ~(tx | ty))
+ *	joint ties	= popcount(tx & ty)
+ *  and the ties of each vector are counted once when its planes are built.
+ *  Planes are padded with zero bits to whole cache lines.
+ */
+
+#ifndef __RANK_BIT_PLANES_HPP
+#define __RANK_BIT_PLANES_HPP
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <mm_malloc.h>
+#include <TriangularIndex.hpp>
+
+class RankBitPlanes
+{
+public:
+	RankBitPlanes(const int numVectors, const int vectorSize) {
+		_numVectors = numVectors;
+		_vectorSize = vectorSize;
+		_numPairs = TriangularIndex::getStrictSize(vectorSize);
+		_numWords = getNumWords(vectorSize);
+
+		_planes = (uint64_t*) _mm_malloc((ssize_t) _numVectors * 2 * _numWords * sizeof(uint64_t), 64);
+		_numTies = (ssize_t*) _mm_malloc((ssize_t) _numVectors * sizeof(ssize_t), 64);
+		if (!_planes || !_numTies) {
+			fprintf(stderr, "Memory allocation failed\n");
+			exit(-1);
+		}
+	}
+	~RankBitPlanes() {
+		_mm_free(_planes);
+		_mm_free(_numTies);
+	}
+
+	/*64-bit words per plane, rounded up to 64 bytes*/
+	static inline ssize_t getNumWords(const int vectorSize) {
+		return ((TriangularIndex::getStrictSize(vectorSize) + 63) / 64 + 7) / 8 * 8;
+	}
+	/*bytes needed for numVectors vectors of vectorSize elements*/
+	static inline ssize_t getMemorySize(const int numVectors, const int vectorSize) {
+		return (ssize_t) numVectors * 2 * getNumWords(vectorSize) * sizeof(uint64_t);
+	}
+
+	inline ssize_t getNumPairs() const {
+		return _numPairs;
+	}
+	inline ssize_t getNumTies(const int vector) const {
+		return _numTies[vector];
+	}
+
+	/*planes of a vector. Different vectors may be built concurrently*/
+	template<typename FloatType>
+	void build(const int vector, const FloatType* x) {
+		uint64_t* greater = _getGreater(vector);
+		uint64_t* tie = _getTie(vector);
+		ssize_t numTies = 0, p = 0;
+
+		memset(greater, 0, 2 * _numWords * sizeof(uint64_t));
+		for (int i = 0; i < _vectorSize - 1; ++i) {
+			const FloatType xi = x[i];
+			for (int j = i + 1; j < _vectorSize; ++j, ++p) {
+				const uint64_t bit = (uint64_t) 1 << (p & 63);
+				if (x[j] > xi) {
+					greater[p >> 6] |= bit;
+				} else if (x[j] == xi) {
+					tie[p >> 6] |= bit;
+					++numTies;
+				}
+			}
+		}
+		_numTies[vector] = numTies;
+	}
+
+	/*discordant pairs and joint ties of two vectors*/
+	inline void count(const int a, const int b, ssize_t& numDiscordant,
+			ssize_t& numTiesXY) const {
+		const uint64_t* __restrict__ ga = _getGreater(a);
+		const uint64_t* __restrict__ gb = _getGreater(b);
+		ssize_t discordant = 0, ties = 0;
+
+		if (_numTies[a] == 0 || _numTies[b] == 0) {
+			/*one vector has no ties, so only its partner's ties are masked and there are no joint ties*/
+			const uint64_t* __restrict__ t = _getTie(_numTies[a] == 0 ? b : a);
+			if (_numTies[a] == 0 && _numTies[b] == 0) {
+				for (ssize_t w = 0; w < _numWords; ++w) {
+					discordant += __builtin_popcountll(ga[w] ^ gb[w]);
+				}
+			} else {
+				for (ssize_t w = 0; w < _numWords; ++w) {
+					discordant += __builtin_popcountll((ga[w] ^ gb[w]) & ~t[w]);
+				}
+			}
+		} else {
+			const uint64_t* __restrict__ ta = _getTie(a);
+			const uint64_t* __restrict__ tb = _getTie(b);
+			for (ssize_t w = 0; w < _numWords; ++w) {
+				discordant += __builtin_popcountll((ga[w] ^ gb[w]) & ~(ta[w] | tb[w]));
+				ties += __builtin_popcountll(ta[w] & tb[w]);
+			}
+		}
+		numDiscordant = discordant;
+		numTiesXY = ties;
+	}
+
+private:
+	int _numVectors;
+	int _vectorSize;
+	ssize_t _numPairs;	/*bits per plane*/
+	ssize_t _numWords;	/*64-bit words per plane*/
+	uint64_t* _planes;	/*greater and tie planes of each vector*/
+	ssize_t* _numTies;	/*tied pairs of each vector*/
+
+	inline uint64_t* _getGreater(const int vector) const {
+		return _planes + (ssize_t) vector * 2 * _numWords;
+	}
+	inline uint64_t* _getTie(const int vector) const {
+		return _getGreater(vector) + _numWords;
+	}
+};
+
+#endif	/*__RANK_BIT_PLANES_HPP*/
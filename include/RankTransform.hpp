@@ -0,0 +1,327 @@
+/*
+ * RankTransform.hpp
+ *
+ *  Rank transform of vectors for the rank-based measures (SpearmanR,
+ *  KendallTau, MIAdaptive and the rank transform of PearsonRMKL). Tied values
+ *  are ranked by one of the policies
+ *	RT_TIES_AVERAGE	average of the ranks they span: 1 2 2 3 -> 1 2.5 2.5 4
+ *	RT_TIES_DENSE		distinct values are numbered: 1 2 2 3 -> 1 2 2 3
+ *	RT_TIES_FIRST		order of appearance: 1 2 2 3 -> 1 2 3 4
+ *  Average ranks make the Pearson correlation of two rank vectors the standard
+ *  Spearman correlation with ties. Dense ranks keep the sort order of a vector
+ *  in its values, so the ranks of any subset of the elements follow by counting
+ *  (see SpearmanR). Ranks start from base, 1 by default.
+ *
+ *  A vector is sorted by an LSD radix sort on order-preserving unsigned keys
+ *  of its values, 8 bits per pass. The histograms of all passes are built in
+ *  one sweep over the keys, and passes whose digit is the same for all keys
+ *  are skipped. rankMatrix ranks the vectors of a matrix in parallel, and
+ *  sorts each vector with all threads when there are fewer vectors than
+ *  threads and the vectors are long.
+ *
+ *  With skipMissing, 0.0 marks a missing value as in PearsonRMKL: only the
+ *  observed values are ranked and the missing ones stay 0.
+ */
+
+#ifndef __RANK_TRANSFORM_HPP
+#define __RANK_TRANSFORM_HPP
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <mm_malloc.h>
+#include <omp.h>
+
+/*tie policies*/
+#define RT_TIES_AVERAGE	0
+#define RT_TIES_DENSE		1
+#define RT_TIES_FIRST		2
+
+#define RT_RADIX_BITS		8
+#define RT_RADIX_BUCKETS	(1 << RT_RADIX_BITS)
+
+/*minimum vector size to sort one vector with several threads*/
+#define RT_PARALLEL_MIN_SIZE	(1 << 16)
+
+#ifdef WITH_PHI
+#pragma offload_attribute(push, target(mic))
+#endif
+
+/*unsigned keys with the order of the values: the sign bit is flipped for
+ *non-negative values and all bits for negative ones. -0.0 is keyed as 0.0*/
+template<typename FloatType>
+struct RadixKey;
+
+template<>
+struct RadixKey<float>
+{
+	typedef uint32_t Type;
+	static inline Type get(float value) {
+		Type bits;
+		if (value == 0) {
+			value = 0;
+		}
+		memcpy(&bits, &value, sizeof(bits));
+		return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+	}
+};
+
+template<>
+struct RadixKey<double>
+{
+	typedef uint64_t Type;
+	static inline Type get(double value) {
+		Type bits;
+		if (value == 0) {
+			value = 0;
+		}
+		memcpy(&bits, &value, sizeof(bits));
+		return (bits & 0x8000000000000000ull) ? ~bits : bits | 0x8000000000000000ull;
+	}
+};
+
+/*scratch space to rank vectors of up to size elements. A buffer is used by one
+ *thread at a time; with numThreads > 1 it sorts a vector with that many threads*/
+template<typename FloatType>
+class RankBuffer
+{
+public:
+	typedef typename RadixKey<FloatType>::Type KeyType;
+	enum {
+		NUM_DIGITS = (sizeof(KeyType) * 8 + RT_RADIX_BITS - 1) / RT_RADIX_BITS
+	};
+
+	RankBuffer(const int size, const int numThreads = 1) {
+		_size = size;
+		_numThreads = numThreads > 1 ? numThreads : 1;
+		_keys = (KeyType*) _mm_malloc((ssize_t) 2 * (_size + 1) * sizeof(KeyType), 64);
+		_index = (int*) _mm_malloc((ssize_t) 2 * (_size + 1) * sizeof(int), 64);
+		_counts = (int*) _mm_malloc((ssize_t) (NUM_DIGITS + _numThreads) * RT_RADIX_BUCKETS * sizeof(int), 64);
+		if (!_keys || !_index || !_counts) {
+			fprintf(stderr, "Memory allocation failed\n");
+			exit(-1);
+		}
+	}
+	~RankBuffer() {
+		_mm_free(_keys);
+		_mm_free(_index);
+		_mm_free(_counts);
+	}
+
+	int _size;
+	int _numThreads;
+	KeyType* _keys;	/*keys and their shadow for the passes*/
+	int* _index;	/*element of each key and their shadow*/
+	int* _counts;	/*histograms of all digits, or of the threads in one pass*/
+};
+
+class RankTransform
+{
+public:
+	/*replace vec[0 .. n) by its ranks. The buffer holds at least n elements.
+	 *Returns the number of distinct ranked values*/
+	template<typename FloatType>
+	static int rankVector(FloatType* vec, const int n, const int ties,
+			RankBuffer<FloatType>& buffer, const bool skipMissing = false,
+			const int base = 1) {
+		typedef typename RankBuffer<FloatType>::KeyType KeyType;
+		KeyType* keys = buffer._keys;
+		int* index = buffer._index;
+		int i, j, numRanked = 0, numDistinct = 0;
+
+		for (i = 0; i < n; ++i) {
+			if (skipMissing && vec[i] == 0) {
+				continue;
+			}
+			keys[numRanked] = RadixKey<FloatType>::get(vec[i]);
+			index[numRanked] = i;
+			++numRanked;
+		}
+
+		/*sort the keys and get the sorted buffers*/
+		const bool shadow = (buffer._numThreads > 1 && numRanked >= RT_PARALLEL_MIN_SIZE) ?
+				_sortParallel(buffer, numRanked) : _sort(buffer, numRanked);
+		if (shadow) {
+			keys += buffer._size + 1;
+			index += buffer._size + 1;
+		}
+
+		/*the tie group [i, j) spans the positions i .. j - 1*/
+		for (i = 0; i < numRanked; i = j) {
+			for (j = i + 1; j < numRanked && keys[j] == keys[i]; ++j);
+			switch (ties) {
+			case RT_TIES_DENSE:
+				for (int k = i; k < j; ++k) {
+					vec[index[k]] = base + numDistinct;
+				}
+				break;
+			case RT_TIES_FIRST:
+				for (int k = i; k < j; ++k) {
+					vec[index[k]] = base + k;
+				}
+				break;
+			default: {
+				const FloatType rank = base + (FloatType) (i + j - 1) / 2;
+				for (int k = i; k < j; ++k) {
+					vec[index[k]] = rank;
+				}
+				break;
+			}
+			}
+			++numDistinct;
+		}
+		return numDistinct;
+	}
+
+	/*rank each of the numVectors vectors of vectorSize elements, vectorSizeAligned apart*/
+	template<typename FloatType>
+	static void rankMatrix(FloatType* vectors, const int numVectors,
+			const int vectorSize, const ssize_t vectorSizeAligned, const int ties,
+			const int numThreads, const bool skipMissing = false, const int base = 1) {
+
+		if (numVectors < numThreads && vectorSize >= RT_PARALLEL_MIN_SIZE) {
+			/*few long vectors: all threads sort one vector at a time*/
+			RankBuffer<FloatType> buffer(vectorSize, numThreads);
+			for (int i = 0; i < numVectors; ++i) {
+				rankVector(vectors + (ssize_t) i * vectorSizeAligned, vectorSize,
+						ties, buffer, skipMissing, base);
+			}
+			return;
+		}
+
+#pragma omp parallel num_threads(numThreads)
+		{
+			RankBuffer<FloatType> buffer(vectorSize);
+#pragma omp for schedule(dynamic, 64)
+			for (int i = 0; i < numVectors; ++i) {
+				rankVector(vectors + (ssize_t) i * vectorSizeAligned, vectorSize,
+						ties, buffer, skipMissing, base);
+			}
+		}
+	}
+
+private:
+	/*sort the first n keys with their indices.
+	 *Returns true if the result is in the shadow buffers*/
+	template<typename FloatType>
+	static bool _sort(RankBuffer<FloatType>& buffer, const int n) {
+		typedef typename RankBuffer<FloatType>::KeyType KeyType;
+		const int numDigits = RankBuffer<FloatType>::NUM_DIGITS;
+		KeyType* src = buffer._keys;
+		KeyType* dst = src + buffer._size + 1;
+		int* srcIndex = buffer._index;
+		int* dstIndex = srcIndex + buffer._size + 1;
+		int* counts = buffer._counts;
+		bool shadow = false;
+
+		if (n < 2) {
+			return false;
+		}
+
+		/*histograms of all digits in one sweep*/
+		memset(counts, 0, numDigits * RT_RADIX_BUCKETS * sizeof(int));
+		for (int i = 0; i < n; ++i) {
+			const KeyType key = src[i];
+			for (int d = 0; d < numDigits; ++d) {
+				++counts[d * RT_RADIX_BUCKETS + ((key >> (d * RT_RADIX_BITS)) & (RT_RADIX_BUCKETS - 1))];
+			}
+		}
+
+		for (int d = 0; d < numDigits; ++d) {
+			int* count = counts + d * RT_RADIX_BUCKETS;
+			const int shift = d * RT_RADIX_BITS;
+
+			/*all keys share this digit*/
+			if (count[(src[0] >> shift) & (RT_RADIX_BUCKETS - 1)] == n) {
+				continue;
+			}
+			for (int b = 0, offset = 0; b < RT_RADIX_BUCKETS; ++b) {
+				const int c = count[b];
+				count[b] = offset;
+				offset += c;
+			}
+			for (int i = 0; i < n; ++i) {
+				const int pos = count[(src[i] >> shift) & (RT_RADIX_BUCKETS - 1)]++;
+				dst[pos] = src[i];
+				dstIndex[pos] = srcIndex[i];
+			}
+			KeyType* t = src; src = dst; dst = t;
+			int* ti = srcIndex; srcIndex = dstIndex; dstIndex = ti;
+			shadow = !shadow;
+		}
+		return shadow;
+	}
+
+	/*the same as _sort with buffer._numThreads threads on contiguous chunks of the keys*/
+	template<typename FloatType>
+	static bool _sortParallel(RankBuffer<FloatType>& buffer, const int n) {
+		typedef typename RankBuffer<FloatType>::KeyType KeyType;
+		const int numDigits = RankBuffer<FloatType>::NUM_DIGITS;
+		const int numThreads = buffer._numThreads;
+		int* threadCounts = buffer._counts + numDigits * RT_RADIX_BUCKETS;
+		bool shadow = false, skip = false;
+
+#pragma omp parallel num_threads(numThreads)
+		{
+			const int tid = omp_get_thread_num();
+			const int nthreads = omp_get_num_threads();
+			const int lo = (ssize_t) n * tid / nthreads;
+			const int hi = (ssize_t) n * (tid + 1) / nthreads;
+			KeyType* src = buffer._keys;
+			KeyType* dst = src + buffer._size + 1;
+			int* srcIndex = buffer._index;
+			int* dstIndex = srcIndex + buffer._size + 1;
+			int* count = threadCounts + tid * RT_RADIX_BUCKETS;
+
+			for (int d = 0; d < numDigits; ++d) {
+				const int shift = d * RT_RADIX_BITS;
+
+				/*histogram of the own chunk*/
+				memset(count, 0, RT_RADIX_BUCKETS * sizeof(int));
+				for (int i = lo; i < hi; ++i) {
+					++count[(src[i] >> shift) & (RT_RADIX_BUCKETS - 1)];
+				}
+#pragma omp barrier
+
+				/*offsets by digit, then by thread, which keeps the sort stable*/
+#pragma omp single
+				{
+					int offset = 0;
+					skip = false;
+					for (int b = 0; b < RT_RADIX_BUCKETS && !skip; ++b) {
+						const int start = offset;
+						for (int t = 0; t < nthreads; ++t) {
+							const int c = threadCounts[t * RT_RADIX_BUCKETS + b];
+							threadCounts[t * RT_RADIX_BUCKETS + b] = offset;
+							offset += c;
+						}
+						skip = offset - start == n;
+					}
+					if (!skip) {
+						shadow = !shadow;
+					}
+				}
+				if (skip) {
+					continue;
+				}
+
+				for (int i = lo; i < hi; ++i) {
+					const int pos = count[(src[i] >> shift) & (RT_RADIX_BUCKETS - 1)]++;
+					dst[pos] = src[i];
+					dstIndex[pos] = srcIndex[i];
+				}
+				KeyType* t = src; src = dst; dst = t;
+				int* ti = srcIndex; srcIndex = dstIndex; dstIndex = ti;
+#pragma omp barrier
+			}
+		}
+		return shadow;
+	}
+};
+
+#ifdef WITH_PHI
+#pragma offload_attribute(pop)
+#endif
+
+#endif	/*__RANK_TRANSFORM_HPP*/
@@ -0,0 +1,870 @@
+/*
+ * ResultWriter.hpp
+ *
+ *  Persisted results of the distributed engines. Each process (shard) writes
+ *  the tiles it computed to its own binary file, together with an index that
+ *  maps global tile indices to file offsets. Optionally, per-row top-K
+ *  neighbor lists or a thresholded edge list are written per shard as well.
+ *  Shards are combined by utils/MergeShards.
+ *
+ *  File names for shard i of prefix P:
+ *		P.i.tiles			binary tiles (ShardHeader followed by tiles)
+ *		P.i.index			tile index (ShardHeader followed by ShardIndexEntry records)
+ *		P.i.neighbors.csv	per-row top-K, "row value neighbor count" sorted by row and descending value
+ *		P.i.edges.csv		edges within [minValue, maxValue], "row col value"
+ *		P.i.histogram.csv	pairs per number of elements and value rounded to
+ *							RW_HISTOGRAM_BINS, "count value frequency" as the count
+ *							tables of PearsonRMKL
+ *
+ *  Engines with missing values pass the number of jointly observed elements of
+ *  each pair along with a tile. Pairs with fewer than _minCount of them are
+ *  neither neighbors nor edges. Without counts, the count is the vector size.
+ *
+ *  Threads of the multi-threaded engines add tiles concurrently, each with its
+ *  own thread index. Histograms and edge lines are kept per thread and merged
+ *  at close(). The top-K heaps are shared and guarded by RW_ROW_LOCKS locks,
+ *  striped over blocks of tileDim rows; appends to the shard files take one
+ *  more lock.
+ *
+ *  Tiles are stored row-major with tileDim x tileDim elements each. Only the
+ *  entries with row <= col are meaningful on diagonal tiles; the others are
+ *  stored as zeros.
+ *
+ *  With _singleFile (WITH_MPI only), all processes write one file per result
+ *  kind through MPI-IO instead of one file per shard:
+ *		P.tiles				ShardHeader (one shard holding all tiles) followed by all
+ *							tiles in global tile order, tile t at sizeof(ShardHeader) + t * tileBytes
+ *		P.neighbors			ShardHeader followed by _numNeighbors NeighborRecords per row
+ *  The offsets follow from the global tile index and the row index, so no
+ *  index file is needed. Rank 0 writes the header. The tiles go through the
+ *  same two buffers as the shard files: a full buffer is written with
+ *  nonblocking independent writes, one per run of consecutive tiles, while the
+ *  other one fills. Processes fill their buffers at different times under the
+ *  dynamic tile distribution, so the writes are not collective. Edges and
+ *  histograms are still written per shard.
+ *
+ *  With _packedEncoding, the tiles also go to P.packed, the full matrix as a
+ *  packed upper triangle shared by all shards (see PackedMatrix.hpp). The
+ *  quantization range is [_minValue, _maxValue] when both are given, [-1, 1]
+ *  otherwise.
+ */
+
+#ifndef __RESULT_WRITER_HPP
+#define __RESULT_WRITER_HPP
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <PackedMatrix.hpp>
+#ifdef WITH_MPI
+#include <mpi.h>
+#endif
+
+#define RW_MAGIC	"PCCSHARD"
+#define RW_VERSION	2
+
+/*number of tiles per output buffer. Two buffers are used*/
+#ifndef RW_TILES_PER_BUFFER
+#define RW_TILES_PER_BUFFER	4096
+#endif
+
+/*histogram bins per unit of value: values are rounded to 3 decimals*/
+#define RW_HISTOGRAM_BINS	1000
+
+/*locks over the top-K heaps. Rows of block b = row / tileDim take lock b % RW_ROW_LOCKS*/
+#define RW_ROW_LOCKS	256
+
+/*bytes of edge lines buffered per thread before they are appended to the shard file*/
+#define RW_EDGE_BUFFER_BYTES	(1 << 20)
+
+/*self-describing header of the shard files*/
+struct ShardHeader
+{
+	char _magic[8];				/*RW_MAGIC*/
+	int32_t _version;			/*RW_VERSION*/
+	int32_t _floatSize;		/*sizeof(FloatType)*/
+	int32_t _tileDim;			/*number of vectors per tile side*/
+	int32_t _vectorSize;	/*number of elements per vector*/
+	int64_t _numVectors;	/*matrix dimension*/
+	int64_t _numTiles;		/*number of tiles in the triangular tile space*/
+	int64_t _numShardTiles;	/*number of tiles in this shard*/
+	int32_t _shard;				/*shard index (MPI rank)*/
+	int32_t _numShards;		/*number of shards*/
+	char _metric[16];			/*name of the correlation measure*/
+	int32_t _numNeighbors;	/*records per row of a neighbor file*/
+	int32_t _reserved;
+
+	void init(const char* metric, const int shard, const int numShards,
+			const int64_t numVectors, const int vectorSize, const int tileDim,
+			const int floatSize) {
+		memset(this, 0, sizeof(ShardHeader));
+		memcpy(_magic, RW_MAGIC, 8);
+		_version = RW_VERSION;
+		_floatSize = floatSize;
+		_tileDim = tileDim;
+		_vectorSize = vectorSize;
+		_numVectors = numVectors;
+		int64_t tileDimSize = (numVectors + tileDim - 1) / tileDim;
+		_numTiles = (tileDimSize + 1) * tileDimSize / 2;
+		_numShardTiles = 0;
+		_shard = shard;
+		_numShards = numShards;
+		strncpy(_metric, metric, sizeof(_metric) - 1);
+	}
+	bool isValid() const {
+		return memcmp(_magic, RW_MAGIC, 8) == 0 && _version == RW_VERSION;
+	}
+};
+
+struct ShardIndexEntry
+{
+	int64_t _tileIndex;	/*global tile index*/
+	int64_t _offset;		/*byte offset in the tile file*/
+};
+
+/*one top-K neighbor of a row in a single-file neighbor file. Unused records have _neighbor = -1*/
+struct NeighborRecord
+{
+	double _value;
+	int32_t _neighbor;
+	int32_t _count;			/*jointly observed elements of the pair, the vector size without missing values*/
+};
+
+/*output options shared by the engines*/
+struct ResultOptions
+{
+	ResultOptions() {
+		_writeTiles = true;
+		_numNeighbors = 0;
+		_writeEdges = false;
+		_minValue = -DBL_MAX;
+		_maxValue = DBL_MAX;
+		_singleFile = false;
+		_packedEncoding = PM_NONE;
+		_minCount = 0;
+		_writeHistogram = false;
+	}
+	inline bool enabled() const {
+		return _prefix.length() > 0;
+	}
+	std::string _prefix;	/*output prefix. Empty means no output*/
+	bool _writeTiles;		/*write binary tiles*/
+	int _numNeighbors;	/*per-row top-K. 0 disables*/
+	bool _writeEdges;		/*write all pairs within [_minValue, _maxValue] when top-K is disabled*/
+	double _minValue;		/*minimum reported value. Unbounded by default*/
+	double _maxValue;		/*maximum reported value. Unbounded by default*/
+	bool _singleFile;		/*one file for all processes via MPI-IO [WITH_MPI]*/
+	int _packedEncoding;	/*packed full matrix P.packed. PM_NONE disables*/
+	int _minCount;			/*minimum number of jointly observed elements of reported pairs*/
+	bool _writeHistogram;	/*write the histogram of the values per count*/
+};
+
+template<typename FloatType>
+class ResultWriter
+{
+public:
+	ResultWriter(const ResultOptions& options, const char* metric,
+			const int shard, const int numShards, const int numVectors,
+			const int vectorSize, const int tileDim, const int numThreads = 1) {
+		char name[32];
+
+		_options = options;
+		_tileDim = tileDim;
+		_tileSize = (ssize_t) tileDim * tileDim;
+		_numVectors = numVectors;
+		_vectorSize = vectorSize;
+		_header.init(metric, shard, numShards, numVectors, vectorSize, tileDim,
+				sizeof(FloatType));
+		_header._numNeighbors = _options._numNeighbors;
+		sprintf(name, ".%d", shard);
+		_shardPrefix = _options._prefix + name;
+		_tileFile = NULL;
+		_edgeFile = NULL;
+		_buffers[0] = _buffers[1] = NULL;
+		_current = 0;
+		_numBuffered = 0;
+		_writing = false;
+		_closed = false;
+		_collective = false;
+		_packed = NULL;
+		_histogramFile = NULL;
+		_threads.resize(std::max(1, numThreads));
+		pthread_mutex_init(&_fileLock, NULL);
+		for (int i = 0; i < RW_ROW_LOCKS; ++i) {
+			pthread_mutex_init(&_rowLocks[i], NULL);
+		}
+#ifdef WITH_MPI
+		_collective = _options._singleFile;
+#endif
+
+		/*binary tiles*/
+		if (_options._writeTiles) {
+#ifdef WITH_MPI
+			if (_collective) {
+				_openTilesCollective();
+			}
+#endif
+			if (!_collective) {
+				_tileFile = fopen((_shardPrefix + ".tiles").c_str(), "wb");
+				if (!_tileFile) {
+					fprintf(stderr, "Failed to open file %s\n", (_shardPrefix + ".tiles").c_str());
+					exit(-1);
+				}
+				fwrite(&_header, sizeof(ShardHeader), 1, _tileFile);
+			}
+			for (int i = 0; i < 2; ++i) {
+				_buffers[i] = (FloatType*) malloc(RW_TILES_PER_BUFFER * _tileSize * sizeof(FloatType));
+				if (!_buffers[i]) {
+					fprintf(stderr, "Memory allocation failed\n");
+					exit(-1);
+				}
+			}
+		}
+
+		/*packed full matrix*/
+		if (_options._packedEncoding != PM_NONE) {
+			bool bounded = _options._minValue > -DBL_MAX && _options._maxValue < DBL_MAX;
+			_packed = new PackedMatrixWriter<FloatType>(_options._prefix + ".packed",
+					metric, shard, numVectors, vectorSize, tileDim,
+					_options._packedEncoding, bounded ? _options._minValue : -1,
+					bounded ? _options._maxValue : 1, _threads.size());
+		}
+
+		/*top-K neighbors*/
+		if (_options._numNeighbors > 0) {
+			_heaps.resize(numVectors);
+		} else if (_options._writeEdges) {
+			_edgeFile = fopen((_shardPrefix + ".edges.csv").c_str(), "w");
+			if (!_edgeFile) {
+				fprintf(stderr, "Failed to open file %s\n", (_shardPrefix + ".edges.csv").c_str());
+				exit(-1);
+			}
+		}
+
+		/*histogram, filled per count on first use*/
+		if (_options._writeHistogram) {
+			_histogramFile = fopen((_shardPrefix + ".histogram.csv").c_str(), "w");
+			if (!_histogramFile) {
+				fprintf(stderr, "Failed to open file %s\n", (_shardPrefix + ".histogram.csv").c_str());
+				exit(-1);
+			}
+			for (size_t t = 0; t < _threads.size(); ++t) {
+				_threads[t]._histogram.resize(vectorSize + 1, NULL);
+			}
+		}
+	}
+	~ResultWriter() {
+		close();
+		pthread_mutex_destroy(&_fileLock);
+		for (int i = 0; i < RW_ROW_LOCKS; ++i) {
+			pthread_mutex_destroy(&_rowLocks[i]);
+		}
+	}
+
+	/*add a computed tile. tile[(row - rowStart) * ld + col - colStart] holds the value of (row, col)
+	 *and counts[(row - rowStart) * countLd + col - colStart], if given, its number of jointly observed elements.
+	 *thread is the index of the calling thread, below numThreads*/
+	void addTile(const ssize_t tileIndex, const int rowStart, const int rowEnd,
+			const int colStart, const int colEnd, const FloatType* tile,
+			const int ld, const int* counts = NULL, const int countLd = 0,
+			const int thread = 0) {
+		int row, col, count;
+		FloatType value;
+		ThreadState& state = _threads[thread];
+
+		/*binary tiles*/
+		if (_tileFile) {
+			pthread_mutex_lock(&_fileLock);
+			ShardIndexEntry entry;
+			entry._tileIndex = tileIndex;
+			entry._offset = sizeof(ShardHeader)
+					+ (int64_t) _index.size() * _tileSize * sizeof(FloatType);
+			_index.push_back(entry);
+
+			_copyTile(_buffers[_current] + _numBuffered * _tileSize, rowStart,
+					rowEnd, colStart, colEnd, tile, ld);
+			if (++_numBuffered == RW_TILES_PER_BUFFER) {
+				_flush();
+			}
+			pthread_mutex_unlock(&_fileLock);
+		}
+#ifdef WITH_MPI
+		else if (_collective && _options._writeTiles) {
+			pthread_mutex_lock(&_fileLock);
+			/*position in the current buffer*/
+			ShardIndexEntry entry;
+			entry._tileIndex = tileIndex;
+			entry._offset = _numBuffered;
+			_index.push_back(entry);
+
+			_copyTile(_buffers[_current] + _numBuffered * _tileSize, rowStart,
+					rowEnd, colStart, colEnd, tile, ld);
+			if (++_numBuffered == RW_TILES_PER_BUFFER) {
+				_flushCollective();
+			}
+			pthread_mutex_unlock(&_fileLock);
+		}
+#endif
+
+		if (_packed) {
+			_packed->addTile(tileIndex, rowStart, rowEnd, colStart, colEnd, tile, ld, thread);
+		}
+
+		if (_options._numNeighbors > 0) {
+			_addNeighbors(rowStart, rowEnd, colStart, colEnd, tile, ld, counts, countLd);
+		}
+
+		/*edges or histogram*/
+		if (_edgeFile || _histogramFile) {
+			for (row = rowStart; row < rowEnd; ++row) {
+				for (col = colStart; col < colEnd; ++col) {
+					if (row > col) {
+						continue;
+					}
+					value = tile[(row - rowStart) * ld + col - colStart];
+					count = counts ? counts[(row - rowStart) * countLd + col - colStart] : _vectorSize;
+					if (_histogramFile && value == value) {
+						_addToHistogram(state._histogram, count, value);
+					}
+					if (_edgeFile && _isReported(value, count)) {
+						_addEdge(state, row, col, value);
+					}
+				}
+			}
+			if (state._edges.size() >= RW_EDGE_BUFFER_BYTES) {
+				_appendEdges(state);
+			}
+		}
+	}
+
+	/*flush all buffers and write the index and top-K lists. Collective with _singleFile*/
+	void close() {
+		if (_closed) {
+			return;
+		}
+		_closed = true;
+		_mergeThreads();
+		if (_packed) {
+			_packed->close();
+			delete _packed;
+			_packed = NULL;
+		}
+
+#ifdef WITH_MPI
+		if (_collective) {
+			if (_options._writeTiles) {
+				_closeTilesCollective();
+			}
+			if (_options._numNeighbors > 0) {
+				_writeNeighborsCollective();
+			}
+			if (_edgeFile) {
+				fclose(_edgeFile);
+				_edgeFile = NULL;
+			}
+			_writeHistogram();
+			return;
+		}
+#endif
+
+		if (_tileFile) {
+			if (_numBuffered > 0) {
+				_flush();
+			}
+			_wait();
+
+			/*update the header*/
+			_header._numShardTiles = _index.size();
+			fseek(_tileFile, 0, SEEK_SET);
+			fwrite(&_header, sizeof(ShardHeader), 1, _tileFile);
+			fclose(_tileFile);
+			_tileFile = NULL;
+			free(_buffers[0]);
+			free(_buffers[1]);
+
+			/*write the index*/
+			FILE* file = fopen((_shardPrefix + ".index").c_str(), "wb");
+			if (!file) {
+				fprintf(stderr, "Failed to open file %s\n", (_shardPrefix + ".index").c_str());
+				exit(-1);
+			}
+			fwrite(&_header, sizeof(ShardHeader), 1, file);
+			if (_index.size()) {
+				fwrite(&_index[0], sizeof(ShardIndexEntry), _index.size(), file);
+			}
+			fclose(file);
+		}
+
+		if (_options._numNeighbors > 0) {
+			_writeNeighbors();
+		}
+		if (_edgeFile) {
+			fclose(_edgeFile);
+			_edgeFile = NULL;
+		}
+		_writeHistogram();
+	}
+
+private:
+	/*a top-K neighbor ordered by value and index*/
+	struct Neighbor {
+		Neighbor(const FloatType value, const int neighbor, const int count) {
+			_value = value;
+			_neighbor = neighbor;
+			_count = count;
+		}
+		bool operator>(const Neighbor& other) const {
+			return _value > other._value || (_value == other._value && _neighbor > other._neighbor);
+		}
+		FloatType _value;
+		int _neighbor;
+		int _count;
+	};
+
+	ResultOptions _options;
+	ShardHeader _header;
+	std::string _shardPrefix;
+	int _tileDim;
+	ssize_t _tileSize;
+	int _numVectors;
+	int _vectorSize;
+	bool _closed;
+
+	/*double-buffered binary tiles*/
+	FILE* _tileFile;
+	FloatType* _buffers[2];
+	int _current;
+	ssize_t _numBuffered;
+	ssize_t _numWriting;
+	int _writingBuffer;
+	bool _writing;
+	pthread_t _thread;
+	std::vector<ShardIndexEntry> _index;
+
+	/*single-file output: P.tiles and the pending writes of the buffer being written*/
+	bool _collective;
+#ifdef WITH_MPI
+	MPI_File _collectiveFile;
+	MPI_Datatype _tileType;
+	std::vector<MPI_Request> _requests;
+#endif
+
+	/*packed full matrix*/
+	PackedMatrixWriter<FloatType>* _packed;
+
+	FILE* _edgeFile;
+	FILE* _histogramFile;
+
+	/*per-row min-heaps of the top-K neighbors*/
+	std::vector<std::vector<Neighbor> > _heaps;
+	pthread_mutex_t _rowLocks[RW_ROW_LOCKS];
+
+	/*results of one thread, merged into _threads[0] at close()*/
+	struct ThreadState {
+		std::vector<int64_t*> _histogram;	/*frequencies per count and value bin*/
+		std::string _edges;	/*edge lines not yet appended to _edgeFile*/
+	};
+	std::vector<ThreadState> _threads;
+	pthread_mutex_t _fileLock;	/*appends to the shard files*/
+
+	/*copy a tile into dst, padding the ragged tiles at the matrix edge with zeros.
+	 *entries below the diagonal are not computed by all engines and are stored as zeros*/
+	inline void _copyTile(FloatType* dst, const int rowStart, const int rowEnd,
+			const int colStart, const int colEnd, const FloatType* tile,
+			const int ld) {
+		int row, col;
+		for (row = rowStart; row < rowEnd; ++row, dst += _tileDim) {
+			memcpy(dst, tile + (row - rowStart) * ld,
+					(colEnd - colStart) * sizeof(FloatType));
+			for (col = colStart; col < colEnd && col < row; ++col) {
+				dst[col - colStart] = 0;
+			}
+			for (col = colEnd - colStart; col < _tileDim; ++col) {
+				dst[col] = 0;
+			}
+		}
+		for (row = rowEnd - rowStart; row < _tileDim; ++row, dst += _tileDim) {
+			memset(dst, 0, _tileDim * sizeof(FloatType));
+		}
+	}
+
+	inline bool _isReported(const FloatType value, const int count) const {
+		return value >= _options._minValue && value <= _options._maxValue
+				&& count >= _options._minCount;
+	}
+
+	/*offer the pairs of a tile to the heaps of their rows, then of their columns.
+	 *One lock is held at a time, that of the block of the current heap*/
+	void _addNeighbors(const int rowStart, const int rowEnd, const int colStart,
+			const int colEnd, const FloatType* tile, const int ld, const int* counts,
+			const int countLd) {
+		int lock = -1, row, col, count;
+		FloatType value;
+
+		for (row = rowStart; row < rowEnd; ++row) {
+			lock = _switchLock(lock, row);
+			for (col = std::max(row, colStart); col < colEnd; ++col) {
+				value = tile[(row - rowStart) * ld + col - colStart];
+				count = counts ? counts[(row - rowStart) * countLd + col - colStart] : _vectorSize;
+				if (_isReported(value, count)) {
+					_push(row, col, value, count);
+				}
+			}
+		}
+		for (col = colStart; col < colEnd; ++col) {
+			lock = _switchLock(lock, col);
+			for (row = rowStart; row < rowEnd && row < col; ++row) {
+				value = tile[(row - rowStart) * ld + col - colStart];
+				count = counts ? counts[(row - rowStart) * countLd + col - colStart] : _vectorSize;
+				if (_isReported(value, count)) {
+					_push(col, row, value, count);
+				}
+			}
+		}
+		if (lock >= 0) {
+			pthread_mutex_unlock(&_rowLocks[lock]);
+		}
+	}
+	/*release the lock held, unless it is that of row, and take the one of row*/
+	inline int _switchLock(const int held, const int row) {
+		const int lock = (row / _tileDim) % RW_ROW_LOCKS;
+		if (lock != held) {
+			if (held >= 0) {
+				pthread_mutex_unlock(&_rowLocks[held]);
+			}
+			pthread_mutex_lock(&_rowLocks[lock]);
+		}
+		return lock;
+	}
+
+	inline void _push(const int row, const int neighbor, const FloatType value,
+			const int count) {
+		std::vector<Neighbor>& heap = _heaps[row];
+		const Neighbor entry(value, neighbor, count);
+
+		/*ties in value go to the larger index, whatever the order the pairs arrive in*/
+		if ((int) heap.size() < _options._numNeighbors) {
+			heap.push_back(entry);
+			std::push_heap(heap.begin(), heap.end(), std::greater<Neighbor>());
+		} else if (entry > heap.front()) {
+			std::pop_heap(heap.begin(), heap.end(), std::greater<Neighbor>());
+			heap.back() = entry;
+			std::push_heap(heap.begin(), heap.end(), std::greater<Neighbor>());
+		}
+	}
+
+	inline void _addToHistogram(std::vector<int64_t*>& histogram, const int count,
+			const double value) {
+		const int numBins = 2 * RW_HISTOGRAM_BINS + 1;
+		long bin = lrint(value * RW_HISTOGRAM_BINS) + RW_HISTOGRAM_BINS;
+
+		if (count < 0 || count > _vectorSize) {
+			return;
+		}
+		if (!histogram[count]) {
+			histogram[count] = (int64_t*) calloc(numBins, sizeof(int64_t));
+			if (!histogram[count]) {
+				fprintf(stderr, "Memory allocation failed\n");
+				exit(-1);
+			}
+		}
+		bin = std::max(0L, std::min((long) numBins - 1, bin));
+		++histogram[count][bin];
+	}
+
+	inline void _addEdge(ThreadState& state, const int row, const int col,
+			const double value) {
+		char line[64];
+		int length = snprintf(line, sizeof(line), "%d %d %g\n", row, col, value);
+		state._edges.append(line, length);
+	}
+	/*append the buffered edge lines of a thread to the shard file*/
+	void _appendEdges(ThreadState& state) {
+		pthread_mutex_lock(&_fileLock);
+		if (fwrite(state._edges.data(), 1, state._edges.size(), _edgeFile) != state._edges.size()) {
+			fprintf(stderr, "Failed to write the edges of shard %d\n", _header._shard);
+		}
+		pthread_mutex_unlock(&_fileLock);
+		state._edges.clear();
+	}
+
+	/*merge the histograms of all threads into _threads[0] and append their edges*/
+	void _mergeThreads() {
+		const int numBins = 2 * RW_HISTOGRAM_BINS + 1;
+		ThreadState& merged = _threads[0];
+
+		for (size_t t = 0; t < _threads.size(); ++t) {
+			ThreadState& state = _threads[t];
+			if (state._edges.size()) {
+				_appendEdges(state);
+			}
+			if (t == 0) {
+				continue;
+			}
+			for (size_t count = 0; count < state._histogram.size(); ++count) {
+				if (!state._histogram[count]) {
+					continue;
+				}
+				if (!merged._histogram[count]) {
+					merged._histogram[count] = state._histogram[count];
+				} else {
+					for (int bin = 0; bin < numBins; ++bin) {
+						merged._histogram[count][bin] += state._histogram[count][bin];
+					}
+					free(state._histogram[count]);
+				}
+				state._histogram[count] = NULL;
+			}
+		}
+		_threads.resize(1);
+	}
+
+	void _writeHistogram() {
+		std::vector<int64_t*>& histogram = _threads[0]._histogram;
+		if (!_histogramFile) {
+			return;
+		}
+		for (int count = 0; count <= _vectorSize; ++count) {
+			if (!histogram[count]) {
+				continue;
+			}
+			for (int bin = 0; bin <= 2 * RW_HISTOGRAM_BINS; ++bin) {
+				if (histogram[count][bin]) {
+					fprintf(_histogramFile, "%d %g %ld\n", count,
+							(double) (bin - RW_HISTOGRAM_BINS) / RW_HISTOGRAM_BINS,
+							(long) histogram[count][bin]);
+				}
+			}
+			free(histogram[count]);
+		}
+		std::vector<int64_t*>().swap(histogram);
+		fclose(_histogramFile);
+		_histogramFile = NULL;
+	}
+
+	void _writeNeighbors() {
+		FILE* file = fopen((_shardPrefix + ".neighbors.csv").c_str(), "w");
+		if (!file) {
+			fprintf(stderr, "Failed to open file %s\n", (_shardPrefix + ".neighbors.csv").c_str());
+			exit(-1);
+		}
+		for (int row = 0; row < _numVectors; ++row) {
+			std::vector<Neighbor>& heap = _heaps[row];
+			std::sort(heap.begin(), heap.end(), std::greater<Neighbor>());
+			for (size_t i = 0; i < heap.size(); ++i) {
+				fprintf(file, "%d %g %d %d\n", row, (double) heap[i]._value,
+						heap[i]._neighbor, heap[i]._count);
+			}
+			std::vector<Neighbor>().swap(heap);
+		}
+		fclose(file);
+	}
+
+#ifdef WITH_MPI
+	static MPI_File _openCollective(const std::string& fileName,
+			const MPI_Offset size) {
+		MPI_File file;
+		if (MPI_File_open(MPI_COMM_WORLD, (char*) fileName.c_str(),
+				MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+			fprintf(stderr, "Failed to open file %s\n", fileName.c_str());
+			exit(-1);
+		}
+		/*drop the stale tail of an existing file*/
+		MPI_File_set_size(file, size);
+		return file;
+	}
+
+	/*open P.tiles and write its header. Tile t is at sizeof(ShardHeader) + t * tileBytes*/
+	void _openTilesCollective() {
+		int rank;
+		MPI_Status status;
+		const ssize_t tileBytes = _tileSize * sizeof(FloatType);
+
+		MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+		ShardHeader header = _header;
+		header._shard = 0;
+		header._numShards = 1;
+		header._numShardTiles = header._numTiles;
+		_collectiveFile = _openCollective(_options._prefix + ".tiles",
+				sizeof(ShardHeader) + header._numTiles * tileBytes);
+		if (rank == 0) {
+			MPI_File_write_at(_collectiveFile, 0, &header, sizeof(ShardHeader), MPI_BYTE, &status);
+		}
+		MPI_Type_contiguous(tileBytes, MPI_BYTE, &_tileType);
+		MPI_Type_commit(&_tileType);
+	}
+
+	/*start writing the current buffer, one write per run of consecutive tiles, and switch buffers*/
+	void _flushCollective() {
+		FloatType* buffer = _buffers[_current];
+		MPI_Request request;
+		size_t first, last;
+
+		_waitCollective();
+		for (first = 0; first < _index.size(); first = last) {
+			for (last = first + 1; last < _index.size()
+					&& _index[last]._tileIndex == _index[last - 1]._tileIndex + 1; ++last);
+			MPI_File_iwrite_at(_collectiveFile, sizeof(ShardHeader)
+					+ (MPI_Offset) _index[first]._tileIndex * _tileSize * sizeof(FloatType),
+					buffer + _index[first]._offset * _tileSize, last - first, _tileType, &request);
+			_requests.push_back(request);
+		}
+		_index.clear();
+		_current ^= 1;
+		_numBuffered = 0;
+	}
+	inline void _waitCollective() {
+		if (_requests.size()) {
+			MPI_Waitall(_requests.size(), &_requests[0], MPI_STATUSES_IGNORE);
+			_requests.clear();
+		}
+	}
+	void _closeTilesCollective() {
+		if (_numBuffered > 0) {
+			_flushCollective();
+		}
+		_waitCollective();
+		MPI_File_close(&_collectiveFile);
+		MPI_Type_free(&_tileType);
+		free(_buffers[0]);
+		free(_buffers[1]);
+		std::vector<ShardIndexEntry>().swap(_index);
+	}
+
+	/*a top-K entry sent to the owner of its row*/
+	struct Item {
+		int32_t _row;
+		int32_t _neighbor;
+		double _value;
+		int32_t _count;
+	};
+
+	/*merge the per-process top-K lists on the row owners and write P.neighbors*/
+	void _writeNeighborsCollective() {
+		int rank, numProcs;
+		MPI_Datatype itemType, recordType;
+		MPI_Status status;
+		const int numNeighbors = _options._numNeighbors;
+
+		MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+		MPI_Comm_size(MPI_COMM_WORLD, &numProcs);
+		MPI_Type_contiguous(sizeof(Item), MPI_BYTE, &itemType);
+		MPI_Type_commit(&itemType);
+		MPI_Type_contiguous(sizeof(NeighborRecord), MPI_BYTE, &recordType);
+		MPI_Type_commit(&recordType);
+
+		/*row r is owned by process r / rowsPerProc. Rows are sent in order, so by owner*/
+		const int rowsPerProc = (_numVectors + numProcs - 1) / numProcs;
+		std::vector<Item> items;
+		std::vector<int> sendCounts(numProcs, 0), sendDispls(numProcs, 0),
+				recvCounts(numProcs), recvDispls(numProcs);
+		for (int row = 0; row < _numVectors; ++row) {
+			std::vector<Neighbor>& heap = _heaps[row];
+			for (size_t i = 0; i < heap.size(); ++i) {
+				Item item;
+				item._row = row;
+				item._neighbor = heap[i]._neighbor;
+				item._value = heap[i]._value;
+				item._count = heap[i]._count;
+				items.push_back(item);
+			}
+			sendCounts[row / rowsPerProc] += heap.size();
+			std::vector<Neighbor>().swap(heap);
+		}
+		MPI_Alltoall(&sendCounts[0], 1, MPI_INT, &recvCounts[0], 1, MPI_INT, MPI_COMM_WORLD);
+		int numReceived = 0;
+		for (int i = 0; i < numProcs; ++i) {
+			sendDispls[i] = i > 0 ? sendDispls[i - 1] + sendCounts[i - 1] : 0;
+			recvDispls[i] = numReceived;
+			numReceived += recvCounts[i];
+		}
+		std::vector<Item> received(numReceived + 1);
+		MPI_Alltoallv(items.size() ? &items[0] : NULL, &sendCounts[0], &sendDispls[0],
+				itemType, &received[0], &recvCounts[0], &recvDispls[0], itemType,
+				MPI_COMM_WORLD);
+		std::vector<Item>().swap(items);
+
+		/*keep the K largest values per own row*/
+		const int loRow = std::min(_numVectors, rank * rowsPerProc);
+		const int hiRow = std::min(_numVectors, loRow + rowsPerProc);
+		std::vector<NeighborRecord> records((ssize_t) (hiRow - loRow) * numNeighbors + 1);
+		for (size_t i = 0; i < records.size(); ++i) {
+			records[i]._value = 0;
+			records[i]._neighbor = -1;
+			records[i]._count = _vectorSize;
+		}
+		std::vector<std::vector<Neighbor> > rows(hiRow - loRow);
+		for (int i = 0; i < numReceived; ++i) {
+			rows[received[i]._row - loRow].push_back(Neighbor(received[i]._value,
+					received[i]._neighbor, received[i]._count));
+		}
+		for (int row = loRow; row < hiRow; ++row) {
+			std::vector<Neighbor>& list = rows[row - loRow];
+			std::sort(list.begin(), list.end(), std::greater<Neighbor>());
+			NeighborRecord* dst = &records[(ssize_t) (row - loRow) * numNeighbors];
+			for (size_t i = 0; i < list.size() && (int) i < numNeighbors; ++i) {
+				dst[i]._value = list[i]._value;
+				dst[i]._neighbor = list[i]._neighbor;
+				dst[i]._count = list[i]._count;
+			}
+		}
+
+		/*contiguous row ranges in row order*/
+		ShardHeader header = _header;
+		header._shard = 0;
+		header._numShards = 1;
+		header._numShardTiles = 0;
+		MPI_File file = _openCollective(_options._prefix + ".neighbors",
+				sizeof(ShardHeader) + (MPI_Offset) _numVectors * numNeighbors * sizeof(NeighborRecord));
+		if (rank == 0) {
+			MPI_File_write_at(file, 0, &header, sizeof(ShardHeader), MPI_BYTE, &status);
+		}
+		MPI_File_write_at_all(file,
+				sizeof(ShardHeader) + (MPI_Offset) loRow * numNeighbors * sizeof(NeighborRecord),
+				&records[0], (hiRow - loRow) * numNeighbors, recordType, &status);
+		MPI_File_close(&file);
+		MPI_Type_free(&itemType);
+		MPI_Type_free(&recordType);
+	}
+#endif	/*WITH_MPI*/
+
+	/*hand the current buffer to the writer thread and switch to the other buffer*/
+	void _flush() {
+		_wait();
+		_numWriting = _numBuffered;
+		_writingBuffer = _current;
+		_writing = true;
+		if (pthread_create(&_thread, NULL, _writerThread, this) != 0) {
+			/*write synchronously*/
+			_writerThread(this);
+			_writing = false;
+		}
+		_current ^= 1;
+		_numBuffered = 0;
+	}
+	inline void _wait() {
+		if (_writing) {
+			pthread_join(_thread, NULL);
+			_writing = false;
+		}
+	}
+	static void* _writerThread(void* arg) {
+		ResultWriter<FloatType>* writer = (ResultWriter<FloatType>*) arg;
+		if (fwrite(writer->_buffers[writer->_writingBuffer], sizeof(FloatType) * writer->_tileSize,
+				writer->_numWriting, writer->_tileFile) != (size_t) writer->_numWriting) {
+			fprintf(stderr, "Failed to write the tiles of shard %d\n", writer->_header._shard);
+		}
+		return NULL;
+	}
+};
+
+#endif	/*__RESULT_WRITER_HPP*/
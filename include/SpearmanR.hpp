@@ -24,6 +24,15 @@ using namespace std;
 #pragma once
 
 #include <DeviceUtils.hpp>
+#include <DotKernel.hpp>
+#include <RankTransform.hpp>
+#include <TileTuner.hpp>
+#include <TriangularIndex.hpp>
+#include <TileScheduler.hpp>
+#include <ResultWriter.hpp>
+#include <MPITileScheduler.hpp>
+#include <MPIRing.hpp>
+#include <NodeSharedMatrix.hpp>
 
 #ifdef WITH_MPI
 #include <mpi.h>
@@ -41,27 +50,53 @@ using namespace std;
 /*tile size*/
 #define SR_PHI_TILE_DIM	4		/*must be divided by 236*/
 #define SR_PHI_TILE_SIZE	(SR_PHI_TILE_DIM * SR_PHI_TILE_DIM)
-#define SR_MT_TILE_DIM		8
+#define SR_MT_TILE_DIM		8		/*default; see setTileGeometry()*/
 #define SR_MPI_TILE_DIM	8
 #define SR_MPI_TILE_SIZE (SR_MPI_TILE_DIM * SR_MPI_TILE_DIM)
 
-/*maximum dimension size*/
-#ifndef SR_MAX_MAT_DIM
-#define SR_MAX_MAT_DIM			(1<<25)
-#endif
-
 /*maximum Xeon Phi buffer size*/
 #define SR_PHI_BUFFER_SIZE (1 << 29)
 
 /*software barrier for hardware threads per core*/
 //#define SOFT_BARRIER	1	
 
+/*pairwise-complete modes for data with missing values (0.0)*/
+#define SR_MISSING_NONE		0	/*all elements are observed*/
+#define SR_MISSING_EXACT		1	/*ranks over the jointly observed elements of each pair*/
+#define SR_MISSING_GLOBAL_RANKS	2	/*ranks over the observed elements of each vector*/
+
+/*per-thread buffers of the pairwise-complete kernels, indexed by dense rank*/
+struct SRWorkspace
+{
+	SRWorkspace(const int vectorSize) {
+		_counts = (int*) _mm_malloc(2 * ((ssize_t) vectorSize + 1) * sizeof(int), 64);
+		_ranks = (double*) _mm_malloc(2 * ((ssize_t) vectorSize + 1) * sizeof(double), 64);
+		if (!_counts || !_ranks) {
+			fprintf(stderr, "Memory allocation failed\n");
+			exit(-1);
+		}
+		memset(_counts, 0, 2 * ((ssize_t) vectorSize + 1) * sizeof(int));
+		_countsY = _counts + vectorSize + 1;
+		_ranksY = _ranks + vectorSize + 1;
+	}
+	~SRWorkspace() {
+		_mm_free(_counts);
+		_mm_free(_ranks);
+	}
+
+	int* _counts;		/*jointly observed elements per dense rank of X, kept zero between pairs*/
+	int* _countsY;
+	double* _ranks;	/*average rank of each dense rank of X over the jointly observed elements*/
+	double* _ranksY;
+};
+
 /*template class*/
 template<typename FloatType>
 class SpearmanR {
 public:
 	SpearmanR(int numVectors, int vectorSize, int numCPUThreads,
-			int numMICThreads, int micIndex, int rank, int numProcs);
+			int numMICThreads, int micIndex, int rank, int numProcs,
+			bool ringBlock = false);
 	~SpearmanR();
 
 	inline FloatType* getVectors() {
@@ -94,6 +129,10 @@ public:
 	/*MPI*/
 #ifdef WITH_MPI
 	void runMPICPU();
+	void runMPICPURing();	/*ring distribution: O(N/p) vectors per process*/
+	/*rows [rowStart, rowEnd) of the input read in by this process before runMPICPU or
+	 *runMPICPURing, and where row rowStart goes. Collective*/
+	FloatType* getInputRows(int& rowStart, int& rowEnd);
 #ifdef WITH_PHI
 	void runMPIXeonPhi();
 #endif	/*with phi*/
@@ -101,9 +140,62 @@ public:
 
 	/*transpose the matrix*/
 	void transpose();
+
+	/*persisted results of the MPI engine*/
+	inline void setResultOptions(const ResultOptions& options) {
+		_resultOptions = options;
+	}
+
+	/*compute only shard shard of numShards of the tile space [multi-threaded mode]*/
+	inline void setShard(const int shard, const int numShards) {
+		_shard = shard;
+		_numShards = numShards;
+	}
+
+	/*pairwise-complete mode [multi-threaded and MPI CPU modes]*/
+	inline void setMissing(const int missing) {
+		_missing = missing;
+	}
+
+	/*tile geometry of the CPU engines*/
+	inline void setTileGeometry(const int tileDim, const int kBlock) {
+		if (tileDim > 0) {
+			_tileDim = tileDim;
+		}
+		if (kBlock > 0 && kBlock % 16 == 0) {
+			_kBlock = kBlock;
+		}
+	}
+	/*time candidate geometries on the loaded data (or use the per-host cache). Collective in the MPI modes*/
+	inline void autotuneTileGeometry() {
+		TileGeometry geometry;
+
+		/*only rank 0 times and touches the cache; all ranks must share one tile space*/
+		if (_rank == 0) {
+			/*rank 0 holds at least the rows from zero up to the end of its own ones*/
+			int numRows = _rowEnd;
+#ifdef WITH_MPI
+			if (_sharedVectors) {
+				int loRow;
+				_sharedVectors->getRowRange(loRow, numRows);
+			}
+#endif
+			geometry = TileTuner::tuneDotKernel<FloatType>("spearman", _vectors,
+					numRows, _vectorSize, _vectorSizeAligned, true);
+		}
+#ifdef WITH_MPI
+		int values[2] = { geometry._tileDim, geometry._kBlock };
+		MPI_Bcast(values, 2, MPI_INT, 0, MPI_COMM_WORLD);
+		geometry = TileGeometry(values[0], values[1]);
+#endif
+		setTileGeometry(geometry._tileDim, geometry._kBlock);
+	}
 private:
 	FloatType* _vectors; /*vector data. Stored consecutively and each vector contains an aligned number of elements*/
 	int _numVectors; /*number of vectors in the data*/
+	int _rowStart;	/*_vectors holds rows [_rowStart, _rowEnd), row i at (i - _rowStart) * _vectorSizeAligned*/
+	int _rowEnd;
+	bool _ringBlock;	/*only the own block of the ring is held [CPU_MPI_RING]*/
 	int _vectorSize; /*effective vector size, i.e. the real number of elements per vector*/
 	int _vectorSizeAligned; /*aligned to vector size to 16 so that the address is aligned to 64 byte boundary*/
 	//int _maxPartitionSize; /*maximum partition size for asynchronous mode*/
@@ -112,13 +204,51 @@ private:
 	int _micIndex;	/*index of MIC used by this processs*/
 	int _rank;			/*process rank*/
 	int _numProcs;	/*number of MPI processes*/
+	int _shard;			/*job-array shard of the multi-threaded engine*/
+	int _numShards;	/*number of job-array shards*/
 	int _tiledPrMatrix; /*how the pearson correlation matrix is stored*/
+	int _tileDim;	/*tile dimension for the CPU engines*/
+	int _kBlock;	/*K-block size of the dot-product kernel*/
+	ResultOptions _resultOptions;	/*output of the MPI engine*/
+	int _missing;	/*pairwise-complete mode*/
+#ifdef WITH_MPI
+	NodeSharedMatrix<FloatType>* _sharedVectors;	/*node-local shared input of the MPI engine*/
+#endif
 	FloatType* _spearmanCorr; /*pearson correlation matrix*/
 
 	/*used for software barrier*/
 	int* _barriers;
 	int* _counts;
 
+	/*average ranks of the vectors. The pairwise-complete modes rank the observed
+	 *elements of a vector, dense for the exact mode, and missing ones stay 0*/
+	inline void _rankVectors(FloatType* vectors, const int numVectors, int numThreads) {
+		if (numThreads < 1) {
+			numThreads = omp_get_num_procs();
+		}
+		RankTransform::rankMatrix(vectors, numVectors, _vectorSize, _vectorSizeAligned,
+				_missing == SR_MISSING_EXACT ? RT_TIES_DENSE : RT_TIES_AVERAGE,
+				numThreads, _missing != SR_MISSING_NONE);
+	}
+	inline void _checkMissing() {
+		if (_missing != SR_MISSING_NONE) {
+			fprintf(stderr, "Pairwise-complete mode is supported by the multi-threaded and MPI CPU engines only\n");
+			exit(-1);
+		}
+	}
+	FloatType _computeSRCorrMissing(SRWorkspace& ws, const FloatType* __restrict__ vecX,
+			const FloatType* __restrict__ vecY, int& count);
+	FloatType _computeSRCorrExact(SRWorkspace& ws, const FloatType* __restrict__ vecX,
+			const FloatType* __restrict__ vecY, int& count);
+	FloatType _computeSRCorrGlobalRanks(const FloatType* __restrict__ vecX,
+			const FloatType* __restrict__ vecY, int& count);
+	/*tile of the pairwise-complete mode. rowVectors and colVectors hold the vectors
+	 *from rowStart and colStart. Only the pairs with row <= col are computed*/
+	void _computeTileMissing(SRWorkspace& ws, const FloatType* rowVectors,
+			const int rowStart, const int rowEnd, const FloatType* colVectors,
+			const int colStart, const int colEnd, FloatType* tile, int* counts,
+			const int ld);
+
 	/*for Xeon Phi*/
 #ifdef WITH_PHI
 	__attribute__((target(mic)))
@@ -165,24 +295,13 @@ private:
 
 	/*static function members*/
 public:
-	/*when matrix dimension size is large than 2^21, we should use long double instead of double*/
+	/*exact integer mappings, see TriangularIndex.hpp*/
 #ifdef WITH_PHI
 	__attribute__((target(mic)))
 #endif
 	inline void getCoordinate(const ssize_t globalIndex,
 			const ssize_t matrixDimSize, int& row, int& col) {
-#if SR_MAX_MAT_DIM < (1 << 25)
-		typedef double mydouble;
-#else
-		typedef long double mydouble;
-#endif
-		mydouble p, q;
-		p = static_cast<mydouble>(matrixDimSize - 1);
-		q = static_cast<mydouble>(globalIndex);
-		row = (int) ceil(p - 0.5 - sqrt(p * p + p - 2 * (q + 1) + 0.25));
-		col = row
-				+ (globalIndex - (2 * (matrixDimSize - 1) - row + 1) * row / 2)
-				+ 1;
+		TriangularIndex::getStrictCoordinate(globalIndex, matrixDimSize, row, col);
 	}
 
 	/*conditions: row < col*/
@@ -191,16 +310,7 @@ public:
 #endif
 	inline ssize_t getGlobalIndex(const ssize_t matrixDimSize, const int row,
 			const int col) {
-#if SR_MAX_MAT_DIM < (1 << 25)
-		typedef double mydouble;
-#else
-		typedef long double mydouble;
-#endif
-
-		mydouble p, q;
-		p = static_cast<mydouble>(matrixDimSize);
-
-		return (ssize_t) ((p - 1 - 0.5 * (row - 1)) * row + col - (row + 1));
+		return TriangularIndex::getStrictIndex(matrixDimSize, row, col);
 	}
 
 #ifdef WITH_PHI
@@ -208,16 +318,7 @@ public:
 #endif
 	inline void getTileCoordinate(const ssize_t globalIndex,
 			const ssize_t tileDim, int& row, int& col) {
-#if SR_MAX_MAT_DIM < (1 << 25)
-		typedef double mydouble;
-#else
-		typedef long double mydouble;
-#endif
-		mydouble p, q;
-		p = static_cast<mydouble>(tileDim);
-		q = static_cast<mydouble>(globalIndex);
-		row = (int) ceil(p - 0.5 - sqrt(p * p + p - 2 * (q + 1) + 0.25));
-		col = row + (globalIndex - (2 * tileDim - row + 1) * row / 2);
+		TriangularIndex::getUpperCoordinate(globalIndex, tileDim, row, col);
 	}
 
 	/*conditions: row <= col*/
@@ -226,16 +327,7 @@ public:
 #endif
 	inline ssize_t getTileGlobalIndex(const ssize_t matrixDimSize, const int row,
 		const int col) {
-#if SR_MAX_MAT_DIM < (1 << 25)
-    typedef double mydouble;
-#else
-    typedef long double mydouble;
-#endif
-
-    mydouble p, q;
-    p = static_cast<mydouble>(matrixDimSize);
-
-    return (ssize_t) ((p - 0.5 * (row - 1)) * row + col - row);
+		return TriangularIndex::getUpperIndex(matrixDimSize, row, col);
 	}
 #ifdef WITH_PHI
 __attribute__((target(mic)))
@@ -270,7 +362,7 @@ __attribute__((target(mic)))
 
 template<typename FloatType>
 SpearmanR<FloatType>::SpearmanR(int numVectors, int vectorSize, int numCPUThreads,
-		int numMICThreads, int micIndex, int rank, int numProcs) {
+		int numMICThreads, int micIndex, int rank, int numProcs, bool ringBlock) {
 	int alignment = 64 / sizeof(FloatType);	/*align to 64 byte boundary*/
 	_numVectors = numVectors;
 	_vectorSize = vectorSize;
@@ -280,21 +372,32 @@ SpearmanR<FloatType>::SpearmanR(int numVectors, int vectorSize, int numCPUThread
 	_micIndex = micIndex; /*index of mic device*/
 	_rank = rank;
 	_numProcs = numProcs;
-
-	/*check the number of vectors*/
-	if (_numVectors > SR_MAX_MAT_DIM) {
-		fprintf(stderr,
-				"The number of vectors exceeds the maximum limit (%ld)\n",
-				(ssize_t) SR_MAX_MAT_DIM);
-		exit(-1);
-	}
+	_shard = 0;
+	_numShards = 1;
+	_missing = SR_MISSING_NONE;
+#ifdef WITH_MPI
+	_sharedVectors = NULL;
+#endif
+	_tileDim = SR_MT_TILE_DIM;
+	_kBlock = DK_K_BLOCK;
 
 	/*allocate space*/
 	_spearmanCorr = NULL;
 
+	/*all vectors, or only the own block of the ring*/
+	_ringBlock = ringBlock;
+	_rowStart = 0;
+	_rowEnd = _numVectors;
+#ifdef WITH_MPI
+	if (_ringBlock) {
+		MPIRing<FloatType>::getBlockRange(_numVectors, MPIRing<FloatType>::getBlockSize(
+				_numVectors, _numProcs, TT_MAX_TILE_DIM), _rank, _rowStart, _rowEnd);
+	}
+#endif
+
 	/*align each vector*/
 	_vectors = (FloatType*) mm_malloc(
-			(ssize_t)_numVectors * _vectorSizeAligned * sizeof(FloatType), 64);
+			(ssize_t)max(1, _rowEnd - _rowStart) * _vectorSizeAligned * sizeof(FloatType), 64);
 	if (!_vectors) {
 		fprintf(stderr, "Memory allocation failed at line %d in file %s\n",
 		__LINE__, __FILE__);
@@ -304,6 +407,13 @@ SpearmanR<FloatType>::SpearmanR(int numVectors, int vectorSize, int numCPUThread
 
 template<typename FloatType>
 SpearmanR<FloatType>::~SpearmanR() {
+#ifdef WITH_MPI
+	if (_sharedVectors) {
+		/*_vectors points into the shared window*/
+		delete _sharedVectors;
+		_vectors = NULL;
+	}
+#endif
 	if (_vectors) {
 		mm_free(_vectors);
 	}
@@ -315,19 +425,144 @@ SpearmanR<FloatType>::~SpearmanR() {
 template<typename FloatType>
 void SpearmanR<FloatType>::generateRandomData(const int seed) {
 	srand48(11);
-	for (int i = 0; i < _numVectors; ++i) {
-		FloatType* __restrict__ dst = _vectors + i * _vectorSizeAligned;
+	/*rows before the held ones still draw their numbers, so that a ring block gets the rows of the full matrix*/
+	for (ssize_t i = 0; i < (ssize_t) _rowStart * _vectorSize; ++i) {
+		drand48();
+	}
+	for (int i = _rowStart; i < _rowEnd; ++i) {
+		FloatType* __restrict__ dst = _vectors + (ssize_t) (i - _rowStart) * _vectorSizeAligned;
 		for (int j = 0; j < _vectorSize; ++j) {
 			dst[j] = drand48();
 		}
 	}
 }
+/*Spearman correlation over the elements observed in both vectors*/
+template<typename FloatType>
+FloatType SpearmanR<FloatType>::_computeSRCorrMissing(SRWorkspace& ws,
+		const FloatType* __restrict__ vecX, const FloatType* __restrict__ vecY, int& count) {
+	FloatType corr;
+
+	if (_missing == SR_MISSING_EXACT) {
+		corr = _computeSRCorrExact(ws, vecX, vecY, count);
+	} else {
+		corr = _computeSRCorrGlobalRanks(vecX, vecY, count);
+	}
+	if (count < 2 || count < _resultOptions._minCount) {
+		return NAN;
+	}
+	return corr;
+}
+
+/*the vectors hold dense ranks. Counting the jointly observed elements per dense
+ *rank filters the sort order of each vector through the other's observed
+ *elements, and the prefix sums of the counts give the average ranks over them*/
+template<typename FloatType>
+FloatType SpearmanR<FloatType>::_computeSRCorrExact(SRWorkspace& ws,
+		const FloatType* __restrict__ vecX, const FloatType* __restrict__ vecY, int& count) {
+	int* __restrict__ countsX = ws._counts;
+	int* __restrict__ countsY = ws._countsY;
+	double* __restrict__ ranksX = ws._ranks;
+	double* __restrict__ ranksY = ws._ranksY;
+	int j, maxX = 0, maxY = 0, numObserved = 0;
+	double start, sumXX = 0, sumYY = 0, sumXY = 0;
+
+	for (j = 0; j < _vectorSize; ++j) {
+		const int x = (int) vecX[j];
+		const int y = (int) vecY[j];
+		if (x != 0 && y != 0) {
+			countsX[x]++;
+			countsY[y]++;
+			maxX = max(maxX, x);
+			maxY = max(maxY, y);
+			++numObserved;
+		}
+	}
+	count = numObserved;
+	if (numObserved < 2 || numObserved < _resultOptions._minCount) {
+		memset(countsX, 0, (maxX + 1) * sizeof(int));
+		memset(countsY, 0, (maxY + 1) * sizeof(int));
+		return NAN;
+	}
+
+	/*a tie group of c elements after start others spans the ranks start + 1 .. start + c*/
+	for (j = 1, start = 0; j <= maxX; ++j) {
+		ranksX[j] = start + (countsX[j] + 1) * 0.5;
+		sumXX += countsX[j] * ranksX[j] * ranksX[j];
+		start += countsX[j];
+		countsX[j] = 0;
+	}
+	for (j = 1, start = 0; j <= maxY; ++j) {
+		ranksY[j] = start + (countsY[j] + 1) * 0.5;
+		sumYY += countsY[j] * ranksY[j] * ranksY[j];
+		start += countsY[j];
+		countsY[j] = 0;
+	}
+	for (j = 0; j < _vectorSize; ++j) {
+		const int x = (int) vecX[j];
+		const int y = (int) vecY[j];
+		if (x != 0 && y != 0) {
+			sumXY += ranksX[x] * ranksY[y];
+		}
+	}
+
+	/*both rank vectors have the mean (n + 1) / 2*/
+	const double mean = (numObserved + 1) * 0.5;
+	const double sumMean = numObserved * mean * mean;
+	return (sumXY - sumMean) / sqrt((sumXX - sumMean) * (sumYY - sumMean));
+}
+
+/*the vectors hold average ranks over their own observed elements. Pearson
+ *correlation of the ranks over the jointly observed elements*/
+template<typename FloatType>
+FloatType SpearmanR<FloatType>::_computeSRCorrGlobalRanks(const FloatType* __restrict__ vecX,
+		const FloatType* __restrict__ vecY, int& count) {
+	double n = 0, sumX = 0, sumY = 0, sumXX = 0, sumYY = 0, sumXY = 0;
+
+#pragma vector aligned
+#pragma simd reduction(+:n, sumX, sumY, sumXX, sumYY, sumXY)
+	for (int j = 0; j < _vectorSize; ++j) {
+		const double x = vecX[j];
+		const double y = vecY[j];
+		const double observedX = x != 0 ? 1 : 0;
+		const double observedY = y != 0 ? 1 : 0;
+		n += observedX * observedY;
+		sumX += x * observedY;
+		sumY += y * observedX;
+		sumXX += x * x * observedY;
+		sumYY += y * y * observedX;
+		sumXY += x * y;
+	}
+	count = (int) n;
+	return (n * sumXY - sumX * sumY) / sqrt((n * sumXX - sumX * sumX) * (n * sumYY - sumY * sumY));
+}
+
+template<typename FloatType>
+void SpearmanR<FloatType>::_computeTileMissing(SRWorkspace& ws,
+		const FloatType* rowVectors, const int rowStart, const int rowEnd,
+		const FloatType* colVectors, const int colStart, const int colEnd,
+		FloatType* tile, int* counts, const int ld) {
+	for (int row = rowStart; row < rowEnd; ++row) {
+		const FloatType* vecX = rowVectors + (ssize_t) (row - rowStart) * _vectorSizeAligned;
+		for (int col = colStart; col < colEnd; ++col) {
+			const ssize_t index = (ssize_t) (row - rowStart) * ld + col - colStart;
+			if (row > col) {
+				tile[index] = 0;
+				counts[index] = 0;
+				continue;
+			}
+			tile[index] = _computeSRCorrMissing(ws, vecX,
+					colVectors + (ssize_t) (col - colStart) * _vectorSizeAligned, counts[index]);
+		}
+	}
+}
+
 template<typename FloatType>
 void SpearmanR<FloatType>::runSingleThreaded() {
 	double stime, etime;
 #ifdef VERBOSE
 	fprintf(stderr, "execute function %s\n", __FUNCTION__);
 #endif
+	_checkMissing();
 
 	/*output matrix*/
 	_spearmanCorr = (FloatType*) mm_malloc(
@@ -343,35 +578,18 @@ void SpearmanR<FloatType>::runSingleThreaded() {
 
 	/*allocate vectors for mean and variance*/
 	double t1 = getSysTime();
-	int rank, j;
+	int j;
 	FloatType x, meanX, varX, prod;
 	FloatType* __restrict__ vecX;
 	FloatType* __restrict__ vecY;
 	const FloatType avg = 1.0 / (FloatType)_vectorSize;
 
+	/*average ranks of the vectors*/
+	_rankVectors(_vectors, _numVectors, 1);
+
 	vecX = _vectors;
-	CustomPair<FloatType, int>* ranks = (CustomPair<FloatType, int>*)mm_malloc(_vectorSize * sizeof(CustomPair<FloatType, int>), 64);
 	for (int i = 0; i < _numVectors; ++i, vecX += _vectorSizeAligned) {
 
-		/*get the rank vector*/
-		for(j = 0; j < _vectorSize; ++j){
-			ranks[j]._first = vecX[j];
-			ranks[j]._second = j;
-		}
-		qsort(ranks, _vectorSize, sizeof(CustomPair<FloatType, int>), CustomPair<FloatType, int>::ascendFirst);
-		for(j = 0, rank = 1; j < _vectorSize - 1; ++j){
-			vecX[ranks[j]._second] = rank;
-			if(ranks[j]._first != ranks[j + 1]._first){
-				rank++;
-			}
-		}
-		vecX[ranks[j]._second] = rank;
-
-		/*do we need to normalize the ranks to avoid overflow? FIXME*/
-    for(j = 0; j < _vectorSize; ++j){
-      vecX[j] /= rank;
-    }
-		
 		/*get the vector data*/
 		meanX = 0;
 #pragma vector aligned
@@ -398,7 +616,6 @@ void SpearmanR<FloatType>::runSingleThreaded() {
 			vecX[j] = x * varX;
 		}
 	}
-	mm_free(ranks);
 	double t2 = getSysTime();
 	fprintf(stderr, "time for ranking and transformation: %f seconds\n", t2 - t1);
 
@@ -437,7 +654,7 @@ void SpearmanR<FloatType>::runSingleThreaded() {
 template<typename FloatType>
 void SpearmanR<FloatType>::runMultiThreaded() {
 	double stime, etime;
-	const int tileDim = (_numVectors + SR_MT_TILE_DIM - 1) / SR_MT_TILE_DIM;
+	const int tileDim = (_numVectors + _tileDim - 1) / _tileDim;
 	const ssize_t numTiles = (ssize_t) (tileDim + 1) * tileDim / 2;
 	ssize_t totalNumPairs = 0;
 	const FloatType avg = 1.0 / (FloatType)_vectorSize;
@@ -464,11 +681,29 @@ void SpearmanR<FloatType>::runMultiThreaded() {
 	}
 	omp_set_num_threads(_numCPUThreads);
 
+	/*dynamic tile scheduler*/
+	TileScheduler scheduler(numTiles, _numCPUThreads);
+
+	/*job-array shard: a balanced slice of the tile space*/
+	ssize_t firstTile, lastTile;
+	TileScheduler::getShardRange(numTiles, _shard, _numShards, firstTile, lastTile);
+	scheduler.setRange(firstTile, lastTile);
+
+	/*persisted results of the shard*/
+	ResultWriter<FloatType>* writer = NULL;
+	if (_resultOptions.enabled()) {
+		writer = new ResultWriter<FloatType>(_resultOptions, "spearman", _shard,
+				_numShards, _numVectors, _vectorSize, _tileDim, _numCPUThreads);
+	}
+
+	/*ranks of the vectors*/
+	_rankVectors(_vectors, _numVectors, _numCPUThreads);
+
 	/*entering the core loop*/
 #pragma omp parallel reduction(+:totalNumPairs)
 	{
-		ssize_t chunkSize;
-		int row, col, rank, j;
+		ssize_t chunkSize, tileStart, tileEnd;
+		int row, col, j;
 		int loRowRange, hiRowRange;
 		int loColRange, hiColRange;
 		int startColPerRow, endColPerRow;
@@ -476,11 +711,8 @@ void SpearmanR<FloatType>::runMultiThreaded() {
 		ssize_t numPairsProcessed = 0;
 		FloatType meanX, varX, x, prod;
 		FloatType* __restrict__ vecX;
-		FloatType* __restrict__ vecY;
 		const int tid = omp_get_thread_num();
 		const int nthreads = omp_get_num_threads();
-		typedef CustomPair<FloatType, int> MyPair;
-		MyPair* ranks = (MyPair*)mm_malloc(_vectorSize * sizeof(MyPair), 64);
 
 		/*compute mean and variance*/
 		chunkSize = (_numVectors + nthreads - 1) / nthreads;
@@ -491,24 +723,10 @@ void SpearmanR<FloatType>::runMultiThreaded() {
 		for (row = loRowRange; row <= hiRowRange; ++row, vecX +=
 				_vectorSizeAligned) {
 
-    	/*get the rank vector*/
-    	for(j = 0; j < _vectorSize; ++j){
-      	ranks[j]._first = vecX[j];
-      	ranks[j]._second = j;
-    	}
-    	qsort(ranks, _vectorSize, sizeof(CustomPair<FloatType, int>), CustomPair<FloatType, int>::ascendFirst);
-	    for(j = 0, rank = 1; j < _vectorSize - 1; ++j){
-     		vecX[ranks[j]._second] = rank;
-    	  if(ranks[j]._first != ranks[j + 1]._first){
-        	rank++;
-  	   	}
- 	   	}
-			vecX[ranks[j]._second] = rank;
-
-			/*do we need to normalize the ranks to avoid overflow? FIXME*/
-    	for(j = 0; j < _vectorSize; ++j){
-      	vecX[j] /= rank;
-    	}
+			/*the pairwise-complete mode correlates the ranks per pair*/
+			if (_missing) {
+				continue;
+			}
 
 			/*compute the mean*/
 			meanX = 0;
@@ -539,65 +757,100 @@ void SpearmanR<FloatType>::runMultiThreaded() {
 		/*synchronize all threads*/
 #pragma omp barrier
 
-		/*compute pairwise correlation coefficient*/
-		chunkSize = (numTiles + nthreads - 1) / nthreads;
-		loRowRange = loColRange = tileDim + 1;
-		if (tid * chunkSize < numTiles) {
-			getTileCoordinate(tid * chunkSize, tileDim, loRowRange, loColRange);
+		/*per-thread tile buffer*/
+		FloatType* __restrict__ tile = (FloatType*) mm_malloc(
+				_tileDim * _tileDim * sizeof(FloatType), 64);
+		if (!tile) {
+			fprintf(stderr, "Memory allocation failed\n");
+			exit(-1);
 		}
-		hiRowRange = hiColRange = tileDim;
-		if ((tid + 1) * chunkSize <= numTiles) {
-			getTileCoordinate((tid + 1) * chunkSize - 1, tileDim, hiRowRange,
-					hiColRange);
+		/*jointly observed elements per pair [pairwise-complete mode]*/
+		SRWorkspace* ws = NULL;
+		int* counts = NULL;
+		if (_missing) {
+			ws = new SRWorkspace(_vectorSize);
+			counts = (int*) mm_malloc(_tileDim * _tileDim * sizeof(int), 64);
+			if (!counts) {
+				fprintf(stderr, "Memory allocation failed\n");
+				exit(-1);
+			}
 		}
-		//fprintf(stderr, "tid (%d): %d %d %d %d\n", tid, loRowRange, loColRange, hiRowRange, hiColRange);
-		for (int tileRow = loRowRange; tileRow <= hiRowRange; tileRow++) {
-			/*compute the effective range per row*/
-			startColPerRow = (tileRow == loRowRange) ? loColRange : tileRow;
-			endColPerRow = (tileRow == hiRowRange) ? hiColRange : tileDim - 1;
-
-			rowStart = tileRow * SR_MT_TILE_DIM;
-			rowEnd = min(_numVectors, rowStart + SR_MT_TILE_DIM);
-			for (int tileCol = startColPerRow; tileCol <= endColPerRow;
-					++tileCol) {
-				colStart = tileCol * SR_MT_TILE_DIM;
-				colEnd = min(_numVectors, colStart + SR_MT_TILE_DIM);
-				/*compute the tile*/
-				vecX = _vectors + rowStart * _vectorSizeAligned;
-				for (row = rowStart; row < rowEnd; ++row, vecX +=
-						_vectorSizeAligned) {
-					vecY = _vectors + colStart * _vectorSizeAligned;
-					for (col = colStart; col < colEnd; ++col, vecY +=
-							_vectorSizeAligned) {
-						if(row > col){
-							continue;
-						}
-						/*statistics*/
-						++numPairsProcessed;
 
-						prod = 0;
-#pragma vector aligned
-#pragma simd reduction(+:prod)
-						for (int j = 0; j < _vectorSize; ++j) {
-							prod += vecX[j] * vecY[j];
+		/*compute pairwise correlation coefficient*/
+		scheduler.threadStart(tid);
+		while (scheduler.nextChunk(tid, tileStart, tileEnd)) {
+			getTileCoordinate(tileStart, tileDim, loRowRange, loColRange);
+			getTileCoordinate(tileEnd - 1, tileDim, hiRowRange, hiColRange);
+			for (int tileRow = loRowRange; tileRow <= hiRowRange; tileRow++) {
+				/*compute the effective range per row*/
+				startColPerRow = (tileRow == loRowRange) ? loColRange : tileRow;
+				endColPerRow = (tileRow == hiRowRange) ? hiColRange : tileDim - 1;
+
+				rowStart = tileRow * _tileDim;
+				rowEnd = min(_numVectors, rowStart + _tileDim);
+				for (int tileCol = startColPerRow; tileCol <= endColPerRow;
+						++tileCol) {
+					colStart = tileCol * _tileDim;
+					colEnd = min(_numVectors, colStart + _tileDim);
+					/*compute the tile using the register-blocked kernel*/
+					if (_missing) {
+						_computeTileMissing(*ws, _vectors + (ssize_t) rowStart * _vectorSizeAligned,
+								rowStart, rowEnd, _vectors + (ssize_t) colStart * _vectorSizeAligned,
+								colStart, colEnd, tile, counts, _tileDim);
+					} else {
+						DotKernel<FloatType>::computeTile(_vectors, _vectorSize,
+								_vectorSizeAligned, rowStart, rowEnd, colStart, colEnd, tile,
+								_tileDim, _kBlock);
+					}
+					if (writer) {
+						writer->addTile(getTileGlobalIndex(tileDim, tileRow, tileCol),
+								rowStart, rowEnd, colStart, colEnd, tile, _tileDim, counts, _tileDim,
+								tid);
+					}
+					for (row = rowStart; row < rowEnd; ++row) {
+						for (col = colStart; col < colEnd; ++col) {
+							if(row > col){
+								continue;
+							}
+							/*statistics*/
+							++numPairsProcessed;
+
+							prod = tile[(row - rowStart) * _tileDim + col - colStart];
+							_spearmanCorr[(ssize_t)row * _numVectors + col] = prod;
+							_spearmanCorr[(ssize_t)col * _numVectors + row] = prod;
 						}
-						_spearmanCorr[(ssize_t)row * _numVectors + col] = prod;
-						_spearmanCorr[(ssize_t)col * _numVectors + row] = prod;
 					}
 				}
 			}
 		}
-		mm_free(ranks);
+		scheduler.threadFinish(tid);
+		mm_free(tile);
+		if (ws) {
+			delete ws;
+			mm_free(counts);
+		}
 
 		/*reduction*/
 		totalNumPairs += numPairsProcessed;
 	} /*#pragma omp paralle*/
+
+	if (writer) {
+		writer->close();
+		delete writer;
+	}
 	
 	/*recored the system time*/
 	etime = getSysTime();
 	fprintf(stderr, "Overall time (%ld pairs): %f seconds\n", totalNumPairs,
 			etime - stime);
 
+	/*report load balance*/
+#ifdef VERBOSE
+	scheduler.report(stderr, true);
+#else
+	scheduler.report(stderr, false);
+#endif
+
 #if 0
   for(int i = 0; i < _numVectors; ++i){
     for(int j = i; j < _numVectors; ++j){
@@ -622,6 +875,7 @@ void SpearmanR<FloatType>::runSingleXeonPhi() {
 #ifdef VERBOSE
   fprintf(stderr, "execute function %s\n", __FUNCTION__);
 #endif
+	_checkMissing();
 
 	/*set the number of threads on Xeon Phi*/
 #pragma offload target(mic:_micIndex) inout(_numMICThreads)
@@ -683,15 +937,14 @@ void SpearmanR<FloatType>::runSingleXeonPhi() {
 	{
 #pragma omp parallel
 		{
-			int row, col, rank, j;
+			int row, col, j;
 			int chunkSize, loRowRange, hiRowRange;
 			FloatType x, y, r, meanX, varX;
 			FloatType* __restrict__ vecX;
 			const int tid = omp_get_thread_num();
 			const int nthreads = omp_get_num_threads();
 			const FloatType avg = 1.0 / (FloatType)_vectorSize;
-			typedef CustomPair<FloatType, int> MyPair;
-			MyPair* ranks = (MyPair*)mm_malloc(_vectorSize * sizeof(MyPair), 64);
+			RankBuffer<FloatType> ranks(_vectorSize);
 
 			/*compute mean and variance*/
 			chunkSize = (_numVectors + nthreads - 1) / nthreads;
@@ -702,23 +955,8 @@ void SpearmanR<FloatType>::runSingleXeonPhi() {
 			for (row = loRowRange; row < hiRowRange; ++row, vecX +=
 					_vectorSizeAligned) {
 
-    		/*get the rank vector*/
-      	for(j = 0; j < _vectorSize; ++j){
-      	  ranks[j]._first = vecX[j];
-        	ranks[j]._second = j;
-      	}
-      	qsort(ranks, _vectorSize, sizeof(CustomPair<FloatType, int>), CustomPair<FloatType, int>::ascendFirst);
-	    	for(j = 0, rank = 1; j < _vectorSize - 1; ++j){
-      		vecX[ranks[j]._second] = rank;
-      		if(ranks[j]._first != ranks[j + 1]._first){
-        		rank++;
-      		}
-   		 	}
-				vecX[ranks[j]._second] = rank;
-				/*do we need to normalize the ranks to avoid overflow? FIXME*/
-    		for(j = 0; j < _vectorSize; ++j){
-      		vecX[j] /= rank;
-    		}
+    		/*average ranks of the vector*/
+    		RankTransform::rankVector(vecX, _vectorSize, RT_TIES_AVERAGE, ranks);
 
 				/*compute the mean*/
 				meanX = 0;
@@ -746,7 +984,6 @@ void SpearmanR<FloatType>::runSingleXeonPhi() {
 					vecX[j] = x * varX;
 				}
 			}
-			mm_free(ranks);
 		}
 	}
 	double t2 = getSysTime();
@@ -1135,12 +1372,32 @@ __attribute__((target(mic))) void SpearmanR<double>::_runSingleXeonPhiCore(
 
 
 #ifdef WITH_MPI
+template<typename FloatType>
+FloatType* SpearmanR<FloatType>::getInputRows(int& rowStart, int& rowEnd) {
+	/*the own block of the ring*/
+	if (_ringBlock) {
+		rowStart = _rowStart;
+		rowEnd = _rowEnd;
+		return _vectors;
+	}
+
+	/*the own rows are read straight into the node-local shared copy*/
+	if (!_sharedVectors) {
+		_sharedVectors = new NodeSharedMatrix<FloatType>(MPI_COMM_WORLD,
+				_numVectors, _vectorSizeAligned);
+		mm_free(_vectors);
+		_vectors = _sharedVectors->getVectors();
+	}
+	_sharedVectors->getRowRange(rowStart, rowEnd);
+	return _vectors + (ssize_t) rowStart * _vectorSizeAligned;
+}
+
 template<typename FloatType>
 void SpearmanR<FloatType>::runMPICPU() {
 	double stime, etime;
-	const int tileDim = (_numVectors + SR_MPI_TILE_DIM -1) / SR_MPI_TILE_DIM;
+	const int tileDim = (_numVectors + _tileDim -1) / _tileDim;
+	const ssize_t tileSize = (ssize_t)_tileDim * _tileDim;
 	const ssize_t numTiles = (ssize_t)(tileDim + 1) * tileDim / 2;
-	const ssize_t numPairs = (ssize_t)(_numVectors + 1) * _numVectors / 2;	/*include self-vs-self*/
 	ssize_t numPairsProcessed = 0, totalNumPairs;
 
 #ifdef VERBOSE
@@ -1152,20 +1409,18 @@ void SpearmanR<FloatType>::runMPICPU() {
 	stime = getSysTime();
 
 	/*compute the mean and variance*/
-	int row, col;
+	int row, j;
 	int loRowRange, hiRowRange;
-	int loColRange, hiColRange;
-	int startColPerRow, endColPerRow;
 	int rowStart, rowEnd, colStart, colEnd;
-	ssize_t offset = 0, rowOffset, colOffset;
-	FloatType x, meanX, varX, prod;
+	ssize_t offset = 0;
+	FloatType x, meanX, varX;
 	FloatType* __restrict__ vecX;
-	FloatType* __restrict__ vecY;
 	const FloatType avg = 1.0 / (FloatType)_vectorSize;
 
 	/*allocate buffer*/
 	ssize_t chunkSize = (numTiles + _numProcs - 1) / _numProcs;
-	_spearmanCorr = (FloatType*)mm_malloc( chunkSize * SR_MPI_TILE_DIM * SR_MPI_TILE_DIM * sizeof(FloatType), 64);
+	ssize_t capacity = chunkSize * tileSize;
+	_spearmanCorr = (FloatType*)mm_malloc(capacity * sizeof(FloatType), 64);
 	if(!_spearmanCorr) {
 		fprintf(stderr, "Memory allocation failed\n");
 		exit(-1);
@@ -1173,34 +1428,21 @@ void SpearmanR<FloatType>::runMPICPU() {
 	_tiledPrMatrix = 1;
 
 	/*normalize the data*/
-	chunkSize = (_numVectors + _numProcs - 1) / _numProcs;
-	loRowRange = _rank * chunkSize;
-	hiRowRange = min(_numVectors, (_rank + 1) * (int) chunkSize);
+	if (!_sharedVectors) {
+		_sharedVectors = new NodeSharedMatrix<FloatType>(MPI_COMM_WORLD,
+				_numVectors, _vectorSizeAligned);
+	}
+	/*rows of the processes of a node are contiguous*/
+	_sharedVectors->getRowRange(loRowRange, hiRowRange);
 	vecX = _vectors + loRowRange * _vectorSizeAligned;
  	
-	typedef CustomPair<FloatType, int> MyPair;
-	MyPair* ranks = (MyPair*)mm_malloc(_vectorSize * sizeof(MyPair), 64);
+	_rankVectors(vecX, hiRowRange - loRowRange, _numCPUThreads);
 	for (row = loRowRange; row < hiRowRange; ++row, vecX +=
 			_vectorSizeAligned) {
- 
-  	/*get the rank vector*/
-		int j, rank;
-   	for(j = 0; j < _vectorSize; ++j){
-   		ranks[j]._first = vecX[j];
-    	ranks[j]._second = j;
-   	}
-   	qsort(ranks, _vectorSize, sizeof(MyPair), MyPair::ascendFirst);
-   	for(j = 0, rank = 1; j < _vectorSize - 1; ++j){
-     	vecX[ranks[j]._second] = rank;
-    	if(ranks[j]._first != ranks[j + 1]._first){
-      	rank++;
-     	}
-    }
-   	vecX[ranks[j]._second] = rank;
 
-		/*do we need to normalize the ranks to avoid overflow? FIXME*/
-		for(j = 0; j < _vectorSize; ++j){
-			vecX[j] /= rank;
+		/*the pairwise-complete mode correlates the ranks per pair*/
+		if (_missing) {
+			continue;
 		}
 
 		/*compute the mean*/
@@ -1229,95 +1471,258 @@ void SpearmanR<FloatType>::runMPICPU() {
 			vecX[j] = x * varX;
 		}
 	}
-	mm_free(ranks);
-
-	/*all gather to communicate the data*/
-	int* displs = (int*)mm_malloc(_numProcs * sizeof(int), 64);
-	int* recvCounts = (int*)mm_malloc(_numProcs * sizeof(int), 64);
-	row = 0;
-	for(int i = 0; i < _numProcs; ++i) {
-		displs[i] = row;
-		recvCounts[i] = min((int)chunkSize, _numVectors - row);
-		row += chunkSize;
-	}
-	const int key = loRowRange < hiRowRange ? 1 : 0;
-	MPI_Comm mycomm;
-	MPI_Comm_split(MPI_COMM_WORLD, key, _rank, &mycomm);
-	if(typeid(FloatType) == typeid(float)) {
-		if(key) {
-			MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_FLOAT, _vectors, recvCounts, displs, MPI_FLOAT, mycomm);
+
+	/*publish the own rows into the node-local shared copy and gather the rows of the other nodes.
+	 *the private copy is released*/
+	vecX = _sharedVectors->gather(_vectors);
+	if (vecX != _vectors) {
+		mm_free(_vectors);
+		_vectors = vecX;
+	}
+	MPI_Barrier(MPI_COMM_WORLD);
+
+	/*dynamic distribution of the tiles*/
+	MPITileScheduler scheduler(numTiles, MPI_COMM_WORLD);
+	ssize_t chunkStart, chunkEnd, tileIndex;
+	int tileRow, tileCol;
+
+	/*jointly observed elements per pair [pairwise-complete mode]*/
+	SRWorkspace* ws = NULL;
+	int* counts = NULL;
+	if (_missing) {
+		ws = new SRWorkspace(_vectorSize);
+		counts = (int*) mm_malloc(tileSize * sizeof(int), 64);
+		if (!counts) {
+			fprintf(stderr, "Memory allocation failed\n");
+			exit(-1);
 		}
-	} else if(typeid(FloatType) == typeid(double)) {
-		if(key) {
-			MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DOUBLE, _vectors, recvCounts, displs, MPI_DOUBLE, mycomm);
+	}
+	/*persisted results*/
+	ResultWriter<FloatType>* writer = NULL;
+	if (_resultOptions.enabled()) {
+		writer = new ResultWriter<FloatType>(_resultOptions, "spearman", _rank,
+				_numProcs, _numVectors, _vectorSize, _tileDim);
+	}
+	while (scheduler.nextChunk(chunkStart, chunkEnd)) {
+		/*the buffer holds all tiles computed by this process*/
+		_spearmanCorr = MPITileScheduler::reserve(_spearmanCorr, offset, capacity,
+				offset + (chunkEnd - chunkStart) * tileSize);
+		getTileCoordinate(chunkStart, tileDim, tileRow, tileCol);
+		for (tileIndex = chunkStart; tileIndex < chunkEnd; ++tileIndex) {
+			rowStart = tileRow * _tileDim;
+			rowEnd = min(_numVectors, rowStart + _tileDim);
+			colStart = tileCol * _tileDim;
+			colEnd = min(_numVectors, colStart + _tileDim);
+			/*compute each tile directly into the tiled output*/
+			if (_missing) {
+				_computeTileMissing(*ws, _vectors + (ssize_t) rowStart * _vectorSizeAligned,
+						rowStart, rowEnd, _vectors + (ssize_t) colStart * _vectorSizeAligned,
+						colStart, colEnd, _spearmanCorr + offset, counts, _tileDim);
+			} else {
+				DotKernel<FloatType>::computeTile(_vectors, _vectorSize,
+						_vectorSizeAligned, rowStart, rowEnd, colStart, colEnd,
+						_spearmanCorr + offset, _tileDim, _kBlock);
+			}
+
+			/*statistics*/
+			for (row = rowStart; row < rowEnd; row++) {
+				numPairsProcessed += colEnd - max(row, colStart);
+			}
+			if (writer) {
+				writer->addTile(tileIndex, rowStart, rowEnd, colStart, colEnd,
+						_spearmanCorr + offset, _tileDim, counts, _tileDim);
+			}
+
+			/*move to the next tile*/
+			offset += tileSize;
+			if (++tileCol == tileDim) {
+				tileRow++;
+				tileCol = tileRow;
+			}
 		}
-	} else {
-		printf("Only support floating-point values\n");
-		return;
 	}
-	mm_free(displs);
-	mm_free(recvCounts);
-	MPI_Comm_free(&mycomm);
+	scheduler.finish();
+	if (ws) {
+		delete ws;
+		mm_free(counts);
+	}
+
+	if (writer) {
+		writer->close();
+		delete writer;
+	}
+
+	/*compute the total number of edges*/
+	MPI_Reduce(&numPairsProcessed, &totalNumPairs, 1, MPI_INT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+
+	/*recored the system time*/
+	etime = getSysTime();
+	if (_rank == 0) {
+		fprintf(stderr, "Overall time (%ld pairs): %f seconds\n", totalNumPairs, etime - stime);
+	}
+	scheduler.report();
+}
+
+/*systolic ring: each process owns one block of vectors and pairs it with the blocks passing through*/
+template<typename FloatType>
+void SpearmanR<FloatType>::runMPICPURing() {
+	double stime, etime, waitTime, maxWaitTime;
+	const int tileDim = (_numVectors + _tileDim - 1) / _tileDim;
+	/*blocks are aligned to every tile dimension the tuner may pick, so they can be loaded before tuning*/
+	const int blockSize = MPIRing<FloatType>::getBlockSize(_numVectors, _numProcs, TT_MAX_TILE_DIM);
+	const ssize_t tileSize = (ssize_t)_tileDim * _tileDim;
+	ssize_t numPairsProcessed = 0, totalNumPairs;
+
+#ifdef VERBOSE
+	if(_rank == 0) fprintf(stderr, "execute function %s\n", __FUNCTION__);
+#endif
+	if (TT_MAX_TILE_DIM % _tileDim != 0) {
+		if (_rank == 0) {
+			fprintf(stderr, "The tile dimension must divide %d in the ring mode\n", TT_MAX_TILE_DIM);
+		}
+		exit(-1);
+	}
+
+	/*record the system time*/
 	MPI_Barrier(MPI_COMM_WORLD);
+	stime = getSysTime();
 
-	/*get the tile range*/
-	chunkSize = (numTiles + _numProcs - 1) / _numProcs;
-	loRowRange = loColRange = tileDim + 1;
-	if(_rank * chunkSize < numTiles) {
-		getTileCoordinate(_rank * chunkSize, tileDim, loRowRange, loColRange);
-	}
-	hiRowRange = hiColRange = tileDim;
-	if((_rank + 1) * chunkSize <= numTiles) {
-		getTileCoordinate((_rank + 1) * chunkSize - 1, tileDim,
-				hiRowRange, hiColRange);
-	}
-	offset = 0;
-	//fprintf(stderr, "proc(%d): %d %d %d %d\n", _rank, loRowRange, loColRange, hiRowRange, hiColRange);
-	for (int tileRow = loRowRange; tileRow <= hiRowRange; tileRow++) {
-		rowStart = tileRow * SR_MPI_TILE_DIM;
-		rowEnd = min(_numVectors, rowStart + SR_MPI_TILE_DIM);
-		startColPerRow = (tileRow == loRowRange) ? loColRange : tileRow;
-		endColPerRow = (tileRow == hiRowRange) ? hiColRange : tileDim - 1;
-		for (int tileCol = startColPerRow; tileCol <= endColPerRow;
-				++tileCol) {
-			colStart = tileCol * SR_MPI_TILE_DIM;
-			colEnd = min(_numVectors, colStart + SR_MPI_TILE_DIM);
-			/*compute each tile*/
-			vecX = _vectors + rowStart * _vectorSizeAligned;
-			for (row = rowStart, rowOffset = offset; row < rowEnd; row++, vecX +=
-					_vectorSizeAligned, rowOffset += SR_MPI_TILE_DIM) {
-				vecY = _vectors + colStart * _vectorSizeAligned;
-				for (col = colStart, colOffset = rowOffset; col < colEnd; ++col, vecY +=
-						_vectorSizeAligned, colOffset++) {
-					if (row > col) {
-						continue;
-					}
+	int row, j;
+	int loRowRange, hiRowRange;
+	int rowStart, rowEnd, colStart, colEnd;
+	FloatType x, meanX, varX;
+	FloatType* __restrict__ vecX;
+	const FloatType avg = 1.0 / (FloatType)_vectorSize;
 
-					/*statistics*/
-					numPairsProcessed++;
+	/*normalize the own block*/
+	MPIRing<FloatType>::getBlockRange(_numVectors, blockSize, _rank, loRowRange, hiRowRange);
+	vecX = _vectors + (ssize_t) (loRowRange - _rowStart) * _vectorSizeAligned;
+ 	
+	_rankVectors(vecX, hiRowRange - loRowRange, _numCPUThreads);
+	for (row = loRowRange; row < hiRowRange; ++row, vecX +=
+			_vectorSizeAligned) {
 
-					/*compute the dot product*/
-					prod = 0;
+		/*the pairwise-complete mode correlates the ranks per pair*/
+		if (_missing) {
+			continue;
+		}
+
+		/*compute the mean*/
+		meanX = 0;
 #pragma vector aligned
-#pragma simd reduction(+:prod)
-					for (int j = 0; j < _vectorSize; ++j) {
-						prod += vecX[j] * vecY[j];
-					}
-					_spearmanCorr[colOffset] = prod;
+#pragma simd reduction(+:meanX)
+		for (j = 0; j < _vectorSize; ++j) {
+			meanX += vecX[j] * avg;
+		}
+
+		/*compute the variance*/
+		varX = 0;
+#pragma vector aligned
+#pragma simd reduction(+:varX)
+		for (j = 0; j < _vectorSize; ++j) {
+			x = vecX[j] - meanX;
+			varX += x * x;
+		}
+		varX = 1 / sqrt(varX);
+
+		/*normalize the data*/
+#pragma vector aligned
+#pragma simd
+		for (j = 0; j < _vectorSize; ++j) {
+			x = vecX[j] - meanX;
+			vecX[j] = x * varX;
+		}
+	}
+
+	/*the own block is copied into the ring, which holds all vectors used from here on*/
+	MPIRing<FloatType> ring(MPI_COMM_WORLD, _vectors + (ssize_t) (loRowRange - _rowStart) * _vectorSizeAligned,
+			_numVectors, _vectorSizeAligned, blockSize);
+	RingBlock<FloatType> rows, cols;
+	mm_free(_vectors);
+	_vectors = NULL;
+
+	/*tile buffer*/
+	FloatType* __restrict__ tile = (FloatType*) mm_malloc(tileSize * sizeof(FloatType), 64);
+	if (!tile) {
+		fprintf(stderr, "Memory allocation failed\n");
+		exit(-1);
+	}
+	/*jointly observed elements per pair [pairwise-complete mode]*/
+	SRWorkspace* ws = NULL;
+	int* counts = NULL;
+	if (_missing) {
+		ws = new SRWorkspace(_vectorSize);
+		counts = (int*) mm_malloc(tileSize * sizeof(int), 64);
+		if (!counts) {
+			fprintf(stderr, "Memory allocation failed\n");
+			exit(-1);
+		}
+	}
+
+	/*persisted results*/
+	ResultWriter<FloatType>* writer = NULL;
+	if (_resultOptions.enabled()) {
+		writer = new ResultWriter<FloatType>(_resultOptions, "spearman", _rank,
+				_numProcs, _numVectors, _vectorSize, _tileDim);
+	}
+
+	while (ring.next(rows, cols)) {
+		/*blocks start at tile boundaries, so each tile of the block pair is a global tile*/
+		for (rowStart = rows._start; rowStart < rows._end; rowStart += _tileDim) {
+			rowEnd = min(rows._end, rowStart + _tileDim);
+			colStart = rows._start == cols._start ? rowStart : cols._start;
+			for (; colStart < cols._end; colStart += _tileDim) {
+				colEnd = min(cols._end, colStart + _tileDim);
+
+				/*compute the tile using the register-blocked kernel*/
+				if (_missing) {
+					_computeTileMissing(*ws,
+							rows._vectors + (ssize_t) (rowStart - rows._start) * _vectorSizeAligned,
+							rowStart, rowEnd,
+							cols._vectors + (ssize_t) (colStart - cols._start) * _vectorSizeAligned,
+							colStart, colEnd, tile, counts, _tileDim);
+				} else {
+					DotKernel<FloatType>::computeTile(
+							rows._vectors + (ssize_t) (rowStart - rows._start) * _vectorSizeAligned,
+							rowStart, rowEnd,
+							cols._vectors + (ssize_t) (colStart - cols._start) * _vectorSizeAligned,
+							colStart, colEnd, _vectorSize, _vectorSizeAligned, tile, _tileDim,
+							_kBlock);
+				}
+
+				/*statistics*/
+				for (row = rowStart; row < rowEnd; row++) {
+					numPairsProcessed += colEnd - max(row, colStart);
+				}
+
+				if (writer) {
+					writer->addTile(getTileGlobalIndex(tileDim, rowStart / _tileDim, colStart / _tileDim),
+							rowStart, rowEnd, colStart, colEnd, tile, _tileDim, counts, _tileDim);
 				}
 			}
-			/*move to the next tile*/
-			offset += SR_MPI_TILE_SIZE;
 		}
 	}
+	mm_free(tile);
+	if (ws) {
+		delete ws;
+		mm_free(counts);
+	}
+
+	if (writer) {
+		writer->close();
+		delete writer;
+	}
 
 	/*compute the total number of edges*/
 	MPI_Reduce(&numPairsProcessed, &totalNumPairs, 1, MPI_INT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+	waitTime = ring.getWaitTime();
+	MPI_Reduce(&waitTime, &maxWaitTime, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
 
 	/*recored the system time*/
 	etime = getSysTime();
 	if (_rank == 0) {
 		fprintf(stderr, "Overall time (%ld pairs): %f seconds\n", totalNumPairs, etime - stime);
+		fprintf(stderr, "Ring communication wait (maximum over processes): %f seconds\n", maxWaitTime);
 	}
 }
 
@@ -1334,6 +1739,7 @@ void SpearmanR<FloatType>::runMPIXeonPhi() {
 #ifdef VERBOSE
   if(_rank == 0) fprintf(stderr, "execute function %s\n", __FUNCTION__);
 #endif
+	_checkMissing();
 
 	/*set the number of threads on the Xeon Phi*/
 #pragma offload target(mic:_micIndex) inout(_numMICThreads)
@@ -1395,15 +1801,14 @@ void SpearmanR<FloatType>::runMPIXeonPhi() {
 	{
 #pragma omp parallel
 		{
-			int row, col, rank, j;
+			int row, col, j;
 			int chunkSize, loRowRange, hiRowRange;
 			FloatType x, y, r, meanX, varX;
 			FloatType* __restrict__ vecX;
 			const int tid = omp_get_thread_num();
 			const int nthreads = omp_get_num_threads();
 			const FloatType avg = 1.0 / (FloatType)_vectorSize;
-			typedef CustomPair<FloatType, int> MyPair;
-			MyPair* ranks = (MyPair*)mm_malloc(_vectorSize * sizeof(MyPair), 64);
+			RankBuffer<FloatType> ranks(_vectorSize);
 
 			/*compute mean and variance*/
 			chunkSize = (_numVectors + nthreads - 1) / nthreads;
@@ -1416,24 +1821,8 @@ void SpearmanR<FloatType>::runMPIXeonPhi() {
 			vecX = vectors + loRowRange * _vectorSizeAligned;
 			for (row = loRowRange; row < hiRowRange; ++row, vecX +=
 					_vectorSizeAligned) {
-        /*get the rank vector*/
-        for(j = 0; j < _vectorSize; ++j){
-          ranks[j]._first = vecX[j];
-          ranks[j]._second = j;
-        }
-        qsort(ranks, _vectorSize, sizeof(CustomPair<FloatType, int>), CustomPair<FloatType, int>::ascendFirst);
- 		   	for(j = 0, rank = 1; j < _vectorSize - 1; ++j){
-    			vecX[ranks[j]._second] = rank;
-      		if(ranks[j]._first != ranks[j + 1]._first){
-        		rank++;
-      		}
-    		}
-				vecX[ranks[j]._second] = rank;
-
-				/*do we need to normalize the ranks to avoid overflow? FIXME*/
-    		for(j = 0; j < _vectorSize; ++j){
-      		vecX[j] /= rank;
-    		}
+        /*average ranks of the vector*/
+        RankTransform::rankVector(vecX, _vectorSize, RT_TIES_AVERAGE, ranks);
 
 				/*compute the mean*/
 				meanX = 0;
@@ -1461,7 +1850,6 @@ void SpearmanR<FloatType>::runMPIXeonPhi() {
 					vecX[j] = x * varX;
 				}
 			}
-			mm_free(ranks);
 		}
 	}
 	//double t2 = getSysTime();
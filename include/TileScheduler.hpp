@@ -0,0 +1,177 @@
+/*
+ * TileScheduler.hpp
+ *
+ *  Dynamic scheduler for the triangular tile space used by the pairwise
+ *  engines. Tiles are handed out in global index order (row-major over the
+ *  upper triangle, so consecutive tiles share the same row panel) from a
+ *  shared atomic counter. Chunk sizes are guided: large at the beginning and
+ *  shrinking towards minChunk as the remaining work drains, so that threads
+ *  finish at about the same time even when the per-tile cost is skewed.
+ */
+
+#ifndef __TILE_SCHEDULER_HPP
+#define __TILE_SCHEDULER_HPP
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <mm_malloc.h>
+#include <omp.h>
+#include <TriangularIndex.hpp>
+
+/*each thread takes 1/(TS_GUIDED_FACTOR * numThreads) of the remaining tiles*/
+#define TS_GUIDED_FACTOR	4
+
+class TileScheduler
+{
+public:
+	TileScheduler(const ssize_t numTiles, const int numThreads,
+			const ssize_t minChunk = 1) {
+		_numTiles = numTiles;
+		_numThreads = numThreads > 0 ? numThreads : 1;
+		_minChunk = minChunk > 0 ? minChunk : 1;
+		_first = 0;
+		_next = 0;
+
+		/*per-thread statistics, one cache line each*/
+		_stats = (ThreadStats*) _mm_malloc(_numThreads * sizeof(ThreadStats), 64);
+		if (!_stats) {
+			fprintf(stderr, "Memory allocation failed\n");
+			exit(-1);
+		}
+		for (int i = 0; i < _numThreads; ++i) {
+			_stats[i]._startTime = _stats[i]._finishTime = 0;
+			_stats[i]._busyTime = 0;
+			_stats[i]._numTiles = 0;
+			_stats[i]._numChunks = 0;
+		}
+	}
+	~TileScheduler() {
+		_mm_free(_stats);
+	}
+
+	/*reset the counter so that the scheduler can be reused*/
+	void reset() {
+		_next = _first;
+	}
+
+	/*restrict the scheduler to the tiles [first, last)*/
+	void setRange(const ssize_t first, const ssize_t last) {
+		_first = _next = first;
+		_numTiles = last;
+	}
+
+	/*balanced slice [first, last) of numTiles tiles for shard shard of numShards*/
+	static void getShardRange(const ssize_t numTiles, const int shard,
+			const int numShards, ssize_t& first, ssize_t& last) {
+		int64_t lo, hi;
+		TriangularIndex::getRange(numTiles, shard, numShards, lo, hi);
+		first = lo;
+		last = hi;
+	}
+
+	/*called by each thread before entering the scheduling loop*/
+	inline void threadStart(const int tid) {
+		if (tid < _numThreads) {
+			_stats[tid]._startTime = omp_get_wtime();
+		}
+	}
+
+	/*called by each thread after the scheduling loop*/
+	inline void threadFinish(const int tid) {
+		if (tid < _numThreads) {
+			_stats[tid]._finishTime = omp_get_wtime();
+			_stats[tid]._busyTime = _stats[tid]._finishTime - _stats[tid]._startTime;
+		}
+	}
+
+	/*get the next chunk of tiles [start, end). Return false if no work left*/
+	inline bool nextChunk(const int tid, ssize_t& start, ssize_t& end) {
+		ssize_t curr, chunk;
+
+		curr = _next;
+		while (curr < _numTiles) {
+			chunk = (_numTiles - curr) / (TS_GUIDED_FACTOR * _numThreads);
+			if (chunk < _minChunk) {
+				chunk = _minChunk;
+			}
+			end = curr + chunk;
+			if (end > _numTiles) {
+				end = _numTiles;
+			}
+			/*try to claim the chunk*/
+			ssize_t prev = __sync_val_compare_and_swap(&_next, curr, end);
+			if (prev == curr) {
+				start = curr;
+				if (tid < _numThreads) {
+					_stats[tid]._numTiles += end - start;
+					_stats[tid]._numChunks++;
+				}
+				return true;
+			}
+			curr = prev;
+		}
+		return false;
+	}
+
+	/*report per-thread busy and idle time. Idle time is measured against the latest finishing thread*/
+	void report(FILE* file = stderr, const bool perThread = false) {
+		double startTime, finishTime, busyTime = 0, idleTime, maxIdleTime = 0;
+		int numActive = 0;
+
+		startTime = finishTime = 0;
+		for (int i = 0; i < _numThreads; ++i) {
+			if (_stats[i]._startTime == 0) {
+				continue;
+			}
+			if (numActive == 0 || _stats[i]._startTime < startTime) {
+				startTime = _stats[i]._startTime;
+			}
+			if (_stats[i]._finishTime > finishTime) {
+				finishTime = _stats[i]._finishTime;
+			}
+			++numActive;
+		}
+		if (numActive == 0 || finishTime <= startTime) {
+			return;
+		}
+
+		for (int i = 0; i < _numThreads; ++i) {
+			if (_stats[i]._startTime == 0) {
+				continue;
+			}
+			idleTime = (_stats[i]._startTime - startTime) + (finishTime - _stats[i]._finishTime);
+			busyTime += _stats[i]._busyTime;
+			if (idleTime > maxIdleTime) {
+				maxIdleTime = idleTime;
+			}
+			if (perThread) {
+				fprintf(file, "thread %d: %ld tiles in %ld chunks, busy %f seconds, idle %f seconds\n",
+						i, (long) _stats[i]._numTiles, (long) _stats[i]._numChunks, _stats[i]._busyTime, idleTime);
+			}
+		}
+		fprintf(file, "Tile scheduler (%d threads): average idle %.2f%%, maximum idle %.2f%%\n",
+				numActive, 100.0 * (1.0 - busyTime / (numActive * (finishTime - startTime))),
+				100.0 * maxIdleTime / (finishTime - startTime));
+	}
+
+private:
+	/*padded to a cache line to avoid false sharing. The array is 64-byte aligned*/
+	struct ThreadStats {
+		double _startTime;
+		double _finishTime;
+		double _busyTime;
+		ssize_t _numTiles;
+		ssize_t _numChunks;
+		char _padding[24];
+	};
+
+	ssize_t _numTiles;	/*end of the tile range*/
+	ssize_t _first;			/*start of the tile range*/
+	ssize_t _minChunk;
+	int _numThreads;
+	ThreadStats* _stats;
+	volatile ssize_t _next __attribute__((aligned(64)));
+};
+
+#endif	/*__TILE_SCHEDULER_HPP*/
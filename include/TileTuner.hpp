@@ -0,0 +1,234 @@
+/*
+ * TileTuner.hpp
+ *
+ *  Startup autotuner for the tile geometry (tile dimension and K-block size)
+ *  of the dot-product engines. Candidate geometries are timed on a sample of
+ *  the real data and the fastest one is cached on disk, keyed by CPU model,
+ *  engine name and vector length, so that later runs on the same host skip
+ *  the timing.
+ *
+ *  The cache file is given by the environment variable PCC_TILE_CACHE and
+ *  defaults to $HOME/.pcc_tile_cache. Each line has the format
+ *  "cpu_model<TAB>engine<TAB>vector_length<TAB>tile_dim<TAB>k_block".
+ */
+
+#ifndef __TILE_TUNER_HPP
+#define __TILE_TUNER_HPP
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <string>
+#include <immintrin.h>
+#include <omp.h>
+#include <DotKernel.hpp>
+
+/*maximum number of vectors used for timing*/
+#define TT_SAMPLE_VECTORS	384
+/*maximum number of elements per vector used for timing*/
+#define TT_SAMPLE_SIZE		4096
+/*number of timing repeats per candidate*/
+#define TT_NUM_REPEATS		2
+/*largest candidate tile dimension. Every candidate divides it*/
+#define TT_MAX_TILE_DIM		64
+
+struct TileGeometry
+{
+	TileGeometry(const int tileDim = 8, const int kBlock = DK_K_BLOCK) {
+		_tileDim = tileDim;
+		_kBlock = kBlock;
+	}
+	int _tileDim;	/*number of vectors per tile side*/
+	int _kBlock;	/*number of elements per K-block*/
+};
+
+class TileTuner
+{
+public:
+	/*get the geometry for the engine, from the cache or by timing candidates on the data*/
+	template<typename FloatType>
+	static TileGeometry tuneDotKernel(const char* engine,
+			const FloatType* vectors, const int numVectors, const int vectorSize,
+			const int vectorSizeAligned, const bool verbose = true) {
+		static const int tileDims[] = { 8, 16, 32, TT_MAX_TILE_DIM };
+		static const int kBlocks[] = { 128, 256, 512, 1024 };
+		const int numTileDims = sizeof(tileDims) / sizeof(tileDims[0]);
+		const int numKBlocks = sizeof(kBlocks) / sizeof(kBlocks[0]);
+		const int lengthKey = getLengthKey(vectorSize);
+		const std::string cpuModel = getCPUModel();
+		TileGeometry best;
+		double stime, etime, bestTime = -1;
+
+		/*look up the cache*/
+		if (lookup(cpuModel, engine, lengthKey, best)) {
+			if (verbose) {
+				fprintf(stderr, "Tile geometry (cached): tile %d, K-block %d\n",
+						best._tileDim, best._kBlock);
+			}
+			return best;
+		}
+
+		/*sample of the data*/
+		const int numSamples = numVectors < TT_SAMPLE_VECTORS ? numVectors : TT_SAMPLE_VECTORS;
+		const int sampleSize = vectorSize < TT_SAMPLE_SIZE ? vectorSize : TT_SAMPLE_SIZE;
+		if (numSamples < 1 || sampleSize < 1) {
+			return best;
+		}
+
+		FloatType* tile = (FloatType*) _mm_malloc(tileDims[numTileDims - 1]
+				* tileDims[numTileDims - 1] * sizeof(FloatType), 64);
+		if (!tile) {
+			fprintf(stderr, "Memory allocation failed\n");
+			exit(-1);
+		}
+
+		for (int i = 0; i < numTileDims; ++i) {
+			for (int j = 0; j < numKBlocks; ++j) {
+				/*skip K-blocks larger than the vector*/
+				if (j > 0 && kBlocks[j - 1] >= sampleSize) {
+					break;
+				}
+				TileGeometry geometry(tileDims[i], kBlocks[j]);
+				double time = -1;
+				for (int r = 0; r < TT_NUM_REPEATS; ++r) {
+					stime = omp_get_wtime();
+					_runSample(vectors, numSamples, sampleSize, vectorSizeAligned,
+							geometry, tile);
+					etime = omp_get_wtime();
+					if (time < 0 || etime - stime < time) {
+						time = etime - stime;
+					}
+				}
+				if (bestTime < 0 || time < bestTime) {
+					bestTime = time;
+					best = geometry;
+				}
+			}
+		}
+		_mm_free(tile);
+
+		/*save to the cache*/
+		store(cpuModel, engine, lengthKey, best);
+		if (verbose) {
+			fprintf(stderr, "Tile geometry (tuned): tile %d, K-block %d\n",
+					best._tileDim, best._kBlock);
+		}
+		return best;
+	}
+
+	/*get the CPU model name*/
+	static std::string getCPUModel() {
+		char line[1024];
+		std::string model = "unknown";
+		FILE* file = fopen("/proc/cpuinfo", "r");
+		if (!file) {
+			return model;
+		}
+		while (fgets(line, sizeof(line), file)) {
+			if (strncmp(line, "model name", 10) == 0) {
+				char* p = strchr(line, ':');
+				if (p) {
+					for (++p; *p == ' ' || *p == '\t'; ++p);
+					model = p;
+					/*remove the trailing whitespaces*/
+					while (model.length() && (model[model.length() - 1] == '\n'
+							|| model[model.length() - 1] == ' ')) {
+						model.erase(model.length() - 1);
+					}
+				}
+				break;
+			}
+		}
+		fclose(file);
+
+		/*tabs are used as separators in the cache file*/
+		for (size_t i = 0; i < model.length(); ++i) {
+			if (model[i] == '\t') {
+				model[i] = ' ';
+			}
+		}
+		return model;
+	}
+
+	/*vector lengths are bucketed to the next power of two*/
+	static int getLengthKey(const int vectorSize) {
+		int key = 1;
+		while (key < vectorSize) {
+			key <<= 1;
+		}
+		return key;
+	}
+
+	static std::string getCacheFileName() {
+		const char* name = getenv("PCC_TILE_CACHE");
+		if (name && name[0]) {
+			return std::string(name);
+		}
+		const char* home = getenv("HOME");
+		return std::string(home ? home : ".") + "/.pcc_tile_cache";
+	}
+
+	static bool lookup(const std::string& cpuModel, const char* engine,
+			const int lengthKey, TileGeometry& geometry) {
+		char line[1024];
+		bool found = false;
+		FILE* file = fopen(getCacheFileName().c_str(), "r");
+		if (!file) {
+			return false;
+		}
+		while (fgets(line, sizeof(line), file)) {
+			char* model = strtok(line, "\t");
+			char* name = strtok(NULL, "\t");
+			char* length = strtok(NULL, "\t");
+			char* tileDim = strtok(NULL, "\t");
+			char* kBlock = strtok(NULL, "\t\n");
+			if (!model || !name || !length || !tileDim || !kBlock) {
+				continue;
+			}
+			if (cpuModel == model && strcmp(engine, name) == 0
+					&& atoi(length) == lengthKey) {
+				/*the last entry wins*/
+				geometry._tileDim = atoi(tileDim);
+				geometry._kBlock = atoi(kBlock);
+				found = geometry._tileDim > 0 && geometry._kBlock > 0
+						&& geometry._kBlock % 16 == 0;
+			}
+		}
+		fclose(file);
+		return found;
+	}
+
+	static void store(const std::string& cpuModel, const char* engine,
+			const int lengthKey, const TileGeometry& geometry) {
+		FILE* file = fopen(getCacheFileName().c_str(), "a");
+		if (!file) {
+			fprintf(stderr, "Failed to write the tile geometry cache %s\n",
+					getCacheFileName().c_str());
+			return;
+		}
+		fprintf(file, "%s\t%s\t%d\t%d\t%d\n", cpuModel.c_str(), engine, lengthKey,
+				geometry._tileDim, geometry._kBlock);
+		fclose(file);
+	}
+
+private:
+	/*all tiles in the upper triangle of the sample*/
+	template<typename FloatType>
+	static void _runSample(const FloatType* vectors, const int numVectors,
+			const int vectorSize, const int vectorSizeAligned,
+			const TileGeometry& geometry, FloatType* tile) {
+		const int tileDim = geometry._tileDim;
+		for (int rowStart = 0; rowStart < numVectors; rowStart += tileDim) {
+			int rowEnd = rowStart + tileDim < numVectors ? rowStart + tileDim : numVectors;
+			for (int colStart = rowStart; colStart < numVectors; colStart += tileDim) {
+				int colEnd = colStart + tileDim < numVectors ? colStart + tileDim : numVectors;
+				DotKernel<FloatType>::computeTile(vectors, vectorSize,
+						vectorSizeAligned, rowStart, rowEnd, colStart, colEnd, tile,
+						tileDim, geometry._kBlock);
+			}
+		}
+	}
+};
+
+#endif	/*__TILE_TUNER_HPP*/
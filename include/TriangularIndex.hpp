@@ -0,0 +1,182 @@
+/*
+ * TriangularIndex.hpp
+ *
+ *  Exact integer mapping between the linear index of a triangular (or
+ *  rectangular, or blocked) index space and its (row, column) coordinate.
+ *  The inverse mapping uses an integer square root instead of a floating-point
+ *  one, so it is exact for every dimension that fits an int and there is no
+ *  need to switch between double and long double with the matrix size.
+ *  isqrt() also takes unsigned __int128 where the compiler provides it.
+ *
+ *  Triangular spaces are ordered row-major over the upper triangle:
+ *	upper	pairs (row, col) with row <= col < dim, e.g. the tile space
+ *	strict	pairs (row, col) with row < col < dim, e.g. the vector pairs
+ *
+ *  TriangularIterator walks consecutive indices of a triangular space with one
+ *  increment per step, so a range of tiles needs a single square root.
+ */
+
+#ifndef __TRIANGULAR_INDEX_HPP
+#define __TRIANGULAR_INDEX_HPP
+#include <stdint.h>
+#include <math.h>
+#include <sys/types.h>
+
+#ifdef WITH_PHI
+#pragma offload_attribute(push, target(mic))
+#endif
+
+class TriangularIndex
+{
+public:
+	/*floor(sqrt(n)) for an unsigned integer type. The floating-point estimate is
+	 *only a starting point, corrected by Newton steps from above*/
+	template<typename UIntType>
+	static inline UIntType isqrt(const UIntType n) {
+		UIntType x, y;
+
+		if (n < 2) {
+			return n;
+		}
+		x = (UIntType) sqrt((double) n) + 1;
+		/*one step from any positive guess lands on or above floor(sqrt(n))*/
+		x = (x + n / x) >> 1;
+		while ((y = (x + n / x) >> 1) < x) {
+			x = y;
+		}
+		return x;
+	}
+
+	/*number of pairs in the upper triangle including the diagonal*/
+	static inline int64_t getUpperSize(const int64_t dim) {
+		return dim * (dim + 1) / 2;
+	}
+	/*number of pairs in the strict upper triangle*/
+	static inline int64_t getStrictSize(const int64_t dim) {
+		return dim * (dim - 1) / 2;
+	}
+
+	/*index of the first pair in row of the upper triangle*/
+	static inline int64_t getUpperRowStart(const int64_t dim, const int64_t row) {
+		return row * (2 * dim - row + 1) / 2;
+	}
+
+	/*conditions: row <= col*/
+	static inline int64_t getUpperIndex(const int64_t dim, const int row,
+			const int col) {
+		return getUpperRowStart(dim, row) + col - row;
+	}
+
+	/*inverse of getUpperIndex*/
+	static inline void getUpperCoordinate(const int64_t index, const int64_t dim,
+			int& row, int& col) {
+		int64_t r;
+		const int64_t b = 2 * dim + 1;
+
+		/*row is the largest r with r * (2 * dim - r + 1) / 2 <= index. b * b < 2^64 for dim < 2^31*/
+		uint64_t d = (uint64_t) b * b - (uint64_t) 8 * index;
+		r = (b - (int64_t) isqrt<uint64_t>(d)) / 2;
+		/*the integer root is at most one below the real one*/
+		if (getUpperRowStart(dim, r) > index) {
+			--r;
+		}
+		row = (int) r;
+		col = (int) (r + index - getUpperRowStart(dim, r));
+	}
+
+	/*conditions: row < col. The strict triangle of dim is the upper triangle of dim - 1 shifted by one column*/
+	static inline int64_t getStrictIndex(const int64_t dim, const int row,
+			const int col) {
+		return getUpperIndex(dim - 1, row, col - 1);
+	}
+
+	/*inverse of getStrictIndex*/
+	static inline void getStrictCoordinate(const int64_t index, const int64_t dim,
+			int& row, int& col) {
+		getUpperCoordinate(index, dim - 1, row, col);
+		++col;
+	}
+
+	/*row-major rectangular space of numRows x numCols*/
+	static inline int64_t getRectIndex(const int64_t numCols, const int row,
+			const int col) {
+		return (int64_t) row * numCols + col;
+	}
+	static inline void getRectCoordinate(const int64_t index,
+			const int64_t numCols, int& row, int& col) {
+		row = (int) (index / numCols);
+		col = (int) (index - row * numCols);
+	}
+
+	/*blocked upper triangle: blocks of blockDim x blockDim elements stored block
+	 *after block in upper block order, row-major within a block. Diagonal and
+	 *border blocks are stored in full, so offsets do not depend on dim % blockDim.
+	 *conditions: row <= col*/
+	static inline int64_t getBlockedOffset(const int64_t numBlocks,
+			const int blockDim, const int row, const int col) {
+		int64_t block = getUpperIndex(numBlocks, row / blockDim, col / blockDim);
+		return (block * blockDim + row % blockDim) * blockDim + col % blockDim;
+	}
+	static inline void getBlockedCoordinate(const int64_t offset,
+			const int64_t numBlocks, const int blockDim, int& row, int& col) {
+		const int64_t blockSize = (int64_t) blockDim * blockDim;
+		const int64_t inner = offset % blockSize;
+
+		getUpperCoordinate(offset / blockSize, numBlocks, row, col);
+		row = row * blockDim + (int) (inner / blockDim);
+		col = col * blockDim + (int) (inner % blockDim);
+	}
+
+	/*balanced slice [first, last) of count items for part of numParts, without overflowing count * part*/
+	static inline void getRange(const int64_t count, const int part,
+			const int numParts, int64_t& first, int64_t& last) {
+		const int64_t quotient = count / numParts;
+		const int64_t remainder = count % numParts;
+
+		first = quotient * part + (part < remainder ? part : remainder);
+		last = first + quotient + (part < remainder ? 1 : 0);
+	}
+};
+
+/*walks the upper (or strict upper) triangle of dim from a starting index*/
+class TriangularIterator
+{
+public:
+	TriangularIterator(const int64_t dim, const int64_t index,
+			const bool strict = false) {
+		_dim = (int) dim;
+		_strict = strict ? 1 : 0;
+		if (strict) {
+			TriangularIndex::getStrictCoordinate(index, dim, _row, _col);
+		} else {
+			TriangularIndex::getUpperCoordinate(index, dim, _row, _col);
+		}
+	}
+
+	inline int row() const {
+		return _row;
+	}
+	inline int col() const {
+		return _col;
+	}
+
+	/*move to the next index*/
+	inline void next() {
+		if (++_col == _dim) {
+			++_row;
+			_col = _row + _strict;
+		}
+	}
+
+private:
+	int _dim;
+	int _strict;
+	int _row;
+	int _col;
+};
+
+#ifdef WITH_PHI
+#pragma offload_attribute(pop)
+#endif
+
+#endif	/*__TRIANGULAR_INDEX_HPP*/
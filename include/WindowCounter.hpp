@@ -0,0 +1,225 @@
+/*
+ * WindowCounter.hpp
+ *
+ *  Number of points in a window of the rank grid of a vector pair, for the
+ *  adaptive partitioning of MIAdaptive. The points are given as the CSR
+ *  sparse matrix of MIAdaptive::_createSparseMatrix: the x ranks colIndices
+ *  in the order of y, with the rows rowPtrY.
+ *
+ *  A query scans the rows of the window, which costs the points of its whole
+ *  horizontal strip. Once the scans of a pair have cost as much as building
+ *  a counting structure, the structure is built and answers the rest:
+ *	vectorSize <= WC_SAT_MAX_SIZE		summed-area table of the grid, 16-bit counts, O(1)
+ *	vectorSize <= WC_TREE_MAX_SIZE	merge-sort tree over colIndices, O(log^2 n)
+ *  so a pair costs at most about twice the cheaper of the two ways. Strips
+ *  shorter than a query of the structure are always scanned. Longer vectors
+ *  are only scanned, as their trees no longer fit in the cache.
+ */
+
+#ifndef __WINDOW_COUNTER_HPP
+#define __WINDOW_COUNTER_HPP
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <mm_malloc.h>
+#include <DeviceUtils.hpp>
+
+/*maximum vector sizes of the summed-area table and the merge-sort tree*/
+#define WC_SAT_MAX_SIZE		1024
+#define WC_TREE_MAX_SIZE	4096
+
+#ifdef WITH_PHI
+#pragma offload_attribute(push, target(mic))
+#endif
+
+template<typename RankType>
+class WindowCounter
+{
+public:
+	WindowCounter(const int vectorSize) {
+		_vectorSize = vectorSize;
+		_useTable = vectorSize <= WC_SAT_MAX_SIZE;
+		for (_numLevels = 1; (1 << (_numLevels - 1)) < vectorSize; ++_numLevels);
+
+		_table = NULL;
+		_tree = NULL;
+		if (_useTable) {
+			_table = (uint16_t*) _mm_malloc((ssize_t) (vectorSize + 1) * (vectorSize + 1) * sizeof(uint16_t), 64);
+			_buildCost = (ssize_t) (vectorSize + 1) * (vectorSize + 1);
+			_queryCost = 1;
+		} else if (vectorSize <= WC_TREE_MAX_SIZE) {
+			_tree = (RankType*) _mm_malloc((ssize_t) _numLevels * vectorSize * sizeof(RankType), 64);
+			_buildCost = (ssize_t) _numLevels * vectorSize;
+			/*points of a strip that cost as much as a query of the tree*/
+			_queryCost = 2 * _numLevels * _numLevels;
+		} else {
+			_queryCost = vectorSize;
+		}
+		if ((_useTable && !_table) || (!_useTable && vectorSize <= WC_TREE_MAX_SIZE && !_tree)) {
+			fprintf(stderr, "Memory allocation failed\n");
+			exit(-1);
+		}
+		_rowPtrY = NULL;
+		_colIndices = NULL;
+	}
+	~WindowCounter() {
+		if (_table) {
+			_mm_free(_table);
+		}
+		if (_tree) {
+			_mm_free(_tree);
+		}
+	}
+
+	/*start a pair*/
+	inline void reset(const RankType* rowPtrY, const RankType* colIndices) {
+		_rowPtrY = rowPtrY;
+		_colIndices = colIndices;
+		_scanCost = 0;
+		_built = false;
+	}
+
+	/*points with x1 <= x <= x2 and y1 <= y <= y2. The window is valid and not empty in y*/
+	inline int count(const Window<RankType>& window) {
+		const int beg = _rowPtrY[window._y1];
+		const int end = _rowPtrY[window._y2 + 1];
+
+		if (end - beg > _queryCost) {
+			if (!_built && _scanCost + (end - beg) > _buildCost) {
+				_build();
+			}
+			if (_built) {
+				return _useTable ? _countTable(window) : _countTree(beg, end, window._x1, window._x2);
+			}
+			_scanCost += end - beg;
+		}
+
+		/*scan the rows of the window*/
+		int n = 0;
+		for (int i = beg; i < end; ++i) {
+			const int x = _colIndices[i];
+			n += x >= window._x1 && x <= window._x2;
+		}
+		return n;
+	}
+
+private:
+	int _vectorSize;
+	int _numLevels;			/*levels of the merge-sort tree*/
+	bool _useTable;
+	bool _built;
+	ssize_t _buildCost;		/*points to build the structure*/
+	ssize_t _scanCost;		/*points scanned for the current pair in strips longer than _queryCost*/
+	int _queryCost;			/*points of a strip from which the structure is used*/
+	const RankType* _rowPtrY;
+	const RankType* _colIndices;
+	uint16_t* _table;		/*entry (y, x): points below y and left of x*/
+	RankType* _tree;		/*level l: colIndices sorted within aligned blocks of 2^l*/
+
+	void _build() {
+		const int n = _vectorSize;
+
+		if (_useTable) {
+			const ssize_t width = n + 1;
+			memset(_table, 0, width * sizeof(uint16_t));
+			for (int y = 0; y < n; ++y) {
+				uint16_t* __restrict__ above = _table + y * width;
+				uint16_t* __restrict__ row = above + width;
+
+				/*points of the row, then the running sum over x*/
+				memset(row, 0, width * sizeof(uint16_t));
+				for (int i = _rowPtrY[y]; i < _rowPtrY[y + 1]; ++i) {
+					row[_colIndices[i] + 1]++;
+				}
+				uint16_t sum = 0;
+				for (int x = 0; x < width; ++x) {
+					sum += row[x];
+					row[x] = above[x] + sum;
+				}
+			}
+		} else {
+			memcpy(_tree, _colIndices, n * sizeof(RankType));
+			for (int l = 1; l < _numLevels; ++l) {
+				const RankType* __restrict__ src = _tree + (ssize_t) (l - 1) * n;
+				RankType* __restrict__ dst = _tree + (ssize_t) l * n;
+				const int half = 1 << (l - 1);
+
+				/*merge the sorted halves of each block*/
+				for (int start = 0; start < n; start += 2 * half) {
+					int i = start, j = start + half, k = start;
+					const int mid = start + half < n ? start + half : n;
+					const int end = start + 2 * half < n ? start + 2 * half : n;
+					while (i < mid && j < end) {
+						dst[k++] = src[j] < src[i] ? src[j++] : src[i++];
+					}
+					while (i < mid) {
+						dst[k++] = src[i++];
+					}
+					while (j < end) {
+						dst[k++] = src[j++];
+					}
+				}
+			}
+		}
+		_built = true;
+	}
+
+	inline int _countTable(const Window<RankType>& w) const {
+		const ssize_t width = _vectorSize + 1;
+		const uint16_t* lo = _table + (ssize_t) w._y1 * width;
+		const uint16_t* hi = _table + (ssize_t) (w._y2 + 1) * width;
+
+		return (int) hi[w._x2 + 1] - hi[w._x1] - lo[w._x2 + 1] + lo[w._x1];
+	}
+
+	/*values in [x1, x2] of a sorted range*/
+	static inline int _countSorted(const RankType* data, const int size, const int x1, const int x2) {
+		int lo = 0, hi = size;
+		while (lo < hi) {
+			const int mid = (lo + hi) >> 1;
+			if (data[mid] < x1) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+		const int first = lo;
+		hi = size;
+		while (lo < hi) {
+			const int mid = (lo + hi) >> 1;
+			if (data[mid] <= x2) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+		return lo - first;
+	}
+
+	/*values in [x1, x2] of colIndices[beg .. end), from the aligned blocks covering the range*/
+	inline int _countTree(int beg, int end, const int x1, const int x2) const {
+		int n = 0;
+
+		for (int l = 0; beg < end && l < _numLevels; ++l) {
+			const int size = 1 << l;
+			const RankType* level = _tree + (ssize_t) l * _vectorSize;
+			if (((beg >> l) & 1) && beg + size <= end) {
+				n += _countSorted(level + beg, size, x1, x2);
+				beg += size;
+			}
+			if (((end >> l) & 1) && end - size >= beg) {
+				end -= size;
+				n += _countSorted(level + end, size, x1, x2);
+			}
+		}
+		return n;
+	}
+};
+
+#ifdef WITH_PHI
+#pragma offload_attribute(pop)
+#endif
+
+#endif	/*__WINDOW_COUNTER_HPP*/
@@ -0,0 +1,322 @@
+/*
+ * MergeShards.cpp
+ *
+ *  Combine the per-shard results written by ResultWriter.
+ *
+ *	MergeShards tiles <prefix> <numShards> <outfile>
+ *		merge P.i.tiles/P.i.index (i = 0 .. numShards - 1) into a single tile file
+ *		ordered by global tile index. The output has the same format as a shard
+ *		holding all tiles, i.e. tile t starts at sizeof(ShardHeader) + t * tileBytes
+ *
+ *	MergeShards neighbors <K> <outfile> <infile1> [<infile2> ...]
+ *		k-way merge of per-row top-K neighbor lists ("row value neighbor count",
+ *		sorted by row and descending value) keeping the K largest values per row
+ *
+ *	MergeShards histograms <outfile> <infile1> [<infile2> ...]
+ *		sum the count tables ("count value frequency") of PearsonRMKL shards or
+ *		the P.i.histogram.csv files of ResultWriter
+ *
+ *  Lines starting with '#' (the self-describing headers of job-array shards)
+ *  are skipped in the text inputs.
+ */
+#include <ResultWriter.hpp>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <map>
+using namespace std;
+
+struct TileLocation
+{
+	int64_t _tileIndex;
+	int64_t _offset;
+	int _shard;
+	bool operator<(const TileLocation& other) const {
+		return _tileIndex < other._tileIndex;
+	}
+};
+
+static void printUsage()
+{
+	fprintf(stderr, "MergeShards tiles prefix numShards outfile\n");
+	fprintf(stderr, "MergeShards neighbors K outfile infile1 [infile2 ...]\n");
+	fprintf(stderr, "MergeShards histograms outfile infile1 [infile2 ...]\n");
+}
+
+static bool readHeader(FILE* file, const string& name, ShardHeader& header)
+{
+	if (fread(&header, sizeof(ShardHeader), 1, file) != 1 || !header.isValid()) {
+		fprintf(stderr, "Invalid shard file %s\n", name.c_str());
+		return false;
+	}
+	return true;
+}
+
+static int mergeTiles(const string& prefix, const int numShards, const string& outfile)
+{
+	ShardHeader first, header;
+	vector<TileLocation> tiles;
+	vector<FILE*> files;
+	char name[32];
+
+	/*read all indices*/
+	for (int shard = 0; shard < numShards; ++shard) {
+		sprintf(name, ".%d", shard);
+		string indexName = prefix + name + ".index";
+		FILE* file = fopen(indexName.c_str(), "rb");
+		if (!file) {
+			fprintf(stderr, "Failed to open file %s\n", indexName.c_str());
+			return -1;
+		}
+		if (!readHeader(file, indexName, header)) {
+			fclose(file);
+			return -1;
+		}
+		if (shard == 0) {
+			first = header;
+		}
+		/*all shards must describe the same run*/
+		if (header._numShards != numShards || header._shard != shard
+				|| header._floatSize != first._floatSize
+				|| header._tileDim != first._tileDim
+				|| header._numVectors != first._numVectors
+				|| header._vectorSize != first._vectorSize
+				|| strncmp(header._metric, first._metric, sizeof(header._metric))) {
+			fprintf(stderr, "Shard %s does not match shard 0\n", indexName.c_str());
+			fclose(file);
+			return -1;
+		}
+		for (int64_t i = 0; i < header._numShardTiles; ++i) {
+			ShardIndexEntry entry;
+			if (fread(&entry, sizeof(ShardIndexEntry), 1, file) != 1) {
+				fprintf(stderr, "Truncated index file %s\n", indexName.c_str());
+				fclose(file);
+				return -1;
+			}
+			TileLocation location;
+			location._tileIndex = entry._tileIndex;
+			location._offset = entry._offset;
+			location._shard = shard;
+			tiles.push_back(location);
+		}
+		fclose(file);
+
+		string tileName = prefix + name + ".tiles";
+		file = fopen(tileName.c_str(), "rb");
+		if (!file) {
+			fprintf(stderr, "Failed to open file %s\n", tileName.c_str());
+			return -1;
+		}
+		files.push_back(file);
+	}
+
+	/*every tile must be present exactly once*/
+	sort(tiles.begin(), tiles.end());
+	if ((int64_t) tiles.size() != first._numTiles) {
+		fprintf(stderr, "Expected %ld tiles but found %ld\n", (long) first._numTiles,
+				(long) tiles.size());
+		return -1;
+	}
+	for (size_t i = 0; i < tiles.size(); ++i) {
+		if (tiles[i]._tileIndex != (int64_t) i) {
+			fprintf(stderr, "Tile %ld is missing or duplicated\n", (long) i);
+			return -1;
+		}
+	}
+
+	/*write the merged file*/
+	FILE* out = fopen(outfile.c_str(), "wb");
+	if (!out) {
+		fprintf(stderr, "Failed to open file %s\n", outfile.c_str());
+		return -1;
+	}
+	header = first;
+	header._shard = 0;
+	header._numShards = 1;
+	header._numShardTiles = first._numTiles;
+	fwrite(&header, sizeof(ShardHeader), 1, out);
+
+	const size_t tileBytes = (size_t) first._tileDim * first._tileDim * first._floatSize;
+	vector<char> buffer(tileBytes);
+	for (size_t i = 0; i < tiles.size(); ++i) {
+		FILE* file = files[tiles[i]._shard];
+		if (fseek(file, tiles[i]._offset, SEEK_SET)
+				|| fread(&buffer[0], 1, tileBytes, file) != tileBytes) {
+			fprintf(stderr, "Failed to read tile %ld from shard %d\n",
+					(long) tiles[i]._tileIndex, tiles[i]._shard);
+			fclose(out);
+			return -1;
+		}
+		fwrite(&buffer[0], 1, tileBytes, out);
+	}
+	fclose(out);
+	for (size_t i = 0; i < files.size(); ++i) {
+		fclose(files[i]);
+	}
+	fprintf(stderr, "Merged %ld tiles from %d shards\n", (long) tiles.size(), numShards);
+	return 0;
+}
+
+struct NeighborLine
+{
+	int _row;
+	double _value;
+	int _neighbor;
+	int _count;
+	bool operator<(const NeighborLine& other) const {
+		return _value > other._value;
+	}
+};
+
+/*next line that is neither empty nor a '#' header*/
+static bool readDataLine(FILE* file, char* buffer, const int size)
+{
+	while (fgets(buffer, size, file)) {
+		if (buffer[0] != '#' && buffer[strspn(buffer, " \t\r\n")] != '\0') {
+			return true;
+		}
+	}
+	return false;
+}
+
+static inline bool readNeighbor(FILE* file, NeighborLine& line)
+{
+	char buffer[256];
+	return readDataLine(file, buffer, sizeof(buffer))
+			&& sscanf(buffer, "%d %lf %d %d", &line._row, &line._value,
+					&line._neighbor, &line._count) == 4;
+}
+
+static int mergeNeighbors(const int numNeighbors, const string& outfile,
+		const vector<string>& infiles)
+{
+	vector<FILE*> files;
+	vector<NeighborLine> heads;
+	vector<bool> valid;
+	vector<NeighborLine> row;
+
+	for (size_t i = 0; i < infiles.size(); ++i) {
+		FILE* file = fopen(infiles[i].c_str(), "r");
+		if (!file) {
+			fprintf(stderr, "Failed to open file %s\n", infiles[i].c_str());
+			return -1;
+		}
+		files.push_back(file);
+		heads.push_back(NeighborLine());
+		valid.push_back(readNeighbor(file, heads.back()));
+	}
+
+	FILE* out = fopen(outfile.c_str(), "w");
+	if (!out) {
+		fprintf(stderr, "Failed to open file %s\n", outfile.c_str());
+		return -1;
+	}
+
+	/*the inputs are sorted by row, so merge one row at a time*/
+	while (1) {
+		int current = -1;
+		for (size_t i = 0; i < files.size(); ++i) {
+			if (valid[i] && (current < 0 || heads[i]._row < current)) {
+				current = heads[i]._row;
+			}
+		}
+		if (current < 0) {
+			break;
+		}
+
+		row.clear();
+		for (size_t i = 0; i < files.size(); ++i) {
+			while (valid[i] && heads[i]._row == current) {
+				row.push_back(heads[i]);
+				valid[i] = readNeighbor(files[i], heads[i]);
+			}
+		}
+		stable_sort(row.begin(), row.end());
+		for (size_t i = 0; i < row.size() && (int) i < numNeighbors; ++i) {
+			fprintf(out, "%d %g %d %d\n", row[i]._row, row[i]._value,
+					row[i]._neighbor, row[i]._count);
+		}
+	}
+	fclose(out);
+	for (size_t i = 0; i < files.size(); ++i) {
+		fclose(files[i]);
+	}
+	return 0;
+}
+
+static int mergeHistograms(const string& outfile, const vector<string>& infiles)
+{
+	/*(value, count) -> frequency, in the order of the count tables*/
+	map<pair<double, int>, long> bins;
+	char buffer[256];
+	int count;
+	double value;
+	long frequency;
+
+	for (size_t i = 0; i < infiles.size(); ++i) {
+		FILE* file = fopen(infiles[i].c_str(), "r");
+		if (!file) {
+			fprintf(stderr, "Failed to open file %s\n", infiles[i].c_str());
+			return -1;
+		}
+		while (readDataLine(file, buffer, sizeof(buffer))) {
+			if (sscanf(buffer, "%d %lf %ld", &count, &value, &frequency) != 3) {
+				fprintf(stderr, "Invalid line in file %s: %s", infiles[i].c_str(), buffer);
+				fclose(file);
+				return -1;
+			}
+			bins[make_pair(value, count)] += frequency;
+		}
+		fclose(file);
+	}
+
+	FILE* out = fopen(outfile.c_str(), "w");
+	if (!out) {
+		fprintf(stderr, "Failed to open file %s\n", outfile.c_str());
+		return -1;
+	}
+	for (map<pair<double, int>, long>::iterator it = bins.begin(); it != bins.end(); ++it) {
+		fprintf(out, "%d %g %ld\n", it->first.second, it->first.first, it->second);
+	}
+	fclose(out);
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2) {
+		printUsage();
+		return -1;
+	}
+
+	string mode = argv[1];
+	if (mode == "tiles" && argc == 5) {
+		int numShards = atoi(argv[3]);
+		if (numShards < 1) {
+			fprintf(stderr, "The number of shards must be positive\n");
+			return -1;
+		}
+		return mergeTiles(argv[2], numShards, argv[4]);
+	}
+	if (mode == "neighbors" && argc >= 5) {
+		int numNeighbors = atoi(argv[2]);
+		if (numNeighbors < 1) {
+			fprintf(stderr, "K must be positive\n");
+			return -1;
+		}
+		vector<string> infiles;
+		for (int i = 4; i < argc; ++i) {
+			infiles.push_back(argv[i]);
+		}
+		return mergeNeighbors(numNeighbors, argv[3], infiles);
+	}
+	if (mode == "histograms" && argc >= 4) {
+		vector<string> infiles;
+		for (int i = 3; i < argc; ++i) {
+			infiles.push_back(argv[i]);
+		}
+		return mergeHistograms(argv[2], infiles);
+	}
+	printUsage();
+	return -1;
+}
@@ -1,54 +1,92 @@
-#include<stdio.h>
-#include <math.h>
+/*
+ * bijection_test.cpp
+ *
+ *  Check that the mappings of TriangularIndex.hpp are a bijection:
+ *  index -> (row, col) -> index, and that TriangularIterator agrees.
+ *
+ *	bijection_test [numVectors] [numSampledRows]
+ *		walks the whole upper triangle of numVectors (default 128000) and then
+ *		the first and last pairs of numSampledRows rows (default 1000) of the
+ *		largest dimension that fits an int
+ *
+ *  build: g++ -O2 -I../../include bijection_test.cpp -o bijection_test
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <TriangularIndex.hpp>
 
-static ssize_t compCoordinate(int matrixDimSize, int row, int col)
+static bool checkPair(const int64_t matrixDimSize, const int row, const int col,
+		const int64_t expected)
 {
-	ssize_t globalIndex = 0;
-	double p, q;
-	p = static_cast<double>(matrixDimSize);
+	int r, c;
+	int64_t globalIndex = TriangularIndex::getUpperIndex(matrixDimSize, row, col);
+	if (globalIndex != expected) {
+		printf("wrong: job id is not correct %ld != %ld\n", (long) globalIndex,
+				(long) expected);
+		return false;
+	}
 
-	globalIndex = (ssize_t)((p - 0.5 * (row - 1) ) * row + col - row);
-	if(globalIndex < 0){
-		printf("wrong computation: %ld\n", globalIndex);
+	/*reversely compute the coordinate*/
+	TriangularIndex::getUpperCoordinate(globalIndex, matrixDimSize, r, c);
+	if (r != row || c != col) {
+		printf("wrong: globalIndex: %ld r %d c %d row %d col %d\n",
+				(long) globalIndex, r, c, row, col);
+		return false;
 	}
 
-	return globalIndex;
+	/*strict upper triangle*/
+	if (row < col) {
+		globalIndex = TriangularIndex::getStrictIndex(matrixDimSize, row, col);
+		TriangularIndex::getStrictCoordinate(globalIndex, matrixDimSize, r, c);
+		if (r != row || c != col) {
+			printf("wrong: strict globalIndex: %ld r %d c %d row %d col %d\n",
+					(long) globalIndex, r, c, row, col);
+			return false;
+		}
+	}
+	return true;
 }
-static void getCoordinate(ssize_t globalIndex, ssize_t matrixDimSize,
-    int& row, int& col) {
-  double p, q;
-  p = static_cast<double>(matrixDimSize);
-  q = static_cast<double>(globalIndex);
 
-	row = (int) ceil(p - 0.5 - sqrt(p * p + p - 2 * (q + 1) + 0.25));
-	col = row + (globalIndex - (2 * matrixDimSize - (row - 1)) * row / 2);
-
-}
 int main(int argc, char* argv[])
 {
-	ssize_t jobId;
-	int numVectors = 128000;
-	ssize_t numPairs = (numVectors + 1) * numVectors / 2;
+	int64_t jobId;
+	int numVectors = argc > 1 ? atoi(argv[1]) : 128000;
+	int numSampledRows = argc > 2 ? atoi(argv[2]) : 1000;
 
+	/*the whole triangle*/
 	jobId = 0;
-	for(int row = 0; row < numVectors; ++row){
-		for(int col = row; col < numVectors; ++col){
-			int r, c;
-			ssize_t globalIndex = compCoordinate(numVectors, row, col);
-			if(globalIndex != jobId){
-				printf("wrong: job id is not correct %ld != %ld\n", globalIndex, jobId);
-				break;
+	TriangularIterator it(numVectors, 0);
+	for (int row = 0; row < numVectors; ++row) {
+		for (int col = row; col < numVectors; ++col, it.next()) {
+			if (!checkPair(numVectors, row, col, jobId)) {
+				return -1;
 			}
-
-			/*reversely compute the coordinate*/
-			getCoordinate(globalIndex, numVectors, r, c);
-			if(r != row || c != col){
-				printf("wrong: globalIndex: %ld r %d c %d row %d col %d\n", globalIndex, r, c, row, col);
-				break;
+			if (it.row() != row || it.col() != col) {
+				printf("wrong: iterator at row %d col %d instead of row %d col %d\n",
+						it.row(), it.col(), row, col);
+				return -1;
 			}
 			/*increase the job identifier*/
 			++jobId;
 		}
 	}
+	if (jobId != TriangularIndex::getUpperSize(numVectors)) {
+		printf("wrong: %ld pairs instead of %ld\n", (long) jobId,
+				(long) TriangularIndex::getUpperSize(numVectors));
+		return -1;
+	}
+
+	/*sampled rows of the largest dimension*/
+	const int64_t maxDimSize = 0x7fffffff;
+	for (int i = 0; i < numSampledRows; ++i) {
+		int row = (int) (maxDimSize - 1 - (maxDimSize - 1) / numSampledRows * i);
+		int64_t rowStart = TriangularIndex::getUpperRowStart(maxDimSize, row);
+		if (!checkPair(maxDimSize, row, row, rowStart)
+				|| !checkPair(maxDimSize, row, maxDimSize - 1,
+						rowStart + maxDimSize - 1 - row)) {
+			return -1;
+		}
+	}
+	printf("passed\n");
 	return 0;
 }